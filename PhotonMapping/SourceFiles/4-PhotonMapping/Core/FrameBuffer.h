@@ -5,18 +5,30 @@
 #include "MainGUI/DebugText.hpp"
 
 #include <QObject>
+#include <QRect>
+#include <atomic>
 #include <cmath>
+#include <cstring>
+#include <vector>
 
+// The render thread accumulates into fbuffer and calls publishFrame() after
+// every frame, which copies it into a back buffer and hands it over with a
+// lock-free triple buffer swap. The GUI calls updateDisplay() at its own
+// refresh rate to pick up the newest frame and tonemap it into ubuffer, which
+// only the GUI touches. Neither side ever waits for the other.
 class FrameBuffer : public QObject
 {
 	Q_OBJECT
 
 public:
-	FrameBuffer() : width(width),
-					height(height),
-					channals(channals),
+	FrameBuffer() : width(0),
+					height(0),
+					channals(0),
 					ubuffer(nullptr),
 					fbuffer(nullptr),
+					latest(1),
+					back(0),
+					front(2),
 					curRenderCount(0) {}
 
 	~FrameBuffer()
@@ -54,6 +66,7 @@ public:
 		}
 		ubuffer = new unsigned char[width * height * channals];
 		fbuffer = new float[width * height * channals];
+		resetFrames();
 		if (nullptr == ubuffer || nullptr == fbuffer)
 		{
 			TextDinodonS("Initialize Error: FrameBuffer has not applied for enough memory!");
@@ -79,6 +92,7 @@ public:
 		this->width = 0;
 		this->height = 0;
 		this->channals = 0;
+		resetFrames();
 	}
 	bool bufferResize(const int width = 800, const int height = 600)
 	{
@@ -92,9 +106,10 @@ public:
 		if (nullptr != fbuffer)
 			delete[] fbuffer;
 		this->width = width;
-		this->height = width;
+		this->height = height;
 		ubuffer = new unsigned char[width * height * channals];
 		fbuffer = new float[width * height * channals];
+		resetFrames();
 		if (nullptr == ubuffer || nullptr == fbuffer)
 		{
 			TextDinodonS("Resize Error: FrameBuffer has not applied for enough memory!");
@@ -146,6 +161,7 @@ public:
 		return true;
 	}
 
+	// Running average of the samples; tonemapping happens in updateDisplay()
 	inline bool update_f_u_c(const int w, const int h, const int shifting, const float &dat)
 	{
 		if (nullptr == fbuffer)
@@ -161,19 +177,71 @@ public:
 		int offset = (w + h * width) * channals + shifting;
 		float weight = (1.0f / (float)curRenderCount);
 		fbuffer[offset] = weight * dat + (1.0f - weight) * fbuffer[offset];
+		return true;
+	}
 
-		float exposure = 0.75;
-		float temp_c = 1.0f - exp(-fbuffer[offset] * 1.0f / (1 - exposure));
+	// Render thread: called between frames, copies the accumulation buffer
+	// into the back buffer and publishes it.
+	void publishFrame()
+	{
+		if (nullptr == fbuffer)
+			return;
+		std::vector<float> &frame = frames[back];
+		frame.resize(width * height * channals);
+		std::memcpy(frame.data(), fbuffer, frame.size() * sizeof(float));
+		back = latest.exchange(back | freshFrame) & indexMask;
+	}
 
-		ubuffer[offset] = temp_c * 255;
+	// GUI thread: tonemaps the newest published frame into ubuffer. Returns
+	// false when no new frame was published.
+	bool updateDisplay(QRect *dirty, const float exposure = 0.75f)
+	{
+		if (nullptr == ubuffer || !(latest.load() & freshFrame))
+			return false;
+		front = latest.exchange(front) & indexMask;
+		const std::vector<float> &frame = frames[front];
+		const int n = width * height * channals;
+		if ((int)frame.size() != n)
+			return false;
+		const float invScale = 1.0f / (1.0f - exposure);
+		const float *src = frame.data();
+#pragma omp simd
+		for (int i = 0; i < n; i++)
+			ubuffer[i] = (unsigned char)((1.0f - std::exp(-src[i] * invScale)) * 255.f);
+		if (channals == 4)
+			for (int i = 3; i < n; i += 4)
+				ubuffer[i] = 255;
+		*dirty = QRect(0, 0, width, height);
 		return true;
 	}
 
 	unsigned char *getUCbuffer() { return ubuffer; }
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	int getChannals() const { return channals; }
 
 private:
+	static constexpr int indexMask = 3;
+	static constexpr int freshFrame = 4;
+
+	void resetFrames()
+	{
+		for (int i = 0; i < 3; i++)
+			frames[i].clear();
+		latest.store(1);
+		back = 0;
+		front = 2;
+	}
+
 	unsigned char *ubuffer;
 	float *fbuffer;
+
+	// Triple buffer: the render thread owns frames[back], the GUI owns
+	// frames[front]; _latest_ holds the third index plus the freshFrame bit
+	std::vector<float> frames[3];
+	std::atomic<int> latest;
+	int back, front;
+
 	int width;
 	int height;
 	int channals;
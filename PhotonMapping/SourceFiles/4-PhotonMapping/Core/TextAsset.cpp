@@ -0,0 +1,289 @@
+#include "Core/TextAsset.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <omp.h>
+
+static inline bool IsSpace(char c)
+{
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+}
+
+static inline bool IsNumberStart(char c)
+{
+	return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.';
+}
+
+static inline const char *SkipToken(const char *p, const char *end)
+{
+	while (p < end && !IsSpace(*p))
+		++p;
+	return p;
+}
+
+// Number Parsing
+// Parses a decimal integer or float starting at _p_ and returns the end of
+// the token. At most 19 significant digits are accumulated exactly; the
+// result is scaled by a power of ten in double precision.
+static const double powersOf10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+									1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static const char *ParseNumber(const char *p, const char *end, double *v)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+	uint64_t mantissa = 0;
+	int digits = 0, exponent = 0;
+	for (; p < end && *p >= '0' && *p <= '9'; ++p)
+	{
+		if (digits < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa)
+				++digits;
+		}
+		else
+			++exponent;
+	}
+	if (p < end && *p == '.')
+	{
+		for (++p; p < end && *p >= '0' && *p <= '9'; ++p)
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa)
+					++digits;
+				--exponent;
+			}
+		}
+	}
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char *q = p + 1;
+		bool expNegative = false;
+		if (q < end && (*q == '-' || *q == '+'))
+			expNegative = *q++ == '-';
+		if (q < end && *q >= '0' && *q <= '9')
+		{
+			int e = 0;
+			for (; q < end && *q >= '0' && *q <= '9'; ++q)
+				e = std::min(e * 10 + (*q - '0'), 10000);
+			exponent += expNegative ? -e : e;
+			p = q;
+		}
+	}
+	double value = (double)mantissa;
+	if (exponent < 0)
+		value = -exponent <= 22 ? value / powersOf10[-exponent] : value * std::pow(10.0, exponent);
+	else if (exponent > 0)
+		value = exponent <= 22 ? value * powersOf10[exponent] : value * std::pow(10.0, exponent);
+	*v = negative ? -value : value;
+	// Anything left in the token (e.g. "1.5f") is ignored
+	return SkipToken(p, end);
+}
+
+static inline const char *ParseValue(const char *p, const char *end, float *v)
+{
+	double d;
+	p = ParseNumber(p, end, &d);
+	*v = (float)d;
+	return p;
+}
+
+static inline const char *ParseValue(const char *p, const char *end, int *v)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+	long long value = 0;
+	for (; p < end && *p >= '0' && *p <= '9'; ++p)
+		value = std::min(value * 10 + (*p - '0'), (long long)INT32_MAX);
+	*v = (int)(negative ? -value : value);
+	return SkipToken(p, end);
+}
+
+// Counts the numeric tokens in [p, end)
+static size_t CountNumbers(const char *p, const char *end)
+{
+	size_t count = 0;
+	while (p < end)
+	{
+		while (p < end && IsSpace(*p))
+			++p;
+		if (p == end)
+			break;
+		if (IsNumberStart(*p))
+			++count;
+		p = SkipToken(p, end);
+	}
+	return count;
+}
+
+// Parses up to _n_ numeric tokens from [p, end) into _out_, returns the
+// position after the last one and the count in _parsed_
+template <typename T>
+static const char *ParseNumbers(const char *p, const char *end, T *out, size_t n, size_t *parsed)
+{
+	size_t count = 0;
+	while (count < n && p < end)
+	{
+		while (p < end && IsSpace(*p))
+			++p;
+		if (p == end)
+			break;
+		if (IsNumberStart(*p))
+			p = ParseValue(p, end, &out[count++]);
+		else
+			p = SkipToken(p, end);
+	}
+	*parsed = count;
+	return p;
+}
+
+// TextAsset Method Definitions
+TextAsset::TextAsset(const std::string &filename)
+	: start(std::chrono::steady_clock::now())
+{
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	if (!file)
+		return;
+	std::streamoff size = file.tellg();
+	if (size <= 0)
+		return;
+	buffer.resize((size_t)size);
+	file.seekg(0);
+	if (!file.read(buffer.data(), size))
+		return;
+	begin = cur = buffer.data();
+	end = begin + buffer.size();
+}
+
+std::string TextAsset::NextToken()
+{
+	while (cur < end && IsSpace(*cur))
+		++cur;
+	const char *tokenEnd = SkipToken(cur, end);
+	std::string token(cur, tokenEnd);
+	cur = tokenEnd;
+	return token;
+}
+
+bool TextAsset::NextInt(int *v)
+{
+	while (cur < end && IsSpace(*cur))
+		++cur;
+	if (cur == end || !IsNumberStart(*cur))
+		return false;
+	cur = ParseValue(cur, end, v);
+	return true;
+}
+
+bool TextAsset::NextFloat(float *v)
+{
+	while (cur < end && IsSpace(*cur))
+		++cur;
+	if (cur == end || !IsNumberStart(*cur))
+		return false;
+	cur = ParseValue(cur, end, v);
+	return true;
+}
+
+bool TextAsset::ReadFloats(float *out, size_t n) { return ReadNumbers(out, n); }
+
+bool TextAsset::ReadInts(int *out, size_t n) { return ReadNumbers(out, n); }
+
+template <typename T>
+bool TextAsset::ReadNumbers(T *out, size_t n)
+{
+	if (n == 0)
+		return true;
+	// Small inputs are not worth the counting pass
+	const size_t minChunkBytes = 1 << 20;
+	int nChunks = (int)std::min<size_t>(4 * omp_get_max_threads(), (end - cur) / minChunkBytes);
+	if (nChunks <= 1)
+	{
+		size_t parsed;
+		cur = ParseNumbers(cur, end, out, n, &parsed);
+		return parsed == n;
+	}
+
+	// Split the remaining text into chunks that end on line boundaries, so
+	// no token is cut in two
+	std::vector<const char *> bounds(nChunks + 1);
+	bounds[0] = cur;
+	bounds[nChunks] = end;
+	for (int i = 1; i < nChunks; ++i)
+	{
+		const char *p = std::max(bounds[i - 1], cur + (end - cur) / nChunks * i);
+		const char *newline = (const char *)memchr(p, '\n', end - p);
+		bounds[i] = newline ? newline : end;
+	}
+
+	// Count the numbers in every chunk to find where each one writes; only
+	// the chunks up to the one holding the _n_th number are parsed
+	std::vector<size_t> offsets(nChunks + 1, 0);
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = 0; i < nChunks; ++i)
+		offsets[i + 1] = CountNumbers(bounds[i], bounds[i + 1]);
+	for (int i = 0; i < nChunks; ++i)
+		offsets[i + 1] += offsets[i];
+	if (offsets[nChunks] < n)
+		return false;
+	int lastChunk = 0;
+	while (offsets[lastChunk + 1] < n)
+		++lastChunk;
+
+	const char *last = cur;
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = 0; i <= lastChunk; ++i)
+	{
+		size_t parsed;
+		const char *p = ParseNumbers(bounds[i], bounds[i + 1], out + offsets[i],
+									 std::min(offsets[i + 1], n) - offsets[i], &parsed);
+		if (i == lastChunk)
+			last = p;
+	}
+	cur = last;
+	return true;
+}
+
+void TextAsset::ReportLoad(const std::string &name) const
+{
+	float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+	ReportAssetLoad(name, Size(), seconds);
+}
+
+// Asset Load Records
+// Function-local statics, assets may be loaded during static initialization
+static std::mutex &AssetLoadMutex()
+{
+	static std::mutex mutex;
+	return mutex;
+}
+
+static std::vector<AssetLoadRecord> &AssetLoadRecords()
+{
+	static std::vector<AssetLoadRecord> records;
+	return records;
+}
+
+void ReportAssetLoad(const std::string &name, size_t bytes, float seconds)
+{
+	std::lock_guard<std::mutex> lock(AssetLoadMutex());
+	AssetLoadRecords().push_back({name, bytes, seconds});
+}
+
+std::vector<AssetLoadRecord> TakeAssetLoadRecords()
+{
+	std::lock_guard<std::mutex> lock(AssetLoadMutex());
+	std::vector<AssetLoadRecord> records;
+	records.swap(AssetLoadRecords());
+	return records;
+}
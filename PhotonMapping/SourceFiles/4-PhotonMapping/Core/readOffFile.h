@@ -7,6 +7,7 @@
 
 #include "Core/Triangle.h"
 #include "Core/bvhTree.h"
+#include "Core/TextAsset.h"
 
 class offRead
 {
@@ -17,38 +18,36 @@ public:
 	bvh_node *m_bvh;
 	offRead(material *mtrl)
 	{
-		std::fstream f("../../Resources/bunny.obj");
-		std::string ed;
-		f >> vertexs >> normals >> faces;
+		const std::string fileName = "../../Resources/bunny.obj";
+		TextAsset f(fileName);
+		vertexs = normals = faces = 0;
+		f.NextInt(&vertexs);
+		f.NextInt(&normals);
+		f.NextInt(&faces);
+		// The "v", "vn" and "f" line labels are skipped by the number reader
+		std::vector<float> data(3 * (vertexs + normals));
+		f.ReadFloats(data.data(), data.size());
 		vertexArray = new vec3[vertexs];
 		for (int i = 0; i < vertexs; i++)
-		{
-			f >> ed;
-			f >> vertexArray[i][0];
-			f >> vertexArray[i][1];
-			f >> vertexArray[i][2];
-		}
+			vertexArray[i] = vec3(data[3 * i + 0], data[3 * i + 1], data[3 * i + 2]);
 		normalArray = new vec3[normals];
 		for (int i = 0; i < normals; i++)
-		{
-			f >> ed;
-			f >> normalArray[i][0];
-			f >> normalArray[i][1];
-			f >> normalArray[i][2];
-		}
+			normalArray[i] = vec3(data[3 * (vertexs + i) + 0], data[3 * (vertexs + i) + 1], data[3 * (vertexs + i) + 2]);
+		std::vector<int> faceIndices(6 * faces);
+		f.ReadInts(faceIndices.data(), faceIndices.size());
 		hitable **list = new hitable *[faces];
 		int index = 0;
-		int num, v0, v1, v2, n0, n1, n2;
 		float scale = 0.001;
 		vec3 trans(1.9, 1.05, 2.3);
 		for (int i = 0; i < faces; i++)
 		{
-			f >> ed >> v0 >> n0 >> v1 >> n1 >> v2 >> n2;
+			const int *fi = &faceIndices[6 * i];
+			int v0 = fi[0], n0 = fi[1], v1 = fi[2], n1 = fi[3], v2 = fi[4], n2 = fi[5];
 			list[index++] = new triangle(scale * vertexArray[v0 - 1] + trans, scale * vertexArray[v1 - 1] + trans,
 										 scale * vertexArray[v2 - 1] + trans, normalArray[n0 - 1], normalArray[n1 - 1], normalArray[n2 - 1], mtrl);
 		}
+		f.ReportLoad(fileName);
 		m_bvh = new bvh_node(list, index, 0.0, 1.0);
-		f.close();
 	}
 };
 
@@ -10,6 +10,8 @@ DisplayWidget::DisplayWidget(QGroupBox *parent)
 	displayWidgetLayout.addWidget(&m_IMAGraphicsView);
 
 	framebuffer.InitBuffer(800, 600, 4);
+
+	connect(&displayTimer, SIGNAL(timeout()), this, SLOT(RefreshDisplay()));
 }
 
 DisplayWidget::~DisplayWidget()
@@ -34,9 +36,9 @@ void DisplayWidget::startRenderThread()
 
 		connect(rThread, SIGNAL(PrintString(const char *)), this, SLOT(PrintString(const char *)));
 		connect(rThread, SIGNAL(PrintDataD(const char *, const double)), this, SLOT(PrintDataD(const char *, const double)));
-		connect(rThread, SIGNAL(PaintBuffer(unsigned char *, int, int, int)), &m_IMAGraphicsView, SLOT(PaintBuffer(unsigned char *, int, int, int)));
 
 		rThread->start();
+		displayTimer.start(33);
 	}
 
 	renderFlag = true;
@@ -52,6 +54,9 @@ void DisplayWidget::killRenderThread()
 	rThread->quit();
 	// Wait for thread to end
 	rThread->wait();
+	// Show the last published frame and stop refreshing
+	RefreshDisplay();
+	displayTimer.stop();
 	// Remove the render thread
 	delete rThread;
 
@@ -67,3 +72,12 @@ void DisplayWidget::PrintDataD(const char *s, const double data)
 {
 	TextDinodonN(s, data);
 }
+
+void DisplayWidget::RefreshDisplay()
+{
+	QRect dirty;
+	if (!framebuffer.updateDisplay(&dirty))
+		return;
+	m_IMAGraphicsView.UpdateBuffer(framebuffer.getUCbuffer(), framebuffer.getWidth(), framebuffer.getHeight(),
+								   framebuffer.getChannals(), dirty);
+}
@@ -5,6 +5,7 @@
 #include <QtWidgets/QGroupBox>
 #include <QtWidgets/QGridLayout>
 #include <QCloseEvent>
+#include <QTimer>
 
 #include "IMAGraphicsView.h"
 
@@ -31,12 +32,15 @@ private:
 	QGridLayout displayWidgetLayout;
 
 	IMAGraphicsView m_IMAGraphicsView;
+	// Pulls published frames from the framebuffer at the display refresh rate
+	QTimer displayTimer;
 
 	void closeEvent(QCloseEvent *event);
 
 private slots:
 	void PrintString(const char *s);
 	void PrintDataD(const char *s, const double data);
+	void RefreshDisplay();
 };
 
 #endif
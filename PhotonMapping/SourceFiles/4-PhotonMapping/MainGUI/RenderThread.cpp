@@ -1,6 +1,5 @@
 #include "RenderThread.h"
 #include "DebugText.hpp"
-#include <QElapsedTimer>
 #include <omp.h>
 
 #include "Core/FeimosRender.h"
@@ -48,6 +47,7 @@ void showMemoryInfo(void)
 #include "Core/Sphere.h"
 #include "Core/Camera.h"
 #include "Core/readOffFile.h"
+#include "Core/TextAsset.h"
 #include "Core/PhotonTracer.h"
 
 material *light = new diffuse_light(new constant_texture(vec3(27.0f, 27.0f, 27.0f)));
@@ -157,6 +157,14 @@ void RenderThread::run()
 
 	worldInit_PhotonMap(light_shape, world);
 
+	// ģļĶȡʱ
+	for (const AssetLoadRecord &record : TakeAssetLoadRecords())
+	{
+		QString name = QString::fromStdString(record.name).section('/', -1);
+		m_RenderStatus.setDataChanged("Asset Load", name, QString::number(record.seconds * 1000.f), "ms");
+		m_RenderStatus.setDataChanged("Asset Load", name + " size", QString::number(record.bytes / 1000.f / 1000.f), "M");
+	}
+
 	emit PrintString("Init FrameBuffer...");
 	p_framebuffer->bufferResize(WIDTH, HEIGHT);
 
@@ -166,9 +174,6 @@ void RenderThread::run()
 	double wholeTime = 0.0;
 	while (renderFlag)
 	{
-		QElapsedTimer t;
-		t.start();
-
 		p_framebuffer->renderCountIncrease();
 
 		double start = omp_get_wtime(); // ȡʼʱ
@@ -190,7 +195,6 @@ void RenderThread::run()
 				p_framebuffer->update_f_u_c(i, HEIGHT - j - 1, 0, col.x());
 				p_framebuffer->update_f_u_c(i, HEIGHT - j - 1, 1, col.y());
 				p_framebuffer->update_f_u_c(i, HEIGHT - j - 1, 2, col.z());
-				p_framebuffer->set_uc(i, HEIGHT - j - 1, 3, 255);
 			}
 		}
 
@@ -209,10 +213,8 @@ void RenderThread::run()
 		}
 #endif
 
-		emit PaintBuffer(p_framebuffer->getUCbuffer(), WIDTH, HEIGHT, 4);
-
-		while (t.elapsed() < 100)
-			;
+		// һ֡水Լˢȡ߲תȾ̲߳ȴ
+		p_framebuffer->publishFrame();
 
 #if windows_operating_system
 		showMemoryInfo();
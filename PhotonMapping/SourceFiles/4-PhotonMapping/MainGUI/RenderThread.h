@@ -23,7 +23,6 @@ public:
 signals:
 	void PrintString(const char *s);
 	void PrintDataD(const char *s, const double data);
-	void PaintBuffer(unsigned char *buffer, int width, int height, int channals);
 private slots:
 
 public:
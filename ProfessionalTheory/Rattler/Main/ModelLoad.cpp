@@ -1,4 +1,5 @@
 #include "Main/ModelLoad.h"
+#include "Main/RattlerBinary.h"
 #include "Core/Geometry.h"
 #include "Core/Transform.h"
 #include "ImageProcess.h"
@@ -14,6 +15,54 @@
 namespace Rattler
 {
 
+	static uint64_t alignSection(uint64_t offset)
+	{
+		return (offset + RattlerBinaryAlignment - 1) & ~(RattlerBinaryAlignment - 1);
+	}
+
+	static void copyName(char *dst, const std::string &name)
+	{
+		strncpy(dst, name.c_str(), RattlerBinaryNameLength - 1);
+		dst[RattlerBinaryNameLength - 1] = '\0';
+	}
+
+	// д .rattlerbinļͷ֮λáꡢߣÿΰ16ֽڶ룬
+	// ȡ˿ֱڴӳʹЩݣʽ RattlerBinary.h
+	static bool writeRattlerBinary(const std::string &aimFile, RattlerBinaryHeader &header,
+								   const Point3f *P, const int *vertexIndices, const Normal3f *N, const Point2f *uv, const Vector3f *Tan)
+	{
+		static_assert(sizeof(Point3f) == 3 * sizeof(float) && sizeof(Normal3f) == 3 * sizeof(float) &&
+						  sizeof(Vector3f) == 3 * sizeof(float) && sizeof(Point2f) == 2 * sizeof(float),
+					  "vertex data must be tightly packed floats");
+
+		const void *data[5] = {P, vertexIndices, N, uv, Tan};
+		uint64_t bytes[5] = {12ull * header.nVertices, 12ull * header.nTriangles, 12ull * header.nNormals,
+							 8ull * header.nUVs, 12ull * header.nTangents};
+		uint64_t *offsets[5] = {&header.positionOffset, &header.indexOffset, &header.normalOffset,
+								&header.uvOffset, &header.tangentOffset};
+		uint64_t offset = sizeof(RattlerBinaryHeader);
+		for (int i = 0; i < 5; i++)
+		{
+			*offsets[i] = bytes[i] ? offset : 0;
+			offset = alignSection(offset + bytes[i]);
+		}
+		header.fileSize = offset;
+
+		std::ofstream file(aimFile, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+		static const char zeros[RattlerBinaryAlignment] = {};
+		file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		for (int i = 0; i < 5; i++)
+		{
+			if (bytes[i] == 0)
+				continue;
+			file.write(reinterpret_cast<const char *>(data[i]), bytes[i]);
+			file.write(zeros, alignSection(bytes[i]) - bytes[i]);
+		}
+		return (bool)file;
+	}
+
 	void ModelLoad::processMesh(aiMesh *mesh, const aiScene *scene)
 	{
 
@@ -158,6 +207,7 @@ namespace Rattler
 
 			std::string aimFile = outputDir + "/MeshInfo_" + std::to_string(MeshNum) + ".ratr";
 			std::ofstream file(aimFile);
+			std::string diffuseRef = "NoFile_Rattler", alphaRef = "NoFile_Rattler", specularRef = "NoFile_Rattler";
 			// (1) д VertexNum() FaceNum() VertIndexNum( = FaceNum * 3) NormNum() UVNum() TanNum() BiTanNum()
 			{
 				file << "VertexNum " << nVertices << std::endl;
@@ -194,16 +244,9 @@ namespace Rattler
 					bool isGetAlpha = abstractAlpha(diffFilePath, outputDir + "/" + alphaOutName);
 
 					if (isGetDiffuse)
-						file << "Diffuse " << diffOutName << std::endl;
-					else
-						file << "Diffuse "
-							 << "NoFile_Rattler" << std::endl;
-
+						diffuseRef = diffOutName;
 					if (isGetAlpha)
-						file << "Alpha " << alphaOutName << std::endl;
-					else
-						file << "Alpha "
-							 << "NoFile_Rattler" << std::endl;
+						alphaRef = alphaOutName;
 
 					if (specTexName.size() > 0)
 					{
@@ -213,26 +256,12 @@ namespace Rattler
 						std::string specOutName = "Mesh_" + std::to_string(MeshNum) + "_specular.png";
 						bool isGetSpecular = imageCopy(specFilePath, outputDir + "/" + specOutName);
 						if (isGetSpecular)
-							file << "Specular " << specOutName << std::endl;
-						else
-							file << "Specular "
-								 << "NoFile_Rattler" << std::endl;
-					}
-					else
-					{
-						file << "Specular "
-							 << "NoFile_Rattler" << std::endl;
+							specularRef = specOutName;
 					}
 				}
-				else
-				{
-					file << "Diffuse "
-						 << "NoFile_Rattler" << std::endl;
-					file << "Alpha "
-						 << "NoFile_Rattler" << std::endl;
-					file << "Specular "
-						 << "NoFile_Rattler" << std::endl;
-				}
+				file << "Diffuse " << diffuseRef << std::endl;
+				file << "Alpha " << alphaRef << std::endl;
+				file << "Specular " << specularRef << std::endl;
 			}
 
 			// (4) ַ dataʾʼд
@@ -269,6 +298,29 @@ namespace Rattler
 			}
 
 			file.close();
+
+			// (6) ͬдһݶƵ .rattlerbinȾֱڴӳȡ
+			RattlerBinaryHeader header = {};
+			memcpy(header.magic, RattlerBinaryMagic, sizeof(header.magic));
+			header.version = RattlerBinaryVersion;
+			header.headerSize = sizeof(RattlerBinaryHeader);
+			header.nVertices = (uint32_t)nVertices;
+			header.nTriangles = (uint32_t)nTriangles;
+			header.nNormals = (uint32_t)nNormal;
+			header.nUVs = (uint32_t)nUV;
+			header.nTangents = (uint32_t)nTan;
+			for (int i = 0; i < 3; i++)
+			{
+				header.minPos[i] = minPos[i];
+				header.maxPos[i] = maxPos[i];
+			}
+			copyName(header.diffuse, diffuseRef);
+			copyName(header.specular, specularRef);
+			copyName(header.alpha, alphaRef);
+			copyName(header.bump, "NoFile_Rattler");
+			std::string binFile = outputDir + "/MeshInfo_" + std::to_string(MeshNum) + ".rattlerbin";
+			if (!writeRattlerBinary(binFile, header, P, vertexIndices, N, uv, Tan))
+				std::cout << "Error: ޷д " << binFile << std::endl;
 		}
 
 		delete[] vertexIndices;
@@ -339,6 +391,12 @@ namespace Rattler
 			file << "MeshFile "
 				 << "/MeshInfo_" + std::to_string(i) + ".ratr" << std::endl;
 		}
+		// ư汾Ƭļɰ汾ĶȡЩ
+		for (int i = 0; i < MeshNum; i++)
+		{
+			file << "MeshBinFile "
+				 << "/MeshInfo_" + std::to_string(i) + ".rattlerbin" << std::endl;
+		}
 
 		file.close();
 	}
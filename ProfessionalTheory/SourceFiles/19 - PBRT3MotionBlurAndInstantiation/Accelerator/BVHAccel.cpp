@@ -1,4 +1,5 @@
 #include "Accelerator/BVHAccel.h"
+#include "Core/RayPacket.h"
 #include <memory>
 #include "MainGUI/DebugText.hpp"
 
@@ -10,7 +11,11 @@ static long long totalLeafNodes = 0;
 static long long interiorNodes = 0;
 static long long leafNodes = 0;
 
-BVHAccel::~BVHAccel() { free(nodes); }
+BVHAccel::~BVHAccel() {
+	if (nodes) treeBytes -= totalNodes * sizeof(LinearBVHNode) + sizeof(*this) +
+		primitives.size() * sizeof(primitives[0]);
+	delete[] nodes;
+}
 // BVHAccel Local Declarations
 struct BVHPrimitiveInfo {
     BVHPrimitiveInfo() {}
@@ -45,16 +50,6 @@ struct BVHBuildNode {
 	BVHBuildNode *children[2];
 	int splitAxis, firstPrimOffset, nPrimitives;
 };
-struct LinearBVHNode {
-	Bounds3f bounds;
-	union {
-		int primitivesOffset;   // leaf
-		int secondChildOffset;  // interior
-	};
-	uint16_t nPrimitives;  // 0 -> interior node
-	uint8_t axis;          // interior node: xyz
-	uint8_t pad[1];        // ensure 32 byte total size
-};
 // BVHAccel Method Definitions
 BVHAccel::BVHAccel(std::vector<std::shared_ptr<Primitive>> p,
 	int maxPrimsInNode, SplitMethod splitMethod)
@@ -63,29 +58,73 @@ BVHAccel::BVHAccel(std::vector<std::shared_ptr<Primitive>> p,
 	primitives(std::move(p)) {
 	if (primitives.empty()) return;
 	// Build BVH from _primitives_
+	Build();
+}
+void BVHAccel::Build() {
+	// A rebuild after Refit() replaces the tree counted by the last build
+	if (nodes) treeBytes -= totalNodes * sizeof(LinearBVHNode) + sizeof(*this) +
+		primitives.size() * sizeof(primitives[0]);
+	delete[] nodes;
+	// Gather primitive bounds and build the flattened tree over them
+	std::vector<Bounds3f> primBounds(primitives.size());
+	double primitiveArea = 0;
+	for (size_t i = 0; i < primitives.size(); ++i) {
+		primBounds[i] = primitives[i]->WorldBound();
+		primitiveArea += primBounds[i].SurfaceArea();
+	}
+	std::vector<int> orderedPrims;
+	nodes = BuildLinear(primBounds, maxPrimsInNode, splitMethod,
+		&orderedPrims, &totalNodes);
+	std::vector<std::shared_ptr<Primitive>> sortedPrims(primitives.size());
+	for (size_t i = 0; i < orderedPrims.size(); ++i)
+		sortedPrims[i] = primitives[orderedPrims[i]];
+	primitives.swap(sortedPrims);
+	buildCost = RelativeSAHCost(nodes, totalNodes, primitiveArea);
 
-	// Initialize _primitiveInfo_ array for primitives
-	std::vector<BVHPrimitiveInfo> primitiveInfo(primitives.size());
-	for (size_t i = 0; i < primitives.size(); ++i)
-		primitiveInfo[i] = { i, primitives[i]->WorldBound() };
-
-	// Build BVH tree for primitives using _primitiveInfo_
-	int totalNodes = 0;
-	std::vector<std::shared_ptr<Primitive>> orderedPrims;
-	orderedPrims.reserve(primitives.size());
-	BVHBuildNode *root;
-
-	root = recursiveBuild(primitiveInfo, 0, primitives.size(),
-			&totalNodes, orderedPrims);
-	primitives.swap(orderedPrims);
-	primitiveInfo.resize(0);
-
-	// Compute representation of depth-first traversal of BVH tree
 	treeBytes += totalNodes * sizeof(LinearBVHNode) + sizeof(*this) +
 		primitives.size() * sizeof(primitives[0]);
-	nodes = new LinearBVHNode[totalNodes];
-	int offset = 0;
-	flattenBVHTree(root, &offset);
+}
+bool BVHAccel::Refit(float maxCostRatio) {
+	if (!nodes) return false;
+	double primitiveArea = 0;
+	RefitLinear(nodes, [&](const LinearBVHNode &node) {
+		Bounds3f b;
+		float area = 0;
+		for (int i = 0; i < node.nPrimitives; ++i) {
+			Bounds3f primBounds = primitives[node.primitivesOffset + i]->WorldBound();
+			area += primBounds.SurfaceArea();
+			b = Union(b, primBounds);
+		}
+#pragma omp atomic
+		primitiveArea += area;
+		return b;
+	});
+	// Refitted boxes overlap more as primitives drift apart
+	if (RelativeSAHCost(nodes, totalNodes, primitiveArea) <= maxCostRatio * buildCost)
+		return false;
+	Build();
+	return true;
+}
+float BVHAccel::SAHCost(const LinearBVHNode *nodes, int totalNodes,
+	int leafBlockWidth) {
+	if (!nodes) return 0;
+	float rootArea = nodes[0].bounds.SurfaceArea();
+	if (!(rootArea > 0)) return 0;
+	// Traversal and intersection cost 1 each, as in _recursiveBuild_
+	float cost = 0;
+	for (int i = 0; i < totalNodes; ++i) {
+		const LinearBVHNode &node = nodes[i];
+		int n = node.nPrimitives > 0 ?
+			(node.nPrimitives + leafBlockWidth - 1) / leafBlockWidth : 1;
+		cost += n * node.bounds.SurfaceArea();
+	}
+	return cost / rootArea;
+}
+float BVHAccel::RelativeSAHCost(const LinearBVHNode *nodes, int totalNodes,
+	double primitiveArea, int leafBlockWidth) {
+	if (!nodes || !(primitiveArea > 0)) return 0;
+	return SAHCost(nodes, totalNodes, leafBlockWidth) *
+		nodes[0].bounds.SurfaceArea() / primitiveArea;
 }
 Bounds3f BVHAccel::WorldBound() const {
 	return nodes ? nodes[0].bounds : Bounds3f();
@@ -94,9 +133,10 @@ struct BucketInfo {
 	int count = 0;
 	Bounds3f bounds;
 };
-BVHBuildNode *BVHAccel::recursiveBuild(
-	std::vector<BVHPrimitiveInfo> &primitiveInfo, int start, int end, int *totalNodes,
-	std::vector<std::shared_ptr<Primitive>> &orderedPrims) {
+static BVHBuildNode *recursiveBuild(
+	std::vector<BVHPrimitiveInfo> &primitiveInfo, int start, int end,
+	int maxPrimsInNode, int leafBlockWidth, BVHAccel::SplitMethod splitMethod,
+	int *totalNodes, std::vector<int> &orderedPrims) {
 	BVHBuildNode *node = new BVHBuildNode;
 	(*totalNodes)++;
 	// Compute bounds of all primitives in BVH node
@@ -109,7 +149,7 @@ BVHBuildNode *BVHAccel::recursiveBuild(
 		int firstPrimOffset = orderedPrims.size();
 		for (int i = start; i < end; ++i) {
 			int primNum = primitiveInfo[i].primitiveNumber;
-			orderedPrims.push_back(primitives[primNum]);
+			orderedPrims.push_back(primNum);
 		}
 		node->InitLeaf(firstPrimOffset, nPrimitives, bounds);
 		return node;
@@ -128,7 +168,7 @@ BVHBuildNode *BVHAccel::recursiveBuild(
 			int firstPrimOffset = orderedPrims.size();
 			for (int i = start; i < end; ++i) {
 				int primNum = primitiveInfo[i].primitiveNumber;
-				orderedPrims.push_back(primitives[primNum]);
+				orderedPrims.push_back(primNum);
 			}
 			node->InitLeaf(firstPrimOffset, nPrimitives, bounds);
 			return node;
@@ -136,7 +176,7 @@ BVHBuildNode *BVHAccel::recursiveBuild(
 		else {
 			// Partition primitives based on _splitMethod_
 			switch (splitMethod) {
-			case SplitMethod::Middle: {
+			case BVHAccel::SplitMethod::Middle: {
 				// Partition primitives through node's midpoint
 				float pmid =
 					(centroidBounds.pMin[dim] + centroidBounds.pMax[dim]) / 2;
@@ -152,7 +192,7 @@ BVHBuildNode *BVHAccel::recursiveBuild(
 				// to EqualCounts.
 				if (mid != start && mid != end) break;
 			}
-			case SplitMethod::EqualCounts: {
+			case BVHAccel::SplitMethod::EqualCounts: {
 				// Partition primitives into equally-sized subsets
 				mid = (start + end) / 2;
 				std::nth_element(&primitiveInfo[start], &primitiveInfo[mid],
@@ -163,7 +203,7 @@ BVHBuildNode *BVHAccel::recursiveBuild(
 				});
 				break;
 			}
-			case SplitMethod::SAH:
+			case BVHAccel::SplitMethod::SAH:
 			default: {
 				// Partition primitives using approximate SAH
 				if (nPrimitives <= 2) {
@@ -206,6 +246,9 @@ BVHBuildNode *BVHAccel::recursiveBuild(
 							b1 = Union(b1, buckets[j].bounds);
 							count1 += buckets[j].count;
 						}
+						// Leaves are tested _leafBlockWidth_ primitives at a time
+						count0 = (count0 + leafBlockWidth - 1) / leafBlockWidth;
+						count1 = (count1 + leafBlockWidth - 1) / leafBlockWidth;
 						cost[i] = 1 +
 							(count0 * b0.SurfaceArea() +
 								count1 * b1.SurfaceArea()) /
@@ -224,7 +267,7 @@ BVHBuildNode *BVHAccel::recursiveBuild(
 
 					// Either create leaf or split primitives at selected SAH
 					// bucket
-					float leafCost = nPrimitives;
+					float leafCost = (nPrimitives + leafBlockWidth - 1) / leafBlockWidth;
 					if (nPrimitives > maxPrimsInNode || minCost < leafCost) {
 						BVHPrimitiveInfo *pmid = std::partition(
 							&primitiveInfo[start], &primitiveInfo[end - 1] + 1,
@@ -241,7 +284,7 @@ BVHBuildNode *BVHAccel::recursiveBuild(
 						int firstPrimOffset = orderedPrims.size();
 						for (int i = start; i < end; ++i) {
 							int primNum = primitiveInfo[i].primitiveNumber;
-							orderedPrims.push_back(primitives[primNum]);
+							orderedPrims.push_back(primNum);
 						}
 						node->InitLeaf(firstPrimOffset, nPrimitives, bounds);
 						return node;
@@ -252,16 +295,16 @@ BVHBuildNode *BVHAccel::recursiveBuild(
 
 			}
 			node->InitInterior(dim,
-				recursiveBuild(primitiveInfo, start, mid,
-					totalNodes, orderedPrims),
-				recursiveBuild(primitiveInfo, mid, end,
-					totalNodes, orderedPrims));
+				recursiveBuild(primitiveInfo, start, mid, maxPrimsInNode,
+					leafBlockWidth, splitMethod, totalNodes, orderedPrims),
+				recursiveBuild(primitiveInfo, mid, end, maxPrimsInNode,
+					leafBlockWidth, splitMethod, totalNodes, orderedPrims));
 		}
 	}
 	return node;
 }
 
-int BVHAccel::flattenBVHTree(BVHBuildNode *node, int *offset) {
+static int flattenBVHTree(LinearBVHNode *nodes, BVHBuildNode *node, int *offset) {
 	LinearBVHNode *linearNode = &nodes[*offset];
 	linearNode->bounds = node->bounds;
 	int myOffset = (*offset)++;
@@ -273,15 +316,48 @@ int BVHAccel::flattenBVHTree(BVHBuildNode *node, int *offset) {
 		// Create interior flattened BVH node
 		linearNode->axis = node->splitAxis;
 		linearNode->nPrimitives = 0;
-		flattenBVHTree(node->children[0], offset);
+		flattenBVHTree(nodes, node->children[0], offset);
 		linearNode->secondChildOffset =
-			flattenBVHTree(node->children[1], offset);
+			flattenBVHTree(nodes, node->children[1], offset);
 	}
+	delete node;
 	return myOffset;
 }
+LinearBVHNode *BVHAccel::BuildLinear(const std::vector<Bounds3f> &primBounds,
+	int maxPrimsInNode, SplitMethod splitMethod,
+	std::vector<int> *orderedPrims, int *totalNodes, int leafBlockWidth) {
+	*totalNodes = 0;
+	orderedPrims->clear();
+	if (primBounds.empty()) return nullptr;
+	maxPrimsInNode = std::min(255, maxPrimsInNode);
+
+	// Initialize _primitiveInfo_ array for primitives
+	std::vector<BVHPrimitiveInfo> primitiveInfo(primBounds.size());
+	for (size_t i = 0; i < primBounds.size(); ++i)
+		primitiveInfo[i] = { i, primBounds[i] };
+
+	// Build BVH tree for primitives using _primitiveInfo_
+	orderedPrims->reserve(primBounds.size());
+	BVHBuildNode *root = recursiveBuild(primitiveInfo, 0, primBounds.size(),
+		maxPrimsInNode, leafBlockWidth, splitMethod, totalNodes, *orderedPrims);
+
+	// Compute representation of depth-first traversal of BVH tree; the
+	// build nodes are released as they are flattened
+	LinearBVHNode *nodes = new LinearBVHNode[*totalNodes];
+	int offset = 0;
+	flattenBVHTree(nodes, root, &offset);
+	return nodes;
+}
 bool BVHAccel::Intersect(const Ray &ray, SurfaceInteraction *isect) const {
+	PrimitiveHit hit;
+	hit.isect = isect;
+	if (!IntersectHit(ray, &hit)) return false;
+	ComputeHitInteraction(ray, hit, isect);
+	return true;
+}
+bool BVHAccel::IntersectHit(const Ray &ray, PrimitiveHit *hit) const {
 	if (!nodes) return false;
-	bool hit = false;
+	bool hitFound = false;
 
 	Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
 	int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
@@ -297,8 +373,8 @@ bool BVHAccel::Intersect(const Ray &ray, SurfaceInteraction *isect) const {
 				
 				// Intersect ray with primitives in leaf BVH node
 				for (int i = 0; i < node->nPrimitives; ++i)
-					if (primitives[node->primitivesOffset + i]->Intersect(ray, isect))
-						hit = true;
+					if (primitives[node->primitivesOffset + i]->IntersectHit(ray, hit))
+						hitFound = true;
 				if (toVisitOffset == 0) break;
 				currentNodeIndex = nodesToVisit[--toVisitOffset];
 			}
@@ -320,7 +396,50 @@ bool BVHAccel::Intersect(const Ray &ray, SurfaceInteraction *isect) const {
 			currentNodeIndex = nodesToVisit[--toVisitOffset];
 		}
 	}
-	return hit;
+	return hitFound;
+}
+int BVHAccel::IntersectPacket(RayPacket &packet, int active,
+	PrimitiveHit *hits) const {
+	if (!nodes) return 0;
+	int hitMask = 0;
+	// Each stacked node keeps the lanes that reached its parent
+	int toVisitOffset = 0, currentNodeIndex = 0;
+	int nodesToVisit[64], lanesToVisit[64];
+	while (true) {
+		const LinearBVHNode *node = &nodes[currentNodeIndex];
+		int lanes = packet.IntersectBounds(node->bounds, active);
+		if (lanes) {
+			if (node->nPrimitives > 0) {
+				for (int i = 0; i < node->nPrimitives; ++i)
+					hitMask |= primitives[node->primitivesOffset + i]->IntersectPacket(
+						packet, lanes, hits);
+				if (toVisitOffset == 0) break;
+				--toVisitOffset;
+				currentNodeIndex = nodesToVisit[toVisitOffset];
+				active = lanesToVisit[toVisitOffset];
+			}
+			else {
+				// The packet is coherent, so all lanes agree on the near child
+				lanesToVisit[toVisitOffset] = lanes;
+				if (packet.dirIsNeg[node->axis]) {
+					nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+					currentNodeIndex = node->secondChildOffset;
+				}
+				else {
+					nodesToVisit[toVisitOffset++] = node->secondChildOffset;
+					currentNodeIndex = currentNodeIndex + 1;
+				}
+				active = lanes;
+			}
+		}
+		else {
+			if (toVisitOffset == 0) break;
+			--toVisitOffset;
+			currentNodeIndex = nodesToVisit[toVisitOffset];
+			active = lanesToVisit[toVisitOffset];
+		}
+	}
+	return hitMask;
 }
 bool BVHAccel::IntersectP(const Ray &ray) const {
 	if (!nodes) return false;
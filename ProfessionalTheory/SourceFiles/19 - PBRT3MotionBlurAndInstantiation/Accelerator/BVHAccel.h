@@ -13,7 +13,16 @@ struct BVHBuildNode;
 
 // BVHAccel Forward Declarations
 struct BVHPrimitiveInfo;
-struct LinearBVHNode;
+struct LinearBVHNode {
+	Bounds3f bounds;
+	union {
+		int primitivesOffset;   // leaf
+		int secondChildOffset;  // interior
+	};
+	uint16_t nPrimitives;  // 0 -> interior node
+	uint8_t axis;          // interior node: xyz
+	uint8_t pad[1];        // ensure 32 byte total size
+};
 
 class BVHAccel : public Aggregate {
 public:
@@ -28,21 +37,89 @@ public:
 	~BVHAccel();
 	bool Intersect(const Ray &ray, SurfaceInteraction *isect) const;
 	bool IntersectP(const Ray &ray) const;
+	bool IntersectHit(const Ray &ray, PrimitiveHit *hit) const;
+	// Walks the tree once for the whole packet; a node is skipped as soon
+	// as none of the lanes that reached it overlap its bounds
+	int IntersectPacket(RayPacket &packet, int active, PrimitiveHit *hits) const;
+	// Updates the node bounds after primitives moved, keeping the topology.
+	// When the relative SAH cost has grown past _maxCostRatio_ times its
+	// value at the last build the tree is rebuilt instead (returns true).
+	bool Refit(float maxCostRatio = 1.5f);
+	float SAHCost() const { return SAHCost(nodes, totalNodes); }
+
+	// Builds a flattened tree over _primBounds_; leaves index into
+	// _orderedPrims_, which holds the original primitive numbers. The SAH
+	// charges leaves per _leafBlockWidth_ primitives, for SIMD leaf tests.
+	static LinearBVHNode *BuildLinear(const std::vector<Bounds3f> &primBounds,
+		int maxPrimsInNode, SplitMethod splitMethod,
+		std::vector<int> *orderedPrims, int *totalNodes,
+		int leafBlockWidth = 1);
+	// Recomputes the bounds of a flattened tree bottom-up; _leafBounds_
+	// returns the bounds of the primitives of a leaf node. Subtrees below
+	// the first few levels are refitted in parallel.
+	template <typename LeafBounds>
+	static void RefitLinear(LinearBVHNode *nodes, const LeafBounds &leafBounds);
+	// Cost of a flattened tree under the SAH model of BuildLinear()
+	static float SAHCost(const LinearBVHNode *nodes, int totalNodes,
+		int leafBlockWidth = 1);
+	// SAH cost relative to the summed surface area of the primitive bounds.
+	// Unlike the plain cost it stays put when the primitives themselves
+	// grow, so it measures how far a refitted tree has degraded.
+	static float RelativeSAHCost(const LinearBVHNode *nodes, int totalNodes,
+		double primitiveArea, int leafBlockWidth = 1);
 
 private:
 	// BVHAccel Private Methods
-	BVHBuildNode *recursiveBuild(std::vector<BVHPrimitiveInfo> &primitiveInfo,
-		int start, int end, int *totalNodes,
-		std::vector<std::shared_ptr<Primitive>> &orderedPrims);
-	int flattenBVHTree(BVHBuildNode *node, int *offset);
+	void Build();
 
 	// BVHAccel Private Data
 	const int maxPrimsInNode;
 	const SplitMethod splitMethod;
 	std::vector<std::shared_ptr<Primitive>> primitives;
 	LinearBVHNode *nodes = nullptr;
+	int totalNodes = 0;
+	float buildCost = 0;
 };
 
+template <typename LeafBounds>
+void BVHAccel::RefitLinear(LinearBVHNode *nodes, const LeafBounds &leafBounds) {
+	if (!nodes) return;
+	auto refitNode = [&](int i) {
+		LinearBVHNode &node = nodes[i];
+		if (node.nPrimitives > 0)
+			node.bounds = leafBounds(node);
+		else
+			node.bounds = Union(nodes[i + 1].bounds, nodes[node.secondChildOffset].bounds);
+	};
+
+	// Split off the top of the tree breadth first until there are enough
+	// subtrees to share out; a subtree is a contiguous range of _nodes_
+	std::vector<int> top, subtrees(1, 0);
+	while (subtrees.size() < 64) {
+		std::vector<int> next;
+		for (int i : subtrees) {
+			if (nodes[i].nPrimitives > 0)
+				next.push_back(i);
+			else {
+				top.push_back(i);
+				next.push_back(i + 1);
+				next.push_back(nodes[i].secondChildOffset);
+			}
+		}
+		if (next.size() == subtrees.size()) break;
+		subtrees.swap(next);
+	}
+
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int s = 0; s < (int)subtrees.size(); ++s) {
+		// Children follow their parent, so a reverse pass is bottom-up
+		int root = subtrees[s], last = root;
+		while (nodes[last].nPrimitives == 0) last = nodes[last].secondChildOffset;
+		for (int i = last; i >= root; --i) refitNode(i);
+	}
+	for (int i = (int)top.size() - 1; i >= 0; --i) refitNode(top[i]);
+}
+
 
 }
 
@@ -0,0 +1,140 @@
+#include "Accelerator/InstanceAccel.h"
+#include <chrono>
+
+namespace Feimos {
+
+// InstanceAccel Method Definitions
+InstanceAccel::~InstanceAccel() { delete[] nodes; }
+
+int InstanceAccel::AddBLAS(const std::shared_ptr<Primitive> &blas) {
+	blases.push_back(blas);
+	return (int)blases.size() - 1;
+}
+
+int InstanceAccel::AddInstance(int blas, const Transform &ObjectToWorld) {
+	instances.push_back(
+		std::make_shared<TransformedPrimitive>(blases[blas], ObjectToWorld));
+	return (int)instances.size() - 1;
+}
+
+int InstanceAccel::AddInstance(int blas, const AnimatedTransform &ObjectToWorld) {
+	// Static instances own a copy of their transform
+	if (!ObjectToWorld.IsAnimated()) {
+		Transform objectToWorld;
+		ObjectToWorld.Interpolate(0, &objectToWorld);
+		return AddInstance(blas, objectToWorld);
+	}
+	instances.push_back(
+		std::make_shared<TransformedPrimitive>(blases[blas], ObjectToWorld));
+	return (int)instances.size() - 1;
+}
+
+void InstanceAccel::SetTransform(int instance, const Transform &ObjectToWorld) {
+	instances[instance]->SetPrimitiveToWorld(ObjectToWorld);
+}
+
+void InstanceAccel::Build() {
+	auto start = std::chrono::steady_clock::now();
+	delete[] nodes;
+	nodes = nullptr;
+
+	// Only instance bounds enter the TLAS; the BLASes are left untouched
+	std::vector<Bounds3f> instanceBounds(instances.size());
+	for (size_t i = 0; i < instances.size(); ++i)
+		instanceBounds[i] = instances[i]->WorldBound();
+	totalNodes = 0;
+	std::vector<int> ordered;
+	nodes = BVHAccel::BuildLinear(instanceBounds, 4, BVHAccel::SplitMethod::SAH,
+		&ordered, &totalNodes);
+	orderedInstances.resize(ordered.size());
+	for (size_t i = 0; i < ordered.size(); ++i)
+		orderedInstances[i] = instances[ordered[i]].get();
+	buildMilliseconds = std::chrono::duration<float, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+Bounds3f InstanceAccel::WorldBound() const {
+	return nodes ? nodes[0].bounds : Bounds3f();
+}
+
+bool InstanceAccel::Intersect(const Ray &ray, SurfaceInteraction *isect) const {
+	PrimitiveHit hit;
+	hit.isect = isect;
+	if (!IntersectHit(ray, &hit)) return false;
+	ComputeHitInteraction(ray, hit, isect);
+	return true;
+}
+
+bool InstanceAccel::IntersectHit(const Ray &ray, PrimitiveHit *hit) const {
+	if (!nodes) return false;
+	bool hitFound = false;
+	Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+	int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+	int toVisitOffset = 0, currentNodeIndex = 0;
+	int nodesToVisit[64];
+	while (true) {
+		const LinearBVHNode *node = &nodes[currentNodeIndex];
+		if (node->bounds.IntersectP(ray, invDir, dirIsNeg)) {
+			if (node->nPrimitives > 0) {
+				// Each instance transforms the ray into its BLAS
+				for (int i = 0; i < node->nPrimitives; ++i)
+					if (orderedInstances[node->primitivesOffset + i]->IntersectHit(ray, hit))
+						hitFound = true;
+				if (toVisitOffset == 0) break;
+				currentNodeIndex = nodesToVisit[--toVisitOffset];
+			}
+			else {
+				if (dirIsNeg[node->axis]) {
+					nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+					currentNodeIndex = node->secondChildOffset;
+				}
+				else {
+					nodesToVisit[toVisitOffset++] = node->secondChildOffset;
+					currentNodeIndex = currentNodeIndex + 1;
+				}
+			}
+		}
+		else {
+			if (toVisitOffset == 0) break;
+			currentNodeIndex = nodesToVisit[--toVisitOffset];
+		}
+	}
+	return hitFound;
+}
+
+bool InstanceAccel::IntersectP(const Ray &ray) const {
+	if (!nodes) return false;
+	Vector3f invDir(1.f / ray.d.x, 1.f / ray.d.y, 1.f / ray.d.z);
+	int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+	int nodesToVisit[64];
+	int toVisitOffset = 0, currentNodeIndex = 0;
+	while (true) {
+		const LinearBVHNode *node = &nodes[currentNodeIndex];
+		if (node->bounds.IntersectP(ray, invDir, dirIsNeg)) {
+			if (node->nPrimitives > 0) {
+				for (int i = 0; i < node->nPrimitives; ++i)
+					if (orderedInstances[node->primitivesOffset + i]->IntersectP(ray))
+						return true;
+				if (toVisitOffset == 0) break;
+				currentNodeIndex = nodesToVisit[--toVisitOffset];
+			}
+			else {
+				if (dirIsNeg[node->axis]) {
+					nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+					currentNodeIndex = node->secondChildOffset;
+				}
+				else {
+					nodesToVisit[toVisitOffset++] = node->secondChildOffset;
+					currentNodeIndex = currentNodeIndex + 1;
+				}
+			}
+		}
+		else {
+			if (toVisitOffset == 0) break;
+			currentNodeIndex = nodesToVisit[--toVisitOffset];
+		}
+	}
+	return false;
+}
+
+}
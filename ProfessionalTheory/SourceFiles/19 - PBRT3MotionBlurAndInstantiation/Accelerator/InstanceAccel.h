@@ -0,0 +1,61 @@
+#pragma once
+#ifndef __InstanceAccel_h__
+#define __InstanceAccel_h__
+
+#include <vector>
+#include <memory>
+
+#include "Core/FeimosRender.h"
+#include "Core/Primitive.h"
+#include "Accelerator/BVHAccel.h"
+
+namespace Feimos {
+
+// InstanceAccel Declarations
+// Two-level acceleration structure. Bottom level structures (BLAS, e.g. the
+// BVH of one model) are built once and shared by every instance of them;
+// the top level (TLAS) is a BVH over the instances only. Each instance keeps
+// its world-to-object transform precomputed, so moving instances costs a
+// TLAS rebuild and no geometry is copied.
+class InstanceAccel : public Aggregate {
+public:
+	// InstanceAccel Public Methods
+	InstanceAccel() {}
+	~InstanceAccel();
+	// Returns the index of _blas_ for AddInstance()
+	int AddBLAS(const std::shared_ptr<Primitive> &blas);
+	// Return the instance index for SetTransform()
+	int AddInstance(int blas, const Transform &ObjectToWorld);
+	int AddInstance(int blas, const AnimatedTransform &ObjectToWorld);
+	// Moves a static instance; takes effect at the next Build()
+	void SetTransform(int instance, const Transform &ObjectToWorld);
+	// (Re)builds the TLAS over the current instance bounds
+	void Build();
+	int BLASCount() const { return (int)blases.size(); }
+	int InstanceCount() const { return (int)instances.size(); }
+	float BuildMilliseconds() const { return buildMilliseconds; }
+	// Memory of the TLAS and the instances; the BLASes are not included
+	size_t Bytes() const {
+		return sizeof(*this) + totalNodes * sizeof(LinearBVHNode) +
+			instances.size() * (sizeof(TransformedPrimitive) +
+				sizeof(instances[0]) + sizeof(orderedInstances[0]));
+	}
+	Bounds3f WorldBound() const;
+	bool Intersect(const Ray &ray, SurfaceInteraction *isect) const;
+	bool IntersectP(const Ray &ray) const;
+	bool IntersectHit(const Ray &ray, PrimitiveHit *hit) const;
+
+private:
+	// InstanceAccel Private Data
+	std::vector<std::shared_ptr<Primitive>> blases;
+	std::vector<std::shared_ptr<TransformedPrimitive>> instances;
+	// TLAS leaves index _orderedInstances_
+	LinearBVHNode *nodes = nullptr;
+	int totalNodes = 0;
+	std::vector<const TransformedPrimitive *> orderedInstances;
+	float buildMilliseconds = 0;
+};
+
+}
+
+#endif
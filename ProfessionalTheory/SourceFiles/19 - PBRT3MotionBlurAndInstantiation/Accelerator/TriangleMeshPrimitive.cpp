@@ -0,0 +1,633 @@
+#include "Accelerator/TriangleMeshPrimitive.h"
+#include "Core/interaction.h"
+#include "Core/RayPacket.h"
+#include <algorithm>
+
+namespace Feimos {
+
+// TriangleMeshPrimitive Local Definitions
+// Ray-dependent part of the watertight test; the permutation and shear are
+// set up once per traversal rather than once per triangle
+struct WatertightRay {
+	WatertightRay() {}
+	WatertightRay(const Ray &ray) {
+		kz = MaxDimension(Abs(ray.d));
+		kx = kz + 1;
+		if (kx == 3) kx = 0;
+		ky = kx + 1;
+		if (ky == 3) ky = 0;
+		Vector3f d = Permute(ray.d, kx, ky, kz);
+		Sx = -d.x / d.z;
+		Sy = -d.y / d.z;
+		Sz = 1.f / d.z;
+		ox = ray.o[kx];
+		oy = ray.o[ky];
+		oz = ray.o[kz];
+	}
+	int kx, ky, kz;
+	float Sx, Sy, Sz;
+	float ox, oy, oz;
+};
+
+// By-value selects; std::max on references keeps GCC from vectorizing
+static inline float MaxAbs(float a, float b, float c) {
+	a = std::abs(a);
+	b = std::abs(b);
+	c = std::abs(c);
+	float m = a > b ? a : b;
+	return m > c ? m : c;
+}
+
+// Transform the triangle vertices of _block_ to ray coordinate space
+static inline void TransformBlock(const TriangleBlock &block,
+	const WatertightRay &wr, float px[3][TriangleBlockWidth],
+	float py[3][TriangleBlockWidth], float pz[3][TriangleBlockWidth]) {
+	constexpr int W = TriangleBlockWidth;
+	for (int v = 0; v < 3; ++v) {
+		const float *x = block.p[v][wr.kx];
+		const float *y = block.p[v][wr.ky];
+		const float *z = block.p[v][wr.kz];
+#pragma omp simd
+		for (int l = 0; l < W; ++l) {
+			pz[v][l] = z[l] - wr.oz;
+			px[v][l] = (x[l] - wr.ox) + wr.Sx * pz[v][l];
+			py[v][l] = (y[l] - wr.oy) + wr.Sy * pz[v][l];
+		}
+	}
+}
+// Dequantizes as _TriangleMesh::P()_ does, so both blocks see the same vertices
+static inline void TransformBlock(const QuantizedTriangleBlock &block,
+	const WatertightRay &wr, const Point3f &qMin, const Vector3f &qScale,
+	float px[3][TriangleBlockWidth], float py[3][TriangleBlockWidth],
+	float pz[3][TriangleBlockWidth]) {
+	constexpr int W = TriangleBlockWidth;
+	const float xMin = qMin[wr.kx], yMin = qMin[wr.ky], zMin = qMin[wr.kz];
+	const float xScale = qScale[wr.kx], yScale = qScale[wr.ky];
+	const float zScale = qScale[wr.kz];
+	for (int v = 0; v < 3; ++v) {
+		const uint16_t *x = block.q[v][wr.kx];
+		const uint16_t *y = block.q[v][wr.ky];
+		const uint16_t *z = block.q[v][wr.kz];
+#pragma omp simd
+		for (int l = 0; l < W; ++l) {
+			pz[v][l] = (zMin + z[l] * zScale) - wr.oz;
+			px[v][l] = ((xMin + x[l] * xScale) - wr.ox) + wr.Sx * pz[v][l];
+			py[v][l] = ((yMin + y[l] * yScale) - wr.oy) + wr.Sy * pz[v][l];
+		}
+	}
+}
+
+// Watertight test of one ray against all lanes of a block, given its vertices
+// in ray coordinate space. Returns a bit mask of the lanes hit within
+// $(0, tMax]$ and their $t$ and barycentrics.
+static inline int IntersectBlock(float px[3][TriangleBlockWidth],
+	float py[3][TriangleBlockWidth], float pz[3][TriangleBlockWidth],
+	const WatertightRay &wr, float tMax,
+	float *tHit, float *b0, float *b1, float *b2) {
+	constexpr int W = TriangleBlockWidth;
+
+	// Compute edge function coefficients _e0_, _e1_, and _e2_
+	float e0[W], e1[W], e2[W];
+	int onEdge = 0;
+#pragma omp simd reduction(|:onEdge)
+	for (int l = 0; l < W; ++l) {
+		e0[l] = px[1][l] * py[2][l] - py[1][l] * px[2][l];
+		e1[l] = px[2][l] * py[0][l] - py[2][l] * px[0][l];
+		e2[l] = px[0][l] * py[1][l] - py[0][l] * px[1][l];
+		onEdge |= (e0[l] == 0.0f) | (e1[l] == 0.0f) | (e2[l] == 0.0f);
+	}
+	// Fall back to double precision test at triangle edges, lane by lane
+	if (onEdge) {
+		for (int l = 0; l < W; ++l) {
+			if (e0[l] != 0.0f && e1[l] != 0.0f && e2[l] != 0.0f) continue;
+			e0[l] = (float)((double)py[2][l] * (double)px[1][l] -
+				(double)px[2][l] * (double)py[1][l]);
+			e1[l] = (float)((double)py[0][l] * (double)px[2][l] -
+				(double)px[0][l] * (double)py[2][l]);
+			e2[l] = (float)((double)py[1][l] * (double)px[0][l] -
+				(double)px[1][l] * (double)py[0][l]);
+		}
+	}
+
+	// Edge, determinant, range and conservative $t > 0$ tests per lane; the
+	// conditions use bitwise operators so that the loop stays branch free
+	const float gamma2 = gamma(2), gamma3 = gamma(3), gamma5 = gamma(5);
+	int hit[W];
+#pragma omp simd
+	for (int l = 0; l < W; ++l) {
+		int anyNeg = (e0[l] < 0) | (e1[l] < 0) | (e2[l] < 0);
+		int anyPos = (e0[l] > 0) | (e1[l] > 0) | (e2[l] > 0);
+		float det = e0[l] + e1[l] + e2[l];
+		float z0 = pz[0][l] * wr.Sz, z1 = pz[1][l] * wr.Sz, z2 = pz[2][l] * wr.Sz;
+		float tScaled = e0[l] * z0 + e1[l] * z1 + e2[l] * z2;
+		int inRange =
+			((det < 0) & (tScaled < 0) & (tScaled >= tMax * det)) |
+			((det > 0) & (tScaled > 0) & (tScaled <= tMax * det));
+		float invDet = 1 / det;
+		float t = tScaled * invDet;
+
+		float maxZt = MaxAbs(z0, z1, z2);
+		float maxXt = MaxAbs(px[0][l], px[1][l], px[2][l]);
+		float maxYt = MaxAbs(py[0][l], py[1][l], py[2][l]);
+		float deltaZ = gamma3 * maxZt;
+		float deltaX = gamma5 * (maxXt + maxZt);
+		float deltaY = gamma5 * (maxYt + maxZt);
+		float deltaE =
+			2 * (gamma2 * maxXt * maxYt + deltaY * maxXt + deltaX * maxYt);
+		float maxE = MaxAbs(e0[l], e1[l], e2[l]);
+		float deltaT = 3 *
+			(gamma3 * maxE * maxZt + deltaE * maxZt + deltaZ * maxE) *
+			std::abs(invDet);
+
+		tHit[l] = t;
+		b0[l] = e0[l] * invDet;
+		b1[l] = e1[l] * invDet;
+		b2[l] = e2[l] * invDet;
+		hit[l] = ((anyNeg & anyPos) ^ 1) & inRange & (t > deltaT);
+	}
+	int mask = 0;
+	for (int l = 0; l < W; ++l) mask |= hit[l] << l;
+	return mask;
+}
+
+static inline void TriangleDerivatives(const Point3f &p0, const Point3f &p1,
+	const Point3f &p2, const Point2f uv[3], Vector3f *dpdu, Vector3f *dpdv) {
+	// Compute deltas for triangle partial derivatives
+	Vector2f duv02 = uv[0] - uv[2], duv12 = uv[1] - uv[2];
+	Vector3f dp02 = p0 - p2, dp12 = p1 - p2;
+	float determinant = duv02[0] * duv12[1] - duv02[1] * duv12[0];
+	bool degenerateUV = std::abs(determinant) < 1e-8;
+	if (!degenerateUV) {
+		float invdet = 1 / determinant;
+		*dpdu = (duv12[1] * dp02 - duv02[1] * dp12) * invdet;
+		*dpdv = (-duv12[0] * dp02 + duv02[0] * dp12) * invdet;
+	}
+	// A hit with nonzero determinant cannot come from a zero-area triangle,
+	// so the geometric normal below is always well defined
+	if (degenerateUV || Cross(*dpdu, *dpdv).LengthSquared() == 0)
+		CoordinateSystem(Normalize(Cross(p2 - p0, p1 - p0)), dpdu, dpdv);
+}
+
+// TriangleMeshPrimitive Method Definitions
+TriangleMeshPrimitive::TriangleMeshPrimitive(
+	const std::shared_ptr<TriangleMesh> &mesh,
+	const std::shared_ptr<Material> &material,
+	const MediumInterface &mediumInterface, const Transform &ObjectToWorld,
+	bool reverseOrientation)
+	: mesh(mesh), material(material), mediumInterface(mediumInterface),
+	reverseOrientation(reverseOrientation),
+	flipNormal(reverseOrientation ^ ObjectToWorld.SwapsHandedness()) {
+	std::vector<int> triangles(mesh->nTriangles);
+	for (int i = 0; i < mesh->nTriangles; ++i) triangles[i] = i;
+	Build(std::move(triangles));
+}
+TriangleMeshPrimitive::TriangleMeshPrimitive(
+	const std::shared_ptr<TriangleMesh> &mesh, std::vector<int> triangles,
+	const std::shared_ptr<Material> &material,
+	const MediumInterface &mediumInterface, const Transform &ObjectToWorld,
+	bool reverseOrientation)
+	: mesh(mesh), material(material), mediumInterface(mediumInterface),
+	reverseOrientation(reverseOrientation),
+	flipNormal(reverseOrientation ^ ObjectToWorld.SwapsHandedness()) {
+	Build(std::move(triangles));
+}
+TriangleMeshPrimitive::~TriangleMeshPrimitive() { delete[] nodes; }
+
+void TriangleMeshPrimitive::Build(std::vector<int> triangles) {
+	constexpr int W = TriangleBlockWidth;
+	// Fully transparent triangles can never be hit
+	triangles.erase(std::remove_if(triangles.begin(), triangles.end(),
+		[&](int tri) { return mesh->Opacity(tri) == TriangleTransparent; }),
+		triangles.end());
+	nTriangles = (int)triangles.size();
+	if (nTriangles == 0) return;
+	std::vector<Bounds3f> triBounds(triangles.size());
+	double triangleArea = 0;
+	for (size_t i = 0; i < triangles.size(); ++i) {
+		int v[3];
+		mesh->TriangleIndices(triangles[i], v);
+		triBounds[i] = Union(Bounds3f(mesh->P(v[0]), mesh->P(v[1])), mesh->P(v[2]));
+		triangleArea += triBounds[i].SurfaceArea();
+	}
+	std::vector<int> orderedTris;
+	quantized = mesh->QP(0) != nullptr;
+	nodes = BVHAccel::BuildLinear(triBounds, W, BVHAccel::SplitMethod::SAH,
+		&orderedTris, &totalNodes, W);
+	buildCost = BVHAccel::RelativeSAHCost(nodes, totalNodes, triangleArea, W);
+
+	// Pack the triangles of every leaf into SoA blocks of _W_ lanes. Leaves
+	// whose centroids coincide can exceed _W_ and then span several blocks.
+	for (int i = 0; i < totalNodes; ++i) {
+		LinearBVHNode &node = nodes[i];
+		if (node.nPrimitives == 0) continue;
+		int firstBlock = BlockCount();
+		for (int j = 0; j < node.nPrimitives; j += W) {
+			int index = BlockCount();
+			if (quantized)
+				quantizedBlocks.emplace_back();
+			else
+				blocks.emplace_back();
+			int *triangle = BlockTriangles(index);
+			for (int l = 0; l < W; ++l) {
+				int k = node.primitivesOffset + std::min(j + l, node.nPrimitives - 1);
+				triangle[l] = triangles[orderedTris[k]];
+			}
+			FillBlock(index);
+		}
+		node.primitivesOffset = firstBlock;
+	}
+	blocks.shrink_to_fit();
+	quantizedBlocks.shrink_to_fit();
+}
+Bounds3f TriangleMeshPrimitive::FillBlock(int index, float *area) {
+	const int *triangle = BlockTriangles(index);
+	Bounds3f bounds;
+	for (int l = 0; l < TriangleBlockWidth; ++l) {
+		int v[3];
+		mesh->TriangleIndices(triangle[l], v);
+		Bounds3f triBounds;
+		for (int c = 0; c < 3; ++c) {
+			const Point3f p = mesh->P(v[c]);
+			if (quantized) {
+				const uint16_t *q = mesh->QP(v[c]);
+				for (int axis = 0; axis < 3; ++axis)
+					quantizedBlocks[index].q[c][axis][l] = q[axis];
+			}
+			else {
+				blocks[index].p[c][0][l] = p.x;
+				blocks[index].p[c][1][l] = p.y;
+				blocks[index].p[c][2][l] = p.z;
+			}
+			triBounds = Union(triBounds, p);
+		}
+		bounds = Union(bounds, triBounds);
+		// Spare lanes repeat the previous triangle
+		if (area && (l == 0 || triangle[l] != triangle[l - 1]))
+			*area += triBounds.SurfaceArea();
+	}
+	return bounds;
+}
+int TriangleMeshPrimitive::IntersectBlock(int index, const WatertightRay &wr,
+	float tMax, float *tHit, float *b0, float *b1, float *b2) const {
+	constexpr int W = TriangleBlockWidth;
+	float px[3][W], py[3][W], pz[3][W];
+	if (quantized)
+		TransformBlock(quantizedBlocks[index], wr, mesh->QPMin(), mesh->QPScale(),
+			px, py, pz);
+	else
+		TransformBlock(blocks[index], wr, px, py, pz);
+	return Feimos::IntersectBlock(px, py, pz, wr, tMax, tHit, b0, b1, b2);
+}
+bool TriangleMeshPrimitive::Refit(float maxCostRatio) {
+	if (!nodes) return false;
+	constexpr int W = TriangleBlockWidth;
+	// Spare lanes repeat a triangle of the leaf, so whole blocks bound it
+	double triangleArea = 0;
+	BVHAccel::RefitLinear(nodes, [&](const LinearBVHNode &node) {
+		Bounds3f bounds;
+		float area = 0;
+		int nBlocks = (node.nPrimitives + W - 1) / W;
+		for (int j = 0; j < nBlocks; ++j)
+			bounds = Union(bounds, FillBlock(node.primitivesOffset + j, &area));
+#pragma omp atomic
+		triangleArea += area;
+		return bounds;
+	});
+	if (BVHAccel::RelativeSAHCost(nodes, totalNodes, triangleArea, W) <=
+		maxCostRatio * buildCost)
+		return false;
+
+	// Rebuild over the same triangles, gathered from the leaves
+	std::vector<int> triangles;
+	triangles.reserve(nTriangles);
+	for (int i = 0; i < totalNodes; ++i) {
+		const LinearBVHNode &node = nodes[i];
+		for (int j = 0; j < node.nPrimitives; ++j)
+			triangles.push_back(BlockTriangles(node.primitivesOffset + j / W)[j % W]);
+	}
+	delete[] nodes;
+	nodes = nullptr;
+	totalNodes = 0;
+	blocks.clear();
+	quantizedBlocks.clear();
+	Build(std::move(triangles));
+	return true;
+}
+Bounds3f TriangleMeshPrimitive::WorldBound() const {
+	return nodes ? nodes[0].bounds : Bounds3f();
+}
+
+bool TriangleMeshPrimitive::AlphaTest(const Ray &ray, int tri, float b0,
+	float b1, float b2, bool shadowRay) const {
+	int v[3];
+	mesh->TriangleIndices(tri, v);
+	const Point3f p0 = mesh->P(v[0]);
+	const Point3f p1 = mesh->P(v[1]);
+	const Point3f p2 = mesh->P(v[2]);
+	Point2f uv[3];
+	GetUVs(v, uv);
+	Vector3f dpdu, dpdv;
+	TriangleDerivatives(p0, p1, p2, uv, &dpdu, &dpdv);
+	Point3f pHit = b0 * p0 + b1 * p1 + b2 * p2;
+	Point2f uvHit = b0 * uv[0] + b1 * uv[1] + b2 * uv[2];
+	SurfaceInteraction isectLocal(pHit, Vector3f(0, 0, 0), uvHit, -ray.d,
+		dpdu, dpdv, Normal3f(0, 0, 0), Normal3f(0, 0, 0), ray.time, nullptr);
+	// Same thresholds as _Triangle::Intersect_ and _Triangle::IntersectP_
+	if (!shadowRay)
+		return !mesh->alphaMask || mesh->alphaMask->Evaluate(isectLocal) >= 0.99;
+	if (mesh->alphaMask && mesh->alphaMask->Evaluate(isectLocal) == 0)
+		return false;
+	if (mesh->shadowAlphaMask && mesh->shadowAlphaMask->Evaluate(isectLocal) == 0)
+		return false;
+	return true;
+}
+
+void TriangleMeshPrimitive::FillInteraction(const Ray &ray, int tri, float b0,
+	float b1, float b2, SurfaceInteraction *isect) const {
+	int v[3];
+	mesh->TriangleIndices(tri, v);
+	const Point3f p0 = mesh->P(v[0]);
+	const Point3f p1 = mesh->P(v[1]);
+	const Point3f p2 = mesh->P(v[2]);
+
+	// Compute triangle partial derivatives
+	Point2f uv[3];
+	GetUVs(v, uv);
+	Vector3f dpdu, dpdv;
+	TriangleDerivatives(p0, p1, p2, uv, &dpdu, &dpdv);
+
+	// Compute error bounds for triangle intersection
+	float xAbsSum =
+		(std::abs(b0 * p0.x) + std::abs(b1 * p1.x) + std::abs(b2 * p2.x));
+	float yAbsSum =
+		(std::abs(b0 * p0.y) + std::abs(b1 * p1.y) + std::abs(b2 * p2.y));
+	float zAbsSum =
+		(std::abs(b0 * p0.z) + std::abs(b1 * p1.z) + std::abs(b2 * p2.z));
+	Vector3f pError = gamma(7) * Vector3f(xAbsSum, yAbsSum, zAbsSum);
+	// Interpolate $(u,v)$ parametric coordinates and hit point
+	Point2f uvHit = b0 * uv[0] + b1 * uv[1] + b2 * uv[2];
+	Point3f pHit = b0 * p0 + b1 * p1 + b2 * p2;
+
+	int faceIndex = mesh->faceIndices.size() ? mesh->faceIndices[tri] : 0;
+	*isect = SurfaceInteraction(pHit, pError, uvHit, -ray.d, dpdu, dpdv,
+		Normal3f(0, 0, 0), Normal3f(0, 0, 0), ray.time, nullptr, faceIndex);
+
+	// Override surface normal in _isect_ for triangle
+	isect->n = isect->shading.n = Normal3f(Normalize(Cross(p0 - p2, p1 - p2)));
+	if (flipNormal) isect->n = isect->shading.n = -isect->n;
+
+	if (mesh->HasNormals() || mesh->HasTangents()) {
+		// Compute shading normal _ns_ for triangle
+		Normal3f ns;
+		if (mesh->HasNormals()) {
+			ns = (b0 * mesh->N(v[0]) + b1 * mesh->N(v[1]) + b2 * mesh->N(v[2]));
+			ns = ns.LengthSquared() > 0 ? Normalize(ns) : isect->n;
+		}
+		else
+			ns = isect->n;
+
+		// Compute shading tangent _ss_ for triangle
+		Vector3f ss;
+		if (mesh->HasTangents()) {
+			ss = (b0 * mesh->S(v[0]) + b1 * mesh->S(v[1]) + b2 * mesh->S(v[2]));
+			ss = ss.LengthSquared() > 0 ? Normalize(ss) : Normalize(isect->dpdu);
+		}
+		else
+			ss = Normalize(isect->dpdu);
+
+		// Compute shading bitangent _ts_ for triangle and adjust _ss_
+		Vector3f ts = Cross(ss, ns);
+		if (ts.LengthSquared() > 0.f) {
+			ts = Normalize(ts);
+			ss = Cross(ts, ns);
+		}
+		else
+			CoordinateSystem((Vector3f)ns, &ss, &ts);
+
+		// Compute $\dndu$ and $\dndv$ for triangle shading geometry
+		Normal3f dndu, dndv;
+		if (mesh->HasNormals()) {
+			Vector2f duv02 = uv[0] - uv[2];
+			Vector2f duv12 = uv[1] - uv[2];
+			Normal3f dn1 = mesh->N(v[0]) - mesh->N(v[2]);
+			Normal3f dn2 = mesh->N(v[1]) - mesh->N(v[2]);
+			float determinant = duv02[0] * duv12[1] - duv02[1] * duv12[0];
+			if (std::abs(determinant) < 1e-8) {
+				Vector3f dn = Cross(Vector3f(mesh->N(v[2]) - mesh->N(v[0])),
+					Vector3f(mesh->N(v[1]) - mesh->N(v[0])));
+				if (dn.LengthSquared() == 0)
+					dndu = dndv = Normal3f(0, 0, 0);
+				else {
+					Vector3f dnu, dnv;
+					CoordinateSystem(dn, &dnu, &dnv);
+					dndu = Normal3f(dnu);
+					dndv = Normal3f(dnv);
+				}
+			}
+			else {
+				float invDet = 1 / determinant;
+				dndu = (duv12[1] * dn1 - duv02[1] * dn2) * invDet;
+				dndv = (-duv12[0] * dn1 + duv02[0] * dn2) * invDet;
+			}
+		}
+		else
+			dndu = dndv = Normal3f(0, 0, 0);
+		if (reverseOrientation) ts = -ts;
+		isect->SetShadingGeometry(ss, ts, dndu, dndv, true);
+	}
+}
+
+bool TriangleMeshPrimitive::Intersect(const Ray &ray,
+	SurfaceInteraction *isect) const {
+	PrimitiveHit hit;
+	if (!IntersectHit(ray, &hit)) return false;
+	ComputeInteraction(ray, hit, isect);
+	return true;
+}
+
+bool TriangleMeshPrimitive::IntersectHit(const Ray &ray, PrimitiveHit *hit) const {
+	if (!nodes) return false;
+	WatertightRay wr(ray);
+	Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+	int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+
+	// Traversal only records the closest hit; the interaction is built once
+	bool hitFound = false;
+	int toVisitOffset = 0, currentNodeIndex = 0;
+	int nodesToVisit[64];
+	while (true) {
+		const LinearBVHNode *node = &nodes[currentNodeIndex];
+		if (node->bounds.IntersectP(ray, invDir, dirIsNeg)) {
+			if (node->nPrimitives > 0) {
+				if (IntersectLeaf(*node, ray, wr, hit)) hitFound = true;
+				if (toVisitOffset == 0) break;
+				currentNodeIndex = nodesToVisit[--toVisitOffset];
+			}
+			else {
+				if (dirIsNeg[node->axis]) {
+					nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+					currentNodeIndex = node->secondChildOffset;
+				}
+				else {
+					nodesToVisit[toVisitOffset++] = node->secondChildOffset;
+					currentNodeIndex = currentNodeIndex + 1;
+				}
+			}
+		}
+		else {
+			if (toVisitOffset == 0) break;
+			currentNodeIndex = nodesToVisit[--toVisitOffset];
+		}
+	}
+	return hitFound;
+}
+
+bool TriangleMeshPrimitive::IntersectLeaf(const LinearBVHNode &node,
+	const Ray &ray, const WatertightRay &wr, PrimitiveHit *hit) const {
+	bool hitFound = false;
+	int nBlocks = (node.nPrimitives + TriangleBlockWidth - 1) / TriangleBlockWidth;
+	for (int j = 0; j < nBlocks; ++j) {
+		int index = node.primitivesOffset + j;
+		float t[TriangleBlockWidth], b0[TriangleBlockWidth];
+		float b1[TriangleBlockWidth], b2[TriangleBlockWidth];
+		int mask = IntersectBlock(index, wr, ray.tMax, t, b0, b1, b2);
+		const int *triangle = BlockTriangles(index);
+		for (int l = 0; mask; ++l, mask >>= 1) {
+			if (!(mask & 1) || t[l] > ray.tMax) continue;
+			int tri = triangle[l];
+			if (mesh->alphaMask && mesh->Opacity(tri) != TriangleOpaque &&
+				!AlphaTest(ray, tri, b0[l], b1[l], b2[l], false))
+				continue;
+			ray.tMax = t[l];
+			hit->primitive = this;
+			hit->index = tri;
+			hit->b[0] = b0[l];
+			hit->b[1] = b1[l];
+			hit->b[2] = b2[l];
+			hit->deferred = true;
+			hit->nInstances = 0;
+			hitFound = true;
+		}
+	}
+	return hitFound;
+}
+
+int TriangleMeshPrimitive::IntersectPacket(RayPacket &packet, int active,
+	PrimitiveHit *hits) const {
+	if (!nodes) return 0;
+	WatertightRay wr[RayPacketSize];
+	for (int l = 0; l < RayPacketSize; ++l)
+		if (active & (1 << l)) wr[l] = WatertightRay(*packet.ray[l]);
+
+	// Same walk as _BVHAccel::IntersectPacket()_; at the leaves each lane
+	// still tests a whole block of triangles at once
+	int hitMask = 0;
+	int toVisitOffset = 0, currentNodeIndex = 0;
+	int nodesToVisit[64], lanesToVisit[64];
+	while (true) {
+		const LinearBVHNode *node = &nodes[currentNodeIndex];
+		int lanes = packet.IntersectBounds(node->bounds, active);
+		if (lanes) {
+			if (node->nPrimitives > 0) {
+				for (int l = 0, m = lanes; m; ++l, m >>= 1) {
+					if (!(m & 1)) continue;
+					const Ray &ray = *packet.ray[l];
+					if (!IntersectLeaf(*node, ray, wr[l], &hits[l])) continue;
+					packet.tMax[l] = ray.tMax;
+					hitMask |= 1 << l;
+				}
+				if (toVisitOffset == 0) break;
+				--toVisitOffset;
+				currentNodeIndex = nodesToVisit[toVisitOffset];
+				active = lanesToVisit[toVisitOffset];
+			}
+			else {
+				lanesToVisit[toVisitOffset] = lanes;
+				if (packet.dirIsNeg[node->axis]) {
+					nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+					currentNodeIndex = node->secondChildOffset;
+				}
+				else {
+					nodesToVisit[toVisitOffset++] = node->secondChildOffset;
+					currentNodeIndex = currentNodeIndex + 1;
+				}
+				active = lanes;
+			}
+		}
+		else {
+			if (toVisitOffset == 0) break;
+			--toVisitOffset;
+			currentNodeIndex = nodesToVisit[toVisitOffset];
+			active = lanesToVisit[toVisitOffset];
+		}
+	}
+	return hitMask;
+}
+
+void TriangleMeshPrimitive::ComputeInteraction(const Ray &ray,
+	const PrimitiveHit &hit, SurfaceInteraction *isect) const {
+	FillInteraction(ray, hit.index, hit.b[0], hit.b[1], hit.b[2], isect);
+	isect->primitive = this;
+	if (mediumInterface.IsMediumTransition())
+		isect->mediumInterface = mediumInterface;
+	else
+		isect->mediumInterface = MediumInterface(ray.medium);
+}
+
+bool TriangleMeshPrimitive::IntersectP(const Ray &ray) const {
+	if (!nodes) return false;
+	WatertightRay wr(ray);
+	Vector3f invDir(1.f / ray.d.x, 1.f / ray.d.y, 1.f / ray.d.z);
+	int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+	bool alphaTested = mesh->alphaMask || mesh->shadowAlphaMask;
+	int nodesToVisit[64];
+	int toVisitOffset = 0, currentNodeIndex = 0;
+	while (true) {
+		const LinearBVHNode *node = &nodes[currentNodeIndex];
+		if (node->bounds.IntersectP(ray, invDir, dirIsNeg)) {
+			if (node->nPrimitives > 0) {
+				int nBlocks = (node->nPrimitives + TriangleBlockWidth - 1) / TriangleBlockWidth;
+				for (int j = 0; j < nBlocks; ++j) {
+					int index = node->primitivesOffset + j;
+					float t[TriangleBlockWidth], b0[TriangleBlockWidth];
+					float b1[TriangleBlockWidth], b2[TriangleBlockWidth];
+					int mask = IntersectBlock(index, wr, ray.tMax, t, b0, b1, b2);
+					if (mask && !alphaTested) return true;
+					for (int l = 0; mask; ++l, mask >>= 1) {
+						if (!(mask & 1)) continue;
+						int tri = BlockTriangles(index)[l];
+						if (mesh->Opacity(tri) == TriangleOpaque ||
+							AlphaTest(ray, tri, b0[l], b1[l], b2[l], true))
+							return true;
+					}
+				}
+				if (toVisitOffset == 0) break;
+				currentNodeIndex = nodesToVisit[--toVisitOffset];
+			}
+			else {
+				if (dirIsNeg[node->axis]) {
+					nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+					currentNodeIndex = node->secondChildOffset;
+				}
+				else {
+					nodesToVisit[toVisitOffset++] = node->secondChildOffset;
+					currentNodeIndex = currentNodeIndex + 1;
+				}
+			}
+		}
+		else {
+			if (toVisitOffset == 0) break;
+			currentNodeIndex = nodesToVisit[--toVisitOffset];
+		}
+	}
+	return false;
+}
+
+void TriangleMeshPrimitive::ComputeScatteringFunctions(
+	SurfaceInteraction *isect, TransportMode mode,
+	bool allowMultipleLobes) const {
+	if (material)
+		material->ComputeScatteringFunctions(isect, mode, allowMultipleLobes);
+}
+
+}
@@ -0,0 +1,138 @@
+#pragma once
+#ifndef __TriangleMeshPrimitive_h__
+#define __TriangleMeshPrimitive_h__
+
+#include <vector>
+#include <memory>
+
+#include "Core/FeimosRender.h"
+#include "Core/Primitive.h"
+#include "Shape/Triangle.h"
+#include "Accelerator/BVHAccel.h"
+
+namespace Feimos {
+
+struct WatertightRay;
+
+// Triangles per BVH leaf block, one per SIMD lane
+#if defined(__AVX__) || defined(__AVX2__)
+constexpr int TriangleBlockWidth = 8;
+#else
+constexpr int TriangleBlockWidth = 4;
+#endif
+
+// SoA leaf storage: coordinate _axis_ of vertex _v_ in lane _l_ is
+// p[v][axis][l]; short leaves repeat their last triangle in the spare lanes
+struct TriangleBlock {
+	float p[3][3][TriangleBlockWidth];
+	int triangle[TriangleBlockWidth];
+};
+// Same layout for meshes with quantized positions; the lanes keep the
+// mesh's 16 bit coordinates, dequantized when the block is tested
+struct QuantizedTriangleBlock {
+	uint16_t q[3][3][TriangleBlockWidth];
+	int triangle[TriangleBlockWidth];
+};
+
+// TriangleMeshPrimitive Declarations
+// One primitive per mesh: the triangles share the mesh arrays, one material
+// and one medium interface, and the internal BVH references them by index.
+class TriangleMeshPrimitive : public Primitive {
+public:
+	// TriangleMeshPrimitive Public Methods
+	TriangleMeshPrimitive(const std::shared_ptr<TriangleMesh> &mesh,
+		const std::shared_ptr<Material> &material,
+		const MediumInterface &mediumInterface,
+		const Transform &ObjectToWorld, bool reverseOrientation = false);
+	// Restricts the primitive to a subset of the mesh triangles
+	TriangleMeshPrimitive(const std::shared_ptr<TriangleMesh> &mesh,
+		std::vector<int> triangles,
+		const std::shared_ptr<Material> &material,
+		const MediumInterface &mediumInterface,
+		const Transform &ObjectToWorld, bool reverseOrientation = false);
+	~TriangleMeshPrimitive();
+	Bounds3f WorldBound() const;
+	bool Intersect(const Ray &ray, SurfaceInteraction *isect) const;
+	bool IntersectP(const Ray &ray) const;
+	bool IntersectHit(const Ray &ray, PrimitiveHit *hit) const;
+	int IntersectPacket(RayPacket &packet, int active, PrimitiveHit *hits) const;
+	void ComputeInteraction(const Ray &ray, const PrimitiveHit &hit,
+		SurfaceInteraction *isect) const;
+	const AreaLight *GetAreaLight() const { return nullptr; }
+	const Material *GetMaterial() const { return material.get(); }
+	void ComputeScatteringFunctions(SurfaceInteraction *isect,
+		TransportMode mode, bool allowMultipleLobes) const;
+	int TriangleCount() const { return nTriangles; }
+	// Memory held by the primitive itself: nodes and leaf blocks
+	size_t Bytes() const {
+		return sizeof(*this) + totalNodes * sizeof(LinearBVHNode) +
+			blocks.capacity() * sizeof(TriangleBlock) +
+			quantizedBlocks.capacity() * sizeof(QuantizedTriangleBlock);
+	}
+	// Call after the mesh positions changed: refreshes the leaf blocks and
+	// refits the node bounds, or rebuilds when the relative SAH cost grew
+	// past _maxCostRatio_ times its value at the last build (returns true)
+	bool Refit(float maxCostRatio = 1.5f);
+	float SAHCost() const {
+		return BVHAccel::SAHCost(nodes, totalNodes, TriangleBlockWidth);
+	}
+
+private:
+	// TriangleMeshPrimitive Private Methods
+	void Build(std::vector<int> triangles);
+	// Copies the vertices of the block's triangles into its lanes; adds the
+	// surface area of each distinct triangle's bounds to _area_
+	Bounds3f FillBlock(int index, float *area = nullptr);
+	int BlockCount() const {
+		return quantized ? (int)quantizedBlocks.size() : (int)blocks.size();
+	}
+	int *BlockTriangles(int index) {
+		return quantized ? quantizedBlocks[index].triangle : blocks[index].triangle;
+	}
+	const int *BlockTriangles(int index) const {
+		return quantized ? quantizedBlocks[index].triangle : blocks[index].triangle;
+	}
+	// Watertight test of one ray against all lanes of block _index_
+	int IntersectBlock(int index, const WatertightRay &wr, float tMax,
+		float *tHit, float *b0, float *b1, float *b2) const;
+	void GetUVs(const int *v, Point2f uv[3]) const {
+		if (mesh->HasUVs()) {
+			uv[0] = mesh->UV(v[0]);
+			uv[1] = mesh->UV(v[1]);
+			uv[2] = mesh->UV(v[2]);
+		}
+		else {
+			uv[0] = Point2f(0, 0);
+			uv[1] = Point2f(1, 0);
+			uv[2] = Point2f(1, 1);
+		}
+	}
+	bool AlphaTest(const Ray &ray, int tri, float b0, float b1, float b2,
+		bool shadowRay) const;
+	// Tests _ray_ against the triangle blocks of a leaf, shortening
+	// _ray.tMax_ and recording each closer hit in _hit_
+	bool IntersectLeaf(const LinearBVHNode &node, const Ray &ray,
+		const WatertightRay &wr, PrimitiveHit *hit) const;
+	void FillInteraction(const Ray &ray, int tri, float b0, float b1, float b2,
+		SurfaceInteraction *isect) const;
+
+	// TriangleMeshPrimitive Private Data
+	std::shared_ptr<TriangleMesh> mesh;
+	std::shared_ptr<Material> material;
+	MediumInterface mediumInterface;
+	bool reverseOrientation, flipNormal;
+	int nTriangles = 0;
+	// Leaves index _blocks_; nPrimitives is the triangle count of the leaf
+	LinearBVHNode *nodes = nullptr;
+	int totalNodes = 0;
+	float buildCost = 0;
+	// Exactly one of these is used, _quantizedBlocks_ when the mesh keeps
+	// quantized positions
+	bool quantized = false;
+	std::vector<TriangleBlock> blocks;
+	std::vector<QuantizedTriangleBlock> quantizedBlocks;
+};
+
+}
+
+#endif
@@ -0,0 +1,102 @@
+// Microbenchmark of MIPMap::Lookup(st, dstdx, dstdy), the EWA filter, over
+// typical and grazing footprints in every wrap mode. Prints the time per
+// lookup and a hash of the filtered values, which stays the same as long
+// as the filter's results do.
+//
+// Usage: EWABenchmark [resolution]
+
+#include "Texture/MIPMap.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace Feimos;
+
+struct Footprint
+{
+	const char *name;
+	// Minor axis in texels of the finest level, and major / minor
+	float minor, ratio;
+};
+
+static const Footprint footprints[] = {
+	{"typical", 2.f, 1.f},
+	{"grazing8", 1.5f, 8.f},
+	{"grazing32", 0.7f, 32.f},
+	{"magnify", 0.2f, 1.f}};
+
+template <typename T>
+static uint64_t HashTexel(const T &v, uint64_t hash)
+{
+	unsigned char bytes[sizeof(T)];
+	memcpy(bytes, &v, sizeof(T));
+	for (unsigned char b : bytes)
+		hash = (hash ^ b) * 1099511628211ull;
+	return hash;
+}
+
+template <typename T, typename S>
+static void Run(const char *typeName, int res, const T *img)
+{
+	const ImageWrap wrapModes[] = {ImageWrap::Repeat, ImageWrap::Clamp, ImageWrap::Black};
+	const char *wrapNames[] = {"repeat", "clamp", "black"};
+	const int nLookups = 50000, nRuns = 9;
+	for (int w = 0; w < 3; ++w)
+	{
+		MIPMap<T, S> mipmap(Point2i(res, res), img, false, 8.f, wrapModes[w]);
+		for (const Footprint &f : footprints)
+		{
+			// Ellipses at random orientations, partly outside $[0,1]^2$
+			std::mt19937 rng(7);
+			std::uniform_real_distribution<float> U(0, 1);
+			std::vector<Point2f> st(nLookups);
+			std::vector<Vector2f> dstdx(nLookups), dstdy(nLookups);
+			for (int i = 0; i < nLookups; ++i)
+			{
+				st[i] = Point2f(U(rng) * 1.2f - 0.1f, U(rng) * 1.2f - 0.1f);
+				float angle = U(rng) * 2 * Pi, minor = f.minor / res * (0.5f + U(rng));
+				dstdx[i] = Vector2f(std::cos(angle), std::sin(angle)) * (minor * f.ratio);
+				dstdy[i] = Vector2f(-std::sin(angle), std::cos(angle)) * minor;
+			}
+
+			double best = 1e30;
+			uint64_t hash = 14695981039346656037ull;
+			for (int run = 0; run < nRuns; ++run)
+			{
+				uint64_t runHash = 14695981039346656037ull;
+				auto start = std::chrono::steady_clock::now();
+				for (int i = 0; i < nLookups; ++i)
+					runHash = HashTexel(mipmap.Lookup(st[i], dstdx[i], dstdy[i]), runHash);
+				double seconds = std::chrono::duration<double>(
+					std::chrono::steady_clock::now() - start).count();
+				best = std::min(best, seconds);
+				hash = runHash;
+			}
+			printf("%-6s %-7s %-10s %8.1f ns/lookup  hash %016llx\n", typeName,
+				   wrapNames[w], f.name, best / nLookups * 1e9, (unsigned long long)hash);
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const int res = argc > 1 ? std::max(1, atoi(argv[1])) : 256;
+	std::mt19937 rng(3);
+	std::uniform_real_distribution<float> U(0, 1);
+	std::vector<RGBSpectrum> rgb(res * res);
+	std::vector<float> grey(res * res);
+	for (int i = 0; i < res * res; ++i)
+	{
+		float c[3] = {U(rng), U(rng), U(rng)};
+		rgb[i] = RGBSpectrum::FromRGB(c);
+		grey[i] = U(rng);
+	}
+	Run<RGBSpectrum, RGBSpectrum>("rgb", res, rgb.data());
+	Run<RGBSpectrum, RGB8Texel>("srgb8", res, rgb.data());
+	Run<float, float>("float", res, grey.data());
+	return 0;
+}
@@ -0,0 +1,137 @@
+#include "Core/Checkpoint.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace Feimos
+{
+
+	static const char checkpointMagic[8] = {'F', 'M', 'C', 'K', 'P', 'T', '0', '2'};
+
+	template <typename T>
+	static void WriteArray(std::ofstream &out, const std::vector<T> &v)
+	{
+		out.write(reinterpret_cast<const char *>(v.data()), v.size() * sizeof(T));
+	}
+
+	template <typename T>
+	static bool ReadArray(std::ifstream &in, std::vector<T> &v, size_t n)
+	{
+		v.resize(n);
+		in.read(reinterpret_cast<char *>(v.data()), n * sizeof(T));
+		return (bool)in;
+	}
+
+	// Checkpoint Function Definitions
+	bool WriteCheckpoint(const std::string &filename, const RenderCheckpoint &cp)
+	{
+		const std::string tmpName = filename + ".tmp";
+		{
+			std::ofstream out(tmpName, std::ios::binary | std::ios::trunc);
+			if (!out)
+				return false;
+			int header[4] = {cp.resolution.x, cp.resolution.y, cp.passes, cp.samplerSeed};
+			out.write(checkpointMagic, sizeof(checkpointMagic));
+			out.write(reinterpret_cast<const char *>(header), sizeof(header));
+			out.write(reinterpret_cast<const char *>(&cp.fingerprint), sizeof(cp.fingerprint));
+			out.write(reinterpret_cast<const char *>(&cp.renderSeconds), sizeof(cp.renderSeconds));
+			WriteArray(out, cp.rgbSum);
+			WriteArray(out, cp.weightSum);
+			WriteArray(out, cp.stats);
+			WriteArray(out, cp.aovs);
+			if (!out)
+				return false;
+		}
+		// rename() does not replace an existing file on Windows
+		std::remove(filename.c_str());
+		return std::rename(tmpName.c_str(), filename.c_str()) == 0;
+	}
+
+	bool ReadCheckpoint(const std::string &filename, RenderCheckpoint *cp)
+	{
+		std::ifstream in(filename, std::ios::binary);
+		if (!in)
+			return false;
+		char magic[8];
+		int header[4];
+		in.read(magic, sizeof(magic));
+		in.read(reinterpret_cast<char *>(header), sizeof(header));
+		in.read(reinterpret_cast<char *>(&cp->fingerprint), sizeof(cp->fingerprint));
+		in.read(reinterpret_cast<char *>(&cp->renderSeconds), sizeof(cp->renderSeconds));
+		if (!in || std::memcmp(magic, checkpointMagic, sizeof(magic)) != 0)
+			return false;
+		if (header[0] <= 0 || header[1] <= 0)
+			return false;
+		cp->resolution = Point2i(header[0], header[1]);
+		cp->passes = header[2];
+		cp->samplerSeed = header[3];
+		size_t nPixels = (size_t)header[0] * header[1];
+		return ReadArray(in, cp->rgbSum, 3 * nPixels) &&
+			   ReadArray(in, cp->weightSum, nPixels) &&
+			   ReadArray(in, cp->stats, nPixels) &&
+			   ReadArray(in, cp->aovs, nPixels);
+	}
+
+	uint64_t FingerprintBytes(const void *data, size_t size, uint64_t hash)
+	{
+		const unsigned char *bytes = static_cast<const unsigned char *>(data);
+		for (size_t i = 0; i < size; ++i)
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		return hash;
+	}
+
+	// CheckpointWriter Method Definitions
+	CheckpointWriter::CheckpointWriter(const std::string &filename)
+		: filename(filename)
+	{
+		thread = std::thread(&CheckpointWriter::Run, this);
+	}
+
+	CheckpointWriter::~CheckpointWriter()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		cv.notify_one();
+		thread.join();
+	}
+
+	bool CheckpointWriter::Submit(RenderCheckpoint &&checkpoint)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (busy || hasPending)
+				return false;
+			pending = std::move(checkpoint);
+			hasPending = true;
+		}
+		cv.notify_one();
+		return true;
+	}
+
+	void CheckpointWriter::Run()
+	{
+		while (true)
+		{
+			RenderCheckpoint cp;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				cv.wait(lock, [this] { return hasPending || quit; });
+				// A checkpoint submitted before quitting is still written
+				if (!hasPending)
+					return;
+				cp = std::move(pending);
+				hasPending = false;
+				busy = true;
+			}
+			bool ok = WriteCheckpoint(filename, cp);
+			std::lock_guard<std::mutex> lock(mutex);
+			busy = false;
+			if (ok)
+				++nWritten;
+		}
+	}
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+#ifndef __Checkpoint_h__
+#define __Checkpoint_h__
+
+#include "Core/FeimosRender.h"
+#include "Core/Geometry.h"
+#include "Core/Film.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Feimos
+{
+
+	// RenderCheckpoint Declarations
+	// Everything needed to continue a progressive render: the film
+	// accumulation buffers, the per-pixel sample counts and statistics, and
+	// the sampler state. Samplers that can be resumed derive every sample from
+	// (seed, pixel, pass), so the state is just those two numbers.
+	// _fingerprint_ identifies the scene, camera and integrator the film was
+	// rendered with, and _renderSeconds_ is the render time spent so far, so
+	// a resumed run keeps its adaptive sampling time budget.
+	struct RenderCheckpoint
+	{
+		Point2i resolution;
+		int passes = 0;
+		int samplerSeed = 0;
+		uint64_t fingerprint = 0;
+		double renderSeconds = 0;
+		std::vector<float> rgbSum;
+		std::vector<float> weightSum;
+		std::vector<PixelStatistics> stats;
+		std::vector<PixelAOV> aovs;
+	};
+
+	// Writes to a temporary file first and renames it, so an interrupted write
+	// never destroys the previous checkpoint
+	bool WriteCheckpoint(const std::string &filename, const RenderCheckpoint &checkpoint);
+	bool ReadCheckpoint(const std::string &filename, RenderCheckpoint *checkpoint);
+	// FNV-1a over _size_ bytes, chained through _hash_; used to build
+	// checkpoint fingerprints
+	uint64_t FingerprintBytes(const void *data, size_t size,
+							  uint64_t hash = 14695981039346656037ull);
+
+	// CheckpointWriter Declarations
+	// Writes checkpoints on a background thread. Submit() never waits: if the
+	// previous checkpoint is still being written the new one is dropped.
+	class CheckpointWriter
+	{
+	public:
+		CheckpointWriter(const std::string &filename);
+		~CheckpointWriter();
+		bool Submit(RenderCheckpoint &&checkpoint);
+		int Written() const { return nWritten; }
+
+	private:
+		void Run();
+
+		const std::string filename;
+		std::thread thread;
+		std::mutex mutex;
+		std::condition_variable cv;
+		RenderCheckpoint pending;
+		bool hasPending = false, busy = false, quit = false;
+		std::atomic<int> nWritten{0};
+	};
+
+}
+
+#endif
@@ -0,0 +1,191 @@
+#include "Core/Denoiser.h"
+
+namespace Feimos
+{
+
+	static inline float Luminance(float r, float g, float b)
+	{
+		return 0.212671f * r + 0.715160f * g + 0.072169f * b;
+	}
+
+	// DenoiserInput Method Definitions
+	void DenoiserInput::Gather(const Film &film, const float *rgb)
+	{
+		width = film.fullResolution.x;
+		height = film.fullResolution.y;
+		const int nPixels = width * height;
+		for (int c = 0; c < 3; ++c)
+		{
+			color[c].resize(nPixels);
+			albedo[c].resize(nPixels);
+			normal[c].resize(nPixels);
+		}
+		depth.resize(nPixels);
+		variance.resize(nPixels);
+
+		// Demodulate albedo and gather the guide buffers
+		const PixelAOV *aovs = film.AOVs();
+		const PixelStatistics *stats = film.Statistics();
+#pragma omp parallel for
+		for (int i = 0; i < nPixels; ++i)
+		{
+			const PixelAOV &a = aovs[i];
+			float invN = a.nSamples > 0 ? 1.f / a.nSamples : 0.f;
+			float alb[3];
+			for (int c = 0; c < 3; ++c)
+			{
+				alb[c] = a.albedo[c] * invN;
+				if (alb[c] < 1e-3f)
+					alb[c] = 1.f;
+				albedo[c][i] = alb[c];
+				color[c][i] = rgb[3 * i + c] / alb[c];
+			}
+			float nx = a.normal[0] * invN, ny = a.normal[1] * invN, nz = a.normal[2] * invN;
+			float len = std::sqrt(nx * nx + ny * ny + nz * nz);
+			float invLen = len > 0.f ? 1.f / len : 0.f;
+			normal[0][i] = nx * invLen;
+			normal[1][i] = ny * invLen;
+			normal[2][i] = nz * invLen;
+			depth[i] = a.depth * invN;
+
+			// Variance of the pixel mean, brought into demodulated space
+			const PixelStatistics &s = stats[i];
+			float var = 0.f;
+			if (s.nSamples > 1)
+			{
+				double mean = s.lumSum / s.nSamples;
+				var = (float)(std::max(0.0, (s.lumSqSum - s.lumSum * mean) / (s.nSamples - 1)) / s.nSamples);
+			}
+			float lumAlbedo = Luminance(alb[0], alb[1], alb[2]);
+			variance[i] = var / (lumAlbedo * lumAlbedo);
+		}
+	}
+
+	// ATrousDenoiser Method Definitions
+	void ATrousDenoiser::Denoise(const DenoiserInput &input, float *rgb)
+	{
+		width = input.width;
+		height = input.height;
+		const int nPixels = width * height;
+		if (nPixels <= 0)
+			return;
+		for (int c = 0; c < 3; ++c)
+		{
+			color[c] = input.color[c];
+			colorTmp[c].resize(nPixels);
+		}
+		variance = input.variance;
+		varianceTmp.resize(nPixels);
+		depthGrad.resize(nPixels);
+
+		// Screen space depth gradient scales the depth edge stopping function
+		const float *depth = input.depth.data();
+#pragma omp parallel for
+		for (int y = 0; y < height; ++y)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				int i = y * width + x;
+				float dx = x + 1 < width ? std::abs(depth[i + 1] - depth[i]) : 0.f;
+				float dy = y + 1 < height ? std::abs(depth[i + width] - depth[i]) : 0.f;
+				depthGrad[i] = std::max(dx, dy);
+			}
+		}
+
+		for (int it = 0; it < iterations; ++it)
+			Iteration(input, 1 << it);
+
+		// Remodulate
+#pragma omp parallel for
+		for (int i = 0; i < nPixels; ++i)
+			for (int c = 0; c < 3; ++c)
+				rgb[3 * i + c] = color[c][i] * input.albedo[c][i];
+	}
+
+	void ATrousDenoiser::Iteration(const DenoiserInput &input, int step)
+	{
+		static const float kernel[3] = {3.f / 8.f, 1.f / 4.f, 1.f / 16.f};
+		const float *cr = color[0].data(), *cg = color[1].data(), *cb = color[2].data();
+		const float *var = variance.data();
+		const float *nx = input.normal[0].data(), *ny = input.normal[1].data(), *nz = input.normal[2].data();
+		const float *z = input.depth.data(), *zg = depthGrad.data();
+
+#pragma omp parallel
+		{
+			// Per-thread row accumulators; the loop over taps is outside the
+			// loop over x so the inner loop is a straight SIMD loop.
+			std::vector<float> sumR(width), sumG(width), sumB(width), sumW(width), sumV(width);
+			std::vector<float> lumP(width), sigmaL(width);
+#pragma omp for schedule(static)
+			for (int y = 0; y < height; ++y)
+			{
+				const int row = y * width;
+				// The center tap always contributes
+				const float wCenter = kernel[0] * kernel[0];
+#pragma omp simd
+				for (int x = 0; x < width; ++x)
+				{
+					int p = row + x;
+					sumR[x] = wCenter * cr[p];
+					sumG[x] = wCenter * cg[p];
+					sumB[x] = wCenter * cb[p];
+					sumW[x] = wCenter;
+					sumV[x] = wCenter * wCenter * var[p];
+					lumP[x] = Luminance(cr[p], cg[p], cb[p]);
+					sigmaL[x] = 1.f / (sigmaLuminance * std::sqrt(var[p]) + 1e-4f);
+				}
+
+				for (int dy = -2; dy <= 2; ++dy)
+				{
+					int qy = y + dy * step;
+					if (qy < 0 || qy >= height)
+						continue;
+					const int qrow = qy * width;
+					for (int dx = -2; dx <= 2; ++dx)
+					{
+						if (dx == 0 && dy == 0)
+							continue;
+						const float h = kernel[std::abs(dx)] * kernel[std::abs(dy)];
+						const int offset = dx * step;
+						const float dist = step * std::sqrt((float)(dx * dx + dy * dy));
+#pragma omp simd
+						for (int x = 0; x < width; ++x)
+						{
+							int qx = x + offset;
+							float valid = (qx >= 0 && qx < width) ? 1.f : 0.f;
+							qx = std::min(std::max(qx, 0), width - 1);
+							int p = row + x, q = qrow + qx;
+
+							float nDot = std::max(0.f, nx[p] * nx[q] + ny[p] * ny[q] + nz[p] * nz[q]);
+							float wN = std::pow(nDot, sigmaNormal);
+							float wZ = std::exp(-std::abs(z[p] - z[q]) / (sigmaDepth * zg[p] * dist + 1e-4f));
+							float wL = std::exp(-std::abs(lumP[x] - Luminance(cr[q], cg[q], cb[q])) * sigmaL[x]);
+							float w = valid * h * wN * wZ * wL;
+
+							sumR[x] += w * cr[q];
+							sumG[x] += w * cg[q];
+							sumB[x] += w * cb[q];
+							sumW[x] += w;
+							sumV[x] += w * w * var[q];
+						}
+					}
+				}
+
+#pragma omp simd
+				for (int x = 0; x < width; ++x)
+				{
+					float invW = 1.f / sumW[x];
+					colorTmp[0][row + x] = sumR[x] * invW;
+					colorTmp[1][row + x] = sumG[x] * invW;
+					colorTmp[2][row + x] = sumB[x] * invW;
+					varianceTmp[row + x] = sumV[x] * invW * invW;
+				}
+			}
+		}
+
+		for (int c = 0; c < 3; ++c)
+			color[c].swap(colorTmp[c]);
+		variance.swap(varianceTmp);
+	}
+
+}
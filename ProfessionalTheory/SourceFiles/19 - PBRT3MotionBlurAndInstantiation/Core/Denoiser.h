@@ -0,0 +1,65 @@
+#pragma once
+#ifndef __Denoiser_h__
+#define __Denoiser_h__
+
+#include "Core/FeimosRender.h"
+#include "Core/Film.h"
+
+#include <vector>
+
+namespace Feimos
+{
+
+	// DenoiserInput Declarations
+	// Planar (structure of arrays) snapshot of everything the denoiser reads,
+	// so it can be taken on the render thread and filtered elsewhere.
+	struct DenoiserInput
+	{
+		// _rgb_ holds the resolved film radiance, three floats per pixel in
+		// film row order
+		void Gather(const Film &film, const float *rgb);
+
+		int width = 0, height = 0;
+		std::vector<float> color[3]; // radiance demodulated by albedo
+		std::vector<float> albedo[3];
+		std::vector<float> normal[3];
+		std::vector<float> depth, variance;
+	};
+
+	// ATrousDenoiser Declarations
+	// Edge-avoiding a-trous wavelet filter in the spirit of SVGF: the radiance
+	// is demodulated by the first-hit albedo, filtered with a 5x5 B3-spline
+	// kernel whose taps are spread 1, 2, 4, ... pixels apart, and remodulated.
+	// Tap weights are driven by the normal, depth and per-pixel variance
+	// buffers of the film.
+	class ATrousDenoiser
+	{
+	public:
+		// ATrousDenoiser Public Methods
+		ATrousDenoiser(int iterations = 5, float sigmaLuminance = 4.f,
+					   float sigmaNormal = 128.f, float sigmaDepth = 1.f)
+			: iterations(iterations),
+			  sigmaLuminance(sigmaLuminance),
+			  sigmaNormal(sigmaNormal),
+			  sigmaDepth(sigmaDepth) {}
+		// Writes the filtered, remodulated radiance to _rgb_ (three floats per
+		// pixel in film row order)
+		void Denoise(const DenoiserInput &input, float *rgb);
+
+	private:
+		// ATrousDenoiser Private Methods
+		void Iteration(const DenoiserInput &input, int step);
+
+		// ATrousDenoiser Private Data
+		const int iterations;
+		const float sigmaLuminance, sigmaNormal, sigmaDepth;
+		int width = 0, height = 0;
+		// Planar working buffers so that a row can be processed with SIMD
+		std::vector<float> color[3], colorTmp[3];
+		std::vector<float> variance, varianceTmp;
+		std::vector<float> depthGrad;
+	};
+
+}
+
+#endif
@@ -20,6 +20,7 @@ namespace Feimos
 	static constexpr float PiOver4 = 0.78539816339744830961;
 	static constexpr float Sqrt2 = 1.41421356237309504880;
 	inline constexpr float Radians(float deg) { return (Pi / 180) * deg; }
+	inline constexpr float Degrees(float rad) { return (180 / Pi) * rad; }
 
 #define MachineEpsilon (std::numeric_limits<float>::epsilon() * 0.5)
 	inline float gamma(int n)
@@ -0,0 +1,237 @@
+#include "Core/Film.h"
+#include "Core/Checkpoint.h"
+
+#include <limits>
+
+namespace Feimos
+{
+
+	// FilmTile Method Definitions
+	FilmTile::FilmTile(const Bounds2i &pixelBounds, const Bounds2i &sampleBounds,
+					   const Vector2f &filterRadius, const float *filterTable)
+		: pixelBounds(pixelBounds),
+		  sampleBounds(sampleBounds),
+		  filterRadius(filterRadius),
+		  invFilterRadius(1 / filterRadius.x, 1 / filterRadius.y),
+		  filterTable(filterTable),
+		  rgbSum(3 * std::max(0, pixelBounds.Area()), 0.f),
+		  weightSum(std::max(0, pixelBounds.Area()), 0.f),
+		  stats(std::max(0, sampleBounds.Area())),
+		  aovs(std::max(0, sampleBounds.Area())) {}
+
+	void FilmTile::AddSample(const Point2f &pFilm, const Spectrum &L, float sampleWeight)
+	{
+		float rgb[3];
+		L.ToRGB(rgb);
+
+		// Record unfiltered statistics for the pixel the sample belongs to
+		Point2i pPixel((int)std::floor(pFilm.x), (int)std::floor(pFilm.y));
+		if (InsideExclusive(pPixel, sampleBounds))
+		{
+			int width = sampleBounds.pMax.x - sampleBounds.pMin.x;
+			PixelStatistics &s = stats[(pPixel.y - sampleBounds.pMin.y) * width + pPixel.x - sampleBounds.pMin.x];
+			double lum = 0.212671f * rgb[0] + 0.715160f * rgb[1] + 0.072169f * rgb[2];
+			s.lumSum += lum;
+			s.lumSqSum += lum * lum;
+			++s.nSamples;
+		}
+
+		// Compute sample's raster bounds
+		Point2f pFilmDiscrete = pFilm - Vector2f(0.5f, 0.5f);
+		Point2i p0 = (Point2i)Ceil(pFilmDiscrete - filterRadius);
+		Point2i p1 = (Point2i)Floor(pFilmDiscrete + filterRadius) + Point2i(1, 1);
+		p0 = Max(p0, pixelBounds.pMin);
+		p1 = Min(p1, pixelBounds.pMax);
+		if (p1.x - p0.x > filterTableWidth || p1.y - p0.y > filterTableWidth)
+			return;
+
+		// Precompute $x$ and $y$ filter table offsets
+		int ifx[filterTableWidth], ify[filterTableWidth];
+		for (int x = p0.x; x < p1.x; ++x)
+		{
+			float fx = std::abs((x - pFilmDiscrete.x) * invFilterRadius.x * filterTableWidth);
+			ifx[x - p0.x] = std::min((int)std::floor(fx), filterTableWidth - 1);
+		}
+		for (int y = p0.y; y < p1.y; ++y)
+		{
+			float fy = std::abs((y - pFilmDiscrete.y) * invFilterRadius.y * filterTableWidth);
+			ify[y - p0.y] = std::min((int)std::floor(fy), filterTableWidth - 1);
+		}
+
+		// Loop over filter support and add sample to pixel arrays
+		int width = pixelBounds.pMax.x - pixelBounds.pMin.x;
+		for (int y = p0.y; y < p1.y; ++y)
+		{
+			for (int x = p0.x; x < p1.x; ++x)
+			{
+				float filterWeight = filterTable[ify[y - p0.y] * filterTableWidth + ifx[x - p0.x]];
+				int offset = (y - pixelBounds.pMin.y) * width + (x - pixelBounds.pMin.x);
+				rgbSum[3 * offset + 0] += rgb[0] * sampleWeight * filterWeight;
+				rgbSum[3 * offset + 1] += rgb[1] * sampleWeight * filterWeight;
+				rgbSum[3 * offset + 2] += rgb[2] * sampleWeight * filterWeight;
+				weightSum[offset] += filterWeight;
+			}
+		}
+	}
+
+	void FilmTile::AddAOV(const Point2f &pFilm, const Spectrum &albedo, const Normal3f &n, float depth)
+	{
+		Point2i pPixel((int)std::floor(pFilm.x), (int)std::floor(pFilm.y));
+		if (!InsideExclusive(pPixel, sampleBounds))
+			return;
+		int width = sampleBounds.pMax.x - sampleBounds.pMin.x;
+		PixelAOV &a = aovs[(pPixel.y - sampleBounds.pMin.y) * width + pPixel.x - sampleBounds.pMin.x];
+		float rgb[3];
+		albedo.ToRGB(rgb);
+		for (int c = 0; c < 3; ++c)
+			a.albedo[c] += rgb[c];
+		a.normal[0] += n.x;
+		a.normal[1] += n.y;
+		a.normal[2] += n.z;
+		a.depth += depth;
+		++a.nSamples;
+	}
+
+	// Film Method Definitions
+	Film::Film(const Point2i &resolution, std::unique_ptr<Filter> filt)
+		: fullResolution(resolution), filter(std::move(filt))
+	{
+		int nPixels = fullResolution.x * fullResolution.y;
+		rgbSum.reset(new float[3 * nPixels]);
+		weightSum.reset(new float[nPixels]);
+		stats.reset(new PixelStatistics[nPixels]);
+		aovs.reset(new PixelAOV[nPixels]);
+		nDirtyTiles = Point2i((fullResolution.x + dirtyTileSize - 1) / dirtyTileSize,
+							  (fullResolution.y + dirtyTileSize - 1) / dirtyTileSize);
+		tileVersions.reset(new unsigned int[nDirtyTiles.x * nDirtyTiles.y]());
+		Clear();
+
+		// Precompute filter weight table
+		int offset = 0;
+		for (int y = 0; y < filterTableWidth; ++y)
+		{
+			for (int x = 0; x < filterTableWidth; ++x, ++offset)
+			{
+				Point2f p;
+				p.x = (x + 0.5f) * filter->radius.x / filterTableWidth;
+				p.y = (y + 0.5f) * filter->radius.y / filterTableWidth;
+				filterTable[offset] = filter->Evaluate(p);
+			}
+		}
+	}
+
+	void Film::Clear()
+	{
+		int nPixels = fullResolution.x * fullResolution.y;
+		std::fill(rgbSum.get(), rgbSum.get() + 3 * nPixels, 0.f);
+		std::fill(weightSum.get(), weightSum.get() + nPixels, 0.f);
+		std::fill(stats.get(), stats.get() + nPixels, PixelStatistics());
+		std::fill(aovs.get(), aovs.get() + nPixels, PixelAOV());
+		for (int i = 0; i < nDirtyTiles.x * nDirtyTiles.y; ++i)
+			++tileVersions[i];
+	}
+
+	void Film::Snapshot(RenderCheckpoint *cp) const
+	{
+		int nPixels = fullResolution.x * fullResolution.y;
+		cp->resolution = fullResolution;
+		cp->rgbSum.assign(rgbSum.get(), rgbSum.get() + 3 * nPixels);
+		cp->weightSum.assign(weightSum.get(), weightSum.get() + nPixels);
+		cp->stats.assign(stats.get(), stats.get() + nPixels);
+		cp->aovs.assign(aovs.get(), aovs.get() + nPixels);
+	}
+
+	bool Film::Restore(const RenderCheckpoint &cp)
+	{
+		size_t nPixels = (size_t)fullResolution.x * fullResolution.y;
+		if (cp.resolution != fullResolution || cp.rgbSum.size() != 3 * nPixels ||
+			cp.weightSum.size() != nPixels || cp.stats.size() != nPixels || cp.aovs.size() != nPixels)
+			return false;
+		std::copy(cp.rgbSum.begin(), cp.rgbSum.end(), rgbSum.get());
+		std::copy(cp.weightSum.begin(), cp.weightSum.end(), weightSum.get());
+		std::copy(cp.stats.begin(), cp.stats.end(), stats.get());
+		std::copy(cp.aovs.begin(), cp.aovs.end(), aovs.get());
+		for (int i = 0; i < nDirtyTiles.x * nDirtyTiles.y; ++i)
+			++tileVersions[i];
+		return true;
+	}
+
+	std::unique_ptr<FilmTile> Film::GetFilmTile(const Bounds2i &sampleBounds)
+	{
+		// Bound image pixels that samples in _sampleBounds_ contribute to
+		Vector2f halfPixel = Vector2f(0.5f, 0.5f);
+		Bounds2f floatBounds = (Bounds2f)sampleBounds;
+		Point2i p0 = (Point2i)Ceil(floatBounds.pMin - halfPixel - filter->radius);
+		Point2i p1 = (Point2i)Floor(floatBounds.pMax - halfPixel + filter->radius) + Point2i(1, 1);
+		Bounds2i fullBounds(Point2i(0, 0), fullResolution);
+		Bounds2i tilePixelBounds = Intersect(Bounds2i(p0, p1), fullBounds);
+		return std::unique_ptr<FilmTile>(new FilmTile(tilePixelBounds, Intersect(sampleBounds, fullBounds),
+													  filter->radius, filterTable));
+	}
+
+	void Film::MergeFilmTile(std::unique_ptr<FilmTile> tile)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const Bounds2i &pb = tile->pixelBounds;
+		int tileWidth = pb.pMax.x - pb.pMin.x;
+		for (int y = pb.pMin.y; y < pb.pMax.y; ++y)
+		{
+			const float *srcRGB = &tile->rgbSum[3 * (y - pb.pMin.y) * tileWidth];
+			const float *srcW = &tile->weightSum[(y - pb.pMin.y) * tileWidth];
+			float *dstRGB = &rgbSum[3 * (y * fullResolution.x + pb.pMin.x)];
+			float *dstW = &weightSum[y * fullResolution.x + pb.pMin.x];
+			for (int i = 0; i < 3 * tileWidth; ++i)
+				dstRGB[i] += srcRGB[i];
+			for (int i = 0; i < tileWidth; ++i)
+				dstW[i] += srcW[i];
+		}
+
+		// Sample statistics and AOVs only cover the tile's own pixels, which
+		// no other tile touches
+		const Bounds2i &sb = tile->sampleBounds;
+		int sampleWidth = sb.pMax.x - sb.pMin.x;
+		for (int y = sb.pMin.y; y < sb.pMax.y; ++y)
+		{
+			for (int x = sb.pMin.x; x < sb.pMax.x; ++x)
+			{
+				const PixelStatistics &src = tile->stats[(y - sb.pMin.y) * sampleWidth + x - sb.pMin.x];
+				PixelStatistics &dst = stats[y * fullResolution.x + x];
+				dst.lumSum += src.lumSum;
+				dst.lumSqSum += src.lumSqSum;
+				dst.nSamples += src.nSamples;
+
+				const PixelAOV &srcAOV = tile->aovs[(y - sb.pMin.y) * sampleWidth + x - sb.pMin.x];
+				PixelAOV &dstAOV = aovs[y * fullResolution.x + x];
+				for (int c = 0; c < 3; ++c)
+				{
+					dstAOV.albedo[c] += srcAOV.albedo[c];
+					dstAOV.normal[c] += srcAOV.normal[c];
+				}
+				dstAOV.depth += srcAOV.depth;
+				dstAOV.nSamples += srcAOV.nSamples;
+			}
+		}
+
+		// Mark the display tiles overlapped by the tile's filter footprint
+		if (pb.pMax.x <= pb.pMin.x || pb.pMax.y <= pb.pMin.y)
+			return;
+		int tx0 = pb.pMin.x / dirtyTileSize, tx1 = (pb.pMax.x - 1) / dirtyTileSize;
+		int ty0 = pb.pMin.y / dirtyTileSize, ty1 = (pb.pMax.y - 1) / dirtyTileSize;
+		for (int ty = ty0; ty <= ty1; ++ty)
+			for (int tx = tx0; tx <= tx1; ++tx)
+				++tileVersions[ty * nDirtyTiles.x + tx];
+	}
+
+	float Film::RelativeError(const Point2i &p) const
+	{
+		// Standard error of the pixel's mean luminance relative to the mean
+		// itself; pixels with fewer than two samples have no estimate yet.
+		const PixelStatistics &s = stats[p.y * fullResolution.x + p.x];
+		if (s.nSamples < 2)
+			return std::numeric_limits<float>::infinity();
+		double mean = s.lumSum / s.nSamples;
+		double variance = std::max(0.0, (s.lumSqSum - s.lumSum * mean) / (s.nSamples - 1));
+		return (float)(std::sqrt(variance / s.nSamples) / (mean + 1e-3));
+	}
+
+}
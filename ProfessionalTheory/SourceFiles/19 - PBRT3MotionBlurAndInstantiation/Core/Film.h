@@ -0,0 +1,159 @@
+#pragma once
+#ifndef __Film_h__
+#define __Film_h__
+
+#include "Core/FeimosRender.h"
+#include "Core/Geometry.h"
+#include "Core/Spectrum.h"
+
+#include <mutex>
+#include <vector>
+
+namespace Feimos
+{
+
+	// Filter Declarations
+	class Filter
+	{
+	public:
+		// Filter Interface
+		virtual ~Filter() {}
+		Filter(const Vector2f &radius)
+			: radius(radius), invRadius(Vector2f(1 / radius.x, 1 / radius.y)) {}
+		virtual float Evaluate(const Point2f &p) const = 0;
+
+		// Filter Public Data
+		const Vector2f radius, invRadius;
+	};
+
+	class BoxFilter : public Filter
+	{
+	public:
+		BoxFilter(const Vector2f &radius) : Filter(radius) {}
+		float Evaluate(const Point2f &p) const { return 1.f; }
+	};
+
+	class GaussianFilter : public Filter
+	{
+	public:
+		// GaussianFilter Public Methods
+		GaussianFilter(const Vector2f &radius, float alpha)
+			: Filter(radius),
+			  alpha(alpha),
+			  expX(std::exp(-alpha * radius.x * radius.x)),
+			  expY(std::exp(-alpha * radius.y * radius.y)) {}
+		float Evaluate(const Point2f &p) const
+		{
+			return Gaussian(p.x, expX) * Gaussian(p.y, expY);
+		}
+
+	private:
+		// GaussianFilter Private Data
+		const float alpha;
+		const float expX, expY;
+
+		// GaussianFilter Utility Functions
+		float Gaussian(float d, float expv) const
+		{
+			return std::max((float)0, float(std::exp(-alpha * d * d) - expv));
+		}
+	};
+
+	// Per-pixel sample statistics used by adaptive sampling. They are
+	// gathered from the unfiltered samples of the pixel itself.
+	struct PixelStatistics
+	{
+		double lumSum = 0, lumSqSum = 0;
+		int nSamples = 0;
+	};
+
+	// First-hit auxiliary buffers (albedo, shading normal, depth) that guide
+	// the denoiser. Sums over the pixel's samples, divide by _nSamples_.
+	struct PixelAOV
+	{
+		float albedo[3] = {0.f, 0.f, 0.f};
+		float normal[3] = {0.f, 0.f, 0.f};
+		float depth = 0.f;
+		int nSamples = 0;
+	};
+
+	struct RenderCheckpoint;
+
+	static constexpr int filterTableWidth = 16;
+
+	// FilmTile Declarations
+	class FilmTile
+	{
+	public:
+		// FilmTile Public Methods
+		FilmTile(const Bounds2i &pixelBounds, const Bounds2i &sampleBounds,
+				 const Vector2f &filterRadius, const float *filterTable);
+		void AddSample(const Point2f &pFilm, const Spectrum &L, float sampleWeight = 1.f);
+		void AddAOV(const Point2f &pFilm, const Spectrum &albedo, const Normal3f &n, float depth);
+		const Bounds2i &GetPixelBounds() const { return pixelBounds; }
+		const Bounds2i &GetSampleBounds() const { return sampleBounds; }
+
+	private:
+		friend class Film;
+		// FilmTile Private Data
+		const Bounds2i pixelBounds, sampleBounds;
+		const Vector2f filterRadius, invFilterRadius;
+		const float *filterTable;
+		std::vector<float> rgbSum;
+		std::vector<float> weightSum;
+		std::vector<PixelStatistics> stats;
+		std::vector<PixelAOV> aovs;
+	};
+
+	// Film Declarations
+	class Film
+	{
+	public:
+		// Film Public Methods
+		Film(const Point2i &resolution, std::unique_ptr<Filter> filter);
+		std::unique_ptr<FilmTile> GetFilmTile(const Bounds2i &sampleBounds);
+		void MergeFilmTile(std::unique_ptr<FilmTile> tile);
+		void Clear();
+		// Copy the accumulation buffers into / back from a checkpoint; only
+		// call these while no tile is being merged
+		void Snapshot(RenderCheckpoint *checkpoint) const;
+		bool Restore(const RenderCheckpoint &checkpoint);
+
+		int SampleCount(const Point2i &p) const
+		{
+			return stats[p.y * fullResolution.x + p.x].nSamples;
+		}
+		float RelativeError(const Point2i &p) const;
+
+		// Contiguous accumulation buffers: three floats per pixel for the
+		// filter-weighted RGB sum and one float for the filter weight sum.
+		const float *RGBSum() const { return rgbSum.get(); }
+		const float *WeightSum() const { return weightSum.get(); }
+		const PixelStatistics *Statistics() const { return stats.get(); }
+		const PixelAOV *AOVs() const { return aovs.get(); }
+
+		// Every merge bumps the version of the dirtyTileSize^2 tiles it
+		// touched, so the display only has to convert tiles that changed.
+		static constexpr int dirtyTileSize = 16;
+		Point2i DirtyTileCount() const { return nDirtyTiles; }
+		const unsigned int *TileVersions() const { return tileVersions.get(); }
+
+		// Film Public Data
+		const Point2i fullResolution;
+		std::unique_ptr<Filter> filter;
+
+	private:
+		// Film Private Data
+		std::unique_ptr<float[]> rgbSum;
+		std::unique_ptr<float[]> weightSum;
+		std::unique_ptr<PixelStatistics[]> stats;
+		std::unique_ptr<PixelAOV[]> aovs;
+		Point2i nDirtyTiles;
+		std::unique_ptr<unsigned int[]> tileVersions;
+		float filterTable[filterTableWidth * filterTableWidth];
+		std::mutex mutex;
+	};
+
+}
+
+#endif
@@ -3,32 +3,40 @@
 #ifndef __FrameBuffer_H__
 #define __FrameBuffer_H__
 #include "MainGUI/DebugText.hpp"
+#include "Core/Film.h"
+#include "Core/Denoiser.h"
 #include <math.h>
+#include <atomic>
+#include <memory>
+#include <vector>
 #include <QObject>
+#include <QRect>
 
+// FrameBuffer connects the renderer to the GUI. Radiance is accumulated in
+// float precision by the Film it owns. After every frame the render thread
+// calls publishFrame(), which resolves the tiles that changed into a back
+// buffer and hands it over with a lock-free triple buffer swap. The GUI calls
+// updateDisplay() at its own refresh rate to pick up the newest frame and
+// convert the dirty tiles into the 8-bit display image. Neither side ever
+// waits for the other.
 class FrameBuffer : public QObject
 {
 	Q_OBJECT
 
 public:
-	FrameBuffer() : width(width),
-					height(height),
-					channals(channals),
+	FrameBuffer() : width(0),
+					height(0),
+					channals(0),
 					ubuffer(nullptr),
-					fbuffer(nullptr),
+					denoise(false),
+					latest(1),
+					back(0),
+					front(2),
 					curRenderCount(0) {}
 
 	~FrameBuffer()
 	{
-		if (nullptr != ubuffer)
-			delete[] ubuffer;
-		if (nullptr != fbuffer)
-			delete[] fbuffer;
-		ubuffer = nullptr;
-		fbuffer = nullptr;
-		this->width = 0;
-		this->height = 0;
-		this->channals = 0;
+		FreeBuffer();
 	}
 
 	void renderCountIncrease()
@@ -38,46 +46,42 @@ public:
 	void renderCountClear()
 	{
 		curRenderCount = 0;
+		if (film)
+			film->Clear();
 	}
+	int getRenderCount() const { return curRenderCount; }
+	// Used when resuming from a checkpoint
+	void setRenderCount(const int count) { curRenderCount = count; }
 	void InitBuffer(const int width = 800, const int height = 600, const int channals = 4)
 	{
 		this->width = width;
 		this->height = height;
 		this->channals = channals;
 		ubuffer = nullptr;
-		fbuffer = nullptr;
 		if (channals > 4)
 		{
 			TextDinodonS("Initialize Error: Channel is greater than 4!");
 			return;
 		}
-		ubuffer = new unsigned char[width * height * channals];
-		fbuffer = new float[width * height * channals];
-		if (nullptr == ubuffer || nullptr == fbuffer)
+		ubuffer = new unsigned char[width * height * channals]();
+		film.reset(createFilm(width, height));
+		resetFrames();
+		if (nullptr == ubuffer || !film)
 		{
 			TextDinodonS("Initialize Error: FrameBuffer has not applied for enough memory!");
-			this->width = 0;
-			this->height = 0;
-			this->channals = 0;
-			if (nullptr != ubuffer)
-				delete[] ubuffer;
-			if (nullptr != fbuffer)
-				delete[] fbuffer;
-			ubuffer = nullptr;
-			fbuffer = nullptr;
+			FreeBuffer();
 		}
 	}
 	void FreeBuffer()
 	{
 		if (nullptr != ubuffer)
 			delete[] ubuffer;
-		if (nullptr != fbuffer)
-			delete[] fbuffer;
 		ubuffer = nullptr;
-		fbuffer = nullptr;
+		film.reset();
 		this->width = 0;
 		this->height = 0;
 		this->channals = 0;
+		resetFrames();
 	}
 	bool bufferResize(const int width = 800, const int height = 600)
 	{
@@ -88,91 +92,175 @@ public:
 		}
 		if (nullptr != ubuffer)
 			delete[] ubuffer;
-		if (nullptr != fbuffer)
-			delete[] fbuffer;
 		this->width = width;
-		this->height = width;
-		ubuffer = new unsigned char[width * height * channals];
-		fbuffer = new float[width * height * channals];
-		if (nullptr == ubuffer || nullptr == fbuffer)
+		this->height = height;
+		ubuffer = new unsigned char[width * height * channals]();
+		film.reset(createFilm(width, height));
+		resetFrames();
+		curRenderCount = 0;
+		if (nullptr == ubuffer || !film)
 		{
 			TextDinodonS("Resize Error: FrameBuffer has not applied for enough memory!");
-			this->width = 0;
-			this->height = 0;
-			this->channals = 0;
-			if (nullptr != ubuffer)
-				delete[] ubuffer;
-			if (nullptr != fbuffer)
-				delete[] fbuffer;
-			ubuffer = nullptr;
-			fbuffer = nullptr;
+			FreeBuffer();
 			return false;
 		}
 		return true;
 	}
 
-	inline bool set_uc(const int w, const int h, const int shifting, const unsigned char &dat)
+	void setDenoise(const bool enable) { denoise = enable; }
+	bool getDenoise() const { return denoise; }
+
+	// Render thread: called between frames, when no worker writes the film.
+	// Resolves the tiles that changed since the back buffer was last filled
+	// (filtered RGB sum / filter weight sum) and publishes it.
+	void publishFrame()
 	{
-		if (nullptr == ubuffer)
-		{
-			TextDinodonS("Access Error: Buffer is empty and cannot be accessed!");
-			return false;
-		}
-		if (w >= width || h >= height || w < 0 || h < 0)
+		if (!film)
+			return;
+		DisplayFrame &frame = frames[back];
+		const Feimos::Point2i nTiles = film->DirtyTileCount();
+		const unsigned int *versions = film->TileVersions();
+		const float *rgbSum = film->RGBSum();
+		const float *weightSum = film->WeightSum();
+		const int tileSize = Feimos::Film::dirtyTileSize;
+		frame.rgb.resize(3 * width * height);
+		frame.tileVersions.resize(nTiles.x * nTiles.y, 0);
+#pragma omp parallel for schedule(dynamic)
+		for (int t = 0; t < nTiles.x * nTiles.y; t++)
 		{
-			TextDinodonS("Access Error: Coordinates exceed array limit!");
-			return false;
+			if (frame.tileVersions[t] == versions[t])
+				continue;
+			frame.tileVersions[t] = versions[t];
+			int x0 = (t % nTiles.x) * tileSize, x1 = std::min(x0 + tileSize, width);
+			int y0 = (t / nTiles.x) * tileSize, y1 = std::min(y0 + tileSize, height);
+			for (int y = y0; y < y1; y++)
+			{
+				const float *srcRGB = rgbSum + 3 * y * width;
+				const float *srcW = weightSum + y * width;
+				float *dst = frame.rgb.data() + 3 * y * width;
+#pragma omp simd
+				for (int x = x0; x < x1; x++)
+				{
+					float invWeight = srcW[x] > 0.f ? 1.0f / srcW[x] : 0.f;
+					for (int k = 0; k < 3; k++)
+						dst[3 * x + k] = std::max(0.f, srcRGB[3 * x + k] * invWeight);
+				}
+			}
 		}
-		int offset = (w + h * width) * channals + shifting;
-		ubuffer[offset] = dat;
-		return true;
+		frame.denoised = denoise;
+		if (frame.denoised)
+			frame.guides.Gather(*film, frame.rgb.data());
+
+		back = latest.exchange(back | freshFrame) & indexMask;
 	}
 
-	inline bool set_fc(const int w, const int h, const int shifting, const float &dat)
+	// GUI thread: picks up the newest published frame, if any, denoises it
+	// when enabled, tonemaps the tiles that differ from what is on screen and
+	// returns their bounding rectangle in display coordinates. Returns false
+	// when no new frame was published.
+	bool updateDisplay(QRect *dirty, const float exposure = 0.75f)
 	{
-		if (nullptr == fbuffer)
-		{
-			TextDinodonS("Access Error: Buffer is empty and cannot be accessed!");
+		if (nullptr == ubuffer || !(latest.load() & freshFrame))
 			return false;
-		}
-		if (w >= width || h >= height || w < 0 || h < 0)
-		{
-			TextDinodonS("Access Error: Coordinates exceed array limit!");
+		front = latest.exchange(front) & indexMask;
+		const DisplayFrame &frame = frames[front];
+		const int tileSize = Feimos::Film::dirtyTileSize;
+		const int nTilesX = (width + tileSize - 1) / tileSize;
+		const int nTiles = (int)frame.tileVersions.size();
+		if ((int)frame.rgb.size() != 3 * width * height)
 			return false;
-		}
-		int offset = (w + h * width) * channals + shifting;
-		fbuffer[offset] = dat;
-		return true;
-	}
+		displayedVersions.resize(nTiles, 0);
 
-	inline bool update_f_u_c(const int w, const int h, const int shifting, const float &dat)
-	{
-		if (nullptr == fbuffer)
+		// The denoiser spreads every change over a large footprint, so a
+		// denoised frame is always converted as a whole
+		const float *rgb = frame.rgb.data();
+		if (frame.denoised)
 		{
-			TextDinodonS("Access Error: Buffer is empty and cannot be accessed!");
-			return false;
+			denoised.resize(frame.rgb.size());
+			denoiser.Denoise(frame.guides, denoised.data());
+			rgb = denoised.data();
 		}
-		if (w >= width || h >= height || w < 0 || h < 0)
+
+		const float invScale = 1.0f / (1.0f - exposure);
+		*dirty = QRect();
+		for (int t = 0; t < nTiles; t++)
 		{
-			TextDinodonS("Access Error: Coordinates exceed array limit!");
-			return false;
+			if (!frame.denoised && displayedVersions[t] == frame.tileVersions[t])
+				continue;
+			// A denoised tile never matches a film version
+			displayedVersions[t] = frame.denoised ? ~0u : frame.tileVersions[t];
+			int x0 = (t % nTilesX) * tileSize, x1 = std::min(x0 + tileSize, width);
+			int y0 = (t / nTilesX) * tileSize, y1 = std::min(y0 + tileSize, height);
+			for (int y = y0; y < y1; y++)
+			{
+				const float *src = rgb + 3 * y * width;
+				unsigned char *dst = ubuffer + (height - 1 - y) * width * channals;
+#pragma omp simd
+				for (int x = x0; x < x1; x++)
+				{
+					for (int k = 0; k < 3; k++)
+						dst[x * channals + k] = (unsigned char)((1.0f - std::exp(-src[3 * x + k] * invScale)) * 255.f);
+					if (channals == 4)
+						dst[x * channals + 3] = 255;
+				}
+			}
+			// Film row y is display row height-1-y
+			*dirty |= QRect(x0, height - y1, x1 - x0, y1 - y0);
 		}
-		int offset = (w + h * width) * channals + shifting;
-		float weight = (1.0f / (float)curRenderCount);
-		fbuffer[offset] = weight * dat + (1.0f - weight) * fbuffer[offset];
-
-		float exposure = 0.75;
-		float temp_c = 1.0f - std::exp(-fbuffer[offset] * 1.0f / (1 - exposure));
-
-		ubuffer[offset] = temp_c * 255;
-		return true;
+		return !dirty->isEmpty();
 	}
 
 	unsigned char *getUCbuffer() { return ubuffer; }
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	int getChannals() const { return channals; }
+	Feimos::Film *getFilm() { return film.get(); }
 
 private:
+	// A resolved frame handed from the render thread to the GUI
+	struct DisplayFrame
+	{
+		std::vector<float> rgb;
+		std::vector<unsigned int> tileVersions;
+		Feimos::DenoiserInput guides;
+		bool denoised = false;
+	};
+	static constexpr int indexMask = 3;
+	static constexpr int freshFrame = 4;
+
+	static Feimos::Film *createFilm(const int width, const int height)
+	{
+		std::unique_ptr<Feimos::Filter> filter(
+			new Feimos::GaussianFilter(Feimos::Vector2f(1.5f, 1.5f), 2.f));
+		return new Feimos::Film(Feimos::Point2i(width, height), std::move(filter));
+	}
+	void resetFrames()
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			frames[i].rgb.clear();
+			frames[i].tileVersions.clear();
+			frames[i].denoised = false;
+		}
+		displayedVersions.clear();
+		latest.store(1);
+		back = 0;
+		front = 2;
+	}
+
 	unsigned char *ubuffer;
-	float *fbuffer;
+	std::unique_ptr<Feimos::Film> film;
+	Feimos::ATrousDenoiser denoiser;
+	std::vector<float> denoised;
+	bool denoise;
+
+	// Triple buffer: the render thread owns frames[back], the GUI owns
+	// frames[front]; _latest_ holds the third index plus the freshFrame bit
+	DisplayFrame frames[3];
+	std::atomic<int> latest;
+	int back, front;
+	std::vector<unsigned int> displayedVersions;
+
 	int width;
 	int height;
 	int channals;
@@ -0,0 +1,71 @@
+#include "Core/MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Feimos
+{
+
+	// MappedFile Method Definitions
+#ifdef _WIN32
+	MappedFile::MappedFile(const std::string &filename)
+	{
+		HANDLE f = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+							   OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (f == INVALID_HANDLE_VALUE)
+			return;
+		file = f;
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(f, &fileSize) || fileSize.QuadPart == 0)
+			return;
+		mapping = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!mapping)
+			return;
+		data = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (data)
+			size = (size_t)fileSize.QuadPart;
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (data)
+			UnmapViewOfFile(data);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file)
+			CloseHandle(file);
+	}
+#else
+	MappedFile::MappedFile(const std::string &filename)
+	{
+		int fd = open(filename.c_str(), O_RDONLY);
+		if (fd < 0)
+			return;
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0)
+		{
+			void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p != MAP_FAILED)
+			{
+				data = (const char *)p;
+				size = (size_t)st.st_size;
+			}
+		}
+		// The mapping stays valid after the descriptor is closed
+		close(fd);
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (data)
+			munmap((void *)data, size);
+	}
+#endif
+
+}
@@ -0,0 +1,35 @@
+#pragma once
+#ifndef __MappedFile_h__
+#define __MappedFile_h__
+
+#include <cstddef>
+#include <string>
+
+namespace Feimos
+{
+
+	// MappedFile Declarations
+	// Read-only memory mapping of a whole file. Pages are faulted in by the OS
+	// on first touch, so data that is referenced in place is never copied.
+	class MappedFile
+	{
+	public:
+		MappedFile(const std::string &filename);
+		~MappedFile();
+		MappedFile(const MappedFile &) = delete;
+		MappedFile &operator=(const MappedFile &) = delete;
+		bool IsValid() const { return data != nullptr; }
+		const char *Data() const { return data; }
+		size_t Size() const { return size; }
+
+	private:
+		const char *data = nullptr;
+		size_t size = 0;
+#ifdef _WIN32
+		void *file = nullptr, *mapping = nullptr;
+#endif
+	};
+
+}
+
+#endif
@@ -4,6 +4,8 @@
 
 #include "Core/FeimosRender.h"
 
+#include <algorithm>
+
 namespace Feimos
 {
 
@@ -17,12 +19,22 @@ namespace Feimos
 		{
 			int nAlloc = RoundUp(uRes) * RoundUp(vRes);
 			data = new T[nAlloc];
-			for (int i = 0; i < nAlloc; ++i)
-				new (&data[i]) T();
 			if (d)
-				for (int v = 0; v < vRes; ++v)
-					for (int u = 0; u < uRes; ++u)
-						(*this)(u, v) = d[v * uRes + u];
+			{
+				// Each block row of the source is copied as contiguous runs of
+				// BlockSize() texels, one row of blocks per iteration
+				const int vBlocks = RoundUp(vRes) >> logBlockSize;
+#pragma omp parallel for schedule(dynamic, 1) if (uRes * vRes >= 65536)
+				for (int bv = 0; bv < vBlocks; ++bv)
+				{
+					for (int v = bv << logBlockSize; v < std::min(vRes, (bv + 1) << logBlockSize); ++v)
+						for (int u = 0; u < uRes; u += BlockSize())
+						{
+							const T *src = d + (size_t)v * uRes + u;
+							std::copy(src, src + std::min(BlockSize(), uRes - u), &(*this)(u, v));
+						}
+				}
+			}
 		}
 		constexpr int BlockSize() const { return 1 << logBlockSize; }
 		int RoundUp(int x) const
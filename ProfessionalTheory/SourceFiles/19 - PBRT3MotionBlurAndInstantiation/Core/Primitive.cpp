@@ -2,12 +2,50 @@
 #include "Shape/Shape.h"
 #include "Core/interaction.h"
 #include "Core/Transform.h"
+#include "Core/RayPacket.h"
 
 namespace Feimos {
 
 static long long primitiveMemory = 0;
 
 Primitive::~Primitive() {}
+bool Primitive::IntersectHit(const Ray &r, PrimitiveHit *hit) const {
+	// Primitives without a deferred path fill the final interaction directly
+	if (!Intersect(r, hit->isect)) return false;
+	hit->primitive = this;
+	hit->deferred = false;
+	hit->nInstances = 0;
+	return true;
+}
+int Primitive::IntersectPacket(RayPacket &packet, int active,
+	PrimitiveHit *hits) const {
+	int hitMask = 0;
+	for (int l = 0; active; ++l, active >>= 1) {
+		if (!(active & 1) || !IntersectHit(*packet.ray[l], &hits[l])) continue;
+		packet.tMax[l] = packet.ray[l]->tMax;
+		hitMask |= 1 << l;
+	}
+	return hitMask;
+}
+void ComputeHitInteraction(const Ray &r, const PrimitiveHit &hit,
+	SurfaceInteraction *isect) {
+	if (hit.nInstances == 0) {
+		if (hit.deferred) hit.primitive->ComputeInteraction(r, hit, isect);
+		return;
+	}
+	// Recover the ray in the space of the hit primitive, outermost instance first
+	Transform primToWorld[PrimitiveHit::maxInstanceDepth];
+	Ray ray = r;
+	for (int i = hit.nInstances - 1; i >= 0; --i) {
+		Transform worldToPrim;
+		hit.instances[i]->GetTransforms(r.time, &primToWorld[i], &worldToPrim);
+		ray = worldToPrim(ray);
+	}
+	if (hit.deferred) hit.primitive->ComputeInteraction(ray, hit, isect);
+	// Transform instance's intersection data to world space
+	for (int i = 0; i < hit.nInstances; ++i)
+		if (!primToWorld[i].IsIdentity()) *isect = primToWorld[i](*isect);
+}
 // GeometricPrimitive Method Definitions
 GeometricPrimitive::GeometricPrimitive(const std::shared_ptr<Shape> &shape,
 	const std::shared_ptr<Material> &material, const std::shared_ptr<AreaLight> &areaLight,
@@ -35,6 +73,29 @@ bool GeometricPrimitive::Intersect(const Ray &r,
 		isect->mediumInterface = MediumInterface(r.medium);
 	return true;
 }
+bool GeometricPrimitive::IntersectHit(const Ray &r, PrimitiveHit *hit) const {
+	if (!shape->CanDeferInteraction()) return Primitive::IntersectHit(r, hit);
+	float tHit, b[3];
+	if (!shape->IntersectHit(r, &tHit, b)) return false;
+	r.tMax = tHit;
+	hit->primitive = this;
+	hit->index = 0;
+	hit->b[0] = b[0];
+	hit->b[1] = b[1];
+	hit->b[2] = b[2];
+	hit->deferred = true;
+	hit->nInstances = 0;
+	return true;
+}
+void GeometricPrimitive::ComputeInteraction(const Ray &r, const PrimitiveHit &hit,
+	SurfaceInteraction *isect) const {
+	shape->ComputeInteraction(r, hit.b, isect);
+	isect->primitive = this;
+	if (mediumInterface.IsMediumTransition())
+		isect->mediumInterface = mediumInterface;
+	else
+		isect->mediumInterface = MediumInterface(r.medium);
+}
 void GeometricPrimitive::ComputeScatteringFunctions(
 	SurfaceInteraction *isect, TransportMode mode,
 	bool allowMultipleLobes) const {
@@ -54,16 +115,45 @@ const Material *GeometricPrimitive::GetMaterial() const {
 // TransformedPrimitive Method Definitions
 TransformedPrimitive::TransformedPrimitive(std::shared_ptr<Primitive> &primitive,
 	const AnimatedTransform &PrimitiveToWorld)
-	: primitive(primitive), PrimitiveToWorld(PrimitiveToWorld) {
+	: primitive(primitive), PrimitiveToWorld(PrimitiveToWorld),
+	animated(PrimitiveToWorld.IsAnimated()) {
+	if (!animated) {
+		PrimitiveToWorld.Interpolate(0, &primToWorld);
+		worldToPrim = Inverse(primToWorld);
+	}
 	primitiveMemory += sizeof(*this);
 }
+TransformedPrimitive::TransformedPrimitive(const std::shared_ptr<Primitive> &primitive,
+	const Transform &PrimitiveToWorld)
+	: primitive(primitive), staticPrimToWorld(PrimitiveToWorld),
+	PrimitiveToWorld(&staticPrimToWorld, 0, &staticPrimToWorld, 1),
+	animated(false), primToWorld(PrimitiveToWorld),
+	worldToPrim(Inverse(PrimitiveToWorld)) {
+	primitiveMemory += sizeof(*this);
+}
+void TransformedPrimitive::GetTransforms(float time, Transform *primToWorld,
+	Transform *worldToPrim) const {
+	if (!animated) {
+		*primToWorld = this->primToWorld;
+		*worldToPrim = this->worldToPrim;
+		return;
+	}
+	PrimitiveToWorld.Interpolate(time, primToWorld);
+	*worldToPrim = Inverse(*primToWorld);
+}
+void TransformedPrimitive::SetPrimitiveToWorld(const Transform &PrimitiveToWorld) {
+	if (animated) return;
+	staticPrimToWorld = PrimitiveToWorld;
+	primToWorld = PrimitiveToWorld;
+	worldToPrim = Inverse(PrimitiveToWorld);
+}
 
 bool TransformedPrimitive::Intersect(const Ray &r,
 	SurfaceInteraction *isect) const {
 	// Compute _ray_ after transformation by _PrimitiveToWorld_
-	Transform InterpolatedPrimToWorld;
-	PrimitiveToWorld.Interpolate(r.time, &InterpolatedPrimToWorld);
-	Ray ray = Inverse(InterpolatedPrimToWorld)(r);
+	Transform InterpolatedPrimToWorld, InterpolatedWorldToPrim;
+	GetTransforms(r.time, &InterpolatedPrimToWorld, &InterpolatedWorldToPrim);
+	Ray ray = InterpolatedWorldToPrim(r);
 	if (!primitive->Intersect(ray, isect)) return false;
 	r.tMax = ray.tMax;
 	// Transform instance's intersection data to world space
@@ -73,10 +163,21 @@ bool TransformedPrimitive::Intersect(const Ray &r,
 	return true;
 }
 
+bool TransformedPrimitive::IntersectHit(const Ray &r, PrimitiveHit *hit) const {
+	Transform InterpolatedPrimToWorld, InterpolatedWorldToPrim;
+	GetTransforms(r.time, &InterpolatedPrimToWorld, &InterpolatedWorldToPrim);
+	Ray ray = InterpolatedWorldToPrim(r);
+	if (!primitive->IntersectHit(ray, hit)) return false;
+	r.tMax = ray.tMax;
+	// Instancing nested deeper than _maxInstanceDepth_ is not supported
+	if (hit->nInstances < PrimitiveHit::maxInstanceDepth)
+		hit->instances[hit->nInstances++] = this;
+	return true;
+}
+
 bool TransformedPrimitive::IntersectP(const Ray &r) const {
-	Transform InterpolatedPrimToWorld;
-	PrimitiveToWorld.Interpolate(r.time, &InterpolatedPrimToWorld);
-	Transform InterpolatedWorldToPrim = Inverse(InterpolatedPrimToWorld);
+	Transform InterpolatedPrimToWorld, InterpolatedWorldToPrim;
+	GetTransforms(r.time, &InterpolatedPrimToWorld, &InterpolatedWorldToPrim);
 	return primitive->IntersectP(InterpolatedWorldToPrim(r));
 }
 
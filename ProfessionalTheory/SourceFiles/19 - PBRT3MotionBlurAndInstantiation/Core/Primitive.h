@@ -7,6 +7,28 @@
 namespace Feimos
 {
 
+	class Primitive;
+	class TransformedPrimitive;
+	struct RayPacket;
+
+	// PrimitiveHit Declarations
+	// Closest hit found so far during traversal. Only the primitive, its
+	// element index and barycentrics are recorded; the SurfaceInteraction is
+	// built once, for the final hit, by ComputeHitInteraction().
+	struct PrimitiveHit
+	{
+		static constexpr int maxInstanceDepth = 8;
+		const Primitive *primitive = nullptr;
+		int index = 0;
+		float b[3] = {0, 0, 0};
+		// Primitives that cannot defer write straight into _isect_
+		bool deferred = false;
+		SurfaceInteraction *isect = nullptr;
+		// Instances the hit was found through, innermost first
+		const TransformedPrimitive *instances[maxInstanceDepth];
+		int nInstances = 0;
+	};
+
 	class Primitive
 	{
 	public:
@@ -20,8 +42,23 @@ namespace Feimos
 		virtual void ComputeScatteringFunctions(SurfaceInteraction *isect,
 												TransportMode mode,
 												bool allowMultipleLobes) const = 0;
+		// Records a closer hit in _hit_ without building the interaction;
+		// the default falls back to Intersect() into _hit->isect_
+		virtual bool IntersectHit(const Ray &r, PrimitiveHit *hit) const;
+		// IntersectHit() for the _active_ lanes of a coherent packet, with
+		// _hits[l]_ for lane l; returns the lanes that found a closer hit.
+		// The default traces the lanes one at a time.
+		virtual int IntersectPacket(RayPacket &packet, int active,
+									PrimitiveHit *hits) const;
+		// Builds the interaction for a hit recorded by IntersectHit(); _r_ is
+		// in the space of this primitive
+		virtual void ComputeInteraction(const Ray &r, const PrimitiveHit &hit,
+										SurfaceInteraction *isect) const {}
 	};
 
+	void ComputeHitInteraction(const Ray &r, const PrimitiveHit &hit,
+							   SurfaceInteraction *isect);
+
 	class GeometricPrimitive : public Primitive
 	{
 	public:
@@ -40,6 +77,9 @@ namespace Feimos
 		virtual void ComputeScatteringFunctions(SurfaceInteraction *isect,
 												TransportMode mode,
 												bool allowMultipleLobes) const;
+		virtual bool IntersectHit(const Ray &r, PrimitiveHit *hit) const;
+		virtual void ComputeInteraction(const Ray &r, const PrimitiveHit &hit,
+										SurfaceInteraction *isect) const;
 
 	private:
 		// GeometricPrimitive Private Data
@@ -56,8 +96,20 @@ namespace Feimos
 		// TransformedPrimitive Public Methods
 		TransformedPrimitive(std::shared_ptr<Primitive> &primitive,
 							 const AnimatedTransform &PrimitiveToWorld);
+		// Static instance; the transform is copied and its inverse precomputed
+		TransformedPrimitive(const std::shared_ptr<Primitive> &primitive,
+							 const Transform &PrimitiveToWorld);
 		bool Intersect(const Ray &r, SurfaceInteraction *in) const;
 		bool IntersectP(const Ray &r) const;
+		bool IntersectHit(const Ray &r, PrimitiveHit *hit) const;
+		const AnimatedTransform &GetPrimitiveToWorld() const { return PrimitiveToWorld; }
+		// Transforms at _time_; only animated instances interpolate and
+		// invert per call
+		void GetTransforms(float time, Transform *primToWorld,
+						   Transform *worldToPrim) const;
+		// Moves a static instance; the owner rebuilds any aggregate over it
+		void SetPrimitiveToWorld(const Transform &PrimitiveToWorld);
+		const std::shared_ptr<Primitive> &GetPrimitive() const { return primitive; }
 		const AreaLight *GetAreaLight() const { return nullptr; }
 		const Material *GetMaterial() const { return nullptr; }
 		void ComputeScatteringFunctions(SurfaceInteraction *isect, TransportMode mode,
@@ -67,13 +119,20 @@ namespace Feimos
 		}
 		Bounds3f WorldBound() const
 		{
+			if (!animated)
+				return primToWorld(primitive->WorldBound());
 			return PrimitiveToWorld.MotionBounds(primitive->WorldBound());
 		}
 
 	private:
 		// TransformedPrimitive Private Data
 		std::shared_ptr<Primitive> primitive;
+		// Owned transform of static instances; declared before
+		// _PrimitiveToWorld_, which may point at it
+		Transform staticPrimToWorld;
 		const AnimatedTransform PrimitiveToWorld;
+		const bool animated;
+		Transform primToWorld, worldToPrim;
 	};
 
 	class Aggregate : public Primitive
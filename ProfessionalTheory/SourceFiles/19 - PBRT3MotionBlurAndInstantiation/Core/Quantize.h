@@ -0,0 +1,120 @@
+#pragma once
+#ifndef __Quantize_h__
+#define __Quantize_h__
+
+#include "Core/Geometry.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace Feimos
+{
+
+	// Half Float Conversion
+	// IEEE 754 binary16, rounded to nearest even; overflow goes to infinity
+	inline uint16_t FloatToHalf(float f)
+	{
+		uint32_t bits;
+		memcpy(&bits, &f, sizeof(float));
+		uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+		uint32_t exponent = (bits >> 23) & 0xff;
+		uint32_t mantissa = bits & 0x7fffff;
+		if (exponent == 0xff)
+			return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+		int e = (int)exponent - 127 + 15;
+		if (e >= 0x1f)
+			return sign | 0x7c00;
+		if (e <= 0)
+		{
+			// Subnormal half, or zero
+			if (e < -10)
+				return sign;
+			mantissa |= 0x800000;
+			int shift = 14 - e;
+			uint32_t half = mantissa >> shift;
+			uint32_t rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+			if (rest > halfway || (rest == halfway && (half & 1)))
+				++half;
+			return sign | (uint16_t)half;
+		}
+		uint32_t half = ((uint32_t)e << 10) | (mantissa >> 13);
+		uint32_t rest = mantissa & 0x1fff;
+		// A carry out of the mantissa correctly bumps the exponent
+		if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+			++half;
+		return sign | (uint16_t)half;
+	}
+
+	inline float HalfToFloat(uint16_t h)
+	{
+		uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+		uint32_t exponent = (h >> 10) & 0x1f;
+		uint32_t mantissa = h & 0x3ff;
+		uint32_t bits;
+		if (exponent == 0x1f)
+			bits = sign | 0x7f800000 | (mantissa << 13);
+		else if (exponent != 0)
+			bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+		else if (mantissa == 0)
+			bits = sign;
+		else
+		{
+			// Renormalize a subnormal half
+			int e = -1;
+			do
+			{
+				mantissa <<= 1;
+				++e;
+			} while (!(mantissa & 0x400));
+			bits = sign | ((uint32_t)(127 - 15 - e) << 23) | ((mantissa & 0x3ff) << 13);
+		}
+		float f;
+		memcpy(&f, &bits, sizeof(float));
+		return f;
+	}
+
+	// Octahedral Unit Vector Encoding
+	// A direction is projected onto the octahedron |x| + |y| + |z| = 1, the
+	// lower half is folded over the upper one and the two remaining
+	// coordinates are stored as 16-bit snorm values. Length is not kept.
+	inline float OctahedralSign(float v) { return v < 0 ? -1.f : 1.f; }
+
+	inline uint32_t EncodeOctahedral(const Vector3f &v)
+	{
+		float l1 = std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+		if (l1 == 0)
+			return 0;
+		float x = v.x / l1, y = v.y / l1;
+		if (v.z < 0)
+		{
+			float fx = (1 - std::abs(y)) * OctahedralSign(x);
+			float fy = (1 - std::abs(x)) * OctahedralSign(y);
+			x = fx;
+			y = fy;
+		}
+		auto snorm = [](float f) -> uint32_t {
+			f = std::min(std::max(f, -1.f), 1.f);
+			return (uint16_t)(int16_t)std::round(f * 32767.f);
+		};
+		return snorm(x) | (snorm(y) << 16);
+	}
+
+	inline Vector3f DecodeOctahedral(uint32_t e)
+	{
+		Vector3f v((int16_t)(e & 0xffff) / 32767.f, (int16_t)(e >> 16) / 32767.f, 0.f);
+		v.z = 1 - std::abs(v.x) - std::abs(v.y);
+		if (v.z < 0)
+		{
+			float x = (1 - std::abs(v.y)) * OctahedralSign(v.x);
+			float y = (1 - std::abs(v.x)) * OctahedralSign(v.y);
+			v.x = x;
+			v.y = y;
+		}
+		float l = v.Length();
+		return l > 0 ? v / l : v;
+	}
+
+}
+
+#endif
@@ -0,0 +1,154 @@
+#pragma once
+#ifndef __RayPacket_h__
+#define __RayPacket_h__
+
+#include "Core/FeimosRender.h"
+#include "Core/Geometry.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Feimos
+{
+
+	// Rays per packet: a 4x4 pixel block of camera rays
+	constexpr int RayPacketSize = 16;
+
+	// RayPacket Declarations
+	// Up to RayPacketSize rays in SoA form for packet traversal. The packet
+	// is coherent when every direction component has the same sign in all
+	// rays; only then do the near and far children and the slab planes of a
+	// node agree across lanes, so only coherent packets are traced together.
+	struct RayPacket
+	{
+		RayPacket(const Ray *const *rays, int n) : size(n)
+		{
+			// Spare lanes repeat the first ray so the SIMD loops stay valid;
+			// they are never part of an active mask
+			for (int l = 0; l < RayPacketSize; ++l)
+			{
+				const Ray &r = *rays[l < n ? l : 0];
+				ray[l] = &r;
+				ox[l] = r.o.x;
+				oy[l] = r.o.y;
+				oz[l] = r.o.z;
+				rx[l] = 1 / r.d.x;
+				ry[l] = 1 / r.d.y;
+				rz[l] = 1 / r.d.z;
+				tMax[l] = r.tMax;
+			}
+			dirIsNeg[0] = rx[0] < 0;
+			dirIsNeg[1] = ry[0] < 0;
+			dirIsNeg[2] = rz[0] < 0;
+			coherent = true;
+			oMin = oMax = Point3f(ox[0], oy[0], oz[0]);
+			rMin = rMax = Vector3f(rx[0], ry[0], rz[0]);
+			for (int l = 0; l < n; ++l)
+			{
+				Point3f o(ox[l], oy[l], oz[l]);
+				Vector3f r(rx[l], ry[l], rz[l]);
+				for (int a = 0; a < 3; ++a)
+				{
+					// Axis-parallel directions would turn the interval test
+					// below into 0 * inf
+					if ((r[a] < 0) != (bool)dirIsNeg[a] || std::isinf(r[a]))
+						coherent = false;
+					oMin[a] = std::min(oMin[a], o[a]);
+					oMax[a] = std::max(oMax[a], o[a]);
+					rMin[a] = std::min(rMin[a], r[a]);
+					rMax[a] = std::max(rMax[a], r[a]);
+				}
+			}
+		}
+		int FullMask() const { return (1 << size) - 1; }
+		// Returns the lanes of _active_ whose ray overlaps _b_, with the same
+		// result per lane as Bounds3f::IntersectP(ray, invDir, dirIsNeg)
+		inline int IntersectBounds(const Bounds3f &b, int active) const;
+
+		int size;
+		const Ray *ray[RayPacketSize];
+		float ox[RayPacketSize], oy[RayPacketSize], oz[RayPacketSize];
+		float rx[RayPacketSize], ry[RayPacketSize], rz[RayPacketSize];
+		// Closest hit so far per lane; leaves that shorten _ray[l]->tMax_
+		// copy it back here
+		float tMax[RayPacketSize];
+		int dirIsNeg[3];
+		bool coherent;
+		// Extremes of the origins and reciprocal directions, for the
+		// whole-packet frustum test
+		Point3f oMin, oMax;
+		Vector3f rMin, rMax;
+	};
+
+	inline int RayPacket::IntersectBounds(const Bounds3f &b, int active) const
+	{
+#ifdef Feimos_Ray_Bound_ErrorBound
+		const float farScale = 1 + 2 * gamma(3);
+#else
+		const float farScale = 1;
+#endif
+		// Interval test of the whole packet first. Rounding is monotone, so
+		// the slab distances of every lane lie between the products of the
+		// extreme origins and reciprocal directions; if those bounds already
+		// separate, no ray of the packet can enter the box.
+		float nearLo[3], farHi[3];
+		for (int a = 0; a < 3; ++a)
+		{
+			float bNear = b[dirIsNeg[a]][a], bFar = b[1 - dirIsNeg[a]][a];
+			float n0 = bNear - oMax[a], n1 = bNear - oMin[a];
+			float f0 = bFar - oMax[a], f1 = bFar - oMin[a];
+			nearLo[a] = std::min(std::min(n0 * rMin[a], n0 * rMax[a]),
+								 std::min(n1 * rMin[a], n1 * rMax[a]));
+			farHi[a] = std::max(std::max(f0 * rMin[a], f0 * rMax[a]),
+								std::max(f1 * rMin[a], f1 * rMax[a]));
+			farHi[a] *= farScale;
+		}
+		float tMaxHi = -Infinity;
+#pragma omp simd reduction(max : tMaxHi)
+		for (int l = 0; l < RayPacketSize; ++l)
+		{
+			float t = ((active >> l) & 1) ? tMax[l] : -Infinity;
+			tMaxHi = t > tMaxHi ? t : tMaxHi;
+		}
+		for (int a = 0; a < 3; ++a)
+		{
+			if (farHi[a] <= 0 || nearLo[a] >= tMaxHi) return 0;
+			// A slab is never tested against itself by the single-ray test
+			if (nearLo[a] > farHi[(a + 1) % 3] || nearLo[a] > farHi[(a + 2) % 3])
+				return 0;
+		}
+
+		// Per-lane slab test, branch free and in the order of the single-ray
+		// test so that packet and single-ray traversal visit the same nodes
+		const float bx0 = b[dirIsNeg[0]].x, bx1 = b[1 - dirIsNeg[0]].x;
+		const float by0 = b[dirIsNeg[1]].y, by1 = b[1 - dirIsNeg[1]].y;
+		const float bz0 = b[dirIsNeg[2]].z, bz1 = b[1 - dirIsNeg[2]].z;
+		int hit[RayPacketSize];
+#pragma omp simd
+		for (int l = 0; l < RayPacketSize; ++l)
+		{
+			float t0 = (bx0 - ox[l]) * rx[l];
+			float t1 = (bx1 - ox[l]) * rx[l];
+			float ty0 = (by0 - oy[l]) * ry[l];
+			float ty1 = (by1 - oy[l]) * ry[l];
+			t1 *= farScale;
+			ty1 *= farScale;
+			int ok = !(t0 > ty1) & !(ty0 > t1);
+			t0 = ty0 > t0 ? ty0 : t0;
+			t1 = ty1 < t1 ? ty1 : t1;
+			float tz0 = (bz0 - oz[l]) * rz[l];
+			float tz1 = (bz1 - oz[l]) * rz[l];
+			tz1 *= farScale;
+			ok &= !(t0 > tz1) & !(tz0 > t1);
+			t0 = tz0 > t0 ? tz0 : t0;
+			t1 = tz1 < t1 ? tz1 : t1;
+			hit[l] = ok & (t0 < tMax[l]) & (t1 > 0);
+		}
+		int mask = 0;
+		for (int l = 0; l < RayPacketSize; ++l) mask |= hit[l] << l;
+		return mask & active;
+	}
+
+}
+
+#endif
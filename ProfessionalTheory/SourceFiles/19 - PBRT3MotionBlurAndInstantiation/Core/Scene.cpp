@@ -1,10 +1,14 @@
 #include "Core/Scene.h"
 #include "Light/Light.h"
+#include "Core/RayPacket.h"
 
 namespace Feimos
 {
 	static long long nIntersectionTests = 0;
 	static long long nShadowTests = 0;
+	static long long nPacketTests = 0;
+
+	static thread_local long long threadRays = 0;
 
 	// Scene Public Methods
 	Scene::Scene(std::shared_ptr<Primitive> aggregate,
@@ -25,33 +29,65 @@ namespace Feimos
 	bool Scene::Intersect(const Ray &ray, SurfaceInteraction *isect) const
 	{
 		++nIntersectionTests;
+		++threadRays;
 		return aggregate->Intersect(ray, isect);
 	}
 
 	bool Scene::IntersectP(const Ray &ray) const
 	{
 		++nShadowTests;
+		++threadRays;
 		return aggregate->IntersectP(ray);
 	}
 
+	int Scene::IntersectPacket(RayPacket &packet, SurfaceInteraction *isects) const
+	{
+		++nPacketTests;
+		PrimitiveHit hits[RayPacketSize];
+		for (int l = 0; l < packet.size; ++l)
+			hits[l].isect = &isects[l];
+		int hitMask = aggregate->IntersectPacket(packet, packet.FullMask(), hits);
+		for (int l = 0; l < packet.size; ++l)
+			if (hitMask & (1 << l))
+				ComputeHitInteraction(*packet.ray[l], hits[l], &isects[l]);
+		return hitMask;
+	}
+
+	long long Scene::ThreadRayCount() { return threadRays; }
+
 	bool Scene::IntersectTr(Ray ray, Sampler &sampler, SurfaceInteraction *isect,
 							Spectrum *Tr) const
 	{
 		*Tr = Spectrum(1.f);
+		Spectrum tau(0.f);
+		bool hit;
 		while (true)
 		{
 			bool hitSurface = Intersect(ray, isect);
-			// Accumulate beam transmittance for ray segment
-			if (ray.medium)
+			// Accumulate beam transmittance for ray segment; media with a
+			// closed-form optical depth are exponentiated once at the end
+			Spectrum segmentTau;
+			if (ray.medium && ray.medium->OpticalDepth(ray, &segmentTau))
+				tau += segmentTau;
+			else if (ray.medium)
 				*Tr *= ray.medium->Tr(ray, sampler);
 
 			// Initialize next ray segment or terminate transmittance computation
 			if (!hitSurface)
-				return false;
+			{
+				hit = false;
+				break;
+			}
 			if (isect->primitive->GetMaterial() != nullptr)
-				return true;
+			{
+				hit = true;
+				break;
+			}
 			ray = isect->SpawnRay(ray.d);
 		}
+		if (!tau.IsBlack())
+			*Tr *= Exp(-tau);
+		return hit;
 	}
 
 }
@@ -21,6 +21,11 @@ namespace Feimos
 		bool IntersectP(const Ray &ray) const;
 		bool IntersectTr(Ray ray, Sampler &sampler, SurfaceInteraction *isect,
 						 Spectrum *transmittance) const;
+		// Traces a coherent packet in one traversal; bit l of the result is
+		// set when ray l hit, with its interaction in _isects[l]_
+		int IntersectPacket(RayPacket &packet, SurfaceInteraction *isects) const;
+		// Intersect() and IntersectP() calls traced on the calling thread
+		static long long ThreadRayCount();
 		// Scene Public Data
 		std::vector<std::shared_ptr<Light>> lights;
 		std::vector<std::shared_ptr<Light>> infiniteLights;
@@ -0,0 +1,60 @@
+#pragma once
+#ifndef __TextAsset_h__
+#define __TextAsset_h__
+
+#include "Core/MappedFile.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Feimos
+{
+
+	// TextAsset Declarations
+	// Reader for the whitespace separated text assets (.3d, .volume, ...). The
+	// whole file is memory mapped and numbers are parsed in place, without
+	// iostreams. Header tokens are read one at a time; large numeric bodies are
+	// split across threads at line boundaries.
+	class TextAsset
+	{
+	public:
+		TextAsset(const std::string &filename);
+		bool IsValid() const { return begin != nullptr; }
+		size_t Size() const { return end - begin; }
+		std::string NextToken();
+		bool NextInt(int *v);
+		bool NextFloat(float *v);
+		// Parse the next _n_ numbers. Tokens that do not start like a number,
+		// e.g. the "v" in front of a vertex line, are skipped.
+		bool ReadFloats(float *out, size_t n);
+		bool ReadInts(int *out, size_t n);
+		// Records the time since the file was opened under _name_
+		void ReportLoad(const std::string &name) const;
+
+	private:
+		template <typename T>
+		bool ReadNumbers(T *out, size_t n);
+
+		std::unique_ptr<MappedFile> mapped;
+		const char *begin = nullptr, *end = nullptr, *cur = nullptr;
+		std::chrono::steady_clock::time_point start;
+		// Text per number seen by the last ReadNumbers(), to size the next one
+		float numberBytes = 8;
+	};
+
+	// Load times of the assets read so far; the render thread shows them in
+	// the status panel
+	struct AssetLoadRecord
+	{
+		std::string name;
+		size_t bytes;
+		float seconds;
+	};
+	void ReportAssetLoad(const std::string &name, size_t bytes, float seconds);
+	std::vector<AssetLoadRecord> TakeAssetLoadRecords();
+
+}
+
+#endif
@@ -375,6 +375,7 @@ namespace Feimos
 		{
 			return startTransform->HasScale() || endTransform->HasScale();
 		}
+		bool IsAnimated() const { return actuallyAnimated; }
 		Bounds3f MotionBounds(const Bounds3f &b) const;
 		Bounds3f BoundPointMotion(const Point3f &p) const;
 
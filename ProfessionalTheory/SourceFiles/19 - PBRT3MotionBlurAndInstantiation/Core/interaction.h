@@ -69,14 +69,17 @@ namespace Feimos
 	{
 	public:
 		// MediumInteraction Public Methods
-		MediumInteraction() : phase(nullptr) {}
+		MediumInteraction() {}
 		MediumInteraction(const Point3f &p, const Vector3f &wo, float time,
-						  const Medium *medium, PhaseFunction *phase)
-			: Interaction(p, wo, time, medium), phase(phase) {}
-		bool IsValid() const { return phase != nullptr; }
+						  const Medium *medium, const HenyeyGreenstein &phase)
+			: Interaction(p, wo, time, medium), phase(phase), valid(true) {}
+		bool IsValid() const { return valid; }
 
 		// MediumInteraction Public Data
-		std::shared_ptr<PhaseFunction> phase = nullptr;
+		// The phase function is held by value, so sampling a medium
+		// interaction never allocates
+		HenyeyGreenstein phase;
+		bool valid = false;
 	};
 
 	class SurfaceInteraction : public Interaction
@@ -26,11 +26,11 @@ void DirectLightingIntegrator::Preprocess(const Scene &scene,
 }
 
 Spectrum DirectLightingIntegrator::Li(const RayDifferential &ray,
-	const Scene &scene, Sampler &sampler, int depth) const {
+	const Scene &scene, Sampler &sampler, int depth, const PrimaryHit *primary) const {
 	Spectrum L(0.f);
 	// Find closest ray intersection or return background radiance
 	SurfaceInteraction isect;
-	if (!scene.Intersect(ray, &isect)) {
+	if (!IntersectPrimary(scene, ray, &isect, primary)) {
 		for (const auto &light : scene.lights) L += light->Le(ray);
 		return L;
 	}
@@ -38,7 +38,7 @@ Spectrum DirectLightingIntegrator::Li(const RayDifferential &ray,
 	// Compute scattering functions for surface interaction
 	isect.ComputeScatteringFunctions(ray);
 	if (!isect.bsdf)
-		return Li(isect.SpawnRay(ray.d), scene, sampler, depth);
+		return Li(isect.SpawnRay(ray.d), scene, sampler, depth, nullptr);
 	Vector3f wo = isect.wo;
 	// Compute emitted light if ray hit an area light source
 	L += isect.Le(wo);
@@ -29,7 +29,8 @@ namespace Feimos
           strategy(strategy),
           maxDepth(maxDepth) {}
     Spectrum Li(const RayDifferential &ray, const Scene &scene,
-                Sampler &sampler, int depth) const;
+                Sampler &sampler, int depth,
+                const PrimaryHit *primary) const;
     void Preprocess(const Scene &scene, Sampler &sampler);
 
   private:
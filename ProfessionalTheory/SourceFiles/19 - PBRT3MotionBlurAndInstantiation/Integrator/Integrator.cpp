@@ -6,6 +6,7 @@
 #include "Core/interaction.h"
 #include "Core/Scene.h"
 #include "Core/FrameBuffer.h"
+#include "Core/RayPacket.h"
 
 #include "Material/Reflection.h"
 
@@ -89,7 +90,7 @@ Spectrum EstimateDirect(const Interaction &it, const Point2f &uScattering, const
 		else {
 			// Evaluate phase function for light sampling strategy
 			const MediumInteraction &mi = (const MediumInteraction &)it;
-			float p = mi.phase->p(mi.wo, wi);
+			float p = mi.phase.p(mi.wo, wi);
 			f = Spectrum(p);
 			scatteringPdf = p;
 		}
@@ -131,7 +132,7 @@ Spectrum EstimateDirect(const Interaction &it, const Point2f &uScattering, const
 		else {
 			// Sample scattered direction for medium interactions
 			const MediumInteraction &mi = (const MediumInteraction &)it;
-			float p = mi.phase->Sample_p(mi.wo, &wi, uScattering);
+			float p = mi.phase.Sample_p(mi.wo, &wi, uScattering);
 			f = Spectrum(p);
 			scatteringPdf = p;
 		}
@@ -285,6 +286,20 @@ Spectrum SamplerIntegrator::SpecularTransmit(
 }
 
 
+void SamplerIntegrator::SetAdaptiveSampling(float threshold, int minSpp, double budget) {
+	errorThreshold = threshold;
+	minSamples = std::max(2, minSpp);
+	timeBudget = budget;
+	renderTime = 0.0;
+	activePixels = -1;
+}
+
+bool SamplerIntegrator::Converged() const {
+	if (errorThreshold <= 0.f) return false;
+	if (timeBudget > 0.0 && renderTime >= timeBudget) return true;
+	return activePixels == 0;
+}
+
 void SamplerIntegrator::Render(const Scene &scene, double &timeConsume) {
 
 	omp_set_num_threads(20); //̵߳ĸ
@@ -298,51 +313,170 @@ void SamplerIntegrator::Render(const Scene &scene, double &timeConsume) {
 
 	Feimos::Point3f Light(10.0, 10.0, -10.0);
 
-#pragma omp parallel for
-	for (int i = 0; i < pixelBounds.pMax.x; i++) {
-		for (int j = 0; j < pixelBounds.pMax.y; j++) {
-
-			float u = float(i + getClockRandom()) / float(pixelBounds.pMax.x);
-			float v = float(j + getClockRandom()) / float(pixelBounds.pMax.y);
-			int offset = (pixelBounds.pMax.x * j + i);
-
-			std::unique_ptr<Feimos::Sampler> sampler_c = sampler->Clone(offset);
-			Feimos::Point2i pixel(i, j);
-			sampler_c->StartPixel(pixel);
-
-			Feimos::CameraSample cs;
-			cs = sampler_c->GetCameraSample(pixel);
-			
-			//Feimos::Ray ray;
-			//camera->GenerateRay(cs, &ray);
-			Feimos::RayDifferential ray;
-			float rayWeight = //Ͷ˵Ȩض1
-				camera->GenerateRayDifferential(cs, &ray);
-			ray.ScaleDifferentials(
-				1 / std::sqrt((float)sampler_c->samplesPerPixel));
-			
-			Feimos::Spectrum colObj = Li(ray, scene, *sampler_c, 0);
-
-			m_FrameBuffer->update_f_u_c(i, j, 0, colObj[0]);
-			m_FrameBuffer->update_f_u_c(i, j, 1, colObj[1]);
-			m_FrameBuffer->update_f_u_c(i, j, 2, colObj[2]);
-			m_FrameBuffer->set_uc(i, pixelBounds.pMax.y - j - 1, 3, 255);
+	// Ӧ㹻ֵز׷
+	const bool adaptive = errorThreshold > 0.f && m_FrameBuffer->getRenderCount() > minSamples;
+	long long nActive = 0;
+	long long primaryRays = 0, secondaryRays = 0;
+	double primarySeconds = 0, secondarySeconds = 0;
+
+	// 16x16ĿȾۼӵڵFilmTileÿֻϲһεFilm
+	Film *film = m_FrameBuffer->getFilm();
+	const int tileSize = 16;
+	const int nTilesX = (pixelBounds.pMax.x - pixelBounds.pMin.x + tileSize - 1) / tileSize;
+	const int nTilesY = (pixelBounds.pMax.y - pixelBounds.pMin.y + tileSize - 1) / tileSize;
+
+	// 鰴żֳȾͬĿ˲Χصÿ
+	// յ鹱׵˳̶̵߳޹أϵֲλһ
+	for (int wave = 0; wave < 4; wave++) {
+#pragma omp parallel for schedule(dynamic) reduction(+ : nActive, primaryRays, secondaryRays, primarySeconds, secondarySeconds)
+		for (int tile = 0; tile < nTilesX * nTilesY; tile++) {
+			if (((tile % nTilesX) & 1) + 2 * ((tile / nTilesX) & 1) != wave)
+				continue;
+			int x0 = pixelBounds.pMin.x + (tile % nTilesX) * tileSize;
+			int y0 = pixelBounds.pMin.y + (tile / nTilesX) * tileSize;
+			int x1 = std::min(x0 + tileSize, pixelBounds.pMax.x);
+			int y1 = std::min(y0 + tileSize, pixelBounds.pMax.y);
+			std::unique_ptr<FilmTile> filmTile = film->GetFilmTile(Bounds2i(Point2i(x0, y0), Point2i(x1, y1)));
+			int tileActive = 0;
+
+			// ٰ4x4ط飺һߵĵһཻ֮ÿ
+			// ظɫĹ߷Ѿɢ׷
+			for (int by = y0; by < y1; by += 4) {
+				for (int bx = x0; bx < x1; bx += 4) {
+
+					std::unique_ptr<Feimos::Sampler> samplers[RayPacketSize];
+					Feimos::CameraSample cs[RayPacketSize];
+					Feimos::RayDifferential rays[RayPacketSize];
+					float rayWeight[RayPacketSize];
+					int n = 0;
+					for (int j = by; j < std::min(by + 4, y1); j++) {
+						for (int i = bx; i < std::min(bx + 4, x1); i++) {
+
+							Feimos::Point2i pixel(i, j);
+							if (adaptive && film->SampleCount(pixel) >= minSamples &&
+								film->RelativeError(pixel) < errorThreshold)
+								continue;
+							++nActive;
+							++tileActive;
+
+							int offset = (pixelBounds.pMax.x * j + i);
+
+							samplers[n] = sampler->Clone(offset);
+							samplers[n]->StartPixel(pixel);
+							// ڼ֡ȡڼɸֵĲɴ˵õȷ
+							samplers[n]->SetSampleNumber(m_FrameBuffer->getRenderCount() - 1);
+
+							cs[n] = samplers[n]->GetCameraSample(pixel);
+
+							rayWeight[n] = //Ͷ˵Ȩض1
+								camera->GenerateRayDifferential(cs[n], &rays[n]);
+							rays[n].ScaleDifferentials(
+								1 / std::sqrt((float)samplers[n]->samplesPerPixel));
+							++n;
+						}
+					}
+					if (n == 0) continue;
+
+					// ߣͬŵһBVH󽻡
+					// õǸtMax̵㴦ԭԽLi
+					double primaryStart = omp_get_wtime();
+					Feimos::Ray primary[RayPacketSize];
+					const Feimos::Ray *primaryPtr[RayPacketSize];
+					Feimos::SurfaceInteraction isects[RayPacketSize];
+					for (int l = 0; l < n; l++) {
+						primary[l] = rays[l];
+						primaryPtr[l] = &primary[l];
+					}
+					int hitMask = 0;
+					RayPacket packet(primaryPtr, n);
+					if (packetTracing && packet.coherent)
+						hitMask = scene.IntersectPacket(packet, isects);
+					else
+						for (int l = 0; l < n; l++)
+							if (scene.Intersect(primary[l], &isects[l])) hitMask |= 1 << l;
+					primaryRays += n;
+					primarySeconds += omp_get_wtime() - primaryStart;
+
+					double shadeStart = omp_get_wtime();
+					long long raysBefore = Scene::ThreadRayCount();
+					for (int l = 0; l < n; l++) {
+						// LiߵֱȡĽ
+						PrimaryHit hit = {(hitMask & (1 << l)) ? &isects[l] : nullptr, primary[l].tMax};
+
+						Feimos::Spectrum colObj = Li(rays[l], scene, *samplers[l], 0, &hit);
+
+						filmTile->AddSample(cs[l].pFilm, colObj, rayWeight[l]);
+
+						// һཻķʡɫȣʹã
+						// ֱ󽻵Ľ󽻣Ҳռòά
+						Feimos::Spectrum albedo;
+						Feimos::Normal3f nAOV;
+						float depthAOV;
+						FirstHitAOV(rays[l], (hitMask & (1 << l)) ? &isects[l] : nullptr,
+							&albedo, &nAOV, &depthAOV);
+						filmTile->AddAOV(cs[l].pFilm, albedo, nAOV, depthAOV);
+					}
+					secondaryRays += Scene::ThreadRayCount() - raysBefore;
+					secondarySeconds += omp_get_wtime() - shadeStart;
+				}
+			}
+			// 鶼ʱϲʾҲͲ
+			if (tileActive > 0)
+				film->MergeFilmTile(std::move(filmTile));
 		}
 	}
+	activePixels = nActive;
+	throughput.primaryRays = primaryRays;
+	throughput.secondaryRays = secondaryRays;
+	throughput.primarySeconds = primarySeconds;
+	throughput.secondarySeconds = secondarySeconds;
 
 	// 㲢ʾʱ
 	double end = omp_get_wtime();
 	timeConsume = end - start;	
+	renderTime += timeConsume;
 }
 
 
+void SamplerIntegrator::FirstHitAOV(const RayDifferential &ray, SurfaceInteraction *isect,
+	Spectrum *albedo, Normal3f *n, float *depth) const {
+	// δлûBSDF(ʱ߽)ʱȡ1ȡ0
+	*albedo = Spectrum(1.f);
+	*n = Normal3f(0, 0, 0);
+	*depth = 0.f;
+	if (!isect) return;
+	*n = Faceforward(isect->shading.n, -ray.d);
+	*depth = Distance(ray.o, isect->p);
+	isect->ComputeScatteringFunctions(ray, true);
+	if (!isect->bsdf) return;
+	// ù̶4x4ֲƣֱӷR֡޹أ
+	// ÿ֡õͬһֵAOV
+	static const int nAlbedo = 16;
+	static const std::vector<Point2f> uAlbedo = [] {
+		std::vector<Point2f> u;
+		for (int i = 0; i < nAlbedo; i++)
+			u.push_back(Point2f((i % 4 + 0.5f) / 4, (i / 4 + 0.5f) / 4));
+		return u;
+	}();
+	*albedo = isect->bsdf->rho(isect->wo, nAlbedo, &uAlbedo[0]);
+}
+
+bool SamplerIntegrator::IntersectPrimary(const Scene &scene, const Ray &ray, SurfaceInteraction *isect,
+	const PrimaryHit *primary) {
+	if (!primary) return scene.Intersect(ray, isect);
+	if (!primary->isect) return false;
+	ray.tMax = primary->tHit;
+	*isect = *primary->isect;
+	return true;
+}
+
 Spectrum SamplerIntegrator::Li(const RayDifferential &ray, const Scene &scene,
-	Sampler &sampler, int depth) const {
+	Sampler &sampler, int depth, const PrimaryHit *primary) const {
 
 	Feimos::SurfaceInteraction isect;
 
 	Feimos::Spectrum colObj;
-	if (scene.Intersect(ray, &isect)) {
+	if (IntersectPrimary(scene, ray, &isect, primary)) {
 		for (int count = 0; count < scene.lights.size(); count++) {
 			VisibilityTester vist;
 			Vector3f wi;
@@ -15,6 +15,8 @@ namespace Feimos
 		// Integrator Interface
 		virtual ~Integrator() {}
 		virtual void Render(const Scene &scene, double &timeConsume) = 0;
+		// ӦֵʱԤľʱtrue
+		virtual bool Converged() const { return false; }
 		float IntegratorRenderTime; // Ⱦһõʱ
 	};
 
@@ -32,6 +34,21 @@ namespace Feimos
 							bool handleMedia = false,
 							bool specular = false);
 
+	// һ֡Ĺͳƣɫʱ׷ٵĹ߷ֿʱΪ߳ʱ֮ͣ
+	// ɫֵʱɫ
+	struct RayThroughput
+	{
+		long long primaryRays = 0, secondaryRays = 0;
+		double primarySeconds = 0, secondarySeconds = 0;
+	};
+
+	// Render()д߽㣬ʽLi()Li()ĵһֱʹ
+	struct PrimaryHit
+	{
+		const SurfaceInteraction *isect; // δʱΪnullptr
+		float tHit;
+	};
+
 	// SamplerIntegrator Declarations
 	class SamplerIntegrator : public Integrator
 	{
@@ -43,8 +60,21 @@ namespace Feimos
 			: camera(camera), sampler(sampler), pixelBounds(pixelBounds), m_FrameBuffer(m_FrameBuffer) {}
 		virtual void Preprocess(const Scene &scene, Sampler &sampler) {}
 		void Render(const Scene &scene, double &timeConsume);
+		// errorThreshold <= 0 disables adaptive sampling; timeBudget <= 0 means no time limit
+		void SetAdaptiveSampling(float errorThreshold, int minSamples = 16, double timeBudget = 0.0);
+		bool Converged() const;
+		// Render time counted against the budget; a resumed render restores
+		// the time spent before the checkpoint after SetAdaptiveSampling()
+		double RenderTime() const { return renderTime; }
+		void ResumeRenderTime(double seconds) { renderTime = seconds; }
+		long long ActivePixels() const { return activePixels; }
+		// ߰4x4ش󽻣رպ׷
+		void SetPacketTracing(bool enable) { packetTracing = enable; }
+		const RayThroughput &Throughput() const { return throughput; }
 
-		virtual Spectrum Li(const RayDifferential &ray, const Scene &scene, Sampler &sampler, int depth = 0) const;
+		// primaryֻ(depthΪ0)ϸ
+		virtual Spectrum Li(const RayDifferential &ray, const Scene &scene, Sampler &sampler, int depth = 0,
+							const PrimaryHit *primary = nullptr) const;
 		Spectrum SpecularReflect(const RayDifferential &ray,
 								 const SurfaceInteraction &isect,
 								 const Scene &scene, Sampler &sampler,
@@ -54,14 +84,33 @@ namespace Feimos
 								  const Scene &scene, Sampler &sampler, int depth) const;
 
 	protected:
+		// primaryʱȡĽScene::Intersect()
+		static bool IntersectPrimary(const Scene &scene, const Ray &ray, SurfaceInteraction *isect,
+									 const PrimaryHit *primary);
+		// ֡ɵ֡Ӽָ֡Preprocess()мΪǰ֡
+		int RenderCount() const { return m_FrameBuffer ? m_FrameBuffer->getRenderCount() : 0; }
+
 		// SamplerIntegrator Protected Data
 		std::shared_ptr<const Camera> camera;
 
 	private:
+		// һཻAOV(ʡɫߡ)
+		// isectΪߵ󽻽δʱΪnullptr
+		void FirstHitAOV(const RayDifferential &ray, SurfaceInteraction *isect,
+						 Spectrum *albedo, Normal3f *n, float *depth) const;
+
 		// SamplerIntegrator Private Data
 		std::shared_ptr<Sampler> sampler;
 		const Bounds2i pixelBounds;
 		FrameBuffer *m_FrameBuffer;
+		// Adaptive sampling state
+		float errorThreshold = 0.f;
+		int minSamples = 16;
+		double timeBudget = 0.0;
+		double renderTime = 0.0;
+		long long activePixels = -1;
+		bool packetTracing = true;
+		RayThroughput throughput;
 	};
 
 }
@@ -32,7 +32,7 @@ namespace Feimos
 	}
 
 	Spectrum PathIntegrator::Li(const RayDifferential &r, const Scene &scene,
-								Sampler &sampler, int depth) const
+								Sampler &sampler, int depth, const PrimaryHit *primary) const
 	{
 		Spectrum L(0.f), beta(1.f);
 		Ray ray(r);
@@ -53,7 +53,10 @@ namespace Feimos
 
 			// Intersect _ray_ with scene and store intersection in _isect_
 			SurfaceInteraction isect;
-			bool foundIntersection = scene.Intersect(ray, &isect);
+			// The camera ray's hit is used once; _bounces_ is also 0 again
+			// after crossing a medium boundary
+			bool foundIntersection = IntersectPrimary(scene, ray, &isect, primary);
+			primary = nullptr;
 
 			// Possibly add emitted light at intersection
 			if (bounces == 0 || specularBounce)
@@ -21,7 +21,8 @@ namespace Feimos
 
     void Preprocess(const Scene &scene, Sampler &sampler);
     Spectrum Li(const RayDifferential &ray, const Scene &scene,
-                Sampler &sampler, int depth) const;
+                Sampler &sampler, int depth,
+                const PrimaryHit *primary) const;
 
   private:
     // PathIntegrator Private Data
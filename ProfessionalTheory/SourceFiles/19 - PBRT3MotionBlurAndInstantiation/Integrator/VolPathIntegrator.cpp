@@ -7,6 +7,7 @@
 #include "Material/Reflection.h"
 #include "Integrator/VolPathIntegrator.h"
 #include "Core/Spectrum.h"
+#include "Camera/Camera.h"
 
 namespace Feimos
 {
@@ -18,15 +19,40 @@ namespace Feimos
 	{
 		lightDistribution =
 			CreateLightSampleDistribution(lightSampleStrategy, scene);
+
+		// Fresh volume photons every pass, with r^2 scaled by (k + alpha) / (k + 1)
+		// for each pass k = 1..i before this one. The pass index comes from the
+		// frame buffer, so a run resumed from a checkpoint carries on with new
+		// photons and the radius it had reached; photons are emitted at shutter open
+		if (photonsPerPass > 0)
+		{
+			const int pass = RenderCount();
+			const float radius = photonRadius *
+				std::exp(0.5f * (std::lgamma(pass + 1 + radiusAlpha) - std::lgamma(1 + radiusAlpha) -
+								 std::lgamma(pass + 2.f)));
+			volumePhotons->Shoot(scene, sampler, photonsPerPass, maxDepth, radius,
+								 pass, camera->shutterOpen);
+		}
+	}
+
+	void VolPathIntegrator::SetVolumePhotons(int photons, float radius, float alpha)
+	{
+		photonsPerPass = photons;
+		photonRadius = radius;
+		radiusAlpha = alpha;
+		volumePhotons.reset(photons > 0 ? new VolumePhotonMap : nullptr);
 	}
 
 	Spectrum VolPathIntegrator::Li(const RayDifferential &r, const Scene &scene,
-								   Sampler &sampler, int depth) const
+								   Sampler &sampler, int depth, const PrimaryHit *primary) const
 	{
 
 		Spectrum L(0.f), beta(1.f);
 		RayDifferential ray(r);
 		bool specularBounce = false;
+		// Scattered in a medium and met only specular surfaces since; such
+		// paths reaching a light are volume caustics, left to the photon map
+		bool mediumCaustic = false;
 		int bounces;
 
 		// Added after book publication: etaScale tracks the accumulated effect
@@ -42,13 +68,20 @@ namespace Feimos
 		{
 			// Intersect _ray_ with scene and store intersection in _isect_
 			SurfaceInteraction isect;
-			bool foundIntersection = scene.Intersect(ray, &isect);
+			// The camera ray's hit is used once; _bounces_ is also 0 again
+			// after crossing a medium boundary
+			bool foundIntersection = IntersectPrimary(scene, ray, &isect, primary);
+			primary = nullptr;
 
 			// Sample the participating medium, if present
 			MediumInteraction mi;
 			// һɢλ  ֱӴռⲿ
 			if (ray.medium)
-				beta *= ray.medium->Sample(ray, sampler, &mi);
+			{
+				if (volumePhotons)
+					L += beta * volumePhotons->BeamEstimate(ray, sampler);
+				beta *= ray.medium->Sample(ray, sampler, &mi, beta);
+			}
 			if (beta.IsBlack())
 				break;
 
@@ -67,9 +100,10 @@ namespace Feimos
 
 				Vector3f wo = -ray.d, wi;
 				// ʱռڲɢ䷽
-				mi.phase->Sample_p(wo, &wi, sampler.Get2D());
+				mi.phase.Sample_p(wo, &wi, sampler.Get2D());
 				ray = mi.SpawnRay(wi);
 				specularBounce = false;
+				mediumCaustic = true;
 			}
 			else
 			{
@@ -81,7 +115,10 @@ namespace Feimos
 				{
 					// Add emitted light at path vertex or from the environment
 					if (foundIntersection)
-						L += beta * isect.Le(-ray.d);
+					{
+						if (!volumePhotons || !mediumCaustic)
+							L += beta * isect.Le(-ray.d);
+					}
 					else
 						for (const auto &light : scene.infiniteLights)
 							L += beta * light->Le(ray);
@@ -116,6 +153,7 @@ namespace Feimos
 				beta *= f * AbsDot(wi, isect.shading.n) / pdf;
 				// DCHECK(std::isinf(beta.y()) == false);
 				specularBounce = (flags & BSDF_SPECULAR) != 0;
+				mediumCaustic = mediumCaustic && specularBounce;
 				if ((flags & BSDF_SPECULAR) && (flags & BSDF_TRANSMISSION))
 				{
 					float eta = isect.bsdf->eta;
@@ -5,6 +5,7 @@
 #include "Integrator/Integrator.h"
 #include "Core/FeimosRender.h"
 #include "Light/LightDistrib.h"
+#include "Integrator/VolumePhotonMap.h"
 
 namespace Feimos
 {
@@ -24,8 +25,14 @@ namespace Feimos
 			  rrThreshold(rrThreshold),
 			  lightSampleStrategy(lightSampleStrategy) {}
 		Spectrum Li(const RayDifferential &ray, const Scene &scene,
-					Sampler &sampler, int depth) const;
+					Sampler &sampler, int depth,
+					const PrimaryHit *primary) const;
 		void Preprocess(const Scene &scene, Sampler &sampler);
+		// Volume caustics from a photon map reshot every pass (Render call);
+		// 0 photons disables it. The gather radius shrinks by _alpha_ per
+		// pass as in progressive photon mapping, so the average converges.
+		void SetVolumePhotons(int photons, float radius, float alpha = 0.7f);
+		const VolumePhotonMap *VolumePhotons() const { return volumePhotons.get(); }
 
 	private:
 		// VolPathIntegrator Private Data
@@ -33,6 +40,10 @@ namespace Feimos
 		const float rrThreshold;
 		const std::string lightSampleStrategy;
 		std::unique_ptr<LightDistribution> lightDistribution;
+		int photonsPerPass = 0;
+		// Radius of the first pass; later passes derive theirs from it
+		float photonRadius = 0, radiusAlpha = 0.7f;
+		std::unique_ptr<VolumePhotonMap> volumePhotons;
 	};
 
 }
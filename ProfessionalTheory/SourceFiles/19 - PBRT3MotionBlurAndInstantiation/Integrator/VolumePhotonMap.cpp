@@ -0,0 +1,251 @@
+#include "Integrator/VolumePhotonMap.h"
+#include "Accelerator/BVHAccel.h"
+#include "Core/Geometry.h"
+#include "Core/interaction.h"
+#include "Core/Scene.h"
+#include "Light/Light.h"
+#include "Material/Material.h"
+#include "Material/Reflection.h"
+#include "Sampler/Sampler.h"
+#include "Sampler/Sampling.h"
+#include <algorithm>
+
+namespace Feimos
+{
+
+	static long long photonPaths = 0;
+	static long long storedPhotons = 0;
+
+	// Follows one light path until it leaves the specular chain; returns
+	// true and fills _photon_ if it scattered in a medium after at least one
+	// specular surface
+	static bool TraceVolumePhoton(const Scene &scene, Sampler &sampler,
+								  const Distribution1D &lightDistr, int maxDepth,
+								  float time, VolumePhoton *photon)
+	{
+		// Choose a light in proportion to its power and emit a photon from it
+		float lightPdf;
+		int lightNum = lightDistr.SampleDiscrete(sampler.Get1D(), &lightPdf);
+		const std::shared_ptr<Light> &light = scene.lights[lightNum];
+		Point2f uLight0 = sampler.Get2D();
+		Point2f uLight1 = sampler.Get2D();
+		Ray ray;
+		Normal3f nLight;
+		float pdfPos, pdfDir;
+		Spectrum Le = light->Sample_Le(uLight0, uLight1, time, &ray, &nLight,
+									   &pdfPos, &pdfDir);
+		if (pdfPos == 0 || pdfDir == 0 || Le.IsBlack())
+			return false;
+		Spectrum beta = (AbsDot(nLight, ray.d) * Le) / (lightPdf * pdfPos * pdfDir);
+
+		bool specularChain = false;
+		for (int depth = 0; depth < maxDepth; ++depth)
+		{
+			SurfaceInteraction isect;
+			bool foundIntersection = scene.Intersect(ray, &isect);
+
+			// Scattering in a medium ends the photon; only light that got
+			// there through specular surfaces is missing from the path tracer
+			MediumInteraction mi;
+			if (ray.medium)
+				beta *= ray.medium->Sample(ray, sampler, &mi, beta);
+			if (beta.IsBlack())
+				return false;
+			if (mi.IsValid())
+			{
+				if (!specularChain)
+					return false;
+				photon->p = mi.p;
+				photon->wi = mi.wo;
+				photon->power = beta;
+				photon->medium = ray.medium;
+				photon->phase = mi.phase;
+				return true;
+			}
+			if (!foundIntersection)
+				return false;
+
+			// Skip over medium boundaries, continue through specular surfaces
+			isect.ComputeScatteringFunctions(ray, true, TransportMode::Importance);
+			if (!isect.bsdf)
+			{
+				ray = isect.SpawnRay(ray.d);
+				--depth;
+				continue;
+			}
+			Vector3f wo = -ray.d, wi;
+			float pdf;
+			BxDFType flags;
+			Spectrum f = isect.bsdf->Sample_f(wo, &wi, sampler.Get2D(), &pdf,
+											  BSDF_ALL, &flags);
+			if (f.IsBlack() || pdf == 0.f || !(flags & BSDF_SPECULAR))
+				return false;
+			beta *= f * AbsDot(wi, isect.shading.n) / pdf;
+			specularChain = true;
+			ray = isect.SpawnRay(wi);
+		}
+		return false;
+	}
+
+	// VolumePhotonMap Method Definitions
+	VolumePhotonMap::~VolumePhotonMap() { delete[] nodes; }
+
+	void VolumePhotonMap::ShootingStats(long long *paths, long long *stored)
+	{
+		*paths = photonPaths;
+		*stored = storedPhotons;
+	}
+
+	void VolumePhotonMap::Shoot(const Scene &scene, Sampler &sampler, int nPhotons,
+								int maxDepth, float radius, int pass, float time)
+	{
+		delete[] nodes;
+		nodes = nullptr;
+		photons.clear();
+		this->radius = radius;
+		if (scene.lights.empty() || nPhotons <= 0)
+			return;
+
+		// Photons leave the lights in proportion to their power
+		std::vector<float> lightPower;
+		for (const auto &light : scene.lights)
+			lightPower.push_back(light->Power().y());
+		Distribution1D lightDistr(&lightPower[0], (int)lightPower.size());
+		if (lightDistr.funcInt == 0)
+			return;
+
+		// Each chunk of photons has its own random stream, on rows no pixel
+		// uses, so a pass gives the same photons regardless of scheduling
+		const int chunkSize = 4096;
+		const int nChunks = (nPhotons + chunkSize - 1) / chunkSize;
+		std::vector<std::vector<VolumePhoton>> chunkPhotons(nChunks);
+#pragma omp parallel for schedule(dynamic)
+		for (int c = 0; c < nChunks; ++c)
+		{
+			std::unique_ptr<Sampler> photonSampler = sampler.Clone(c);
+			photonSampler->StartPixel(Point2i(c, -1 - pass));
+			int end = std::min(nPhotons, (c + 1) * chunkSize);
+			for (int i = c * chunkSize; i < end; ++i)
+			{
+				photonSampler->SetSampleNumber(i - c * chunkSize);
+				VolumePhoton photon;
+				if (TraceVolumePhoton(scene, *photonSampler, lightDistr, maxDepth, time, &photon))
+				{
+					photon.power /= (float)nPhotons;
+					chunkPhotons[c].push_back(photon);
+				}
+			}
+		}
+		std::vector<VolumePhoton> shot;
+		for (const auto &chunk : chunkPhotons)
+			shot.insert(shot.end(), chunk.begin(), chunk.end());
+		photonPaths += nPhotons;
+		storedPhotons += shot.size();
+		if (shot.empty())
+			return;
+
+		// BVH over the photon spheres; photons are reordered to leaf order
+		std::vector<Bounds3f> photonBounds(shot.size());
+		Vector3f r(radius, radius, radius);
+		for (size_t i = 0; i < shot.size(); ++i)
+			photonBounds[i] = Bounds3f(shot[i].p - r, shot[i].p + r);
+		int totalNodes = 0;
+		std::vector<int> ordered;
+		nodes = BVHAccel::BuildLinear(photonBounds, 4, BVHAccel::SplitMethod::SAH,
+									  &ordered, &totalNodes);
+		photons.resize(ordered.size());
+		for (size_t i = 0; i < ordered.size(); ++i)
+			photons[i] = shot[ordered[i]];
+	}
+
+	Spectrum VolumePhotonMap::BeamEstimate(const Ray &ray, Sampler &sampler) const
+	{
+		if (!nodes || !ray.medium)
+			return Spectrum(0.f);
+
+		// Gather the photons of this medium whose sphere the segment passes
+		// through, with the ray parameter of their closest approach
+		static thread_local std::vector<std::pair<float, int>> hits;
+		hits.clear();
+		const float r2 = radius * radius;
+		const float invLengthSquared = 1 / ray.d.LengthSquared();
+		Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+		int dirIsNeg[3] = {invDir.x < 0, invDir.y < 0, invDir.z < 0};
+		int toVisitOffset = 0, currentNodeIndex = 0;
+		int nodesToVisit[64];
+		while (true)
+		{
+			const LinearBVHNode *node = &nodes[currentNodeIndex];
+			if (node->bounds.IntersectP(ray, invDir, dirIsNeg))
+			{
+				if (node->nPrimitives > 0)
+				{
+					for (int i = 0; i < node->nPrimitives; ++i)
+					{
+						const VolumePhoton &photon = photons[node->primitivesOffset + i];
+						if (photon.medium != ray.medium)
+							continue;
+						Vector3f op = photon.p - ray.o;
+						float t = Dot(op, ray.d) * invLengthSquared;
+						if (t < 0 || t > ray.tMax ||
+							(op - ray.d * t).LengthSquared() > r2)
+							continue;
+						hits.push_back(std::make_pair(t, node->primitivesOffset + i));
+					}
+					if (toVisitOffset == 0)
+						break;
+					currentNodeIndex = nodesToVisit[--toVisitOffset];
+				}
+				else
+				{
+					if (dirIsNeg[node->axis])
+					{
+						nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+						currentNodeIndex = node->secondChildOffset;
+					}
+					else
+					{
+						nodesToVisit[toVisitOffset++] = node->secondChildOffset;
+						currentNodeIndex = currentNodeIndex + 1;
+					}
+				}
+			}
+			else
+			{
+				if (toVisitOffset == 0)
+					break;
+				currentNodeIndex = nodesToVisit[--toVisitOffset];
+			}
+		}
+		if (hits.empty())
+			return Spectrum(0.f);
+
+		// Walk the photons front to back so the transmittance to each one
+		// only costs the segment from the previous photon
+		std::sort(hits.begin(), hits.end());
+		Vector3f wo = -Normalize(ray.d);
+		Spectrum L(0.f), Tr(1.f);
+		float tPrev = 0;
+		for (const auto &hit : hits)
+		{
+			if (hit.first > tPrev)
+			{
+				Ray segment(ray(tPrev), ray.d, hit.first - tPrev, ray.time, ray.medium);
+				Spectrum tau;
+				if (ray.medium->OpticalDepth(segment, &tau))
+					Tr *= Exp(-tau);
+				else
+					Tr *= ray.medium->Tr(segment, sampler);
+				tPrev = hit.first;
+				if (Tr.IsBlack())
+					break;
+			}
+			const VolumePhoton &photon = photons[hit.second];
+			L += Tr * photon.phase.p(wo, photon.wi) * photon.power;
+		}
+
+		// Constant kernel over the disc the photon sphere cuts across the beam
+		return L / (Pi * r2);
+	}
+
+}
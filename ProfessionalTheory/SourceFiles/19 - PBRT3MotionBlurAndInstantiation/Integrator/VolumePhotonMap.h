@@ -0,0 +1,65 @@
+#pragma once
+#ifndef __VolumePhotonMap_h__
+#define __VolumePhotonMap_h__
+
+#include <vector>
+
+#include "Core/FeimosRender.h"
+#include "Core/Geometry.h"
+#include "Core/Spectrum.h"
+#include "Media/Medium.h"
+
+namespace Feimos
+{
+
+	struct LinearBVHNode;
+
+	// A photon left at a scattering event inside a participating medium.
+	// _power_ already includes the scattering coefficient and is divided by
+	// the number of photons shot in its pass.
+	struct VolumePhoton
+	{
+		Point3f p;
+		// Direction back towards where the photon came from
+		Vector3f wi;
+		Spectrum power;
+		const Medium *medium;
+		HenyeyGreenstein phase;
+	};
+
+	// VolumePhotonMap Declarations
+	// Volume caustic map: photons are traced from the lights with
+	// Light::Sample_Le and kept only where they scatter in a medium right
+	// after a chain of specular surfaces (light seen through glass into
+	// smoke). The path tracer can't sample those paths from the camera side,
+	// so they are gathered along camera ray segments with a beam radiance
+	// estimate over a BVH of the photon spheres instead.
+	class VolumePhotonMap
+	{
+	public:
+		// VolumePhotonMap Public Methods
+		VolumePhotonMap() {}
+		~VolumePhotonMap();
+		// Replaces the map with the photons of one pass of _nPhotons_ light
+		// paths; _pass_ selects the random streams of _sampler_
+		void Shoot(const Scene &scene, Sampler &sampler, int nPhotons,
+				   int maxDepth, float radius, int pass, float time);
+		// In-scattered radiance from the stored photons, integrated along
+		// _ray_ from its origin to _ray.tMax_ inside _ray.medium_
+		Spectrum BeamEstimate(const Ray &ray, Sampler &sampler) const;
+		int PhotonCount() const { return (int)photons.size(); }
+		float Radius() const { return radius; }
+		// Light paths traced and photons stored by all passes so far
+		static void ShootingStats(long long *paths, long long *stored);
+
+	private:
+		// VolumePhotonMap Private Data
+		// Photons in BVH leaf order
+		std::vector<VolumePhoton> photons;
+		LinearBVHNode *nodes = nullptr;
+		float radius = 0;
+	};
+
+}
+
+#endif
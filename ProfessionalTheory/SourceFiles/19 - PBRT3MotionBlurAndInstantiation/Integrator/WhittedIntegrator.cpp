@@ -10,12 +10,12 @@ namespace Feimos
 {
 
     Spectrum WhittedIntegrator::Li(const RayDifferential &ray, const Scene &scene,
-                                   Sampler &sampler, int depth) const
+                                   Sampler &sampler, int depth, const PrimaryHit *primary) const
     {
         Spectrum L(0.);
         // Find closest ray intersection or return background radiance
         SurfaceInteraction isect;
-        if (!scene.Intersect(ray, &isect))
+        if (!IntersectPrimary(scene, ray, &isect, primary))
         {
             for (const auto &light : scene.lights)
                 L += light->Le(ray);
@@ -32,7 +32,7 @@ namespace Feimos
         isect.ComputeScatteringFunctions(ray);
 
         if (!isect.bsdf)
-            return Li(isect.SpawnRay(ray.d), scene, sampler, depth);
+            return Li(isect.SpawnRay(ray.d), scene, sampler, depth, nullptr);
 
         // Compute emitted light if ray hit an area light source
         L += isect.Le(wo);
@@ -16,7 +16,8 @@ namespace Feimos
                       const Bounds2i &pixelBounds, FrameBuffer *m_FrameBuffer)
         : SamplerIntegrator(camera, sampler, pixelBounds, m_FrameBuffer), maxDepth(maxDepth) {}
     Spectrum Li(const RayDifferential &ray, const Scene &scene,
-                Sampler &sampler, int depth) const;
+                Sampler &sampler, int depth,
+                const PrimaryHit *primary) const;
 
   private:
     // WhittedIntegrator Private Data
@@ -1,4 +1,6 @@
 #include "Light/DiffuseLight.h"
+#include "Sampler/Sampling.h"
+#include "Sampler/RNG.h"
 
 namespace Feimos
 {
@@ -49,7 +51,6 @@ namespace Feimos
 										 float time, Ray *ray, Normal3f *nLight,
 										 float *pdfPos, float *pdfDir) const
 	{
-		/*
 		// Sample a point on the area light's _Shape_, _pShape_
 		Interaction pShape = shape->Sample(u1, pdfPos);
 		pShape.mediumInterface = mediumInterface;
@@ -81,19 +82,17 @@ namespace Feimos
 		CoordinateSystem(n, &v1, &v2);
 		w = w.x * v1 + w.y * v2 + w.z * n;
 		*ray = pShape.SpawnRay(w);
-		return L(pShape, w);*/
-		return Spectrum(0.f);
+		return L(pShape, w);
 	}
 
 	void DiffuseAreaLight::Pdf_Le(const Ray &ray, const Normal3f &n, float *pdfPos,
 								  float *pdfDir) const
 	{
-		/*
 		Interaction it(ray.o, n, Vector3f(), Vector3f(n), ray.time,
 			mediumInterface);
 		*pdfPos = shape->Pdf(it);
 		*pdfDir = twoSided ? (.5 * CosineHemispherePdf(AbsDot(n, ray.d)))
-			: CosineHemispherePdf(Dot(n, ray.d));*/
+			: CosineHemispherePdf(Dot(n, ray.d));
 	}
 
 }
@@ -26,20 +26,25 @@ bool VisibilityTester::Unoccluded(const Scene &scene) const {
 
 Spectrum VisibilityTester::Tr(const Scene &scene, Sampler &sampler) const {
 	Ray ray(p0.SpawnRayTo(p1));
-	Spectrum Tr(1.f);
+	Spectrum Tr(1.f), tau(0.f);
 	while (true) {
 		SurfaceInteraction isect;
 		bool hitSurface = scene.Intersect(ray, &isect);
 		// Handle opaque surface along ray's path
 		if (hitSurface && isect.primitive->GetMaterial() != nullptr)
 			return Spectrum(0.0f);
-		// Update transmittance for current ray segment
-		if (ray.medium) Tr *= ray.medium->Tr(ray, sampler);
+		// Update transmittance for current ray segment; analytic media only
+		// add to the optical depth, exponentiated once at the end
+		Spectrum segmentTau;
+		if (ray.medium && ray.medium->OpticalDepth(ray, &segmentTau))
+			tau += segmentTau;
+		else if (ray.medium)
+			Tr *= ray.medium->Tr(ray, sampler);
 		// Generate next ray segment or return final transmittance
 		if (!hitSurface) break;
 		ray = isect.SpawnRayTo(p1);
 	}
-	return Tr;
+	return tau.IsBlack() ? Tr : Tr * Exp(-tau);
 }
 
 AreaLight::AreaLight(const Transform &LightToWorld, const MediumInterface &medium, int nSamples)
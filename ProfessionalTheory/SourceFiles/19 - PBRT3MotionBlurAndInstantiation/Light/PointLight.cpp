@@ -19,7 +19,7 @@ namespace Feimos
 	Spectrum PointLight::Sample_Le(const Point2f &u1, const Point2f &u2, float time,
 								   Ray *ray, Normal3f *nLight, float *pdfPos, float *pdfDir) const
 	{
-		*ray = Ray(pLight, UniformSampleSphere(u1), Infinity, time);
+		*ray = Ray(pLight, UniformSampleSphere(u1), Infinity, time, mediumInterface.inside);
 		*nLight = (Normal3f)ray->d;
 		*pdfPos = 1;
 		*pdfDir = UniformSpherePdf();
@@ -5,6 +5,7 @@
 #include <QtWidgets/QGroupBox>
 #include <QtWidgets/QGridLayout>
 #include <QCloseEvent>
+#include <QTimer>
 
 #include "IMAGraphicsView.h"
 
@@ -19,7 +20,8 @@ public:
 	DisplayWidget(QGroupBox *parent = Q_NULLPTR);
 	~DisplayWidget();
 
-	void startRenderThread();
+	void startRenderThread(bool resume = false, bool adaptive = false, bool denoise = false,
+						   const std::string &checkpointFile = "Checkpoint.fmck", int checkpointSeconds = 120);
 	void killRenderThread();
 
 public:
@@ -31,12 +33,15 @@ private:
 	QGridLayout displayWidgetLayout;
 
 	IMAGraphicsView m_IMAGraphicsView;
+	// Pulls published frames from the framebuffer at the display refresh rate
+	QTimer displayTimer;
 
 	void closeEvent(QCloseEvent *event);
 
 private slots:
 	void PrintString(const char *s);
 	void PrintDataD(const char *s, const double data);
+	void RefreshDisplay();
 };
 
 #endif
@@ -1,5 +1,6 @@
 #include "IMAGraphicsView.h"
 #include "DebugText.hpp"
+#include <QPainter>
 
 IMAGraphicsView::IMAGraphicsView(QGraphicsView *parent)
 {
@@ -97,3 +98,22 @@ void IMAGraphicsView::PaintBuffer(unsigned char *buffer, int width, int height,
 	scale(0.5, 0.5);
 	scale(2.0, 2.0);
 }
+
+void IMAGraphicsView::UpdateBuffer(unsigned char *buffer, int width, int height, int channals, const QRect &dirty)
+{
+	// ߴ仯ʱؽ
+	if (map.width() != width || map.height() != height || channals != 4)
+	{
+		PaintBuffer(buffer, width, height, channals);
+		return;
+	}
+	QImage image(buffer, width, height, static_cast<int>(width * channals * sizeof(unsigned char)), QImage::Format_ARGB32);
+	QPainter painter(&map);
+	painter.setCompositionMode(QPainter::CompositionMode_Source);
+	painter.drawImage(dirty.topLeft(), image.copy(dirty).rgbSwapped());
+	painter.end();
+
+	// ǻģҪŻػ
+	resetCachedContent();
+	viewport()->update();
+}
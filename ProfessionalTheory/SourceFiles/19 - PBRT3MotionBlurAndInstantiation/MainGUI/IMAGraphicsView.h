@@ -17,6 +17,8 @@ public:
 
 public:
 	void getMap(QString mapname);
+	// Upload only the _dirty_ rectangle of the buffer into the displayed map
+	void UpdateBuffer(unsigned char *buffer, int width, int height, int channals, const QRect &dirty);
 
 private:
 	int bottom, left, top, right, width, height;
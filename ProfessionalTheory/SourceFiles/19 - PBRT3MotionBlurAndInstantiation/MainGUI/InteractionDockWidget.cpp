@@ -37,4 +37,35 @@ void InteractionDockWidget::setupDock()
 	renderButton->setText("Start Rendering");
 
 	centerLayout->addWidget(renderButton);
+
+	resumeButton = new QPushButton;
+	resumeButton->setText("Resume From Checkpoint");
+
+	centerLayout->addWidget(resumeButton);
+
+	adaptiveCheckBox = new QCheckBox;
+	adaptiveCheckBox->setText("Adaptive Sampling");
+	adaptiveCheckBox->setChecked(false);
+
+	centerLayout->addWidget(adaptiveCheckBox);
+
+	denoiseCheckBox = new QCheckBox;
+	denoiseCheckBox->setText("Denoise Preview");
+	denoiseCheckBox->setChecked(false);
+
+	centerLayout->addWidget(denoiseCheckBox);
+
+	checkpointEdit = new QLineEdit;
+	checkpointEdit->setText("Checkpoint.fmck");
+	checkpointEdit->setToolTip("Checkpoint File");
+
+	centerLayout->addWidget(checkpointEdit);
+
+	checkpointSpinBox = new QSpinBox;
+	checkpointSpinBox->setRange(10, 24 * 3600);
+	checkpointSpinBox->setValue(120);
+	checkpointSpinBox->setPrefix("Checkpoint Every ");
+	checkpointSpinBox->setSuffix(" s");
+
+	centerLayout->addWidget(checkpointSpinBox);
 }
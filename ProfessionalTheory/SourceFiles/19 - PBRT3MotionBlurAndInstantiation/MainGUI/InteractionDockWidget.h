@@ -5,6 +5,9 @@
 #include <QFrame>
 #include <QVBoxLayout>
 #include <QPushButton>
+#include <QCheckBox>
+#include <QLineEdit>
+#include <QSpinBox>
 
 #include "DataTreeWidget.h"
 
@@ -25,6 +28,11 @@ private:
 
 public:
 	QPushButton *renderButton;
+	QPushButton *resumeButton;
+	QCheckBox *adaptiveCheckBox;
+	QCheckBox *denoiseCheckBox;
+	QLineEdit *checkpointEdit;
+	QSpinBox *checkpointSpinBox;
 	DataTreeWidget *m_DataTreeWidget;
 
 protected:
@@ -20,6 +20,7 @@ MainWindow::MainWindow(QWidget *parent)
 	setDock();
 
 	connect(m_InteractionDockWidget.renderButton, SIGNAL(clicked()), this, SLOT(setRendering()));
+	connect(m_InteractionDockWidget.resumeButton, SIGNAL(clicked()), this, SLOT(setResuming()));
 }
 
 void MainWindow::closeEvent(QCloseEvent *event)
@@ -52,6 +53,26 @@ void MainWindow::setRendering()
 		// Ⱦ
 		m_InteractionDockWidget.renderButton->setText("Rendering");
 
-		m_DisplayWidget.startRenderThread();
+		m_DisplayWidget.startRenderThread(false,
+			m_InteractionDockWidget.adaptiveCheckBox->isChecked(),
+			m_InteractionDockWidget.denoiseCheckBox->isChecked(),
+			m_InteractionDockWidget.checkpointEdit->text().toStdString(),
+			m_InteractionDockWidget.checkpointSpinBox->value());
+	}
+}
+
+void MainWindow::setResuming()
+{
+
+	if (!m_DisplayWidget.renderFlag)
+	{
+		// ϴεļȾ
+		m_InteractionDockWidget.renderButton->setText("Rendering");
+
+		m_DisplayWidget.startRenderThread(true,
+			m_InteractionDockWidget.adaptiveCheckBox->isChecked(),
+			m_InteractionDockWidget.denoiseCheckBox->isChecked(),
+			m_InteractionDockWidget.checkpointEdit->text().toStdString(),
+			m_InteractionDockWidget.checkpointSpinBox->value());
 	}
 }
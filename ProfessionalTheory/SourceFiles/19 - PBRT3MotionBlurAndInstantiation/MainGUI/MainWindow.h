@@ -34,6 +34,7 @@ private:
 
 private slots:
 	void setRendering();
+	void setResuming();
 };
 
 #endif
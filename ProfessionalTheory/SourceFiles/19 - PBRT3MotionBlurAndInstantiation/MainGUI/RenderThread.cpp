@@ -1,6 +1,7 @@
 #include "RenderThread.h"
 #include "DebugText.hpp"
 #include <QElapsedTimer>
+#include <typeinfo>
 
 #include "Core/FeimosRender.h"
 #include "Core/Primitive.h"
@@ -8,6 +9,8 @@
 #include "Core/interaction.h"
 #include "Core/Scene.h"
 #include "Core/Transform.h"
+#include "Core/Checkpoint.h"
+#include "Core/TextAsset.h"
 
 #include "Shape/Triangle.h"
 #include "Shape/plyRead.h"
@@ -15,12 +18,14 @@
 #include "Shape/RattlerLoad.h"
 
 #include "Accelerator/BVHAccel.h"
+#include "Accelerator/InstanceAccel.h"
 
 #include "Camera/Camera.h"
 #include "Camera/Perspective.h"
 
 #include "Sampler/Sampler.h"
 #include "Sampler/ClockRand.h"
+#include "Sampler/Random.h"
 
 #include "Integrator/Integrator.h"
 #include "Integrator/WhittedIntegrator.h"
@@ -90,6 +95,11 @@ RenderThread::RenderThread()
 {
 	paintFlag = false;
 	renderFlag = false;
+	resumeFlag = false;
+	adaptiveFlag = false;
+	denoiseFlag = false;
+	checkpointFile = "Checkpoint.fmck";
+	checkpointSeconds = 120;
 }
 
 RenderThread::~RenderThread()
@@ -216,8 +226,25 @@ void RenderThread::run()
 		// // Feimos::RattlerLoad rattler("../../Resources/Rattler/Skull-Rattler/", tri_Object2WorldModel, prims, noMedium, modelAnimatedTrans, true);
 		// tri_Object2WorldModel = Feimos::Translate(Feimos::Vector3f(0.0f, -3.5f, 0.0f)) * Feimos::Scale(0.3f, 0.3f, 0.3f);
 		// Feimos::RattlerLoad rattler("../../Resources/Rattler/Nanosuit-Rattler/", tri_Object2WorldModel, prims, noMedium, modelAnimatedTrans, true);
+		// // ٽṹģ͵BVHֻһΪBLASBVHֻʵƶʵ Build() 
+		// // std::shared_ptr<Feimos::InstanceAccel> tlas = std::make_shared<Feimos::InstanceAccel>();
+		// // Feimos::RattlerLoad rattler("../../Resources/Rattler/Skull-Rattler/", tri_Object2WorldModel, prims, noMedium, modelAnimatedTrans, true, true, nullptr, Feimos::MeshCompressionNone, tlas.get());
+		// // for (int i = 0; i < 2000; i++)
+		// // 	tlas->AddInstance(0, Feimos::Translate(Feimos::Vector3f(0.4f * (i % 50) - 10.0f, -1.0f, -0.4f * (i / 50))));
+		// // tlas->Build();
+		// // prims.push_back(tlas);
+		// // emit PrintDataD("  TLAS instances: ", tlas->InstanceCount());
+		// // emit PrintDataD("  TLAS build (ms): ", tlas->BuildMilliseconds());
+		// // emit PrintDataD("  TLAS memory (MB): ", tlas->Bytes() / 1000.0 / 1000.0);
 
 		// emit PrintDataD("  MeshNumInModel: ", rattler.MeshNumInModel);
+		// //  Feimos::MeshCompressionAll ѹѡʱȽѹǰڴ
+		// // emit PrintDataD("  Mesh memory (MB): ", rattler.meshBytes / 1000.0 / 1000.0);
+		// // emit PrintDataD("  Uncompressed mesh memory (MB): ", rattler.uncompressedMeshBytes / 1000.0 / 1000.0);
+		// // emit PrintDataD("  Mesh BVH and leaf blocks (MB): ", rattler.primitiveBytes / 1000.0 / 1000.0);
+		// // emit PrintDataD("  Alpha opaque triangles: ", rattler.opacityReport.opaque);
+		// // emit PrintDataD("  Alpha transparent triangles (dropped): ", rattler.opacityReport.transparent);
+		// // emit PrintDataD("  Alpha mixed triangles: ", rattler.opacityReport.mixed);
 		// //  for (int i = 0; i < rattler.meshFiles.size(); i++) emit PrintString(rattler.meshFiles[i].c_str());
 		// // emit PrintDataD("rattler.meshFiles.size(): ", rattler.meshFiles.size());
 
@@ -242,6 +269,29 @@ void RenderThread::run()
 	  // Feimos::getInfiniteLight("../../Resources/MonValley1000.hdr", lights, InfinityLightToWorld);
 	}
 
+	// ıԴݣĶȡʱ
+	for (const Feimos::AssetLoadRecord &record : Feimos::TakeAssetLoadRecords())
+	{
+		QString name = QString::fromStdString(record.name).section('/', -1);
+		m_RenderStatus.setDataChanged("Asset Load", name, QString::number(record.seconds * 1000.f), "ms");
+		m_RenderStatus.setDataChanged("Asset Load", name + " size", QString::number(record.bytes / 1000.f / 1000.f), "M");
+	}
+	// ͼڴ棨8λsRGB뾫ȴ洢Ϊȫȴ洢ʱĴС
+	{
+		size_t textureBytes = 0, fullPrecisionBytes = 0;
+		for (const Feimos::TextureMemoryRecord &record : Feimos::TextureMemoryReport())
+		{
+			QString name = QString::fromStdString(record.filename).section('/', -1);
+			m_RenderStatus.setDataChanged("Texture Memory", name,
+										  QString::number(record.bytes / 1000.f / 1000.f) + " (" + QString::number(record.fullPrecisionBytes / 1000.f / 1000.f) + ")", "M");
+			textureBytes += record.bytes;
+			fullPrecisionBytes += record.fullPrecisionBytes;
+		}
+		if (textureBytes > 0)
+			m_RenderStatus.setDataChanged("Texture Memory", "Total",
+										  QString::number(textureBytes / 1000.f / 1000.f) + " (" + QString::number(fullPrecisionBytes / 1000.f / 1000.f) + ")", "M");
+	}
+
 	// ɼٽṹ
 	emit PrintString("Init Accelerator...");
 	std::shared_ptr<Feimos::Aggregate> aggregate;
@@ -252,9 +302,11 @@ void RenderThread::run()
 	// ɲṹ
 	emit PrintString("Init Sampler...");
 	Feimos::Bounds2i ScreenBound(Feimos::Point2i(0, 0), Feimos::Point2i(WIDTH, HEIGHT));
-	std::shared_ptr<Feimos::ClockRandSampler> sampler;
+	std::shared_ptr<Feimos::RandomSampler> sampler;
 	{
-		sampler = std::make_unique<Feimos::ClockRandSampler>(8, ScreenBound);
+		// (, , ֡)Ⱦɸֶ֣֧ϵ
+		sampler = std::make_unique<Feimos::RandomSampler>(8, 0);
+		// sampler = std::make_unique<Feimos::ClockRandSampler>(8, ScreenBound);
 	}
 
 	// ɳ
@@ -265,12 +317,61 @@ void RenderThread::run()
 	}
 
 	emit PrintString("Build Integrator...");
-	std::shared_ptr<Feimos::Integrator> integrator;
+	std::shared_ptr<Feimos::SamplerIntegrator> integrator;
 	{
 		integrator = std::make_shared<Feimos::PathIntegrator>(15, camera, sampler, ScreenBound, 1.f, "spatial", p_framebuffer);
 		// integrator = std::make_shared<Feimos::WhittedIntegrator>(15, camera, sampler, ScreenBound, p_framebuffer);
 		// integrator = std::make_shared<Feimos::VolPathIntegrator>(15, camera, sampler, ScreenBound, 1.f, "spatial", p_framebuffer);
+		// ͼÿ֡Ĺʼռ뾶͸սʵĽɢɹռ뾶֡С
+		// std::static_pointer_cast<Feimos::VolPathIntegrator>(integrator)->SetVolumePhotons(200000, 0.05f);
+	}
+	// ӦֵÿʱԤ()ĬϹرգڽйѡ
+	if (adaptiveFlag)
+		integrator->SetAdaptiveSampling(0.01f, 16, 3600.0);
+	// ʾǰAOVa-trous˲룬ͲԤʱҲжϹЧĬϹرգڽйѡ
+	p_framebuffer->setDenoise(denoiseFlag);
+
+	// ָƣֱʡΧͼԪԴͺÿ
+	// κһͬ˵ԱȾãܽ
+	uint64_t fingerprint = Feimos::FingerprintBytes(&WIDTH, sizeof(WIDTH));
+	fingerprint = Feimos::FingerprintBytes(&HEIGHT, sizeof(HEIGHT), fingerprint);
+	fingerprint = Feimos::FingerprintBytes(&Cam2WorldStart, sizeof(Cam2WorldStart), fingerprint);
+	Feimos::Bounds3f sceneBound = worldScene->WorldBound();
+	fingerprint = Feimos::FingerprintBytes(&sceneBound, sizeof(sceneBound), fingerprint);
+	size_t sceneCounts[2] = {prims.size(), lights.size()};
+	fingerprint = Feimos::FingerprintBytes(sceneCounts, sizeof(sceneCounts), fingerprint);
+	const std::string integratorName = typeid(*integrator).name();
+	fingerprint = Feimos::FingerprintBytes(integratorName.data(), integratorName.size(), fingerprint);
+	int64_t samplesPerPixel = sampler->samplesPerPixel;
+	fingerprint = Feimos::FingerprintBytes(&samplesPerPixel, sizeof(samplesPerPixel), fingerprint);
+
+	// ϵֱ֣ʡӺָƶһʱϴεĽȾ
+	// õȾʱҲһָӦʱԤ㲻¼
+	if (resumeFlag)
+	{
+		Feimos::RenderCheckpoint checkpoint;
+		if (Feimos::ReadCheckpoint(checkpointFile, &checkpoint) && checkpoint.samplerSeed == sampler->Seed() &&
+			checkpoint.fingerprint == fingerprint && p_framebuffer->getFilm()->Restore(checkpoint))
+		{
+			p_framebuffer->setRenderCount(checkpoint.passes);
+			integrator->ResumeRenderTime(checkpoint.renderSeconds);
+			emit PrintDataD("Resume from checkpoint, passes: ", checkpoint.passes);
+		}
+		else
+			emit PrintString("No usable checkpoint, render from scratch.");
 	}
+	auto takeCheckpoint = [&](Feimos::RenderCheckpoint *checkpoint) {
+		p_framebuffer->getFilm()->Snapshot(checkpoint);
+		checkpoint->passes = p_framebuffer->getRenderCount();
+		checkpoint->samplerSeed = sampler->Seed();
+		checkpoint->fingerprint = fingerprint;
+		checkpoint->renderSeconds = integrator->RenderTime();
+	};
+	// ں̨߳д̣Ⱦֻ߳һڴ濽
+	std::unique_ptr<Feimos::CheckpointWriter> checkpointWriter(new Feimos::CheckpointWriter(checkpointFile));
+	const qint64 checkpointInterval = (qint64)checkpointSeconds * 1000; // 
+	QElapsedTimer checkpointTimer;
+	checkpointTimer.start();
 
 	emit PrintString("Start Rendering!");
 	// ʼִȾ
@@ -278,9 +379,6 @@ void RenderThread::run()
 	double wholeTime = 0.0;
 	while (renderFlag)
 	{
-		QElapsedTimer t;
-		t.start();
-
 		double frameTime;
 		integrator->Render(*worldScene, frameTime);
 
@@ -292,17 +390,64 @@ void RenderThread::run()
 			m_RenderStatus.setDataChanged("Performance", "Frame pre second", QString::number(1.0f / (float)frameTime), "");
 			m_RenderStatus.setDataChanged("Performance", "Samples pre frame", QString::number(renderCount), "");
 			m_RenderStatus.setDataChanged("Performance", "Whole time", QString::number(wholeTime), "seconds");
+			// ֮׷ٵĹ߷ֿͳƣλΪÿ߳ÿ
+			const Feimos::RayThroughput &rays = integrator->Throughput();
+			if (rays.primarySeconds > 0)
+				m_RenderStatus.setDataChanged("Performance", "Primary rays", QString::number(rays.primaryRays / rays.primarySeconds / 1e6), "Mrays/s");
+			if (rays.secondarySeconds > 0)
+				m_RenderStatus.setDataChanged("Performance", "Secondary rays", QString::number(rays.secondaryRays / rays.secondarySeconds / 1e6), "Mrays/s");
+			// ݽʰľֲϽ׷٣ʾƽÿߵܶȲѯ
+			long long mediumRays, densityLookups;
+			Feimos::GridDensityMedium::TrackingStats(&mediumRays, &densityLookups);
+			if (mediumRays > 0)
+				m_RenderStatus.setDataChanged("Performance", "Density lookups per ray", QString::number((double)densityLookups / mediumRays), "");
+			// ͼµĹ(ڽɢ)ռӵı
+			long long photonPaths, storedPhotons;
+			Feimos::VolumePhotonMap::ShootingStats(&photonPaths, &storedPhotons);
+			if (photonPaths > 0)
+				m_RenderStatus.setDataChanged("Performance", "Volume photons stored", QString::number(100.0 * storedPhotons / photonPaths), "%");
+			// 黺ڴԤڣδʱͼ
+			Feimos::TextureCacheStats textureCache = Feimos::TextureCache::Get().Stats();
+			m_RenderStatus.setDataChanged("Performance", "Texture cache hits", QString::number(textureCache.hits), "");
+			m_RenderStatus.setDataChanged("Performance", "Texture cache misses", QString::number(textureCache.misses), "");
+			m_RenderStatus.setDataChanged("Performance", "Texture cache evictions", QString::number(textureCache.evictions), "");
+			m_RenderStatus.setDataChanged("Performance", "Texture cache size", QString::number((textureCache.residentBytes + textureCache.pinnedBytes) / (1024.0 * 1024.0)) + " / " + QString::number(textureCache.budgetBytes / (1024.0 * 1024.0)), "MB");
+			if (textureCache.pinnedBytes > 0)
+				m_RenderStatus.setDataChanged("Performance", "Texture decoded levels", QString::number(textureCache.pinnedBytes / (1024.0 * 1024.0)), "MB");
 		}
 #endif
 
-		emit PaintBuffer(p_framebuffer->getUCbuffer(), WIDTH, HEIGHT, 4);
+		// һ֡水Լˢȡ߲תȾ̲߳ȴ
+		p_framebuffer->publishFrame();
 
-		while (t.elapsed() < 1)
-			;
+		if (checkpointTimer.elapsed() >= checkpointInterval)
+		{
+			Feimos::RenderCheckpoint checkpoint;
+			takeCheckpoint(&checkpoint);
+			// һ㻹ûдʱһΣȴ
+			if (checkpointWriter->Submit(std::move(checkpoint)))
+				checkpointTimer.restart();
+		}
 
 #if windows_operating_system
+		m_RenderStatus.setDataChanged("Performance", "Active pixels", QString::number(integrator->ActivePixels()), "");
 		showMemoryInfo();
 #endif
+
+		if (integrator->Converged())
+		{
+			emit PrintDataD("Adaptive sampling stopped, active pixels: ", integrator->ActivePixels());
+			break;
+		}
+	}
+
+	// ʱȺ̨д꣬ͬдյĽ
+	checkpointWriter.reset();
+	{
+		Feimos::RenderCheckpoint checkpoint;
+		takeCheckpoint(&checkpoint);
+		if (Feimos::WriteCheckpoint(checkpointFile, checkpoint))
+			emit PrintDataD("Checkpoint saved, passes: ", checkpoint.passes);
 	}
 
 	emit PrintString("End Rendering.");
@@ -3,6 +3,7 @@
 
 #include <QThread>
 #include <QString>
+#include <string>
 
 #include "Core/FrameBuffer.h"
 #include "IMAGraphicsView.h"
@@ -18,12 +19,20 @@ public:
 public:
 	bool renderFlag;
 	bool paintFlag;
+	// Continue from the last checkpoint instead of starting from scratch
+	bool resumeFlag;
+	// Stop pixels early at the noise threshold; off by default
+	bool adaptiveFlag;
+	// Denoise the displayed image with the AOV-guided filter; off by default
+	bool denoiseFlag;
+	// Checkpoint file and the seconds between background checkpoints
+	std::string checkpointFile;
+	int checkpointSeconds;
 	FrameBuffer *p_framebuffer;
 
 signals:
 	void PrintString(const char *s);
 	void PrintDataD(const char *s, const double data);
-	void PaintBuffer(unsigned char *buffer, int width, int height, int channals);
 private slots:
 
 public:
@@ -24,6 +24,13 @@ namespace Feimos
                                             bool allowMultipleLobes) const = 0;
     virtual ~Material() {}
     static void Bump(const std::shared_ptr<Texture<float>> &d, SurfaceInteraction *si);
+
+  private:
+    // Displacement at _si_ and its $u$ and $v$ derivatives by finite
+    // differences over the ray differential footprint
+    static void bumpDifferences(const std::shared_ptr<Texture<float>> &d,
+                                const SurfaceInteraction &si, float *displace,
+                                float *dddu, float *dddv);
   };
 
 }
@@ -0,0 +1,187 @@
+#include "Media/BrickedVolume.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Feimos
+{
+
+	static long long volumeBytes = 0;
+	static long long occupiedBricks = 0;
+	static long long emptyBricks = 0;
+
+	// BrickedVolume Method Definitions
+	BrickedVolume::BrickedVolume(int nx, int ny, int nz, VolumePrecision precision)
+		: nx(nx), ny(ny), nz(nz),
+		  bricksX((nx + brickSize - 1) >> brickLog2),
+		  bricksY((ny + brickSize - 1) >> brickLog2),
+		  bricksZ((nz + brickSize - 1) >> brickLog2),
+		  precision(precision),
+		  brickIndex((size_t)bricksX * bricksY * bricksZ, -1) {}
+
+	void BrickedVolume::AddSlices(int z0, int nSlices, const float *data)
+	{
+		const int bz = z0 >> brickLog2;
+		const int nLayer = bricksX * bricksY;
+		// Voxel of brick (bx, by) of this layer in _data_; voxels past the
+		// grid edge read as zero
+		auto voxel = [&](int bx, int by, int x, int y, int z) {
+			int gx = (bx << brickLog2) + x, gy = (by << brickLog2) + y;
+			if (gx >= nx || gy >= ny || z >= nSlices)
+				return 0.f;
+			return data[((size_t)z * ny + gy) * nx + gx];
+		};
+
+		// Find the occupied bricks of the layer and their maxima
+		std::vector<float> layerMax(nLayer, 0.f);
+		std::vector<char> occupied(nLayer, 0);
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int b = 0; b < nLayer; ++b)
+		{
+			int bx = b % bricksX, by = b / bricksX;
+			float maxValue = 0;
+			bool nonZero = false;
+			for (int z = 0; z < brickSize; ++z)
+				for (int y = 0; y < brickSize; ++y)
+					for (int x = 0; x < brickSize; ++x)
+					{
+						float v = voxel(bx, by, x, y, z);
+						nonZero |= v != 0;
+						maxValue = std::max(maxValue, v);
+					}
+			occupied[b] = nonZero;
+			layerMax[b] = maxValue;
+		}
+
+		// Append the occupied bricks to the pool in order
+		int first = (int)brickMax.size(), nAdded = 0;
+		for (int b = 0; b < nLayer; ++b)
+		{
+			if (!occupied[b])
+			{
+				++emptyBricks;
+				continue;
+			}
+			brickIndex[(size_t)bz * nLayer + b] = first + nAdded++;
+			brickMax.push_back(layerMax[b]);
+		}
+		occupiedBricks += nAdded;
+		size_t nChunks = (brickMax.size() + chunkBricks - 1) >> chunkLog2;
+		const size_t chunkVoxels = (size_t)chunkBricks * brickVoxels;
+		while (float32.size() + unorm16.size() + unorm8.size() < nChunks)
+		{
+			if (precision == VolumePrecision::Unorm16)
+				unorm16.emplace_back(new uint16_t[chunkVoxels]);
+			else if (precision == VolumePrecision::Unorm8)
+				unorm8.emplace_back(new uint8_t[chunkVoxels]);
+			else
+				float32.emplace_back(new float[chunkVoxels]);
+		}
+
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int b = 0; b < nLayer; ++b)
+		{
+			int brick = brickIndex[(size_t)bz * nLayer + b];
+			if (brick < 0)
+				continue;
+			int bx = b % bricksX, by = b / bricksX;
+			float scale = brickMax[brick] > 0 ? 1 / brickMax[brick] : 0;
+			int chunk = brick >> chunkLog2;
+			int base = (brick & (chunkBricks - 1)) * brickVoxels;
+			for (int z = 0; z < brickSize; ++z)
+				for (int y = 0; y < brickSize; ++y)
+					for (int x = 0; x < brickSize; ++x)
+					{
+						float v = voxel(bx, by, x, y, z);
+						int i = base + VoxelOffset(x, y, z);
+						float q = Clamp(v * scale, 0.f, 1.f);
+						if (precision == VolumePrecision::Unorm16)
+							unorm16[chunk][i] = (uint16_t)std::lround(q * 65535.f);
+						else if (precision == VolumePrecision::Unorm8)
+							unorm8[chunk][i] = (uint8_t)std::lround(q * 255.f);
+						else
+							float32[chunk][i] = v;
+					}
+		}
+		volumeBytes = MemoryBytes();
+	}
+
+	void BrickedVolume::AddDense(const float *data)
+	{
+		for (int z0 = 0; z0 < nz; z0 += brickSize)
+			AddSlices(z0, std::min(brickSize, nz - z0), data + (size_t)z0 * nx * ny);
+	}
+
+	float BrickedVolume::Trilinear(const Point3i &p, const Vector3f &d) const
+	{
+		float v[8];
+		const int inner = brickSize - 1;
+		if (p.x >= 0 && p.y >= 0 && p.z >= 0 && p.x + 1 < nx && p.y + 1 < ny &&
+			p.z + 1 < nz && (p.x & inner) != inner && (p.y & inner) != inner &&
+			(p.z & inner) != inner)
+		{
+			// All eight voxels lie in one brick: one index lookup
+			int brick = brickIndex[BrickOffset(p.x >> brickLog2, p.y >> brickLog2, p.z >> brickLog2)];
+			if (brick < 0)
+				return 0;
+			int o = VoxelOffset(p.x & inner, p.y & inner, p.z & inner);
+			const int dy = brickSize, dz = brickSize * brickSize;
+			const int offsets[8] = {o, o + 1, o + dy, o + dy + 1,
+									o + dz, o + dz + 1, o + dz + dy, o + dz + dy + 1};
+			for (int i = 0; i < 8; ++i)
+				v[i] = Decode(brick, offsets[i]);
+		}
+		else
+		{
+			for (int i = 0; i < 8; ++i)
+				v[i] = Lookup(p.x + (i & 1), p.y + ((i >> 1) & 1), p.z + (i >> 2));
+		}
+		float d00 = Lerp(d.x, v[0], v[1]);
+		float d10 = Lerp(d.x, v[2], v[3]);
+		float d01 = Lerp(d.x, v[4], v[5]);
+		float d11 = Lerp(d.x, v[6], v[7]);
+		float d0 = Lerp(d.y, d00, d10);
+		float d1 = Lerp(d.y, d01, d11);
+		return Lerp(d.z, d0, d1);
+	}
+
+	float BrickedVolume::MaxValue(const Point3i &pMin, const Point3i &pMax) const
+	{
+		Point3i lo(std::max(pMin.x, 0), std::max(pMin.y, 0), std::max(pMin.z, 0));
+		Point3i hi(std::min(pMax.x, nx - 1), std::min(pMax.y, ny - 1), std::min(pMax.z, nz - 1));
+		float maxValue = 0;
+		for (int bz = lo.z >> brickLog2; bz <= hi.z >> brickLog2; ++bz)
+			for (int by = lo.y >> brickLog2; by <= hi.y >> brickLog2; ++by)
+				for (int bx = lo.x >> brickLog2; bx <= hi.x >> brickLog2; ++bx)
+				{
+					int brick = brickIndex[BrickOffset(bx, by, bz)];
+					if (brick < 0)
+						continue;
+					// Clip the range to the brick
+					int x0 = std::max(lo.x, bx << brickLog2), x1 = std::min(hi.x, ((bx + 1) << brickLog2) - 1);
+					int y0 = std::max(lo.y, by << brickLog2), y1 = std::min(hi.y, ((by + 1) << brickLog2) - 1);
+					int z0 = std::max(lo.z, bz << brickLog2), z1 = std::min(hi.z, ((bz + 1) << brickLog2) - 1);
+					if (x1 - x0 == brickSize - 1 && y1 - y0 == brickSize - 1 && z1 - z0 == brickSize - 1)
+					{
+						maxValue = std::max(maxValue, brickMax[brick]);
+						continue;
+					}
+					for (int z = z0; z <= z1; ++z)
+						for (int y = y0; y <= y1; ++y)
+							for (int x = x0; x <= x1; ++x)
+								maxValue = std::max(maxValue,
+													Decode(brick, VoxelOffset(x & (brickSize - 1), y & (brickSize - 1),
+																			  z & (brickSize - 1))));
+				}
+		return maxValue;
+	}
+
+	size_t BrickedVolume::MemoryBytes() const
+	{
+		size_t chunkVoxels = (size_t)chunkBricks * brickVoxels;
+		return brickIndex.size() * sizeof(int) + brickMax.size() * sizeof(float) +
+			   chunkVoxels * (float32.size() * sizeof(float) +
+							  unorm16.size() * sizeof(uint16_t) + unorm8.size());
+	}
+
+}
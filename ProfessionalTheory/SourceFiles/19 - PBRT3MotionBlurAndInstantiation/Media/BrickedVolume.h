@@ -0,0 +1,112 @@
+#pragma once
+#ifndef __BrickedVolume_h__
+#define __BrickedVolume_h__
+
+#include "Core/FeimosRender.h"
+#include "Core/Geometry.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace Feimos
+{
+
+	// Storage of the voxels of non-empty bricks; quantized bricks keep
+	// value / brickMax in [0, 1]
+	enum class VolumePrecision
+	{
+		Float32,
+		Unorm16,
+		Unorm8
+	};
+
+	// BrickedVolume Declarations
+	// Sparse scalar grid of nx*ny*nz voxels split into 8^3 bricks. Bricks
+	// whose voxels are all zero take no storage; the occupancy index maps
+	// every brick to its slot in the brick pool, or -1 when it is empty.
+	// The grid is filled one layer of bricks (8 z slices) at a time, so a
+	// dense copy of the whole volume never has to exist.
+	class BrickedVolume
+	{
+	public:
+		static constexpr int brickLog2 = 3;
+		static constexpr int brickSize = 1 << brickLog2;
+		static constexpr int brickVoxels = brickSize * brickSize * brickSize;
+		// The brick pool grows in chunks of this many bricks, so it is never
+		// reallocated and copied while the volume is filled
+		static constexpr int chunkLog2 = 8;
+		static constexpr int chunkBricks = 1 << chunkLog2;
+
+		BrickedVolume(int nx, int ny, int nz,
+					  VolumePrecision precision = VolumePrecision::Float32);
+		// Stores z slices [z0, z0 + nSlices) given densely as
+		// data[((z - z0) * ny + y) * nx + x]. _z0_ must be a multiple of
+		// brickSize and _nSlices_ brickSize, except for the last layer.
+		void AddSlices(int z0, int nSlices, const float *data);
+		// Fills the whole grid from a dense array
+		void AddDense(const float *data);
+
+		// Voxel value; zero outside the grid
+		float Lookup(int x, int y, int z) const
+		{
+			if (x < 0 || y < 0 || z < 0 || x >= nx || y >= ny || z >= nz)
+				return 0;
+			int brick = brickIndex[BrickOffset(x >> brickLog2, y >> brickLog2, z >> brickLog2)];
+			if (brick < 0)
+				return 0;
+			return Decode(brick, VoxelOffset(x & (brickSize - 1), y & (brickSize - 1),
+											 z & (brickSize - 1)));
+		}
+		// Trilinear interpolation between voxel _p_ and _p_ + (1, 1, 1)
+		float Trilinear(const Point3i &p, const Vector3f &d) const;
+		// Largest voxel value in [pMin, pMax] (inclusive); empty bricks are
+		// skipped and bricks fully inside use their stored maximum
+		float MaxValue(const Point3i &pMin, const Point3i &pMax) const;
+
+		int Resolution(int axis) const { return axis == 0 ? nx : (axis == 1 ? ny : nz); }
+		int BrickCount() const { return (int)brickIndex.size(); }
+		int OccupiedBricks() const { return (int)brickMax.size(); }
+		size_t MemoryBytes() const;
+
+	private:
+		// BrickedVolume Private Methods
+		int BrickOffset(int bx, int by, int bz) const
+		{
+			return (bz * bricksY + by) * bricksX + bx;
+		}
+		static int VoxelOffset(int x, int y, int z)
+		{
+			return (z * brickSize + y) * brickSize + x;
+		}
+		float Decode(int brick, int voxel) const
+		{
+			int chunk = brick >> chunkLog2;
+			int i = (brick & (chunkBricks - 1)) * brickVoxels + voxel;
+			switch (precision)
+			{
+			case VolumePrecision::Unorm16:
+				return unorm16[chunk][i] * brickMax[brick] * (1.f / 65535.f);
+			case VolumePrecision::Unorm8:
+				return unorm8[chunk][i] * brickMax[brick] * (1.f / 255.f);
+			default:
+				return float32[chunk][i];
+			}
+		}
+
+		// BrickedVolume Private Data
+		const int nx, ny, nz;
+		const int bricksX, bricksY, bricksZ;
+		const VolumePrecision precision;
+		std::vector<int> brickIndex;
+		// Per occupied brick: largest voxel value, also the quantization scale
+		std::vector<float> brickMax;
+		// Brick pool chunks; only those matching _precision_ are used
+		std::vector<std::unique_ptr<float[]>> float32;
+		std::vector<std::unique_ptr<uint16_t[]>> unorm16;
+		std::vector<std::unique_ptr<uint8_t[]>> unorm8;
+	};
+
+}
+
+#endif
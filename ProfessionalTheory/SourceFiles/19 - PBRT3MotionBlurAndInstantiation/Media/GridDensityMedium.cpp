@@ -1,9 +1,19 @@
 #include "Media/GridDensityMedium.h"
 #include "Sampler/Sampler.h"
 #include "Core/interaction.h"
+#include <atomic>
 
 namespace Feimos
 {
+	// Shared by every render thread; each tracked ray adds its lookups once
+	static std::atomic<long long> nTrackedRays(0);
+	static std::atomic<long long> nDensityLookups(0);
+
+	static inline void CountTrackedRay(int densityLookups)
+	{
+		nTrackedRays.fetch_add(1, std::memory_order_relaxed);
+		nDensityLookups.fetch_add(densityLookups, std::memory_order_relaxed);
+	}
 
 	// GridDensityMedium Method Definitions
 	float GridDensityMedium::Density(const Point3f &p) const
@@ -14,16 +24,46 @@ namespace Feimos
 		Vector3f d = pSamples - (Point3f)pi;
 
 		// Trilinearly interpolate density values to compute local density
-		float d00 = Lerp(d.x, D(pi), D(pi + Vector3i(1, 0, 0)));
-		float d10 = Lerp(d.x, D(pi + Vector3i(0, 1, 0)), D(pi + Vector3i(1, 1, 0)));
-		float d01 = Lerp(d.x, D(pi + Vector3i(0, 0, 1)), D(pi + Vector3i(1, 0, 1)));
-		float d11 = Lerp(d.x, D(pi + Vector3i(0, 1, 1)), D(pi + Vector3i(1, 1, 1)));
-		float d0 = Lerp(d.y, d00, d10);
-		float d1 = Lerp(d.y, d01, d11);
-		return Lerp(d.z, d0, d1);
+		return density->Trilinear(pi, d);
+	}
+
+	void GridDensityMedium::BuildMajorantGrid()
+	{
+		MajorantGrid &grid = majorantGrid;
+		int n[3] = {nx, ny, nz};
+		for (int a = 0; a < 3; ++a)
+			grid.res[a] = std::max(1, std::min(n[a], MajorantGrid::maxResolution));
+		grid.voxels.resize(grid.res[0] * grid.res[1] * grid.res[2]);
+
+		// A cell bounds every trilinear lookup inside it: _Density()_ at $p$
+		// reads voxels $\lfloor p n - 1/2 \rfloor$ and the next one. One more
+		// voxel on each side absorbs DDA rounding at cell faces.
+#pragma omp parallel for
+		for (int z = 0; z < grid.res[2]; ++z)
+			for (int y = 0; y < grid.res[1]; ++y)
+				for (int x = 0; x < grid.res[0]; ++x)
+				{
+					int cell[3] = {x, y, z};
+					Point3i lo, hi;
+					for (int a = 0; a < 3; ++a)
+					{
+						float c0 = (float)cell[a] / grid.res[a];
+						float c1 = (float)(cell[a] + 1) / grid.res[a];
+						lo[a] = std::max(0, (int)std::floor(c0 * n[a] - .5f) - 1);
+						hi[a] = std::min(n[a] - 1, (int)std::floor(c1 * n[a] - .5f) + 2);
+					}
+					grid.voxels[(z * grid.res[1] + y) * grid.res[0] + x] = density->MaxValue(lo, hi);
+				}
 	}
 
-	Spectrum GridDensityMedium::Sample(const Ray &rWorld, Sampler &sampler, MediumInteraction *mi) const
+	void GridDensityMedium::TrackingStats(long long *rays, long long *densityLookups)
+	{
+		*rays = nTrackedRays.load(std::memory_order_relaxed);
+		*densityLookups = nDensityLookups.load(std::memory_order_relaxed);
+	}
+
+	Spectrum GridDensityMedium::Sample(const Ray &rWorld, Sampler &sampler, MediumInteraction *mi,
+									   const Spectrum &beta) const
 	{
 		Ray ray = WorldToMedium(
 			Ray(rWorld.o, Normalize(rWorld.d), rWorld.tMax * rWorld.d.Length()));
@@ -33,22 +73,35 @@ namespace Feimos
 		if (!b.IntersectP(ray, &tMin, &tMax))
 			return Spectrum(1.f);
 
-		// Run delta-tracking iterations to sample a medium interaction
-		float t = tMin;
-		while (true)
+		// Run delta-tracking iterations to sample a medium interaction, with
+		// the majorant of each grid cell along the ray; empty cells are
+		// skipped without any lookup
+		int lookups = 0;
+		MajorantIterator iter(ray, tMin, tMax, &majorantGrid);
+		float t0, t1, majorant;
+		while (iter.Next(&t0, &t1, &majorant))
 		{
-			t -= std::log(1 - sampler.Get1D()) * invMaxDensity / sigma_t;
-			if (t >= tMax)
-				break;
-			if (Density(ray(t)) * invMaxDensity > sampler.Get1D())
+			if (majorant == 0)
+				continue;
+			float invMajorant = 1 / majorant;
+			float t = t0;
+			while (true)
 			{
-				// Populate _mi_ with medium interaction information and return
-				PhaseFunction *phase = new HenyeyGreenstein(g);
-				*mi = MediumInteraction(rWorld(t), -rWorld.d, rWorld.time, this,
-										phase);
-				return sigma_s / sigma_t;
+				t -= std::log(1 - sampler.Get1D()) * invMajorant / sigma_t;
+				if (t >= t1)
+					break;
+				++lookups;
+				if (Density(ray(t)) * invMajorant > sampler.Get1D())
+				{
+					// Populate _mi_ with medium interaction information and return
+					*mi = MediumInteraction(rWorld(t), -rWorld.d, rWorld.time, this,
+											HenyeyGreenstein(g));
+					CountTrackedRay(lookups);
+					return sigma_s / sigma_t;
+				}
 			}
 		}
+		CountTrackedRay(lookups);
 		return Spectrum(1.f);
 	}
 
@@ -62,28 +115,99 @@ namespace Feimos
 		if (!b.IntersectP(ray, &tMin, &tMax))
 			return Spectrum(1.f);
 
-		// Perform ratio tracking to estimate the transmittance value
-		float Tr = 1, t = tMin;
-
-		while (true)
+		// Perform ratio tracking to estimate the transmittance value, cell by
+		// cell along the majorant grid
+		float Tr = 1;
+		int lookups = 0;
+		MajorantIterator iter(ray, tMin, tMax, &majorantGrid);
+		float t0, t1, majorant;
+		while (iter.Next(&t0, &t1, &majorant))
 		{
-			t -= std::log(1 - sampler.Get1D()) * invMaxDensity / sigma_t;
-			if (t >= tMax)
-				break;
-			float density = Density(ray(t));
-			Tr *= 1 - std::max((float)0, density * invMaxDensity);
-			// Added after book publication: when transmittance gets low,
-			// start applying Russian roulette to terminate sampling.
-			const float rrThreshold = .1;
-			if (Tr < rrThreshold)
+			if (majorant == 0)
+				continue;
+			float invMajorant = 1 / majorant;
+			float t = t0;
+			while (true)
 			{
-				float q = std::max((float).05, 1 - Tr);
-				if (sampler.Get1D() < q)
-					return 0;
-				Tr /= 1 - q;
+				t -= std::log(1 - sampler.Get1D()) * invMajorant / sigma_t;
+				if (t >= t1)
+					break;
+				++lookups;
+				float density = Density(ray(t));
+				Tr *= 1 - std::max((float)0, density * invMajorant);
+				// Added after book publication: when transmittance gets low,
+				// start applying Russian roulette to terminate sampling.
+				const float rrThreshold = .1;
+				if (Tr < rrThreshold)
+				{
+					float q = std::max((float).05, 1 - Tr);
+					if (sampler.Get1D() < q)
+					{
+						CountTrackedRay(lookups);
+						return 0;
+					}
+					Tr /= 1 - q;
+				}
 			}
 		}
+		CountTrackedRay(lookups);
 		return Spectrum(Tr);
 	}
 
+	// MajorantIterator Method Definitions
+	MajorantIterator::MajorantIterator(const Ray &ray, float tMin, float tMax,
+									   const MajorantGrid *grid)
+		: grid(grid), tMin(tMin), tMax(tMax)
+	{
+		// Set up 3D DDA from the point where the ray enters the medium
+		Point3f pGrid = ray(tMin);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			int res = grid->res[axis];
+			voxel[axis] = Clamp((int)(pGrid[axis] * res), 0, res - 1);
+			// Turn $-0$ into $+0$ so that the direction test below holds
+			float d = ray.d[axis] == 0 ? 0 : ray.d[axis];
+			deltaT[axis] = 1 / (std::abs(d) * res);
+			if (d >= 0)
+			{
+				float nextVoxelPos = (float)(voxel[axis] + 1) / res;
+				nextCrossingT[axis] = d == 0 ? Infinity : tMin + (nextVoxelPos - pGrid[axis]) / d;
+				step[axis] = 1;
+				voxelLimit[axis] = res;
+			}
+			else
+			{
+				float nextVoxelPos = (float)voxel[axis] / res;
+				nextCrossingT[axis] = tMin + (nextVoxelPos - pGrid[axis]) / d;
+				step[axis] = -1;
+				voxelLimit[axis] = -1;
+			}
+		}
+	}
+
+	bool MajorantIterator::Next(float *t0, float *t1, float *majorant)
+	{
+		if (tMin >= tMax)
+			return false;
+		// Find _stepAxis_ for stepping to next voxel and exit point _tVoxelExit_
+		int stepAxis = nextCrossingT[0] < nextCrossingT[1] ? 0 : 1;
+		if (nextCrossingT[2] < nextCrossingT[stepAxis])
+			stepAxis = 2;
+		float tVoxelExit = std::min(tMax, nextCrossingT[stepAxis]);
+
+		*t0 = tMin;
+		*t1 = tVoxelExit;
+		*majorant = grid->Lookup(voxel[0], voxel[1], voxel[2]);
+
+		// Advance to next voxel, or stop once the ray leaves the grid
+		tMin = tVoxelExit;
+		if (nextCrossingT[stepAxis] > tMax)
+			tMin = tMax;
+		voxel[stepAxis] += step[stepAxis];
+		if (voxel[stepAxis] == voxelLimit[stepAxis])
+			tMin = tMax;
+		nextCrossingT[stepAxis] += deltaT[stepAxis];
+		return true;
+	}
+
 }
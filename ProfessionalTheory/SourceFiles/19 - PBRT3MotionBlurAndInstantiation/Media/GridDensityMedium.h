@@ -3,14 +3,48 @@
 #include "Core/FeimosRender.h"
 #include "Core/Transform.h"
 #include "Core/Spectrum.h"
+#include "Core/TextAsset.h"
+#include "Media/BrickedVolume.h"
 
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <vector>
 
 namespace Feimos
 {
 
+	// MajorantGrid Declarations
+	// Coarse grid over the $[0,1]^3$ medium space; each cell stores an upper
+	// bound of the density anywhere inside it
+	struct MajorantGrid
+	{
+		static constexpr int maxResolution = 16;
+		float Lookup(int x, int y, int z) const
+		{
+			return voxels[(z * res[1] + y) * res[0] + x];
+		}
+		int res[3] = {0, 0, 0};
+		std::vector<float> voxels;
+	};
+
+	// MajorantIterator Declarations
+	// 3D DDA over the cells of a MajorantGrid crossed by a medium-space ray;
+	// yields the segments of $[\tmin, \tmax]$ in order with their majorant
+	class MajorantIterator
+	{
+	public:
+		MajorantIterator(const Ray &ray, float tMin, float tMax,
+						 const MajorantGrid *grid);
+		bool Next(float *t0, float *t1, float *majorant);
+
+	private:
+		const MajorantGrid *grid;
+		float tMin, tMax;
+		float nextCrossingT[3], deltaT[3];
+		int step[3], voxelLimit[3], voxel[3];
+	};
+
 	// GridDensityMedium Declarations
 	class GridDensityMedium : public Medium
 	{
@@ -19,99 +53,115 @@ namespace Feimos
 		GridDensityMedium(const Spectrum &sigma_a, const Spectrum &sigma_s, float g,
 						  int nx, int ny, int nz, const Transform &mediumToWorld,
 						  const float *d)
+			: GridDensityMedium(sigma_a, sigma_s, g, mediumToWorld,
+								DenseVolume(nx, ny, nz, d)) {}
+		// Takes a volume filled by the caller, e.g. slice by slice from disk
+		GridDensityMedium(const Spectrum &sigma_a, const Spectrum &sigma_s, float g,
+						  const Transform &mediumToWorld,
+						  std::unique_ptr<BrickedVolume> volume)
 			: sigma_a(sigma_a),
 			  sigma_s(sigma_s),
 			  g(g),
-			  nx(nx),
-			  ny(ny),
-			  nz(nz),
+			  nx(volume->Resolution(0)),
+			  ny(volume->Resolution(1)),
+			  nz(volume->Resolution(2)),
 			  WorldToMedium(Inverse(mediumToWorld)),
-			  density(new float[nx * ny * nz])
+			  density(std::move(volume))
 		{
-			memcpy((float *)density.get(), d, sizeof(float) * nx * ny * nz);
 			// Precompute values for Monte Carlo sampling of _GridDensityMedium_
 			sigma_t = (sigma_a + sigma_s)[0];
 			if (Spectrum(sigma_t) != sigma_a + sigma_s)
 			{
 				// 
 			}
-			float maxDensity = 0;
-			for (int i = 0; i < nx * ny * nz; ++i)
-				maxDensity = std::max(maxDensity, density[i]);
-			invMaxDensity = 1.f / maxDensity;
+			BuildMajorantGrid();
 		}
 
 		float Density(const Point3f &p) const;
-		float D(const Point3i &p) const
-		{
-			Bounds3i sampleBounds(Point3i(0, 0, 0), Point3i(nx, ny, nz));
-			if (!InsideExclusive(p, sampleBounds))
-				return 0;
-			return density[(p.z * ny + p.y) * nx + p.x];
-		}
-		Spectrum Sample(const Ray &ray, Sampler &sampler, MediumInteraction *mi) const;
+		float D(const Point3i &p) const { return density->Lookup(p.x, p.y, p.z); }
+		const BrickedVolume &Volume() const { return *density; }
+		Spectrum Sample(const Ray &ray, Sampler &sampler, MediumInteraction *mi,
+						const Spectrum &beta) const;
 		Spectrum Tr(const Ray &ray, Sampler &sampler) const;
+		const MajorantGrid &Majorants() const { return majorantGrid; }
+		// Rays tracked and density lookups made by all grid media so far
+		static void TrackingStats(long long *rays, long long *densityLookups);
 
 	private:
+		// GridDensityMedium Private Methods
+		static std::unique_ptr<BrickedVolume> DenseVolume(int nx, int ny, int nz,
+														  const float *d)
+		{
+			std::unique_ptr<BrickedVolume> volume(new BrickedVolume(nx, ny, nz));
+			volume->AddDense(d);
+			return volume;
+		}
+		void BuildMajorantGrid();
+
 		// GridDensityMedium Private Data
 		const Spectrum sigma_a, sigma_s;
 		const float g;
 		const int nx, ny, nz;
 		const Transform WorldToMedium;
-		std::unique_ptr<float[]> density;
+		std::unique_ptr<BrickedVolume> density;
 		float sigma_t;
-		float invMaxDensity;
+		MajorantGrid majorantGrid;
 	};
 
 	class MediumLoad
 	{
 	public:
-		MediumLoad(std::string name, const Transform &medium2world)
+		MediumLoad(std::string name, const Transform &medium2world,
+				   VolumePrecision precision = VolumePrecision::Float32)
 		{
-			std::fstream f(name);
-			std::string ed;
-			f >> ed;
-			f >> nx;
-			f >> ed;
-			f >> ny;
-			f >> ed;
-			f >> nz;
+			TextAsset f(name);
+			nx = ny = nz = 0;
+			f.NextToken();
+			f.NextInt(&nx);
+			f.NextToken();
+			f.NextInt(&ny);
+			f.NextToken();
+			f.NextInt(&nz);
 			Point3f p0;
 			Point3f p1;
-			f >> ed;
-			f >> p0.x;
-			f >> p0.y;
-			f >> p0.z;
-			f >> ed;
-			f >> p1.x;
-			f >> p1.y;
-			f >> p1.z;
+			f.NextToken();
+			f.NextFloat(&p0.x);
+			f.NextFloat(&p0.y);
+			f.NextFloat(&p0.z);
+			f.NextToken();
+			f.NextFloat(&p1.x);
+			f.NextFloat(&p1.y);
+			f.NextFloat(&p1.z);
 
 			// Ԥ
 			float sig_a_rgb[3], sig_s_rgb[3];
-			f >> ed;
-			f >> sig_a_rgb[0];
-			f >> sig_a_rgb[1];
-			f >> sig_a_rgb[2];
-			f >> ed;
-			f >> sig_s_rgb[0];
-			f >> sig_s_rgb[1];
-			f >> sig_s_rgb[2];
+			f.NextToken();
+			f.NextFloat(&sig_a_rgb[0]);
+			f.NextFloat(&sig_a_rgb[1]);
+			f.NextFloat(&sig_a_rgb[2]);
+			f.NextToken();
+			f.NextFloat(&sig_s_rgb[0]);
+			f.NextFloat(&sig_s_rgb[1]);
+			f.NextFloat(&sig_s_rgb[2]);
 
 			Spectrum sig_a = Spectrum::FromRGB(sig_a_rgb), sig_s = 0.2 * Spectrum::FromRGB(sig_s_rgb);
 			float g = -0.5f;
 
-			float *data = new float[nx * ny * nz];
-			for (int i = 0; i < nx * ny * nz; i++)
+			// ܶϰзֿ߳̽ÿֻһש
+			// (8zƬ)ֱдϡשݣٱ
+			std::unique_ptr<BrickedVolume> volume(new BrickedVolume(nx, ny, nz, precision));
+			std::vector<float> slices((size_t)nx * ny * BrickedVolume::brickSize);
+			for (int z0 = 0; z0 < nz; z0 += BrickedVolume::brickSize)
 			{
-				f >> data[i];
+				int nSlices = std::min(BrickedVolume::brickSize, nz - z0);
+				f.ReadFloats(slices.data(), (size_t)nx * ny * nSlices);
+				volume->AddSlices(z0, nSlices, slices.data());
 			}
 			Transform data2Medium = Translate(Vector3f(p0)) *
 									Scale(p1.x - p0.x, p1.y - p0.y, p1.z - p0.z);
-			med = std::make_shared<GridDensityMedium>(sig_a, sig_s, g, nx, ny, nz,
-													  medium2world * data2Medium, data);
-			f.close();
-			delete[] data;
+			med = std::make_shared<GridDensityMedium>(sig_a, sig_s, g,
+													  medium2world * data2Medium, std::move(volume));
+			f.ReportLoad(name);
 		}
 		std::shared_ptr<Medium> med;
 		int nx, ny, nz;
@@ -8,33 +8,89 @@ namespace Feimos
 {
 
     // HomogeneousMedium Method Definitions
+    HomogeneousMedium::HomogeneousMedium(const Spectrum &sigma_a, const Spectrum &sigma_s, float g)
+        : sigma_a(sigma_a),
+          sigma_s(sigma_s),
+          sigma_t(sigma_s + sigma_a),
+          g(g)
+    {
+        grey = true;
+        for (int i = 0; i < Spectrum::nSamples; ++i)
+        {
+            invSigma_t[i] = sigma_t[i] > 0 ? 1 / sigma_t[i] : Infinity;
+            albedo[i] = sigma_t[i] > 0 ? sigma_s[i] / sigma_t[i] : 0;
+            if (sigma_t[i] != sigma_t[0])
+                grey = false;
+        }
+    }
+
     Spectrum HomogeneousMedium::Tr(const Ray &ray, Sampler &sampler) const
     {
-        return Exp(-sigma_t * std::min(ray.tMax * ray.d.Length(), MaxFloat));
+        float d = std::min(ray.tMax * ray.d.Length(), MaxFloat);
+        if (grey)
+            return Spectrum(std::exp(-sigma_t[0] * d));
+        return Exp(-sigma_t * d);
+    }
+
+    bool HomogeneousMedium::OpticalDepth(const Ray &ray, Spectrum *tau) const
+    {
+        *tau = sigma_t * std::min(ray.tMax * ray.d.Length(), MaxFloat);
+        return true;
     }
 
     Spectrum HomogeneousMedium::Sample(const Ray &ray, Sampler &sampler,
-                                       MediumInteraction *mi) const
+                                       MediumInteraction *mi, const Spectrum &beta) const
     {
-        // Sample a channel and distance along the ray
-        int channel = std::min((int)(sampler.Get1D() * Spectrum::nSamples),
-                               Spectrum::nSamples - 1);
-        float dist = -std::log(1 - sampler.Get1D()) / sigma_t[channel];
-        float t = std::min(dist / ray.d.Length(), ray.tMax);
+        float u = sampler.Get1D();
+        float dLength = ray.d.Length();
+
+        // Grey medium: the channel choice is irrelevant and transmittance
+        // cancels against the sampling density, leaving the albedo
+        if (grey)
+        {
+            float dist = -std::log(1 - sampler.Get1D()) * invSigma_t[0];
+            float t = std::min(dist / dLength, ray.tMax);
+            if (t < ray.tMax)
+            {
+                *mi = MediumInteraction(ray(t), -ray.d, ray.time, this,
+                                        HenyeyGreenstein(g));
+                return albedo;
+            }
+            return Spectrum(1.f);
+        }
+
+        // Pick the hero channel in proportion to the path throughput, so the
+        // channels that still carry energy drive distance sampling; with a
+        // white throughput this is the uniform choice of the book
+        float pChannel[Spectrum::nSamples];
+        float betaSum = 0;
+        for (int i = 0; i < Spectrum::nSamples; ++i)
+            betaSum += std::max(beta[i], 0.f);
+        for (int i = 0; i < Spectrum::nSamples; ++i)
+            pChannel[i] = betaSum > 0 ? std::max(beta[i], 0.f) / betaSum
+                                      : 1 / (float)Spectrum::nSamples;
+        int channel = 0;
+        for (float cdf = pChannel[0]; channel < Spectrum::nSamples - 1 && u >= cdf;)
+            cdf += pChannel[++channel];
+
+        // Sample a distance along the ray with the hero channel
+        float dist = -std::log(1 - sampler.Get1D()) * invSigma_t[channel];
+        float t = std::min(dist / dLength, ray.tMax);
         bool sampledMedium = t < ray.tMax;
         if (sampledMedium)
             *mi = MediumInteraction(ray(t), -ray.d, ray.time, this,
-                                    new HenyeyGreenstein(g));
+                                    HenyeyGreenstein(g));
 
         // Compute the transmittance and sampling density
-        Spectrum Tr = Exp(-sigma_t * std::min(t, MaxFloat) * ray.d.Length());
+        Spectrum Tr = Exp(-sigma_t * std::min(t, MaxFloat) * dLength);
 
-        // Return weighting factor for scattering from homogeneous medium
+        // One-sample balance heuristic over the channels: the density is the
+        // mixture of the per-channel densities weighted by their selection
+        // probabilities
         Spectrum density = sampledMedium ? (sigma_t * Tr) : Tr;
         float pdf = 0;
         for (int i = 0; i < Spectrum::nSamples; ++i)
-            pdf += density[i];
-        pdf *= 1 / (float)Spectrum::nSamples;
+            pdf += pChannel[i] * density[i];
         if (pdf == 0)
         {
             // CHECK(Tr.IsBlack());
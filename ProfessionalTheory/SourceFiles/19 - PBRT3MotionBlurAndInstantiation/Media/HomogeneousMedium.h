@@ -14,19 +14,21 @@ namespace Feimos
 	{
 	public:
 		// HomogeneousMedium Public Methods
-		HomogeneousMedium(const Spectrum &sigma_a, const Spectrum &sigma_s, float g)
-			: sigma_a(sigma_a),
-			  sigma_s(sigma_s),
-			  sigma_t(sigma_s + sigma_a),
-			  g(g) {}
+		HomogeneousMedium(const Spectrum &sigma_a, const Spectrum &sigma_s, float g);
 		Spectrum Tr(const Ray &ray, Sampler &sampler) const;
 		Spectrum Sample(const Ray &ray, Sampler &sampler,
-						MediumInteraction *mi) const;
+						MediumInteraction *mi, const Spectrum &beta) const;
+		bool OpticalDepth(const Ray &ray, Spectrum *tau) const;
 
 	private:
 		// HomogeneousMedium Private Data
 		const Spectrum sigma_a, sigma_s, sigma_t;
 		const float g;
+		// Per-channel 1/sigma_t for distance sampling; a grey medium has the
+		// same extinction in every channel and needs a single exp per query
+		float invSigma_t[Spectrum::nSamples];
+		Spectrum albedo;
+		bool grey;
 	};
 
 }
@@ -31,13 +31,13 @@ namespace Feimos
 	{
 	public:
 		// HenyeyGreenstein Public Methods
-		HenyeyGreenstein(float g) : g(g) {}
+		HenyeyGreenstein(float g = 0) : g(g) {}
 		float p(const Vector3f &wo, const Vector3f &wi) const;
 		float Sample_p(const Vector3f &wo, Vector3f *wi,
 					   const Point2f &sample) const;
 
 	private:
-		const float g;
+		float g;
 	};
 
 	// Medium Declarations
@@ -47,8 +47,15 @@ namespace Feimos
 		// Medium Interface
 		virtual ~Medium() {}
 		virtual Spectrum Tr(const Ray &ray, Sampler &sampler) const = 0;
+		// _beta_ is the throughput of the path so far; media with
+		// wavelength-dependent extinction use it to pick the channel that
+		// drives distance sampling
 		virtual Spectrum Sample(const Ray &ray, Sampler &sampler,
-								MediumInteraction *mi) const = 0;
+								MediumInteraction *mi,
+								const Spectrum &beta) const = 0;
+		// Closed-form optical depth along _ray_ up to _ray.tMax_; media that
+		// can't provide it return false and are handled through Tr()
+		virtual bool OpticalDepth(const Ray &ray, Spectrum *tau) const { return false; }
 	};
 
 	// MediumInterface Declarations
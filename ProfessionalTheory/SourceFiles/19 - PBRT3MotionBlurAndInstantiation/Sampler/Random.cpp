@@ -0,0 +1,71 @@
+#include "Sampler/Random.h"
+
+namespace Feimos
+{
+
+  // Random numbers reserved for one pixel sample
+  static const int64_t samplesPerStream = 65536;
+
+  // RandomSampler Method Definitions
+  RandomSampler::RandomSampler(int ns, int seed) : Sampler(ns), seed(seed), rng(seed) {}
+
+  void RandomSampler::StartStream(int64_t sampleNum)
+  {
+    rng.SetSequence(pixelStream);
+    rng.Advance(sampleNum * samplesPerStream);
+
+    // Array samples live in the slot of the current sample; the stream keeps
+    // running past samplesPerPixel for progressive rendering
+    for (size_t i = 0; i < sampleArray1D.size(); ++i)
+    {
+      int n = samples1DArraySizes[i];
+      for (int j = 0; j < n; ++j)
+        sampleArray1D[i][currentPixelSampleIndex * n + j] = rng.UniformFloat();
+    }
+    for (size_t i = 0; i < sampleArray2D.size(); ++i)
+    {
+      int n = samples2DArraySizes[i];
+      for (int j = 0; j < n; ++j)
+        sampleArray2D[i][currentPixelSampleIndex * n + j] = Point2f(rng.UniformFloat(), rng.UniformFloat());
+    }
+  }
+
+  void RandomSampler::StartPixel(const Point2i &p)
+  {
+    Sampler::StartPixel(p);
+    pixelStream = ((uint64_t)(uint32_t)seed << 48) ^ ((uint64_t)(uint32_t)p.y << 24) ^ (uint64_t)(uint32_t)p.x;
+    StartStream(0);
+  }
+
+  bool RandomSampler::StartNextSample()
+  {
+    int64_t sampleNum = currentPixelSampleIndex + 1;
+    bool more = Sampler::StartNextSample();
+    if (more)
+      StartStream(sampleNum);
+    return more;
+  }
+
+  bool RandomSampler::SetSampleNumber(int64_t sampleNum)
+  {
+    Sampler::SetSampleNumber(sampleNum % samplesPerPixel);
+    StartStream(sampleNum);
+    return true;
+  }
+
+  float RandomSampler::Get1D()
+  {
+    return rng.UniformFloat();
+  }
+
+  Point2f RandomSampler::Get2D()
+  {
+    return Point2f(rng.UniformFloat(), rng.UniformFloat());
+  }
+
+  std::unique_ptr<Sampler> RandomSampler::Clone(int seed)
+  {
+    return std::unique_ptr<Sampler>(new RandomSampler(*this));
+  }
+
+}
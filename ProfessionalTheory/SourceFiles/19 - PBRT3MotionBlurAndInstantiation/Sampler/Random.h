@@ -0,0 +1,40 @@
+#pragma once
+
+#ifndef __Random_h__
+#define __Random_h__
+
+#include "Core/FeimosRender.h"
+#include "Sampler/Sampler.h"
+#include "Sampler/RNG.h"
+
+namespace Feimos
+{
+
+  // RandomSampler Declarations
+  // Independent uniform samples from a PCG stream chosen by the pixel and
+  // advanced by the sample number, so every (pixel, sample) pair sees the same
+  // random numbers regardless of thread scheduling. This is what makes a
+  // progressive render resumable from a checkpoint.
+  class RandomSampler : public Sampler
+  {
+  public:
+    RandomSampler(int ns, int seed = 0);
+    void StartPixel(const Point2i &);
+    bool StartNextSample();
+    bool SetSampleNumber(int64_t sampleNum);
+    float Get1D();
+    Point2f Get2D();
+    std::unique_ptr<Sampler> Clone(int seed);
+    int Seed() const { return seed; }
+
+  private:
+    void StartStream(int64_t sampleNum);
+
+    const int seed;
+    uint64_t pixelStream = 0;
+    RNG rng;
+  };
+
+}
+
+#endif
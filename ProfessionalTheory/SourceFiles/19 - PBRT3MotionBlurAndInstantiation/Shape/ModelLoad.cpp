@@ -2,6 +2,7 @@
 #include "Core/Geometry.h"
 #include "Core/Transform.h"
 #include "Core/Primitive.h"
+#include "Accelerator/TriangleMeshPrimitive.h"
 #include "Texture/ConstantTexture.h"
 #include "Material/MatteMaterial.h"
 #include "Material/PlasticMaterial.h"
@@ -158,19 +159,9 @@ namespace Feimos
 										std::vector<std::shared_ptr<Primitive>> &prims, std::shared_ptr<Material> material)
 	{
 
-		std::vector<std::shared_ptr<Shape>> trisObj;
-		Transform tri_World2Object = Inverse(tri_Object2World);
-		for (int i = 0; i < meshes.size(); i++)
-		{
-			for (int j = 0; j < meshes[i]->nTriangles; ++j)
-			{
-				std::shared_ptr<TriangleMesh> meshPtr = meshes[i];
-				trisObj.push_back(std::make_shared<Triangle>(&tri_Object2World, &tri_World2Object, false, meshPtr, j));
-			}
-		}
 		// 䵽Ԫ
-		for (int i = 0; i < trisObj.size(); ++i)
-			prims.push_back(std::make_shared<GeometricPrimitive>(trisObj[i], material, nullptr, mediumInterface));
+		for (int i = 0; i < meshes.size(); i++)
+			prims.push_back(std::make_shared<TriangleMeshPrimitive>(meshes[i], material, mediumInterface, tri_Object2World));
 
 		meshes.clear();
 		diffTexName.clear();
@@ -181,8 +172,6 @@ namespace Feimos
 	void ModelLoad::buildTextureModel(Transform &tri_Object2World, const MediumInterface &mediumInterface,
 									  std::vector<std::shared_ptr<Primitive>> &prims)
 	{
-		std::vector<std::shared_ptr<Shape>> trisObj;
-		Transform tri_World2Object = Inverse(tri_Object2World);
 		for (int i = 0; i < meshes.size(); i++)
 		{
 			std::string diffFilename = directory + "/" + diffTexName[i];
@@ -191,26 +180,9 @@ namespace Feimos
 			std::shared_ptr<Material> MetalMaterial = getPlasticMaterial(diffFilename, specFilename);
 
 			if (mediumInterface.inside == nullptr && mediumInterface.outside == nullptr)
-			{
-				for (int j = 0; j < meshes[i]->nTriangles; ++j)
-				{
-					std::shared_ptr<TriangleMesh> meshPtr = meshes[i];
-					prims.push_back(std::make_shared<GeometricPrimitive>(
-						std::make_shared<Triangle>(&tri_Object2World, &tri_World2Object, false, meshPtr, j),
-						MetalMaterial, nullptr, mediumInterface));
-				}
-			}
+				prims.push_back(std::make_shared<TriangleMeshPrimitive>(meshes[i], MetalMaterial, mediumInterface, tri_Object2World));
 			else
-			{
-				for (int j = 0; j < meshes[i]->nTriangles; ++j)
-				{
-					std::shared_ptr<TriangleMesh> meshPtr = meshes[i];
-
-					prims.push_back(std::make_shared<GeometricPrimitive>(
-						std::make_shared<Triangle>(&tri_Object2World, &tri_World2Object, false, meshPtr, j),
-						nullptr, nullptr, mediumInterface));
-				}
-			}
+				prims.push_back(std::make_shared<TriangleMeshPrimitive>(meshes[i], nullptr, mediumInterface, tri_Object2World));
 		}
 		meshes.clear();
 		diffTexName.clear();
@@ -5,6 +5,7 @@
 #include "Shape/RattlerLoad.h"
 #include "Shape/Triangle.h"
 #include "Shape/plyRead.h"
+#include "Accelerator/TriangleMeshPrimitive.h"
 
 #include "Material/MaterialSet.h"
 
@@ -57,22 +58,12 @@ namespace Feimos
 			// ǽ
 			Feimos::Point3f(length_Wall, 0.f, 0.f), Feimos::Point3f(length_Wall, length_Wall, length_Wall), Feimos::Point3f(length_Wall, 0.f, length_Wall),
 			Feimos::Point3f(length_Wall, 0.f, 0.f), Feimos::Point3f(length_Wall, length_Wall, 0.f), Feimos::Point3f(length_Wall, length_Wall, length_Wall)};
-		Feimos::Transform tri_World2ConBox = Feimos::Inverse(tri_ConBox2World);
 		std::shared_ptr<Feimos::TriangleMesh> meshConBox = std::make_shared<Feimos::TriangleMesh>(tri_ConBox2World, nTrianglesWall, vertexIndicesWall, nVerticesWall, P_Wall, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
-		std::vector<std::shared_ptr<Feimos::Shape>> trisConBox;
-		for (int i = 0; i < nTrianglesWall; ++i)
-			trisConBox.push_back(std::make_shared<Feimos::Triangle>(&tri_ConBox2World, &tri_World2ConBox, false, meshConBox, i));
 
-		// 䵽Ԫ
-		for (int i = 0; i < nTrianglesWall; ++i)
-		{
-			if (i == 6 || i == 7)
-				prims.push_back(std::make_shared<Feimos::GeometricPrimitive>(trisConBox[i], redWallMaterial, nullptr, mediumInterface));
-			else if (i == 8 || i == 9)
-				prims.push_back(std::make_shared<Feimos::GeometricPrimitive>(trisConBox[i], blueWallMaterial, nullptr, mediumInterface));
-			else
-				prims.push_back(std::make_shared<Feimos::GeometricPrimitive>(trisConBox[i], whiteWallMaterial, nullptr, mediumInterface));
-		}
+		// 䵽ԪÿֲһԪ
+		prims.push_back(std::make_shared<Feimos::TriangleMeshPrimitive>(meshConBox, std::vector<int>{0, 1, 2, 3, 4, 5}, whiteWallMaterial, mediumInterface, tri_ConBox2World));
+		prims.push_back(std::make_shared<Feimos::TriangleMeshPrimitive>(meshConBox, std::vector<int>{6, 7}, redWallMaterial, mediumInterface, tri_ConBox2World));
+		prims.push_back(std::make_shared<Feimos::TriangleMeshPrimitive>(meshConBox, std::vector<int>{8, 9}, blueWallMaterial, mediumInterface, tri_ConBox2World));
 	}
 
 	inline void getDiffuseFloor(const Transform &tri_Floor2World, const float length_Wall, std::shared_ptr<Feimos::Material> material, std::vector<std::shared_ptr<Feimos::Primitive>> &prims, const MediumInterface &mediumInterface)
@@ -95,60 +86,30 @@ namespace Feimos
 		Feimos::Point2f UV[nVerticesWall] = {
 			Feimos::Point2f(0.f, 1.f), Feimos::Point2f(1.f, 1.f), Feimos::Point2f(0.f, 0.f),
 			Feimos::Point2f(1.f, 1.f), Feimos::Point2f(1.f, 0.f), Feimos::Point2f(0.f, 0.f)};
-		Feimos::Transform tri_World2Floor = Feimos::Inverse(tri_Floor2World);
 		std::shared_ptr<Feimos::TriangleMesh> meshFloor = std::make_shared<Feimos::TriangleMesh>(tri_Floor2World, nTrianglesWall, vertexIndicesWall, nVerticesWall, P_Wall, nullptr, nullptr, UV, nullptr, nullptr, nullptr);
-		std::vector<std::shared_ptr<Feimos::Shape>> trisFloor;
-		for (int i = 0; i < nTrianglesWall; ++i)
-			trisFloor.push_back(std::make_shared<Feimos::Triangle>(&tri_Floor2World, &tri_World2Floor, false, meshFloor, i));
 
 		// 䵽Ԫ
-		for (int i = 0; i < nTrianglesWall; ++i)
-		{
-			prims.push_back(std::make_shared<Feimos::GeometricPrimitive>(trisFloor[i], material, nullptr, mediumInterface));
-		}
+		prims.push_back(std::make_shared<Feimos::TriangleMeshPrimitive>(meshFloor, material, mediumInterface, tri_Floor2World));
 	}
 
 	inline void getDragon(Transform tri_Object2World, std::shared_ptr<Feimos::Material> material, std::vector<std::shared_ptr<Feimos::Primitive>> &prims, const MediumInterface &mediumInterface)
 	{
-		std::shared_ptr<Feimos::TriangleMesh> mesh;
-		std::vector<std::shared_ptr<Feimos::Shape>> tris;
-
-		Feimos::Transform tri_World2Object = Inverse(tri_Object2World);
-
 		Feimos::plyInfo plyi("../../Resources/dragon.3d");
-		mesh = std::make_shared<Feimos::TriangleMesh>(tri_Object2World, plyi.nTriangles, plyi.vertexIndices, plyi.nVertices, plyi.vertexArray, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
-		tris.reserve(plyi.nTriangles);
-
-		for (int i = 0; i < plyi.nTriangles; ++i)
-			tris.push_back(std::make_shared<Feimos::Triangle>(&tri_Object2World, &tri_World2Object, false, mesh, i));
-
-		for (int i = 0; i < plyi.nTriangles; ++i)
-			prims.push_back(std::make_shared<Feimos::GeometricPrimitive>(tris[i], material, nullptr, mediumInterface));
+		std::shared_ptr<Feimos::TriangleMesh> mesh = std::make_shared<Feimos::TriangleMesh>(tri_Object2World, plyi.nTriangles, plyi.vertexIndices, plyi.nVertices, plyi.vertexArray, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
 		plyi.Release();
+
+		prims.push_back(std::make_shared<Feimos::TriangleMeshPrimitive>(mesh, material, mediumInterface, tri_Object2World));
 	}
 
 	inline void getMovingDragon(AnimatedTransform animatedTrans, Transform tri_Object2World, std::shared_ptr<Feimos::Material> material, std::vector<std::shared_ptr<Feimos::Primitive>> &prims, const MediumInterface &mediumInterface)
 	{
-		std::shared_ptr<Feimos::TriangleMesh> mesh;
-		std::vector<std::shared_ptr<Feimos::Shape>> tris;
-
-		Feimos::Transform tri_World2Object = Inverse(tri_Object2World);
-
 		Feimos::plyInfo plyi("../../Resources/dragon.3d");
-		mesh = std::make_shared<Feimos::TriangleMesh>(tri_Object2World, plyi.nTriangles, plyi.vertexIndices, plyi.nVertices, plyi.vertexArray, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
-		tris.reserve(plyi.nTriangles);
-
-		for (int i = 0; i < plyi.nTriangles; ++i)
-			tris.push_back(std::make_shared<Feimos::Triangle>(&tri_Object2World, &tri_World2Object, false, mesh, i));
-
-		for (int i = 0; i < plyi.nTriangles; ++i)
-		{
-			std::shared_ptr<Primitive> geoPrim = std::make_shared<Feimos::GeometricPrimitive>(tris[i], material, nullptr, mediumInterface);
-			std::shared_ptr<TransformedPrimitive> aniPrim = std::make_shared<TransformedPrimitive>(geoPrim, animatedTrans);
-			prims.push_back(aniPrim);
-		}
-
+		std::shared_ptr<Feimos::TriangleMesh> mesh = std::make_shared<Feimos::TriangleMesh>(tri_Object2World, plyi.nTriangles, plyi.vertexIndices, plyi.nVertices, plyi.vertexArray, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
 		plyi.Release();
+
+		// ֻһ˶任
+		std::shared_ptr<Primitive> meshPrim = std::make_shared<Feimos::TriangleMeshPrimitive>(mesh, material, mediumInterface, tri_Object2World);
+		prims.push_back(std::make_shared<TransformedPrimitive>(meshPrim, animatedTrans));
 	}
 
 	// ͶӦϵܴ
@@ -207,13 +168,7 @@ namespace Feimos
 
 		std::shared_ptr<Feimos::TriangleMesh> meshBox = std::make_shared<Feimos::TriangleMesh>(tri_Object2World, nTrianglesBox, vertexIndicesWall, nVerticesBox, P_box, nullptr, nullptr, UV_box, nullptr, nullptr, nullptr);
 
-		Feimos::Transform tri_World2Object = Inverse(tri_Object2World);
-		std::vector<std::shared_ptr<Feimos::Shape>> trisBox;
-		for (int i = 0; i < 12; ++i)
-			trisBox.push_back(std::make_shared<Feimos::Triangle>(&tri_Object2World, &tri_World2Object, false, meshBox, i));
-
-		for (int i = 0; i < trisBox.size(); ++i)
-			prims.push_back(std::make_shared<Feimos::GeometricPrimitive>(trisBox[i], mat, nullptr, mediumInterface));
+		prims.push_back(std::make_shared<Feimos::TriangleMeshPrimitive>(meshBox, mat, mediumInterface, tri_Object2World));
 	}
 
 	// ͶӦϵܴ
@@ -272,20 +227,8 @@ namespace Feimos
 
 		std::shared_ptr<Feimos::TriangleMesh> meshBox = std::make_shared<Feimos::TriangleMesh>(tri_Object2World, nTrianglesBox, vertexIndicesWall, nVerticesBox, P_box, nullptr, nullptr, UV_box, nullptr, nullptr, nullptr);
 
-		Feimos::Transform tri_World2Object = Inverse(tri_Object2World);
-		std::vector<std::shared_ptr<Feimos::Shape>> trisBox;
-		for (int i = 0; i < 12; ++i)
-			trisBox.push_back(std::make_shared<Feimos::Triangle>(&tri_Object2World, &tri_World2Object, false, meshBox, i));
-
-		std::vector<std::shared_ptr<Feimos::Primitive>> primsObj;
-		for (int i = 0; i < trisBox.size(); ++i)
-		{
-			std::shared_ptr<Primitive> geoPrim = std::make_shared<Feimos::GeometricPrimitive>(trisBox[i], mat, nullptr, mediumInterface);
-			std::shared_ptr<TransformedPrimitive> aniPrim = std::make_shared<TransformedPrimitive>(geoPrim, animatedTrans);
-			primsObj.push_back(aniPrim);
-		}
-		std::shared_ptr<Feimos::Aggregate> aggregate = std::make_unique<Feimos::BVHAccel>(primsObj, 1);
-		prims.push_back(aggregate);
+		std::shared_ptr<Primitive> meshPrim = std::make_shared<Feimos::TriangleMeshPrimitive>(meshBox, mat, mediumInterface, tri_Object2World);
+		prims.push_back(std::make_shared<TransformedPrimitive>(meshPrim, animatedTrans));
 	}
 
 	// ͶӦϵܴ
@@ -343,13 +286,7 @@ namespace Feimos
 
 		std::shared_ptr<Feimos::TriangleMesh> meshBox = std::make_shared<Feimos::TriangleMesh>(tri_Object2World, nTrianglesBox, vertexIndicesWall, nVerticesBox, P_box, nullptr, nullptr, UV_box, nullptr, nullptr, nullptr);
 
-		Feimos::Transform tri_World2Object = Inverse(tri_Object2World);
-		std::vector<std::shared_ptr<Feimos::Shape>> trisBox;
-		for (int i = 0; i < 12; ++i)
-			trisBox.push_back(std::make_shared<Feimos::Triangle>(&tri_Object2World, &tri_World2Object, false, meshBox, i));
-
-		for (int i = 0; i < trisBox.size(); ++i)
-			prims.push_back(std::make_shared<Feimos::GeometricPrimitive>(trisBox[i], mat, nullptr, mediumInterface));
+		prims.push_back(std::make_shared<Feimos::TriangleMeshPrimitive>(meshBox, mat, mediumInterface, tri_Object2World));
 	}
 
 }
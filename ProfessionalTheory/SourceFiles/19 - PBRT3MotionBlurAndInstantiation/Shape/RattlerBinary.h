@@ -0,0 +1,47 @@
+#pragma once
+#ifndef __RattlerBinary_h__
+#define __RattlerBinary_h__
+
+#include <cstdint>
+
+namespace Feimos
+{
+
+	// .rattlerbin mesh layout, shared by the Rattler converter and RattlerLoad.
+	// A fixed-size little-endian header is followed by the data sections. Every
+	// section starts at a multiple of RattlerBinaryAlignment so it can be used
+	// in place from a memory mapping; an offset of 0 marks an absent section.
+	//   positions float[3] * nVertices
+	//   indices   int32[3] * nTriangles
+	//   normals   float[3] * nNormals  (nNormals is 0 or nVertices)
+	//   uvs       float[2] * nUVs      (nUVs is 0 or nVertices)
+	//   tangents  float[3] * nTangents (nTangents is 0 or nVertices)
+	// Texture references are file names relative to the model directory;
+	// "NoFile_Rattler" or an empty name means the mesh has no such texture.
+	constexpr char RattlerBinaryMagic[8] = {'R', 'A', 'T', 'R', 'B', 'I', 'N', '\0'};
+	constexpr uint32_t RattlerBinaryVersion = 1;
+	constexpr uint64_t RattlerBinaryAlignment = 16;
+	constexpr int RattlerBinaryNameLength = 128;
+
+	struct RattlerBinaryHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t headerSize;
+		uint32_t nVertices, nTriangles;
+		uint32_t nNormals, nUVs, nTangents;
+		uint32_t flags;
+		float minPos[3], maxPos[3];
+		uint64_t positionOffset, indexOffset, normalOffset, uvOffset, tangentOffset;
+		uint64_t fileSize;
+		char diffuse[RattlerBinaryNameLength];
+		char specular[RattlerBinaryNameLength];
+		char alpha[RattlerBinaryNameLength];
+		char bump[RattlerBinaryNameLength];
+	};
+	static_assert(sizeof(RattlerBinaryHeader) % RattlerBinaryAlignment == 0,
+				  "the first section must follow the header without padding");
+
+}
+
+#endif
@@ -4,6 +4,14 @@
 #include "Texture/ConstantTexture.h"
 #include "Texture/ImageTexture.h"
 #include "Accelerator/BVHAccel.h"
+#include "Accelerator/TriangleMeshPrimitive.h"
+#include "Accelerator/InstanceAccel.h"
+#include "Core/MappedFile.h"
+#include "Shape/RattlerBinary.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
 
 namespace Feimos
 {
@@ -28,8 +36,9 @@ namespace Feimos
 		float maxAniso = 8.f;
 		float scale = 1.f;
 		bool gamma = false; // tgapngtrue;
+		// ͼBump()һβҼuvλƵ
 		std::shared_ptr<Texture<float>> bump = std::make_shared<ImageTexture<float, float>>(std::move(map), filename, trilerp,
-																							maxAniso, wrapMode, scale, gamma);
+																							maxAniso, wrapMode, scale, gamma, true);
 		return bump;
 	}
 
@@ -74,7 +83,179 @@ namespace Feimos
 		return std::make_shared<PlasticMaterial>(plasticKd, plasticKr, plasticRoughness, bumpMap, false);
 	}
 
-	RattlerLoad::RattlerLoad(std::string fileDir, const Transform &ObjectToWorld, std::vector<std::shared_ptr<Feimos::Primitive>> &prims, const MediumInterface &mediumInterface, std::vector<AnimatedTransform> instancingTransform, bool isInstancing, bool isTextureNeeded, std::shared_ptr<Feimos::Material> material)
+	// ƬļĶȡڲн׶ιͲٰ֮˳д
+	struct RattlerMeshData
+	{
+		std::shared_ptr<TriangleMesh> mesh;
+		std::string diffuseMap = "NoFile_Rattler", specularMap = "NoFile_Rattler", alphaMap = "NoFile_Rattler", bumpMap = "NoFile_Rattler";
+		int faceNum = 0;
+		bool readFlag = false;
+		MeshMemoryReport report;
+	};
+
+	static std::string getRattlerName(const char *name)
+	{
+		std::string str(name, strnlen(name, RattlerBinaryNameLength));
+		return str.empty() ? "NoFile_Rattler" : str;
+	}
+
+	// ȡƵ .rattlerbin ļʽ RattlerBinary.h
+	// ļڴӳ䣬ֱӳڴ棬ٿ
+	// 㡢Ҫ任ռ䣬ֱӴӳڴһα任ɣҪм
+	static bool loadRattlerBinary(const std::string &filePath, const Transform &ObjectToWorld, RattlerMeshData *data)
+	{
+		static_assert(sizeof(Point3f) == 3 * sizeof(float) && sizeof(Normal3f) == 3 * sizeof(float) &&
+						  sizeof(Vector3f) == 3 * sizeof(float) && sizeof(Point2f) == 2 * sizeof(float),
+					  ".rattlerbin sections are read in place as tightly packed floats");
+
+		std::shared_ptr<MappedFile> mapped = std::make_shared<MappedFile>(filePath);
+		if (!mapped->IsValid() || mapped->Size() < sizeof(RattlerBinaryHeader))
+			return false;
+		const RattlerBinaryHeader &header = *reinterpret_cast<const RattlerBinaryHeader *>(mapped->Data());
+		if (memcmp(header.magic, RattlerBinaryMagic, sizeof(header.magic)) != 0 ||
+			header.version != RattlerBinaryVersion || header.headerSize != sizeof(RattlerBinaryHeader) ||
+			header.fileSize > mapped->Size())
+			return false;
+		if (header.nVertices == 0 || header.nTriangles == 0 || header.nVertices > (uint32_t)std::numeric_limits<int>::max() ||
+			header.nTriangles > (uint32_t)std::numeric_limits<int>::max() / 3)
+			return false;
+
+		// ÿݶεĶͷΧƫΪ0ʾݲ
+		bool valid = true;
+		auto section = [&](uint64_t offset, uint32_t count, uint64_t elementSize) -> const char * {
+			if (offset == 0 || count == 0)
+				return nullptr;
+			if (offset % RattlerBinaryAlignment != 0 || offset > header.fileSize ||
+				count * elementSize > header.fileSize - offset)
+			{
+				valid = false;
+				return nullptr;
+			}
+			return mapped->Data() + offset;
+		};
+		const Point3f *P = reinterpret_cast<const Point3f *>(section(header.positionOffset, header.nVertices, sizeof(Point3f)));
+		const int *vertexIndices = reinterpret_cast<const int *>(section(header.indexOffset, 3 * header.nTriangles, sizeof(int)));
+		const Normal3f *N = reinterpret_cast<const Normal3f *>(section(header.normalOffset, header.nNormals, sizeof(Normal3f)));
+		const Point2f *UV = reinterpret_cast<const Point2f *>(section(header.uvOffset, header.nUVs, sizeof(Point2f)));
+		const Vector3f *S = reinterpret_cast<const Vector3f *>(section(header.tangentOffset, header.nTangents, sizeof(Vector3f)));
+		if (!valid || !P || !vertexIndices)
+			return false;
+		if ((N && header.nNormals != header.nVertices) || (UV && header.nUVs != header.nVertices) ||
+			(S && header.nTangents != header.nVertices))
+			return false;
+		for (uint32_t i = 0; i < 3 * header.nTriangles; i++)
+			if ((uint32_t)vertexIndices[i] >= header.nVertices)
+				return false;
+
+		data->diffuseMap = getRattlerName(header.diffuse);
+		data->specularMap = getRattlerName(header.specular);
+		data->alphaMap = getRattlerName(header.alpha);
+		data->bumpMap = getRattlerName(header.bump);
+		data->faceNum = (int)header.nTriangles;
+		// ӳ䣬ӳһ
+		data->mesh = std::make_shared<TriangleMesh>(ObjectToWorld, (int)header.nTriangles, vertexIndices, (int)header.nVertices,
+													P, S, N, UV, nullptr, nullptr, nullptr, mapped);
+		return true;
+	}
+
+	// ȡıʽ .ratr ļ
+	static bool loadRattlerText(const std::string &curFilePath, const Transform &ObjectToWorld, RattlerMeshData *data)
+	{
+		std::ifstream curFile(curFilePath);
+		if (!curFile)
+			return false;
+
+		int VertexNum = 0, FaceNum = 0, VertIndexNum = 0, NormNum = 0, UVNum = 0, TanNum = 0, BiTanNum = 0;
+		Point3f meshMinPos, meshMaxPos;
+
+		std::string cname;
+		while (curFile >> cname)
+		{
+			if (cname == "VertexNum")
+				curFile >> VertexNum;
+			else if (cname == "FaceNum")
+				curFile >> FaceNum;
+			else if (cname == "VertIndexNum")
+				curFile >> VertIndexNum;
+			else if (cname == "NormNum")
+				curFile >> NormNum;
+			else if (cname == "UVNum")
+				curFile >> UVNum;
+			else if (cname == "TanNum")
+				curFile >> TanNum;
+			else if (cname == "BiTanNum")
+				curFile >> BiTanNum;
+			else if (cname == "minPos")
+				curFile >> meshMinPos.x >> meshMinPos.y >> meshMinPos.z;
+			else if (cname == "maxPos")
+				curFile >> meshMaxPos.x >> meshMaxPos.y >> meshMaxPos.z;
+			else if (cname == "Diffuse")
+				curFile >> data->diffuseMap;
+			else if (cname == "Specular")
+				curFile >> data->specularMap;
+			else if (cname == "Alpha")
+				curFile >> data->alphaMap;
+			else if (cname == "Bump")
+				curFile >> data->bumpMap;
+			else if (cname == "data")
+				break;
+		}
+
+		bool readFlag = true;
+		if (VertexNum == 0 || VertIndexNum == 0)
+			readFlag = false;
+
+		Point3f *vertexArray = new Point3f[VertexNum];
+		int *vertexIndices = new int[FaceNum * 3];
+		Normal3f *NormArray = new Normal3f[NormNum];
+		Point2f *uvArray = new Point2f[UVNum];
+		Vector3f *TangArray;
+		if (TanNum == 0)
+			TangArray = nullptr;
+		else
+			TangArray = new Vector3f[TanNum];
+
+		int tVertexNum = 0, tFaceNum = 0, tNormNum = 0, tUVNum = 0, tTanNum = 0, tBiTanNum = 0;
+		while (curFile >> cname)
+		{
+			if (cname == "Vetx")
+				curFile >> vertexArray[tVertexNum].x >> vertexArray[tVertexNum].y >> vertexArray[tVertexNum++].z;
+			else if (cname == "FaceVetxIdx")
+			{
+				curFile >> vertexIndices[tFaceNum * 3 + 0] >> vertexIndices[tFaceNum * 3 + 1] >> vertexIndices[tFaceNum * 3 + 2];
+				tFaceNum++;
+			}
+			else if (cname == "Norm")
+				curFile >> NormArray[tNormNum].x >> NormArray[tNormNum].y >> NormArray[tNormNum++].z;
+			else if (cname == "UV")
+				curFile >> uvArray[tUVNum].x >> uvArray[tUVNum++].y;
+			else if (cname == "Tan")
+				curFile >> TangArray[tTanNum].x >> TangArray[tTanNum].y >> TangArray[tTanNum++].z;
+			else if (cname == "BiTan")
+			{
+				// PBRTҪ
+				tBiTanNum++;
+			}
+		}
+		if ((VertexNum != tVertexNum) || (FaceNum != tFaceNum))
+			readFlag = false;
+
+		curFile.close();
+
+		data->faceNum = tFaceNum;
+		if (readFlag)
+			data->mesh = std::make_shared<TriangleMesh>(ObjectToWorld, FaceNum, vertexIndices, VertexNum, vertexArray, TangArray,
+														NormNum ? NormArray : nullptr, UVNum ? uvArray : nullptr, nullptr, nullptr, nullptr);
+
+		delete[] vertexArray;
+		delete[] vertexIndices;
+		delete[] NormArray;
+		delete[] uvArray;
+		delete[] TangArray;
+		return readFlag;
+	}
+
+	RattlerLoad::RattlerLoad(std::string fileDir, const Transform &ObjectToWorld, std::vector<std::shared_ptr<Feimos::Primitive>> &prims, const MediumInterface &mediumInterface, std::vector<AnimatedTransform> instancingTransform, bool isInstancing, bool isTextureNeeded, std::shared_ptr<Feimos::Material> material, int meshCompression, InstanceAccel *instanceAccel)
 	{
 
 		modelReadFlag = true;
@@ -100,119 +281,65 @@ namespace Feimos
 				file >> name;
 				meshFiles.push_back(name);
 			}
+			else if (name == "MeshBinFile")
+			{
+				file >> name;
+				meshBinFiles.push_back(name);
+			}
 		}
 		file.close();
 
+		// жȡÿƬļݣʹöļȡʧʱ˻ıļ
+		int meshNum = (int)std::max(meshFiles.size(), meshBinFiles.size());
+		std::vector<RattlerMeshData> meshData(meshNum);
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int meshID = 0; meshID < meshNum; meshID++)
+		{
+			RattlerMeshData &data = meshData[meshID];
+			if (meshID < meshBinFiles.size() && loadRattlerBinary(fileDir + meshBinFiles[meshID], ObjectToWorld, &data))
+				data.readFlag = true;
+			else if (meshID < meshFiles.size())
+				data.readFlag = loadRattlerText(fileDir + meshFiles[meshID], ObjectToWorld, &data);
+			// ѹڴԪ֮ǰ
+			if (data.readFlag)
+				data.report = data.mesh->Compress(meshCompression);
+		}
+
 		// δÿƬ
 		std::vector<std::shared_ptr<Feimos::Primitive>> primsObj;
-		for (int meshID = 0; meshID < meshFiles.size(); meshID++)
+		for (int meshID = 0; meshID < meshNum; meshID++)
 		{
-
-			std::string curFilePath = fileDir + meshFiles[meshID];
-
-			std::ifstream curFile(curFilePath);
-			if (!curFile)
-			{
-				modelReadFlag = false;
-				continue;
-			}
-			int VertexNum = 0, FaceNum = 0, VertIndexNum = 0, NormNum = 0, UVNum = 0, TanNum = 0, BiTanNum = 0;
-			Point3f meshMinPos, meshMaxPos;
-
-			std::string diffuseMap = "NoFile_Rattler", specularMap = "NoFile_Rattler", alphaMap = "NoFile_Rattler", bumpMap = "NoFile_Rattler";
-
-			std::string cname;
-			while (curFile >> cname)
-			{
-				if (cname == "VertexNum")
-					curFile >> VertexNum;
-				else if (cname == "FaceNum")
-					curFile >> FaceNum;
-				else if (cname == "VertIndexNum")
-					curFile >> VertIndexNum;
-				else if (cname == "NormNum")
-					curFile >> NormNum;
-				else if (cname == "UVNum")
-					curFile >> UVNum;
-				else if (cname == "TanNum")
-					curFile >> TanNum;
-				else if (cname == "BiTanNum")
-					curFile >> BiTanNum;
-				else if (cname == "minPos")
-					curFile >> meshMinPos.x >> meshMinPos.y >> meshMinPos.z;
-				else if (cname == "maxPos")
-					curFile >> meshMaxPos.x >> meshMaxPos.y >> meshMaxPos.z;
-				else if (cname == "Diffuse")
-					curFile >> diffuseMap;
-				else if (cname == "Specular")
-					curFile >> specularMap;
-				else if (cname == "Alpha")
-					curFile >> alphaMap;
-				else if (cname == "Bump")
-					curFile >> bumpMap;
-				else if (cname == "data")
-					break;
-			}
-
-			if (VertexNum == 0 || VertIndexNum == 0)
+			RattlerMeshData &data = meshData[meshID];
+			if (!data.readFlag)
 				modelReadFlag = false;
-
-			Point3f *vertexArray = new Point3f[VertexNum];
-			int *vertexIndices = new int[FaceNum * 3];
-			Normal3f *NormArray = new Normal3f[NormNum];
-			Point2f *uvArray = new Point2f[UVNum];
-			Vector3f *TangArray;
-			if (TanNum == 0)
-				TangArray = nullptr;
 			else
-				TangArray = new Vector3f[TanNum];
-
-			int tVertexNum = 0, tFaceNum = 0, tNormNum = 0, tUVNum = 0, tTanNum = 0, tBiTanNum = 0;
-			while (curFile >> cname)
 			{
-				if (cname == "Vetx")
-					curFile >> vertexArray[tVertexNum].x >> vertexArray[tVertexNum].y >> vertexArray[tVertexNum++].z;
-				else if (cname == "FaceVetxIdx")
-				{
-					curFile >> vertexIndices[tFaceNum * 3 + 0] >> vertexIndices[tFaceNum * 3 + 1] >> vertexIndices[tFaceNum * 3 + 2];
-					tFaceNum++;
-				}
-				else if (cname == "Norm")
-					curFile >> NormArray[tNormNum].x >> NormArray[tNormNum].y >> NormArray[tNormNum++].z;
-				else if (cname == "UV")
-					curFile >> uvArray[tUVNum].x >> uvArray[tUVNum++].y;
-				else if (cname == "Tan")
-					curFile >> TangArray[tTanNum].x >> TangArray[tTanNum].y >> TangArray[tTanNum++].z;
-				else if (cname == "BiTan")
-				{
-					// PBRTҪ
-					tBiTanNum++;
-				}
+				meshReports.push_back(data.report);
+				meshBytes += data.report.bytes;
+				uncompressedMeshBytes += data.report.uncompressedBytes;
 			}
-			if ((VertexNum != tVertexNum) || (FaceNum != tFaceNum))
-				modelReadFlag = false;
-
-			curFile.close();
 
 			if (modelReadFlag)
 			{
 
-				Transform World2Object = Inverse(ObjectToWorld);
-
-				std::string diffFilename = modelDir + "/" + diffuseMap;
-				std::string specFilename = modelDir + "/" + specularMap;
-				std::string alphaFilename = modelDir + "/" + alphaMap;
-				std::string bumpFilename = modelDir + "/" + bumpMap;
+				std::string diffFilename = modelDir + "/" + data.diffuseMap;
+				std::string specFilename = modelDir + "/" + data.specularMap;
+				std::string alphaFilename = modelDir + "/" + data.alphaMap;
+				std::string bumpFilename = modelDir + "/" + data.bumpMap;
 
 				std::shared_ptr<Material> curMaterial;
-				std::shared_ptr<Texture<float>> alphaTexture;
 				std::shared_ptr<Texture<float>> bumpTexture;
 
-				if (alphaMap != "NoFile_Rattler")
+				if (data.alphaMap != "NoFile_Rattler")
 				{
-					alphaTexture = getAlphaMaskTexture(alphaFilename);
+					data.mesh->alphaMask = getAlphaMaskTexture(alphaFilename);
+					// ͸η࣬ȫ͸βBVH
+					MeshOpacityReport opacity = data.mesh->ClassifyOpacity();
+					opacityReport.opaque += opacity.opaque;
+					opacityReport.transparent += opacity.transparent;
+					opacityReport.mixed += opacity.mixed;
 				}
-				if (bumpMap != "NoFile_Rattler")
+				if (data.bumpMap != "NoFile_Rattler")
 					bumpTexture = getBumpTexture(bumpFilename);
 				else
 					bumpTexture = std::make_shared<ConstantTexture<float>>(0.0f);
@@ -223,14 +350,14 @@ namespace Feimos
 				}
 				else
 				{
-					if (diffuseMap == "NoFile_Rattler")
+					if (data.diffuseMap == "NoFile_Rattler")
 					{
 						// ɻҰ׳
 						curMaterial = getDiffuseMaterial(bumpTexture);
 					}
 					else
 					{
-						if (specularMap == "NoFile_Rattler")
+						if (data.specularMap == "NoFile_Rattler")
 						{
 							// 
 							curMaterial = getDiffuseMaterial(diffFilename, bumpTexture);
@@ -244,39 +371,30 @@ namespace Feimos
 					}
 				}
 
-				std::shared_ptr<TriangleMesh> trimesh =
-					std::make_shared<TriangleMesh>(ObjectToWorld, FaceNum, vertexIndices, VertexNum, vertexArray, TangArray, NormArray, uvArray, alphaTexture, nullptr, nullptr);
-
+				// ÿƬһԪڲBVH
+				std::shared_ptr<TriangleMeshPrimitive> meshPrim;
 				if (mediumInterface.inside == nullptr && mediumInterface.outside == nullptr)
-				{
-					for (int j = 0; j < trimesh->nTriangles; ++j)
-					{
-						primsObj.push_back(std::make_shared<GeometricPrimitive>(
-							std::make_shared<Triangle>(&ObjectToWorld, &World2Object, false, trimesh, j),
-							curMaterial, nullptr, mediumInterface));
-					}
-				}
+					meshPrim = std::make_shared<TriangleMeshPrimitive>(data.mesh, curMaterial, mediumInterface, ObjectToWorld);
 				else
-				{
-					for (int j = 0; j < trimesh->nTriangles; ++j)
-					{
-						primsObj.push_back(std::make_shared<GeometricPrimitive>(
-							std::make_shared<Triangle>(&ObjectToWorld, &World2Object, false, trimesh, j),
-							nullptr, nullptr, mediumInterface));
-					}
-				}
+					meshPrim = std::make_shared<TriangleMeshPrimitive>(data.mesh, nullptr, mediumInterface, ObjectToWorld);
+				// ȫ͸Ƭûпཻ
+				if (meshPrim->TriangleCount() > 0)
+					primsObj.push_back(meshPrim);
+				meshReports.back().primitiveBytes = meshPrim->Bytes();
+				primitiveBytes += meshPrim->Bytes();
+				meshBytes += meshPrim->Bytes();
+				uncompressedMeshBytes += meshPrim->Bytes();
 			}
-			MeshNumInModel += tFaceNum;
-
-			delete[] vertexArray;
-			delete[] vertexIndices;
-			delete[] NormArray;
-			delete[] uvArray;
-			delete[] TangArray;
+			MeshNumInModel += data.faceNum;
 		}
+		// ͬ͸һMIPMapƬͷŷõֵ
+		for (int meshID = 0; meshID < meshNum; meshID++)
+			if (meshData[meshID].mesh && meshData[meshID].mesh->alphaMask)
+				meshData[meshID].mesh->alphaMask->ReleaseRange();
 
-		// ÿģڲüٽṹ
+		// ÿģڲüٽṹʵʱΪĵײBVH(BLAS)
 		std::shared_ptr<Feimos::Primitive> aggregate = std::make_unique<Feimos::BVHAccel>(primsObj, 1);
+		modelAccel = aggregate;
 
 		// ʵ
 		if (!isInstancing || instancingTransform.size() == 0)
@@ -285,10 +403,20 @@ namespace Feimos
 		}
 		else
 		{
+			// ʵֻ붥BVH(TLAS)δ instanceAccel ʱΪģ͵һ
+			std::shared_ptr<InstanceAccel> ownAccel;
+			if (!instanceAccel)
+			{
+				ownAccel = std::make_shared<InstanceAccel>();
+				instanceAccel = ownAccel.get();
+			}
+			int blas = instanceAccel->AddBLAS(aggregate);
 			for (int i = 0; i < instancingTransform.size(); i++)
+				instanceAccel->AddInstance(blas, instancingTransform[i]);
+			if (ownAccel)
 			{
-				std::shared_ptr<Feimos::Primitive> pri = std::make_shared<TransformedPrimitive>(aggregate, instancingTransform[i]);
-				prims.push_back(pri);
+				ownAccel->Build();
+				prims.push_back(ownAccel);
 			}
 		}
 	}
@@ -14,16 +14,29 @@
 namespace Feimos
 {
 
+	class InstanceAccel;
+
 	class RattlerLoad
 	{
 	public:
 		Point3f minPos, maxPos;
 		std::vector<std::string> meshFiles;
+		std::vector<std::string> meshBinFiles;
 		std::string modelDir;
 		bool modelReadFlag;
 		long long MeshNumInModel = 0;
+		// ÿƬڴռúѹmeshCompression Ϊ MeshCompression 
+		std::vector<MeshMemoryReport> meshReports;
+		// ԪBVHSoAҶӿ(primitiveBytes)ǲѹС
+		size_t meshBytes = 0, uncompressedMeshBytes = 0, primitiveBytes = 0;
+		// ͸ηͳ
+		MeshOpacityReport opacityReport;
+		// ģBVHΪBLASӸʵ
+		std::shared_ptr<Feimos::Primitive> modelAccel;
 
-		RattlerLoad(std::string fileDir, const Transform &ObjectToWorld, std::vector<std::shared_ptr<Feimos::Primitive>> &prims, const MediumInterface &mediumInterface, std::vector<AnimatedTransform> instancingTransform, bool isInstancing = false, bool isTextureNeeded = true, std::shared_ptr<Feimos::Material> material = nullptr);
+		// ʵʱ instanceAccelֻBLASʵɵߵ Build()  prims
+		// ģͿԹͬһBVH
+		RattlerLoad(std::string fileDir, const Transform &ObjectToWorld, std::vector<std::shared_ptr<Feimos::Primitive>> &prims, const MediumInterface &mediumInterface, std::vector<AnimatedTransform> instancingTransform, bool isInstancing = false, bool isTextureNeeded = true, std::shared_ptr<Feimos::Material> material = nullptr, int meshCompression = MeshCompressionNone, InstanceAccel *instanceAccel = nullptr);
 	};
 
 }
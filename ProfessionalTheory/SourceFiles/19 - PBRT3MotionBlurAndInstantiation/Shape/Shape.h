@@ -26,6 +26,15 @@ namespace Feimos
 		{
 			return Intersect(ray, nullptr, nullptr, testAlphaTexture);
 		}
+		// Deferred closest-hit interface: IntersectHit() reports only the hit
+		// distance and barycentric-style coordinates _b_, and
+		// ComputeInteraction() builds the interaction once the hit is final.
+		// Shapes that return false from CanDeferInteraction() use Intersect().
+		virtual bool CanDeferInteraction() const { return false; }
+		virtual bool IntersectHit(const Ray &ray, float *tHit, float b[3],
+								  bool testAlphaTexture = true) const { return false; }
+		virtual void ComputeInteraction(const Ray &ray, const float b[3],
+										SurfaceInteraction *isect) const {}
 		virtual float Area() const = 0;
 
 		// Sample a point on the surface of the shape and return the PDF with
@@ -14,30 +14,47 @@ namespace Feimos
 		const Transform &ObjectToWorld, int nTriangles, const int *vertexIndices,
 		int nVertices, const Point3f *P, const Vector3f *S, const Normal3f *N,
 		const Point2f *UV, const std::shared_ptr<Texture<float>> &alphaMask,
-		const std::shared_ptr<Texture<float>> &shadowAlphaMask, const int *fIndices)
+		const std::shared_ptr<Texture<float>> &shadowAlphaMask, const int *fIndices,
+		const std::shared_ptr<const void> &storage)
 		: nTriangles(nTriangles),
 		  nVertices(nVertices),
-		  vertexIndices(vertexIndices, vertexIndices + 3 * nTriangles),
+		  vertexIndices(vertexIndices),
+		  uv(UV),
 		  alphaMask(alphaMask),
-		  shadowAlphaMask(shadowAlphaMask)
+		  shadowAlphaMask(shadowAlphaMask),
+		  storage(storage)
 	{
+		// Meshes may be built from several loader threads at once
+#pragma omp atomic
 		++nMeshes;
+#pragma omp atomic
 		nTris += nTriangles;
-		triMeshBytes += sizeof(*this) + this->vertexIndices.size() * sizeof(int) +
-						nVertices * (sizeof(*P) + (N ? sizeof(*N) : 0) +
-									 (S ? sizeof(*S) : 0) + (UV ? sizeof(*UV) : 0) +
-									 (fIndices ? sizeof(*fIndices) : 0));
+		long long bytes = sizeof(*this) +
+						  nVertices * (sizeof(*P) + (N ? sizeof(*N) : 0) +
+									   (S ? sizeof(*S) : 0) + (fIndices ? sizeof(*fIndices) : 0));
+
+		// Copy _vertexIndices_ and _UV_ unless they live in _storage_
+		if (!storage)
+		{
+			indexStorage.assign(vertexIndices, vertexIndices + 3 * nTriangles);
+			this->vertexIndices = indexStorage.data();
+			bytes += indexStorage.size() * sizeof(int);
+			if (UV)
+			{
+				uvStorage.reset(new Point2f[nVertices]);
+				memcpy(uvStorage.get(), UV, nVertices * sizeof(Point2f));
+				uv = uvStorage.get();
+				bytes += nVertices * sizeof(Point2f);
+			}
+		}
+#pragma omp atomic
+		triMeshBytes += bytes;
 
 		// Transform mesh vertices to world space
 		p.reset(new Point3f[nVertices]);
 		for (int i = 0; i < nVertices; ++i)
 			p[i] = ObjectToWorld(P[i]);
-		// Copy _UV_, _N_, and _S_ vertex data, if present
-		if (UV)
-		{
-			uv.reset(new Point2f[nVertices]);
-			memcpy(uv.get(), UV, nVertices * sizeof(Point2f));
-		}
+		// Copy _N_ and _S_ vertex data, if present
 		if (N)
 		{
 			n.reset(new Normal3f[nVertices]);
@@ -52,34 +69,228 @@ namespace Feimos
 		}
 		if (fIndices)
 			faceIndices = std::vector<int>(fIndices, fIndices + nTriangles);
+		if (alphaMask || shadowAlphaMask)
+			ClassifyOpacity();
+	}
+
+	static float AngleBetween(const Vector3f &a, const Vector3f &b)
+	{
+		return Degrees(std::atan2(Cross(a, b).Length(), Dot(a, b)));
+	}
+
+	MeshMemoryReport TriangleMesh::Compress(int modes)
+	{
+		MeshMemoryReport report;
+		report.uncompressedBytes = Bytes();
+
+		// Quantize positions to 16 bits per axis within the mesh bounds
+		if ((modes & MeshCompressionPositions) && p)
+		{
+			Bounds3f bounds;
+			for (int i = 0; i < nVertices; ++i)
+				bounds = Union(bounds, p[i]);
+			qpMin = bounds.pMin;
+			Vector3f extent = bounds.Diagonal();
+			qpScale = extent / 65535.f;
+			qp.reset(new uint16_t[3 * nVertices]);
+			for (int i = 0; i < nVertices; ++i)
+				for (int c = 0; c < 3; ++c)
+				{
+					float t = extent[c] > 0 ? (p[i][c] - qpMin[c]) / extent[c] : 0.f;
+					qp[3 * i + c] = (uint16_t)std::round(Clamp(t, 0.f, 1.f) * 65535.f);
+				}
+			std::unique_ptr<Point3f[]> original = std::move(p);
+			for (int i = 0; i < nVertices; ++i)
+				report.maxPositionError = std::max(report.maxPositionError, Distance(P(i), original[i]));
+		}
+
+		// Octahedral normals and tangents. Only the direction is kept, which
+		// is all the shading code uses: both are normalized after interpolation.
+		if ((modes & MeshCompressionNormals) && n)
+		{
+			qn.reset(new uint32_t[nVertices]);
+			for (int i = 0; i < nVertices; ++i)
+				qn[i] = EncodeOctahedral(Vector3f(n[i]));
+			std::unique_ptr<Normal3f[]> original = std::move(n);
+			for (int i = 0; i < nVertices; ++i)
+				if (original[i].LengthSquared() > 0)
+					report.maxNormalError = std::max(report.maxNormalError, AngleBetween(Vector3f(N(i)), Vector3f(original[i])));
+		}
+		if ((modes & MeshCompressionNormals) && s)
+		{
+			qs.reset(new uint32_t[nVertices]);
+			for (int i = 0; i < nVertices; ++i)
+				qs[i] = EncodeOctahedral(s[i]);
+			std::unique_ptr<Vector3f[]> original = std::move(s);
+			for (int i = 0; i < nVertices; ++i)
+				if (original[i].LengthSquared() > 0)
+					report.maxNormalError = std::max(report.maxNormalError, AngleBetween(S(i), original[i]));
+		}
+
+		// Half float uvs
+		if ((modes & MeshCompressionUVs) && uv)
+		{
+			quv.reset(new uint16_t[2 * nVertices]);
+			for (int i = 0; i < nVertices; ++i)
+			{
+				quv[2 * i] = FloatToHalf(uv[i].x);
+				quv[2 * i + 1] = FloatToHalf(uv[i].y);
+			}
+			const Point2f *original = uv;
+			uv = nullptr;
+			for (int i = 0; i < nVertices; ++i)
+				report.maxUVError = std::max(report.maxUVError, std::max(std::abs(UV(i).x - original[i].x),
+																		 std::abs(UV(i).y - original[i].y)));
+			uvStorage.reset();
+		}
+
+		// 16-bit indices
+		if ((modes & MeshCompressionIndices) && vertexIndices && nVertices <= 65536)
+		{
+			shortIndices.reset(new uint16_t[3 * nTriangles]);
+			for (int i = 0; i < 3 * nTriangles; ++i)
+				shortIndices[i] = (uint16_t)vertexIndices[i];
+			vertexIndices = nullptr;
+			std::vector<int>().swap(indexStorage);
+		}
+
+		// Release a file mapping nothing refers to anymore
+		if (!vertexIndices && !uv)
+			storage.reset();
+		report.bytes = Bytes();
+		return report;
+	}
+
+	// Bilinear lookups of texels at or above this value cannot round below
+	// the 0.99 threshold of Triangle::Intersect()
+	static const float opaqueAlpha = 0.99f * (1 + 8 * MachineEpsilon);
+
+	MeshOpacityReport TriangleMesh::ClassifyOpacity()
+	{
+		MeshOpacityReport report;
+		std::vector<uint8_t>().swap(opacity);
+		if (!alphaMask && !shadowAlphaMask)
+			return report;
+		opacity.resize(nTriangles);
+		int nOpaque = 0, nTransparent = 0;
+#pragma omp parallel for schedule(dynamic, 1024) reduction(+ : nOpaque, nTransparent)
+		for (int tri = 0; tri < nTriangles; ++tri)
+		{
+			// Same uvs as Triangle::GetUVs()
+			Point2f st[3] = {Point2f(0, 0), Point2f(1, 0), Point2f(1, 1)};
+			if (HasUVs())
+			{
+				int v[3];
+				TriangleIndices(tri, v);
+				for (int i = 0; i < 3; ++i)
+					st[i] = UV(v[i]);
+			}
+			float aMin = 1, aMax = 1, sMin = 1, sMax = 1;
+			bool aBounded = !alphaMask || alphaMask->EvaluateRange(st, &aMin, &aMax);
+			bool sBounded = !shadowAlphaMask || shadowAlphaMask->EvaluateRange(st, &sMin, &sMax);
+			// Camera rays pass alpha >= 0.99 and shadow rays alpha != 0, so
+			// a triangle is transparent only if every lookup is exactly zero
+			TriangleOpacity o = TriangleMixed;
+			if (alphaMask && aBounded && aMin == 0 && aMax == 0)
+				o = TriangleTransparent;
+			else if (aBounded && sBounded && aMin >= opaqueAlpha && sMin > 0)
+				o = TriangleOpaque;
+			opacity[tri] = o;
+			nOpaque += o == TriangleOpaque;
+			nTransparent += o == TriangleTransparent;
+		}
+		report.opaque = nOpaque;
+		report.transparent = nTransparent;
+		report.mixed = nTriangles - nOpaque - nTransparent;
+		return report;
+	}
+
+	size_t TriangleMesh::Bytes() const
+	{
+		size_t bytes = sizeof(*this) + faceIndices.size() * sizeof(int) + opacity.size();
+		if (vertexIndices)
+			bytes += 3 * nTriangles * sizeof(int);
+		if (shortIndices)
+			bytes += 3 * nTriangles * sizeof(uint16_t);
+		if (p)
+			bytes += nVertices * sizeof(Point3f);
+		if (qp)
+			bytes += 3 * nVertices * sizeof(uint16_t);
+		if (n)
+			bytes += nVertices * sizeof(Normal3f);
+		if (qn)
+			bytes += nVertices * sizeof(uint32_t);
+		if (s)
+			bytes += nVertices * sizeof(Vector3f);
+		if (qs)
+			bytes += nVertices * sizeof(uint32_t);
+		if (uv)
+			bytes += nVertices * sizeof(Point2f);
+		if (quv)
+			bytes += 2 * nVertices * sizeof(uint16_t);
+		return bytes;
 	}
 
 	Bounds3f Triangle::ObjectBound() const
 	{
 		// Get triangle vertices in _p0_, _p1_, and _p2_
-		const Point3f &p0 = mesh->p[v[0]];
-		const Point3f &p1 = mesh->p[v[1]];
-		const Point3f &p2 = mesh->p[v[2]];
+		const Point3f p0 = mesh->P(v[0]);
+		const Point3f p1 = mesh->P(v[1]);
+		const Point3f p2 = mesh->P(v[2]);
 		return Union(Bounds3f((*WorldToObject)(p0), (*WorldToObject)(p1)),
 					 (*WorldToObject)(p2));
 	}
 	Bounds3f Triangle::WorldBound() const
 	{
 		// Get triangle vertices in _p0_, _p1_, and _p2_
-		const Point3f &p0 = mesh->p[v[0]];
-		const Point3f &p1 = mesh->p[v[1]];
-		const Point3f &p2 = mesh->p[v[2]];
+		const Point3f p0 = mesh->P(v[0]);
+		const Point3f p1 = mesh->P(v[1]);
+		const Point3f p2 = mesh->P(v[2]);
 		return Union(Bounds3f(p0, p1), p2);
 	}
 	bool Triangle::Intersect(const Ray &ray, float *tHit, SurfaceInteraction *isect,
 							 bool testAlphaTexture) const
 	{
+		float t, b[3];
+		if (!IntersectHit(ray, &t, b, testAlphaTexture))
+			return false;
+		ComputeInteraction(ray, b, isect);
+		*tHit = t;
+		return true;
+	}
+	void Triangle::GetPartials(const Point2f uv[3], Vector3f *dpdu, Vector3f *dpdv) const
+	{
+		const Point3f p0 = mesh->P(v[0]);
+		const Point3f p1 = mesh->P(v[1]);
+		const Point3f p2 = mesh->P(v[2]);
 
+		// Compute deltas for triangle partial derivatives
+		Vector2f duv02 = uv[0] - uv[2], duv12 = uv[1] - uv[2];
+		Vector3f dp02 = p0 - p2, dp12 = p1 - p2;
+		float determinant = duv02[0] * duv12[1] - duv02[1] * duv12[0];
+		bool degenerateUV = std::abs(determinant) < 1e-8;
+		if (!degenerateUV)
+		{
+			float invdet = 1 / determinant;
+			*dpdu = (duv12[1] * dp02 - duv02[1] * dp12) * invdet;
+			*dpdv = (-duv12[0] * dp02 + duv02[0] * dp12) * invdet;
+		}
+		// A hit passed the determinant test, so the triangle itself has
+		// nonzero area and its geometric normal is well defined
+		if (degenerateUV || Cross(*dpdu, *dpdv).LengthSquared() == 0)
+			CoordinateSystem(Normalize(Cross(p2 - p0, p1 - p0)), dpdu, dpdv);
+	}
+	bool Triangle::IntersectHit(const Ray &ray, float *tHit, float b[3],
+								bool testAlphaTexture) const
+	{
 		++nTests;
+		// Fully transparent triangles are never hit through their alpha mask
+		if (testAlphaTexture && opacity == TriangleTransparent)
+			return false;
 		// Get triangle vertices in _p0_, _p1_, and _p2_
-		const Point3f &p0 = mesh->p[v[0]];
-		const Point3f &p1 = mesh->p[v[1]];
-		const Point3f &p2 = mesh->p[v[2]];
+		const Point3f p0 = mesh->P(v[0]);
+		const Point3f p1 = mesh->P(v[1]);
+		const Point3f p2 = mesh->P(v[2]);
 
 		// Perform ray--triangle intersection test
 
@@ -173,32 +384,44 @@ namespace Feimos
 		if (t <= deltaT)
 			return false;
 
+		// Test intersection against alpha texture, if present
+		if (testAlphaTexture && mesh->alphaMask && opacity != TriangleOpaque)
+		{
+			Point2f uv[3];
+			GetUVs(uv);
+			Vector3f dpdu, dpdv;
+			GetPartials(uv, &dpdu, &dpdv);
+			Point2f uvHit = b0 * uv[0] + b1 * uv[1] + b2 * uv[2];
+			Point3f pHit = b0 * p0 + b1 * p1 + b2 * p2;
+			SurfaceInteraction isectLocal(pHit, Vector3f(0, 0, 0), uvHit, -ray.d,
+										  dpdu, dpdv, Normal3f(0, 0, 0),
+										  Normal3f(0, 0, 0), ray.time, this);
+			if (mesh->alphaMask->Evaluate(isectLocal) < 0.99)
+				return false;
+		}
+
+		*tHit = t;
+		b[0] = b0;
+		b[1] = b1;
+		b[2] = b2;
+		++nHits;
+		return true;
+	}
+	void Triangle::ComputeInteraction(const Ray &ray, const float b[3],
+									  SurfaceInteraction *isect) const
+	{
+		// Get triangle vertices in _p0_, _p1_, and _p2_
+		const Point3f p0 = mesh->P(v[0]);
+		const Point3f p1 = mesh->P(v[1]);
+		const Point3f p2 = mesh->P(v[2]);
+		float b0 = b[0], b1 = b[1], b2 = b[2];
+
 		// Compute triangle partial derivatives
-		Vector3f dpdu, dpdv;
 		Point2f uv[3];
 		GetUVs(uv);
-
-		// Compute deltas for triangle partial derivatives
-		Vector2f duv02 = uv[0] - uv[2], duv12 = uv[1] - uv[2];
+		Vector3f dpdu, dpdv;
+		GetPartials(uv, &dpdu, &dpdv);
 		Vector3f dp02 = p0 - p2, dp12 = p1 - p2;
-		float determinant = duv02[0] * duv12[1] - duv02[1] * duv12[0];
-		bool degenerateUV = std::abs(determinant) < 1e-8;
-		if (!degenerateUV)
-		{
-			float invdet = 1 / determinant;
-			dpdu = (duv12[1] * dp02 - duv02[1] * dp12) * invdet;
-			dpdv = (-duv12[0] * dp02 + duv02[0] * dp12) * invdet;
-		}
-		if (degenerateUV || Cross(dpdu, dpdv).LengthSquared() == 0)
-		{
-			// Handle zero determinant for triangle partial derivative matrix
-			Vector3f ng = Cross(p2 - p0, p1 - p0);
-			if (ng.LengthSquared() == 0)
-				// The triangle is actually degenerate; the intersection is
-				// bogus.
-				return false;
-			CoordinateSystem(Normalize(ng), &dpdu, &dpdv);
-		}
 
 		// Compute error bounds for triangle intersection
 		float xAbsSum =
@@ -212,16 +435,6 @@ namespace Feimos
 		Point2f uvHit = b0 * uv[0] + b1 * uv[1] + b2 * uv[2];
 		Point3f pHit = b0 * p0 + b1 * p1 + b2 * p2;
 
-		// Test intersection against alpha texture, if present
-		if (testAlphaTexture && mesh->alphaMask)
-		{
-			SurfaceInteraction isectLocal(pHit, Vector3f(0, 0, 0), uvHit, -ray.d,
-										  dpdu, dpdv, Normal3f(0, 0, 0),
-										  Normal3f(0, 0, 0), ray.time, this);
-			if (mesh->alphaMask->Evaluate(isectLocal) < 0.99)
-				return false;
-		}
-
 		// Fill in _SurfaceInteraction_ from triangle hit
 		*isect = SurfaceInteraction(pHit, pError, uvHit, -ray.d, dpdu, dpdv,
 									Normal3f(0, 0, 0), Normal3f(0, 0, 0), ray.time,
@@ -232,15 +445,15 @@ namespace Feimos
 		if (reverseOrientation ^ transformSwapsHandedness)
 			isect->n = isect->shading.n = -isect->n;
 
-		if (mesh->n || mesh->s)
+		if (mesh->HasNormals() || mesh->HasTangents())
 		{
 			// Initialize _Triangle_ shading geometry
 
 			// Compute shading normal _ns_ for triangle
 			Normal3f ns;
-			if (mesh->n)
+			if (mesh->HasNormals())
 			{
-				ns = (b0 * mesh->n[v[0]] + b1 * mesh->n[v[1]] + b2 * mesh->n[v[2]]);
+				ns = (b0 * mesh->N(v[0]) + b1 * mesh->N(v[1]) + b2 * mesh->N(v[2]));
 				if (ns.LengthSquared() > 0)
 					ns = Normalize(ns);
 				else
@@ -251,9 +464,9 @@ namespace Feimos
 
 			// Compute shading tangent _ss_ for triangle
 			Vector3f ss;
-			if (mesh->s)
+			if (mesh->HasTangents())
 			{
-				ss = (b0 * mesh->s[v[0]] + b1 * mesh->s[v[1]] + b2 * mesh->s[v[2]]);
+				ss = (b0 * mesh->S(v[0]) + b1 * mesh->S(v[1]) + b2 * mesh->S(v[2]));
 				if (ss.LengthSquared() > 0)
 					ss = Normalize(ss);
 				else
@@ -274,13 +487,13 @@ namespace Feimos
 
 			// Compute $\dndu$ and $\dndv$ for triangle shading geometry
 			Normal3f dndu, dndv;
-			if (mesh->n)
+			if (mesh->HasNormals())
 			{
 				// Compute deltas for triangle partial derivatives of normal
 				Vector2f duv02 = uv[0] - uv[2];
 				Vector2f duv12 = uv[1] - uv[2];
-				Normal3f dn1 = mesh->n[v[0]] - mesh->n[v[2]];
-				Normal3f dn2 = mesh->n[v[1]] - mesh->n[v[2]];
+				Normal3f dn1 = mesh->N(v[0]) - mesh->N(v[2]);
+				Normal3f dn2 = mesh->N(v[1]) - mesh->N(v[2]);
 				float determinant = duv02[0] * duv12[1] - duv02[1] * duv12[0];
 				bool degenerateUV = std::abs(determinant) < 1e-8;
 				if (degenerateUV)
@@ -291,8 +504,8 @@ namespace Feimos
 					// (rather than giving up) so that ray differentials for
 					// rays reflected from triangles with degenerate
 					// parameterizations are still reasonable.
-					Vector3f dn = Cross(Vector3f(mesh->n[v[2]] - mesh->n[v[0]]),
-										Vector3f(mesh->n[v[1]] - mesh->n[v[0]]));
+					Vector3f dn = Cross(Vector3f(mesh->N(v[2]) - mesh->N(v[0])),
+										Vector3f(mesh->N(v[1]) - mesh->N(v[0])));
 					if (dn.LengthSquared() == 0)
 						dndu = dndv = Normal3f(0, 0, 0);
 					else
@@ -316,18 +529,17 @@ namespace Feimos
 				ts = -ts;
 			isect->SetShadingGeometry(ss, ts, dndu, dndv, true);
 		}
-
-		*tHit = t;
-		++nHits;
-		return true;
 	}
 	bool Triangle::IntersectP(const Ray &ray, bool testAlphaTexture) const
 	{
 		++nTests;
+		// Fully transparent triangles are never hit through their alpha mask
+		if (testAlphaTexture && opacity == TriangleTransparent)
+			return false;
 		// Get triangle vertices in _p0_, _p1_, and _p2_
-		const Point3f &p0 = mesh->p[v[0]];
-		const Point3f &p1 = mesh->p[v[1]];
-		const Point3f &p2 = mesh->p[v[2]];
+		const Point3f p0 = mesh->P(v[0]);
+		const Point3f p1 = mesh->P(v[1]);
+		const Point3f p2 = mesh->P(v[2]);
 
 		// Perform ray--triangle intersection test
 
@@ -422,7 +634,8 @@ namespace Feimos
 			return false;
 
 		// Test shadow ray intersection against alpha texture, if present
-		if (testAlphaTexture && (mesh->alphaMask || mesh->shadowAlphaMask))
+		if (testAlphaTexture && (mesh->alphaMask || mesh->shadowAlphaMask) &&
+			opacity != TriangleOpaque)
 		{
 			// Compute triangle partial derivatives
 			Vector3f dpdu, dpdv;
@@ -472,9 +685,9 @@ namespace Feimos
 	float Triangle::Area() const
 	{
 		// Get triangle vertices in _p0_, _p1_, and _p2_
-		const Point3f &p0 = mesh->p[v[0]];
-		const Point3f &p1 = mesh->p[v[1]];
-		const Point3f &p2 = mesh->p[v[2]];
+		const Point3f p0 = mesh->P(v[0]);
+		const Point3f p1 = mesh->P(v[1]);
+		const Point3f p2 = mesh->P(v[2]);
 		return 0.5 * Cross(p1 - p0, p2 - p0).Length();
 	}
 
@@ -482,19 +695,19 @@ namespace Feimos
 	{
 		Point2f b = UniformSampleTriangle(u);
 		// Get triangle vertices in _p0_, _p1_, and _p2_
-		const Point3f &p0 = mesh->p[v[0]];
-		const Point3f &p1 = mesh->p[v[1]];
-		const Point3f &p2 = mesh->p[v[2]];
+		const Point3f p0 = mesh->P(v[0]);
+		const Point3f p1 = mesh->P(v[1]);
+		const Point3f p2 = mesh->P(v[2]);
 		Interaction it;
 		it.p = b[0] * p0 + b[1] * p1 + (1 - b[0] - b[1]) * p2;
 		// Compute surface normal for sampled point on triangle
 		it.n = Normalize(Normal3f(Cross(p1 - p0, p2 - p0)));
 		// Ensure correct orientation of the geometric normal; follow the same
 		// approach as was used in Triangle::Intersect().
-		if (mesh->n)
+		if (mesh->HasNormals())
 		{
-			Normal3f ns(b[0] * mesh->n[v[0]] + b[1] * mesh->n[v[1]] +
-						(1 - b[0] - b[1]) * mesh->n[v[2]]);
+			Normal3f ns(b[0] * mesh->N(v[0]) + b[1] * mesh->N(v[1]) +
+						(1 - b[0] - b[1]) * mesh->N(v[2]));
 			it.n = Faceforward(it.n, ns);
 		}
 		// else if (reverseOrientation ^ transformSwapsHandedness)
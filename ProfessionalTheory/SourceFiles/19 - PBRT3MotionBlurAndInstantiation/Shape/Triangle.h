@@ -5,12 +5,50 @@
 #include "Core/FeimosRender.h"
 #include "Core/Transform.h"
 #include "Core/Geometry.h"
+#include "Core/Quantize.h"
 #include "Shape/Shape.h"
 #include "Texture/Texture.h"
 
 namespace Feimos
 {
 
+	// Compressed storage modes for TriangleMesh::Compress()
+	enum MeshCompression
+	{
+		MeshCompressionNone = 0,
+		MeshCompressionPositions = 1 << 0, // 16-bit positions within the mesh bounds
+		MeshCompressionNormals = 1 << 1,   // octahedral normals and tangents, 32 bits each
+		MeshCompressionUVs = 1 << 2,	   // half float uvs
+		MeshCompressionIndices = 1 << 3,   // 16-bit indices, if nVertices <= 65536
+		MeshCompressionAll = MeshCompressionPositions | MeshCompressionNormals |
+							 MeshCompressionUVs | MeshCompressionIndices
+	};
+
+	// Memory held by a mesh before and after compression, and the largest
+	// error the compression introduced. _primitiveBytes_ is the BVH and the
+	// full float leaf blocks of the mesh primitive built over it, which
+	// compression does not shrink; it is not part of the other two.
+	struct MeshMemoryReport
+	{
+		size_t uncompressedBytes = 0, bytes = 0;
+		size_t primitiveBytes = 0;
+		float maxPositionError = 0; // world space distance
+		float maxNormalError = 0;	// degrees, normals and tangents
+		float maxUVError = 0;
+	};
+
+	// Alpha mask result over a whole triangle; see TriangleMesh::ClassifyOpacity()
+	enum TriangleOpacity : uint8_t
+	{
+		TriangleMixed = 0,
+		TriangleOpaque,
+		TriangleTransparent
+	};
+	struct MeshOpacityReport
+	{
+		int opaque = 0, transparent = 0, mixed = 0;
+	};
+
 	struct TriangleMesh
 	{
 		// TriangleMesh Public Methods
@@ -19,16 +57,82 @@ namespace Feimos
 					 const Vector3f *S, const Normal3f *N, const Point2f *uv,
 					 const std::shared_ptr<Texture<float>> &alphaMask,
 					 const std::shared_ptr<Texture<float>> &shadowAlphaMask,
-					 const int *faceIndices);
+					 const int *faceIndices,
+					 const std::shared_ptr<const void> &storage = nullptr);
+		// Replaces the float vertex data selected by _modes_ with compressed
+		// data. Shapes and primitives must be created after this, since they
+		// read the mesh through the accessors below.
+		MeshMemoryReport Compress(int modes);
+		size_t Bytes() const;
+		// Bounds _alphaMask_ and _shadowAlphaMask_ over every triangle's uv
+		// footprint. Opaque triangles then skip the per-hit alpha test and
+		// transparent ones are left out of mesh primitives; triangles whose
+		// textures cannot be bounded stay mixed. Called by the constructor,
+		// and again whenever the masks are assigned later; like Compress(),
+		// before shapes and primitives are created. The masks keep lookup
+		// tables for this until their ReleaseRange() is called, which the
+		// caller does once every mesh sharing them is classified.
+		MeshOpacityReport ClassifyOpacity();
+		TriangleOpacity Opacity(int tri) const
+		{
+			return opacity.empty() ? TriangleMixed : TriangleOpacity(opacity[tri]);
+		}
+		// Vertex data access; compressed attributes are decoded on the fly, so
+		// mesh primitives only pay for it on the final hit
+		int VertexIndex(int i) const { return vertexIndices ? vertexIndices[i] : shortIndices[i]; }
+		void TriangleIndices(int tri, int v[3]) const
+		{
+			for (int i = 0; i < 3; ++i)
+				v[i] = VertexIndex(3 * tri + i);
+		}
+		Point3f P(int i) const
+		{
+			if (p)
+				return p[i];
+			const uint16_t *q = &qp[3 * i];
+			return Point3f(qpMin.x + q[0] * qpScale.x, qpMin.y + q[1] * qpScale.y,
+						   qpMin.z + q[2] * qpScale.z);
+		}
+		// Quantized position of vertex _i_, or null while positions are
+		// floats; P(i) is QPMin() + QP(i) * QPScale() per axis
+		const uint16_t *QP(int i) const { return qp ? &qp[3 * i] : nullptr; }
+		const Point3f &QPMin() const { return qpMin; }
+		const Vector3f &QPScale() const { return qpScale; }
+		Normal3f N(int i) const { return n ? n[i] : Normal3f(DecodeOctahedral(qn[i])); }
+		Vector3f S(int i) const { return s ? s[i] : DecodeOctahedral(qs[i]); }
+		Point2f UV(int i) const
+		{
+			return uv ? uv[i] : Point2f(HalfToFloat(quv[2 * i]), HalfToFloat(quv[2 * i + 1]));
+		}
+		bool HasNormals() const { return n || qn; }
+		bool HasTangents() const { return s || qs; }
+		bool HasUVs() const { return uv || quv; }
 		// TriangleMesh Data
 		const int nTriangles, nVertices;
-		std::vector<int> vertexIndices;
+		// Indices and uvs do not depend on _ObjectToWorld_; when _storage_ is
+		// given they are used in place from the memory it keeps alive (e.g. a
+		// mapped .rattlerbin file) instead of being copied
+		const int *vertexIndices;
 		std::unique_ptr<Point3f[]> p;
 		std::unique_ptr<Normal3f[]> n;
 		std::unique_ptr<Vector3f[]> s;
-		std::unique_ptr<Point2f[]> uv;
+		const Point2f *uv;
 		std::shared_ptr<Texture<float>> alphaMask, shadowAlphaMask;
 		std::vector<int> faceIndices;
+
+	private:
+		std::vector<int> indexStorage;
+		std::unique_ptr<Point2f[]> uvStorage;
+		std::shared_ptr<const void> storage;
+		// Compressed vertex data; the matching float array above is null
+		std::unique_ptr<uint16_t[]> qp;
+		Point3f qpMin;
+		Vector3f qpScale;
+		std::unique_ptr<uint32_t[]> qn, qs;
+		std::unique_ptr<uint16_t[]> quv;
+		std::unique_ptr<uint16_t[]> shortIndices;
+		// One TriangleOpacity per triangle, empty without alpha masks
+		std::vector<uint8_t> opacity;
 	};
 	static long long triMeshBytes = 0;
 	class Triangle : public Shape
@@ -40,7 +144,8 @@ namespace Feimos
 				 int triNumber)
 			: Shape(ObjectToWorld, WorldToObject, reverseOrientation), mesh(mesh)
 		{
-			v = &mesh->vertexIndices[3 * triNumber];
+			mesh->TriangleIndices(triNumber, v);
+			opacity = mesh->Opacity(triNumber);
 			triMeshBytes += sizeof(*this);
 			faceIndex = mesh->faceIndices.size() ? mesh->faceIndices[triNumber] : 0;
 		}
@@ -49,18 +154,24 @@ namespace Feimos
 		bool Intersect(const Ray &ray, float *tHit, SurfaceInteraction *isect,
 					   bool testAlphaTexture = true) const;
 		bool IntersectP(const Ray &ray, bool testAlphaTexture = true) const;
+		bool CanDeferInteraction() const { return true; }
+		bool IntersectHit(const Ray &ray, float *tHit, float b[3],
+						  bool testAlphaTexture = true) const;
+		void ComputeInteraction(const Ray &ray, const float b[3],
+								SurfaceInteraction *isect) const;
 		float Area() const;
 		Interaction Sample(const Point2f &u, float *pdf) const;
 
 	private:
 		// Triangle Private Methods
+		void GetPartials(const Point2f uv[3], Vector3f *dpdu, Vector3f *dpdv) const;
 		void GetUVs(Point2f uv[3]) const
 		{
-			if (mesh->uv)
+			if (mesh->HasUVs())
 			{
-				uv[0] = mesh->uv[v[0]];
-				uv[1] = mesh->uv[v[1]];
-				uv[2] = mesh->uv[v[2]];
+				uv[0] = mesh->UV(v[0]);
+				uv[1] = mesh->UV(v[1]);
+				uv[2] = mesh->UV(v[2]);
 			}
 			else
 			{
@@ -71,8 +182,9 @@ namespace Feimos
 		}
 		// Triangle Private Data
 		std::shared_ptr<TriangleMesh> mesh;
-		const int *v;
+		int v[3];
 		int faceIndex;
+		TriangleOpacity opacity;
 	};
 
 }
@@ -9,6 +9,7 @@
 #include "Core/FeimosRender.h"
 #include "Core/Geometry.h"
 #include "Core/Transform.h"
+#include "Core/TextAsset.h"
 
 #include "MainGUI/DebugText.hpp"
 
@@ -29,34 +30,33 @@ namespace Feimos
 			nVertices = 0;
 			nTriangles = 0;
 
-			std::fstream f(filePath);
-			std::string ed;
+			TextAsset f(filePath);
 			for (int i = 0; i < 2; i++)
 			{
-				f >> ed;
+				std::string ed = f.NextToken();
 				if (ed == "vertex")
-					f >> nVertices;
+					f.NextInt(&nVertices);
 				else if (ed == "face")
-					f >> nTriangles;
+					f.NextInt(&nTriangles);
 			}
 
 			vertexArray = new Point3f[nVertices];
 			vertexIndices = new int[3 * nTriangles];
 
+			static_assert(sizeof(Point3f) == 3 * sizeof(float), "vertices are parsed as a float array");
+			f.ReadFloats(reinterpret_cast<float *>(vertexArray), 3 * nVertices);
 			for (int i = 0; i < nVertices; i++)
-			{
-				f >> vertexArray[i][0];
-				f >> vertexArray[i][1];
-				f >> vertexArray[i][2];
 				vertexArray[i] *= 20;
-			}
+			// ÿ "3 i0 i1 i2"ͷĶһ󶪵
+			std::vector<int> faces(4 * nTriangles);
+			f.ReadInts(faces.data(), faces.size());
 			for (int i = 0; i < nTriangles; i++)
 			{
-				f >> ed;
-				f >> vertexIndices[i * 3 + 0];
-				f >> vertexIndices[i * 3 + 1];
-				f >> vertexIndices[i * 3 + 2];
+				vertexIndices[i * 3 + 0] = faces[i * 4 + 1];
+				vertexIndices[i * 3 + 1] = faces[i * 4 + 2];
+				vertexIndices[i * 3 + 2] = faces[i * 4 + 3];
 			}
+			f.ReportLoad(filePath);
 		}
 		void Release()
 		{
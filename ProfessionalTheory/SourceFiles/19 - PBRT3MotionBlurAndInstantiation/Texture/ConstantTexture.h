@@ -14,6 +14,17 @@ namespace Feimos
     // ConstantTexture Public Methods
     ConstantTexture(const T &value) : value(value) {}
     T Evaluate(const SurfaceInteraction &) const { return value; }
+    bool EvaluateRange(const Point2f uv[3], T *minValue, T *maxValue) const
+    {
+      *minValue = *maxValue = value;
+      return true;
+    }
+    bool EvaluateGradient(const SurfaceInteraction &, T *v, T *dvdu, T *dvdv) const
+    {
+      *v = value;
+      *dvdu = *dvdv = T(0.f);
+      return true;
+    }
 
   private:
     T value;
@@ -1,6 +1,8 @@
 #include "Texture/ImageTexture.h"
 #include "3rdLib/stb_image.h"
 
+#include <cstdio>
+
 namespace Feimos
 {
 
@@ -39,24 +41,82 @@ namespace Feimos
 		return nullptr;
 	}
 
+	// Name of the .mip file holding an image filtered with the given settings,
+	// next to the image itself
+	static std::string mipFilename(const std::string &filename, int channels,
+								   ImageWrap wrap, float scale, bool gamma)
+	{
+		uint32_t settings[4] = {(uint32_t)channels, (uint32_t)wrap, (uint32_t)gamma,
+								FloatToBits(scale)};
+		uint32_t hash = 2166136261u;
+		for (uint32_t v : settings)
+			for (int i = 0; i < 4; ++i)
+				hash = (hash ^ ((v >> (8 * i)) & 0xff)) * 16777619u;
+		char suffix[16];
+		snprintf(suffix, sizeof(suffix), ".%08x.mip", hash);
+		return filename + suffix;
+	}
+
+	// The .mip file _mipName_ if an earlier run wrote it for the same source
+	// image and settings; filtering can push colour maps past 1, so the texel
+	// format is not compared
+	static std::shared_ptr<const MipFile> openMipFile(const std::string &mipName,
+													  const MipFileHeader &settings,
+													  int channels, ImageWrap wrap)
+	{
+		std::shared_ptr<const MipFile> file = std::make_shared<MipFile>(mipName);
+		if (!file->IsValid())
+			return nullptr;
+		const MipFileHeader &h = file->Header();
+		if (h.gamma == settings.gamma && h.scale == settings.scale &&
+			h.wrapMode == (uint32_t)wrap && h.channels == (uint32_t)channels &&
+			h.tileSize == (uint32_t)TextureCache::tileSize &&
+			h.sourceSize == settings.sourceSize && h.sourceTime == settings.sourceTime)
+			return file;
+		return nullptr;
+	}
+
 	// ImageTexture Method Definitions
 	template <typename Tmemory, typename Treturn>
 	ImageTexture<Tmemory, Treturn>::ImageTexture(
 		std::unique_ptr<TextureMapping2D> mapping, const std::string &filename,
 		bool doTrilinear, float maxAniso, ImageWrap wrapMode, float scale,
-		bool gamma)
+		bool gamma, bool gradient)
 		: mapping(std::move(mapping))
 	{
 		mipmap =
 			GetTexture(filename, doTrilinear, maxAniso, wrapMode, scale, gamma);
+		if (gradient && std::is_same<Tmemory, float>::value)
+			gradientMap = GetGradientTexture(filename, doTrilinear, maxAniso,
+											 wrapMode, scale, gamma);
+	}
+
+	static std::vector<TextureMemoryRecord> textureRecords;
+
+	std::vector<TextureMemoryRecord> TextureMemoryReport() { return textureRecords; }
+
+	template <typename T>
+	static void recordTexture(const std::string &name, const MIPMapBase<T> *mipmap)
+	{
+		TextureMemoryRecord record;
+		record.filename = name;
+		record.width = mipmap->Width();
+		record.height = mipmap->Height();
+		record.texelBytes = mipmap->TexelBytes();
+		record.bytes = mipmap->MemoryBytes();
+		record.fullPrecisionBytes = mipmap->MemoryBytes() / mipmap->TexelBytes() * sizeof(T);
+		textureRecords.push_back(record);
 	}
 
 	template <typename Tmemory, typename Treturn>
-	std::map<TexInfo, std::unique_ptr<MIPMap<Tmemory>>>
+	std::map<TexInfo, std::unique_ptr<MIPMapBase<Tmemory>>>
 		ImageTexture<Tmemory, Treturn>::textures;
+	template <typename Tmemory, typename Treturn>
+	std::map<TexInfo, std::unique_ptr<MIPMapBase<RGBSpectrum>>>
+		ImageTexture<Tmemory, Treturn>::gradientTextures;
 
 	template <typename Tmemory, typename Treturn>
-	MIPMap<Tmemory> *ImageTexture<Tmemory, Treturn>::GetTexture(
+	MIPMapBase<Tmemory> *ImageTexture<Tmemory, Treturn>::GetTexture(
 		const std::string &filename, bool doTrilinear, float maxAniso,
 		ImageWrap wrap, float scale, bool gamma)
 	{
@@ -65,6 +125,187 @@ namespace Feimos
 		if (textures.find(texInfo) != textures.end())
 			return textures[texInfo].get();
 
+		MIPMapBase<Tmemory> *mipmap =
+			CreateTexture(filename, doTrilinear, maxAniso, wrap, scale, gamma);
+		textures[texInfo].reset(mipmap);
+		recordTexture(filename, mipmap);
+		return mipmap;
+	}
+
+	template <typename Tmemory, typename Treturn>
+	MIPMapBase<RGBSpectrum> *ImageTexture<Tmemory, Treturn>::GetGradientTexture(
+		const std::string &filename, bool doTrilinear, float maxAniso,
+		ImageWrap wrap, float scale, bool gamma)
+	{
+		TexInfo texInfo(filename, doTrilinear, maxAniso, wrap, scale, gamma);
+		auto found = gradientTextures.find(texInfo);
+		if (found != gradientTextures.end())
+			return found->second.get();
+
+		// Same source stamp and settings as the image's own .mip file, under
+		// a name of its own
+		MipFileHeader settings = {};
+		if (filename == "" ||
+			!MipFile::Stamp(filename, &settings.sourceSize, &settings.sourceTime))
+			return nullptr;
+		settings.format = (uint32_t)MipTexelFormat::Half;
+		settings.gamma = gamma;
+		settings.scale = scale;
+		const std::string mipName = mipFilename(filename + ".gradient", 3, wrap, scale, gamma);
+		std::shared_ptr<const MipFile> file = openMipFile(mipName, settings, 3, wrap);
+
+		int width = 0, height = 0, nComponents;
+		if (!file && !stbi_info(filename.c_str(), &width, &height, &nComponents))
+			return nullptr;
+		// The derivatives are taken at the power-of-two resolution the MIPMap
+		// would resample the image to, so the gradient map is never resampled
+		// itself (resampling clamps texels to be non-negative)
+		Point2i source(width, height);
+		Point2i resolution(RoundUpPow2(width), RoundUpPow2(height));
+		auto loader = [filename, source, resolution, wrap, scale, gamma]() {
+			std::unique_ptr<float[]> d(new float[resolution.x * resolution.y]);
+			Point2i res;
+			std::unique_ptr<RGBSpectrum[]> texels(loadImage(filename, res));
+			if (!texels || res != source)
+			{
+				float grey;
+				convertIn(RGBSpectrum(0.5f), &grey, scale, gamma);
+				for (int i = 0; i < resolution.x * resolution.y; ++i)
+					d[i] = grey;
+			}
+			else if (source == resolution)
+				for (int i = 0; i < resolution.x * resolution.y; ++i)
+					convertIn(texels[i], &d[i], scale, gamma);
+			else
+			{
+				std::unique_ptr<float[]> img(new float[source.x * source.y]);
+				for (int i = 0; i < source.x * source.y; ++i)
+					convertIn(texels[i], &img[i], scale, gamma);
+				MIPMap<float> resampled(source, img.get());
+				for (int t = 0; t < resolution.y; ++t)
+					for (int s = 0; s < resolution.x; ++s)
+						d[t * resolution.x + s] = resampled.Texel(0, s, t);
+			}
+
+			// Central differences in $(s,t)$ units; Repeat wraps around, the
+			// other modes take one-sided differences at the edges
+			std::unique_ptr<RGBSpectrum[]> g(new RGBSpectrum[resolution.x * resolution.y]);
+			auto neighbours = [wrap](int i, int n, int *i0, int *i1) {
+				if (wrap == ImageWrap::Repeat)
+				{
+					*i0 = (i + n - 1) % n;
+					*i1 = (i + 1) % n;
+					return 2;
+				}
+				*i0 = std::max(i - 1, 0);
+				*i1 = std::min(i + 1, n - 1);
+				return *i1 - *i0;
+			};
+#pragma omp parallel for schedule(dynamic, 16)
+			for (int t = 0; t < resolution.y; ++t)
+			{
+				int t0, t1;
+				int dt = neighbours(t, resolution.y, &t0, &t1);
+				for (int s = 0; s < resolution.x; ++s)
+				{
+					int s0, s1;
+					int ds = neighbours(s, resolution.x, &s0, &s1);
+					RGBSpectrum &texel = g[t * resolution.x + s];
+					texel[0] = d[t * resolution.x + s];
+					texel[1] = ds == 0 ? 0.f : (d[t * resolution.x + s1] - d[t * resolution.x + s0]) * resolution.x / ds;
+					texel[2] = dt == 0 ? 0.f : (d[t1 * resolution.x + s] - d[t0 * resolution.x + s]) * resolution.y / dt;
+				}
+			}
+			return g;
+		};
+		MIPMapBase<RGBSpectrum> *mipmap =
+			CompactMIPMap<RGBSpectrum, RGBHalfTexel>(std::move(file), resolution, loader, mipName,
+													 settings, doTrilinear, maxAniso, wrap);
+		gradientTextures[texInfo].reset(mipmap);
+		recordTexture(filename + " (gradient)", mipmap);
+		return mipmap;
+	}
+
+	template <typename Tmemory, typename Treturn>
+	template <typename T, typename S>
+	MIPMapBase<T> *ImageTexture<Tmemory, Treturn>::CompactMIPMap(
+		std::shared_ptr<const MipFile> file, const Point2i &resolution,
+		std::function<std::unique_ptr<T[]>()> loader, const std::string &mipName,
+		const MipFileHeader &settings, bool doTrilinear, float maxAniso, ImageWrap wrap)
+	{
+		if (file)
+			return new MIPMap<T, S>(std::move(file), doTrilinear, maxAniso, wrap);
+		MIPMap<T, S> *mipmap = new MIPMap<T, S>(
+			resolution, std::move(loader), doTrilinear, maxAniso, wrap);
+		mipmap->SetMipFile(mipName, settings);
+		return mipmap;
+	}
+
+	template <typename Tmemory, typename Treturn>
+	MIPMapBase<Tmemory> *ImageTexture<Tmemory, Treturn>::CreateTexture(
+		const std::string &filename, bool doTrilinear, float maxAniso,
+		ImageWrap wrap, float scale, bool gamma)
+	{
+		// Colour maps decoded from 8-bit images keep 8-bit sRGB texels, in
+		// memory and in their .mip file, as long as they are not scaled past
+		// 1; anything else keeps half floats. The choice follows the source
+		// alone: stbi_loadf() already linearizes 8-bit images, so their
+		// texels fit sRGB codes whether or not _gamma_ is set.
+		bool stamped = false, color8 = false;
+		MipFileHeader settings = {};
+		if (filename != "" &&
+			MipFile::Stamp(filename, &settings.sourceSize, &settings.sourceTime))
+		{
+			stamped = true;
+			color8 = scale > 0 && scale <= 1 && !stbi_is_hdr(filename.c_str()) &&
+					 !stbi_is_16_bit(filename.c_str());
+		}
+		settings.format = (uint32_t)(color8 ? MipTexelFormat::SRGB8 : MipTexelFormat::Half);
+		settings.gamma = gamma;
+		settings.scale = scale;
+
+		// A .mip file made by an earlier run for the same image and settings
+		// is mapped and read tile by tile, with no decoding at all; filtering
+		// can push colour maps past 1, in which case the file holds half floats
+		const std::string mipName =
+			mipFilename(filename, MipTexel<Tmemory>::channels, wrap, scale, gamma);
+		std::shared_ptr<const MipFile> file;
+		if (stamped)
+			file = openMipFile(mipName, settings, MipTexel<Tmemory>::channels, wrap);
+
+		// Otherwise only the header is read now; the image is decoded into the
+		// texture cache when one of its texels is first needed, and the .mip
+		// file is written then
+		int width = 0, height = 0, nComponents;
+		if (file || (stamped && stbi_info(filename.c_str(), &width, &height, &nComponents)))
+		{
+			Point2i expected(width, height);
+			auto loader = [filename, expected, scale, gamma]() {
+				Point2i resolution;
+				std::unique_ptr<RGBSpectrum[]> texels(loadImage(filename, resolution));
+				std::unique_ptr<Tmemory[]> convertedTexels(
+					new Tmemory[expected.x * expected.y]);
+				if (!texels || resolution != expected)
+				{
+					Tmemory grey;
+					convertIn(RGBSpectrum(0.5f), &grey, scale, gamma);
+					for (int i = 0; i < expected.x * expected.y; ++i)
+						convertedTexels[i] = grey;
+				}
+				else
+					for (int i = 0; i < expected.x * expected.y; ++i)
+						convertIn(texels[i], &convertedTexels[i], scale, gamma);
+				return convertedTexels;
+			};
+			if (color8)
+				return CompactMIPMap<Tmemory, typename CompactTexel<Tmemory>::Color>(
+					std::move(file), expected, loader, mipName, settings, doTrilinear,
+					maxAniso, wrap);
+			return CompactMIPMap<Tmemory, typename CompactTexel<Tmemory>::Linear>(
+				std::move(file), expected, loader, mipName, settings, doTrilinear,
+				maxAniso, wrap);
+		}
+
 		// Create _MIPMap_ for _filename_
 		Point2i resolution;
 		std::unique_ptr<RGBSpectrum[]> texels(loadImage(filename, resolution));
@@ -86,7 +327,7 @@ namespace Feimos
 				// std::swap(texels[o1], texels[o2]);
 			}
 
-		MIPMap<Tmemory> *mipmap = nullptr;
+		MIPMapBase<Tmemory> *mipmap = nullptr;
 		if (texels)
 		{
 			// Convert texels to type _Tmemory_ and create _MIPMap_
@@ -103,7 +344,6 @@ namespace Feimos
 			Tmemory oneVal = scale;
 			mipmap = new MIPMap<Tmemory>(Point2i(1, 1), &oneVal);
 		}
-		textures[texInfo].reset(mipmap);
 		return mipmap;
 	}
 
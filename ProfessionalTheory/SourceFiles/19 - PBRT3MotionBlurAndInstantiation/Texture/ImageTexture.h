@@ -5,14 +5,28 @@
 #include "Texture/Texture.h"
 #include "Texture/MIPMap.h"
 #include "Core/Spectrum.h"
+#include <functional>
 #include <map>
 #include <memory>
+#include <vector>
 
 namespace Feimos
 {
 
 	RGBSpectrum *loadImage(const std::string &filename, Point2i &resolution);
 
+	// Texel memory of an image texture's whole pyramid, as stored and as it
+	// would be in full precision
+	struct TextureMemoryRecord
+	{
+		std::string filename;
+		int width, height;
+		int texelBytes;
+		size_t bytes, fullPrecisionBytes;
+	};
+	// Every image texture created so far
+	std::vector<TextureMemoryRecord> TextureMemoryReport();
+
 	// TexInfo Declarations
 	struct TexInfo
 	{
@@ -51,9 +65,11 @@ namespace Feimos
 	{
 	public:
 		// ImageTexture Public Methods
+		// With _gradient_, a float texture also keeps a map of its value and
+		// $(s,t)$ derivatives, built once per image, for EvaluateGradient()
 		ImageTexture(std::unique_ptr<TextureMapping2D> m,
 					 const std::string &filename, bool doTri, float maxAniso,
-					 ImageWrap wm, float scale, bool gamma);
+					 ImageWrap wm, float scale, bool gamma, bool gradient = false);
 		static void ClearCache()
 		{
 			// textures.erase(textures.begin(), textures.end());
@@ -67,12 +83,53 @@ namespace Feimos
 			convertOut(mem, &ret);
 			return ret;
 		}
+		bool EvaluateRange(const Point2f uv[3], Treturn *minValue, Treturn *maxValue) const
+		{
+			Bounds2f st;
+			if (!mapping->MapBounds(uv, &st))
+				return false;
+			Tmemory lo, hi;
+			mipmap->TexelRange(st, &lo, &hi);
+			convertOut(lo, minValue);
+			convertOut(hi, maxValue);
+			return true;
+		}
+		void ReleaseRange() const { mipmap->ReleaseTexelRange(); }
+		bool EvaluateGradient(const SurfaceInteraction &si, Treturn *value,
+							  Treturn *dvdu, Treturn *dvdv) const
+		{
+			Vector2f dstdu, dstdv;
+			if (!gradientMap || !mapping->MapDerivatives(&dstdu, &dstdv))
+				return false;
+			Vector2f dstdx, dstdy;
+			Point2f st = mapping->Map(si, &dstdx, &dstdy);
+			RGBSpectrum g = gradientMap->Lookup(st, dstdx, dstdy);
+			*value = Treturn(g[0]);
+			*dvdu = Treturn(dstdu[0] * g[1] + dstdu[1] * g[2]);
+			*dvdv = Treturn(dstdv[0] * g[1] + dstdv[1] * g[2]);
+			return true;
+		}
 
 	private:
 		// ImageTexture Private Methods
-		static MIPMap<Tmemory> *GetTexture(const std::string &filename,
-										   bool doTrilinear, float maxAniso,
-										   ImageWrap wm, float scale, bool gamma);
+		static MIPMapBase<Tmemory> *GetTexture(const std::string &filename,
+											   bool doTrilinear, float maxAniso,
+											   ImageWrap wm, float scale, bool gamma);
+		static MIPMapBase<Tmemory> *CreateTexture(const std::string &filename,
+												  bool doTrilinear, float maxAniso,
+												  ImageWrap wm, float scale, bool gamma);
+		// Lazily loaded MIPMap whose texels are the image's value and its $s$
+		// and $t$ derivatives; nullptr when the image cannot be read
+		static MIPMapBase<RGBSpectrum> *GetGradientTexture(const std::string &filename,
+														   bool doTrilinear, float maxAniso,
+														   ImageWrap wm, float scale, bool gamma);
+		// Lazily loaded MIPMap keeping its texels as _S_, read from _file_
+		// when there is one
+		template <typename T, typename S>
+		static MIPMapBase<T> *CompactMIPMap(
+			std::shared_ptr<const MipFile> file, const Point2i &resolution,
+			std::function<std::unique_ptr<T[]>()> loader, const std::string &mipName,
+			const MipFileHeader &settings, bool doTrilinear, float maxAniso, ImageWrap wrap);
 		static void convertIn(const RGBSpectrum &from, RGBSpectrum *to, float scale,
 							  bool gamma)
 		{
@@ -94,8 +151,10 @@ namespace Feimos
 
 		// ImageTexture Private Data
 		std::unique_ptr<TextureMapping2D> mapping;
-		MIPMap<Tmemory> *mipmap;
-		static std::map<TexInfo, std::unique_ptr<MIPMap<Tmemory>>> textures;
+		MIPMapBase<Tmemory> *mipmap;
+		MIPMapBase<RGBSpectrum> *gradientMap = nullptr;
+		static std::map<TexInfo, std::unique_ptr<MIPMapBase<Tmemory>>> textures;
+		static std::map<TexInfo, std::unique_ptr<MIPMapBase<RGBSpectrum>>> gradientTextures;
 	};
 
 	extern template class ImageTexture<float, float>;
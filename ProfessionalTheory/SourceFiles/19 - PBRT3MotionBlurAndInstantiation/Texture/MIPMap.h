@@ -6,9 +6,16 @@
 #include "Core/Spectrum.h"
 #include "Texture/Texture.h"
 #include "Core/Memory.h"
+#include "Texture/TextureCache.h"
+#include "Texture/MipFile.h"
+#include "Texture/TexelFormat.h"
 
 #include <vector>
 #include <string>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <type_traits>
 
 namespace Feimos
 {
@@ -30,22 +37,81 @@ namespace Feimos
 		float weight[4];
 	};
 
-	// MIPMap Declarations
+	// MIPMapBase Declarations
+	// Lookups of a MIPMap returning _T_, whatever type its texels are stored as
 	template <typename T>
-	class MIPMap
+	class MIPMapBase
+	{
+	public:
+		virtual ~MIPMapBase() {}
+		virtual int Width() const = 0;
+		virtual int Height() const = 0;
+		virtual int Levels() const = 0;
+		virtual T Lookup(const Point2f &st, float width = 0.f) const = 0;
+		virtual T Lookup(const Point2f &st, Vector2f dstdx, Vector2f dstdy) const = 0;
+		virtual void TexelRange(const Bounds2f &st, T *minValue, T *maxValue) const = 0;
+		virtual void ReleaseTexelRange() const = 0;
+		// Bytes the texels of all levels take, and bytes per texel
+		virtual size_t MemoryBytes() const = 0;
+		virtual int TexelBytes() const = 0;
+	};
+
+	// MIPMap Declarations
+	// Levels are filtered in full precision _T_ and stored as _S_, one of the
+	// types in TexelFormat.h; texels are decoded back to _T_ as they are read
+	template <typename T, typename S = T>
+	class MIPMap final : public MIPMapBase<T>
 	{
 	public:
 		// MIPMap Public Methods
 		MIPMap(const Point2i &resolution, const T *data, bool doTri = false,
 			   float maxAniso = 8.f, ImageWrap wrapMode = ImageWrap::Repeat);
+		// Lazily loaded MIPMap: nothing is decoded until a texel is first
+		// read. The levels then live as tiles in the _TextureCache_. Evicted
+		// tiles are read back from the .mip file (see SetMipFile()), or
+		// rebuilt from levels kept after the one call to _loader_, which
+		// must return _resolution_ texels.
+		MIPMap(const Point2i &resolution,
+			   std::function<std::unique_ptr<T[]>()> loader, bool doTri = false,
+			   float maxAniso = 8.f, ImageWrap wrapMode = ImageWrap::Repeat);
+		// MIPMap read tile by tile from a pre-filtered .mip file
+		MIPMap(std::shared_ptr<const MipFile> file, bool doTri = false,
+			   float maxAniso = 8.f, ImageWrap wrapMode = ImageWrap::Repeat);
+		~MIPMap();
+		// Has a lazily loaded MIPMap write the levels it filters to a .mip
+		// file the first time it decodes its image, and read its tiles from
+		// that file from then on. _settings_ gives the format, channels,
+		// scale, gamma and source stamp; the rest of the header is filled in
+		// here. Must be called before the first lookup.
+		void SetMipFile(const std::string &filename, const MipFileHeader &settings)
+		{
+			mipFilename = filename;
+			mipSettings = settings;
+		}
 		int Width() const { return resolution[0]; }
 		int Height() const { return resolution[1]; }
-		int Levels() const { return pyramid.size(); }
-		const T &Texel(int level, int s, int t) const;
+		int Levels() const { return levelRes.size(); }
+		T Texel(int level, int s, int t) const;
 		T Lookup(const Point2f &st, float width = 0.f) const;
 		T Lookup(const Point2f &st, Vector2f dstdx, Vector2f dstdy) const;
+		// Bounds of the finest level bilinear lookups (those made without a
+		// filter footprint) at any $(s,t)$ inside _st_
+		void TexelRange(const Bounds2f &st, T *minValue, T *maxValue) const;
+		// Frees the tables TexelRange() built; a later call builds them
+		// again. Must not run concurrently with TexelRange().
+		void ReleaseTexelRange() const;
+		size_t MemoryBytes() const
+		{
+			size_t n = 0;
+			for (const Point2i &r : levelRes)
+				n += (size_t)r[0] * r[1];
+			return n * sizeof(S);
+		}
+		int TexelBytes() const { return sizeof(S); }
 
 	private:
+		template <typename, typename>
+		friend class MIPMap;
 		// MIPMap Private Methods
 		std::unique_ptr<ResampleWeight[]> resampleWeights(int oldRes, int newRes)
 		{
@@ -71,29 +137,126 @@ namespace Feimos
 		}
 		float clamp(float v) { return Clamp(v, 0.f, Infinity); }
 		Spectrum clamp(const Spectrum &v) { return v.Clamp(0.f, Infinity); }
+		static float texelMin(float a, float b) { return std::min(a, b); }
+		static float texelMax(float a, float b) { return std::max(a, b); }
+		static Spectrum texelMin(const Spectrum &a, const Spectrum &b)
+		{
+			Spectrum r;
+			for (int i = 0; i < Spectrum::nSamples; ++i)
+				r[i] = std::min(a[i], b[i]);
+			return r;
+		}
+		static Spectrum texelMax(const Spectrum &a, const Spectrum &b)
+		{
+			Spectrum r;
+			for (int i = 0; i < Spectrum::nSamples; ++i)
+				r[i] = std::max(a[i], b[i]);
+			return r;
+		}
+		// _s_ mapped into $[0, res)$ by the wrap mode, or -1 outside a Black
+		// image
+		int wrap(int s, int res) const
+		{
+			switch (wrapMode)
+			{
+			case ImageWrap::Repeat:
+				return Mod(s, res);
+			case ImageWrap::Clamp:
+				return Clamp(s, 0, res - 1);
+			default:
+				return (s < 0 || s >= res) ? -1 : s;
+			}
+		}
+		static void initWeightLut()
+		{
+			if (weightLut[0] == 0.)
+			{
+				for (int i = 0; i < WeightLUTSize; ++i)
+				{
+					float alpha = 2;
+					float r2 = float(i) / float(WeightLUTSize - 1);
+					weightLut[i] = std::exp(-alpha * r2) - std::exp(-alpha);
+				}
+			}
+		}
+		void buildPyramid(const T *img, std::true_type);
+		void buildPyramid(const T *img, std::false_type);
+		// Stores the levels of _full_, which match _levelRes_, as _S_
+		void encodeLevels(const MIPMap<T> &full,
+						  std::vector<std::unique_ptr<BlockedArray<S>>> *levels) const;
+		// Texel $(s,t)$ of a level, both inside the level
+		T texel(int level, int s, int t) const
+		{
+			if (textureId)
+				return cachedTexel(level, s, t);
+			T v;
+			DecodeTexel((*pyramid[level])(s, t), &v);
+			return v;
+		}
+		T cachedTexel(int level, int s, int t) const;
+		std::shared_ptr<const CachedTile> loadTile(int level, int ts, int tt) const;
+		std::shared_ptr<const CachedTile> readTile(const MipFile &file, int level,
+												   int ts, int tt) const;
+		std::shared_ptr<const CachedTile> insertTiles(int level, int ts, int tt) const;
+		std::unique_ptr<MIPMap<T>> decode() const;
+		bool decodedLevels() const;
 		T triangle(int level, const Point2f &st) const;
 		T EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const;
+		void buildRangePyramid() const;
 
 		// MIPMap Private Data
 		const bool doTrilinear;
 		const float maxAnisotropy;
 		const ImageWrap wrapMode;
 		Point2i resolution;
-		std::vector<std::unique_ptr<BlockedArray<T>>> pyramid;
+		std::vector<Point2i> levelRes;
+		std::vector<std::unique_ptr<BlockedArray<S>>> pyramid;
+		// Sources of a lazily loaded MIPMap; _textureId_ is 0 for one built
+		// eagerly. Once set, _mipFile_ is preferred over decoding with
+		// _loader_; it is read and replaced with std::atomic_load/store.
+		std::function<std::unique_ptr<T[]>()> loader;
+		Point2i loaderResolution;
+		uint32_t textureId = 0;
+		mutable std::mutex loadMutex;
+		mutable std::shared_ptr<const MipFile> mipFile;
+		// Levels decoded with _loader_ when no .mip file could be written,
+		// kept as _S_ so that evicted tiles are copied from them rather than
+		// rebuilt by decoding the image again. Set once under _loadMutex_;
+		// their _decodedBytes_ are pinned in the texture cache's budget.
+		mutable std::vector<std::unique_ptr<BlockedArray<S>>> decoded;
+		mutable size_t decodedBytes = 0;
+		std::string mipFilename;
+		MipFileHeader mipSettings;
 		static constexpr int WeightLUTSize = 128;
 		static float weightLut[WeightLUTSize];
+		// Per-level texel minima and maxima over $2^i \times 2^i$ blocks of the
+		// finest level, built on the first TexelRange() call and kept until
+		// ReleaseTexelRange(); they are as large as the uncompressed image
+		// and not counted by the texture cache
+		mutable std::mutex rangeMutex;
+		mutable std::atomic<bool> rangeBuilt{false};
+		mutable std::vector<std::vector<T>> rangeMin, rangeMax;
+		mutable std::vector<Point2i> rangeRes;
 	};
 
 	// MIPMap Method Definitions
-	template <typename T>
-	MIPMap<T>::MIPMap(const Point2i &res, const T *img, bool doTrilinear,
-					  float maxAnisotropy, ImageWrap wrapMode)
+	template <typename T, typename S>
+	MIPMap<T, S>::MIPMap(const Point2i &res, const T *img, bool doTrilinear,
+						 float maxAnisotropy, ImageWrap wrapMode)
 		: doTrilinear(doTrilinear),
 		  maxAnisotropy(maxAnisotropy),
 		  wrapMode(wrapMode),
 		  resolution(res)
 	{
+		buildPyramid(img, std::is_same<T, S>());
+		// Initialize EWA filter weights if needed
+		initWeightLut();
+		mipMapMemory += (4 * resolution[0] * resolution[1] * sizeof(S)) / 3;
+	}
 
+	template <typename T, typename S>
+	void MIPMap<T, S>::buildPyramid(const T *img, std::true_type)
+	{
 		std::unique_ptr<T[]> resampledImage = nullptr;
 		if (!IsPowerOf2(resolution[0]) || !IsPowerOf2(resolution[1]))
 		{
@@ -105,12 +268,13 @@ namespace Feimos
 			resampledImage.reset(new T[resPow2[0] * resPow2[1]]);
 
 			// Apply _sWeights_ to zoom in $s$ direction
-			for (int64_t t = 0; t < resolution[1]; ++t)
+#pragma omp parallel for schedule(dynamic, 16)
+			for (int t = 0; t < resolution[1]; ++t)
 			{
 				for (int s = 0; s < resPow2[0]; ++s)
 				{
 					// Compute texel $(s,t)$ in $s$-zoomed image
-					resampledImage[t * resPow2[0] + s] = 0.f;
+					resampledImage[(int64_t)t * resPow2[0] + s] = 0.f;
 					for (int j = 0; j < 4; ++j)
 					{
 						int origS = sWeights[s].firstTexel + j;
@@ -119,9 +283,9 @@ namespace Feimos
 						else if (wrapMode == ImageWrap::Clamp)
 							origS = Clamp(origS, 0, resolution[0] - 1);
 						if (origS >= 0 && origS < (int)resolution[0])
-							resampledImage[t * resPow2[0] + s] +=
+							resampledImage[(int64_t)t * resPow2[0] + s] +=
 								sWeights[s].weight[j] *
-								img[t * resolution[0] + origS];
+								img[(int64_t)t * resolution[0] + origS];
 					}
 				}
 			}
@@ -129,10 +293,13 @@ namespace Feimos
 			// Resample image in $t$ direction
 			std::unique_ptr<ResampleWeight[]> tWeights =
 				resampleWeights(resolution[1], resPow2[1]);
-			std::vector<T *> resampleBufs;
 
-			T *workData = new T[resPow2[1]];
-			for (int64_t s = 0; s < resPow2[0]; ++s)
+			// Columns are independent; each thread filters into its own buffer
+#pragma omp parallel
+			{
+			std::unique_ptr<T[]> workData(new T[resPow2[1]]);
+#pragma omp for schedule(dynamic, 16)
+			for (int s = 0; s < resPow2[0]; ++s)
 			{
 				for (int t = 0; t < resPow2[1]; ++t)
 				{
@@ -146,15 +313,13 @@ namespace Feimos
 							offset = Clamp(offset, 0, (int)resolution[1] - 1);
 						if (offset >= 0 && offset < (int)resolution[1])
 							workData[t] += tWeights[t].weight[j] *
-										   resampledImage[offset * resPow2[0] + s];
+										   resampledImage[(int64_t)offset * resPow2[0] + s];
 					}
 				}
 				for (int t = 0; t < resPow2[1]; ++t)
-					resampledImage[t * resPow2[0] + s] = clamp(workData[t]);
+					resampledImage[(int64_t)t * resPow2[0] + s] = clamp(workData[t]);
+			}
 			}
-			delete[] workData;
-			for (auto ptr : resampleBufs)
-				delete[] ptr;
 			resolution = resPow2;
 		}
 		// Initialize levels of MIPMap from image
@@ -165,15 +330,19 @@ namespace Feimos
 		pyramid[0].reset(
 			new BlockedArray<T>(resolution[0], resolution[1],
 								resampledImage ? resampledImage.get() : img));
+		levelRes.push_back(resolution);
 		for (int i = 1; i < nLevels; ++i)
 		{
 			// Initialize $i$th MIPMap level from $i-1$st level
 			int sRes = std::max(1, pyramid[i - 1]->uSize() / 2);
 			int tRes = std::max(1, pyramid[i - 1]->vSize() / 2);
 			pyramid[i].reset(new BlockedArray<T>(sRes, tRes));
+			levelRes.push_back(Point2i(sRes, tRes));
 
-			// Filter four texels from finer level of pyramid
-			for (int64_t t = 0; t < tRes; ++t)
+			// Filter four texels from finer level of pyramid; the rows of a
+			// level are independent, the levels are built one after another
+#pragma omp parallel for schedule(dynamic, 16) if (sRes * tRes >= 4096)
+			for (int t = 0; t < tRes; ++t)
 			{
 				for (int s = 0; s < sRes; ++s)
 					(*pyramid[i])(s, t) =
@@ -183,47 +352,286 @@ namespace Feimos
 								Texel(i - 1, 2 * s + 1, 2 * t + 1));
 			}
 		}
-		// Initialize EWA filter weights if needed
-		if (weightLut[0] == 0.)
+	}
+
+	template <typename T, typename S>
+	void MIPMap<T, S>::buildPyramid(const T *img, std::false_type)
+	{
+		// Every level is filtered from the full precision one above it, so
+		// storage rounding does not build up towards the coarse levels
+		MIPMap<T> full(resolution, img, doTrilinear, maxAnisotropy, wrapMode);
+		resolution = full.resolution;
+		levelRes = full.levelRes;
+		encodeLevels(full, &pyramid);
+	}
+
+	template <typename T, typename S>
+	void MIPMap<T, S>::encodeLevels(const MIPMap<T> &full,
+									std::vector<std::unique_ptr<BlockedArray<S>>> *levels) const
+	{
+		levels->resize(levelRes.size());
+		for (size_t i = 0; i < levelRes.size(); ++i)
 		{
-			for (int i = 0; i < WeightLUTSize; ++i)
-			{
-				float alpha = 2;
-				float r2 = float(i) / float(WeightLUTSize - 1);
-				weightLut[i] = std::exp(-alpha * r2) - std::exp(-alpha);
-			}
+			const int sRes = levelRes[i][0], tRes = levelRes[i][1];
+			(*levels)[i].reset(new BlockedArray<S>(sRes, tRes));
+			BlockedArray<S> &level = *(*levels)[i];
+#pragma omp parallel for schedule(dynamic, 16) if (sRes * tRes >= 4096)
+			for (int t = 0; t < tRes; ++t)
+				for (int s = 0; s < sRes; ++s)
+					EncodeTexel(full.texel(i, s, t), &level(s, t));
 		}
-		mipMapMemory += (4 * resolution[0] * resolution[1] * sizeof(T)) / 3;
 	}
 
-	template <typename T>
-	const T &MIPMap<T>::Texel(int level, int s, int t) const
+	template <typename T, typename S>
+	MIPMap<T, S>::MIPMap(const Point2i &res,
+						 std::function<std::unique_ptr<T[]>()> loader,
+						 bool doTrilinear, float maxAnisotropy, ImageWrap wrapMode)
+		: doTrilinear(doTrilinear),
+		  maxAnisotropy(maxAnisotropy),
+		  wrapMode(wrapMode),
+		  resolution(RoundUpPow2(res[0]), RoundUpPow2(res[1])),
+		  loader(std::move(loader)),
+		  loaderResolution(res),
+		  textureId(TextureCache::Get().NewTexture())
+	{
+		// Level resolutions match those the eager constructor arrives at
+		int nLevels = 1 + Log2Int(std::max(resolution[0], resolution[1]));
+		levelRes.push_back(resolution);
+		for (int i = 1; i < nLevels; ++i)
+			levelRes.push_back(Point2i(std::max(1, levelRes[i - 1][0] / 2),
+									   std::max(1, levelRes[i - 1][1] / 2)));
+		initWeightLut();
+	}
+
+	template <typename T, typename S>
+	MIPMap<T, S>::MIPMap(std::shared_ptr<const MipFile> file, bool doTrilinear,
+						 float maxAnisotropy, ImageWrap wrapMode)
+		: doTrilinear(doTrilinear),
+		  maxAnisotropy(maxAnisotropy),
+		  wrapMode(wrapMode),
+		  resolution(file->Header().width, file->Header().height),
+		  loaderResolution(file->Header().sourceWidth, file->Header().sourceHeight),
+		  textureId(TextureCache::Get().NewTexture()),
+		  mipFile(std::move(file))
 	{
-		const BlockedArray<T> &l = *pyramid[level];
+		int nLevels = 1 + Log2Int(std::max(resolution[0], resolution[1]));
+		levelRes.push_back(resolution);
+		for (int i = 1; i < nLevels; ++i)
+			levelRes.push_back(Point2i(std::max(1, levelRes[i - 1][0] / 2),
+									   std::max(1, levelRes[i - 1][1] / 2)));
+		initWeightLut();
+	}
+
+	template <typename T, typename S>
+	MIPMap<T, S>::~MIPMap()
+	{
+		if (textureId)
+			TextureCache::Get().Release(textureId);
+		if (decodedBytes)
+			TextureCache::Get().Unpin(decodedBytes);
+	}
+
+	template <typename T, typename S>
+	T MIPMap<T, S>::Texel(int level, int s, int t) const
+	{
+		const Point2i &l = levelRes[level];
 		// Compute texel $(s,t)$ accounting for boundary conditions
-		switch (wrapMode)
+		s = wrap(s, l[0]);
+		t = wrap(t, l[1]);
+		if (s < 0 || t < 0)
+			return T(0.f);
+		return texel(level, s, t);
+	}
+
+	template <typename T, typename S>
+	T MIPMap<T, S>::cachedTexel(int level, int s, int t) const
+	{
+		// The tiles a thread used last sit in a small direct mapped table in
+		// front of the cache, so the texels of one filter footprint mostly
+		// get by without taking a shard lock
+		struct RecentTile
 		{
-		case ImageWrap::Repeat:
-			s = Mod(s, l.uSize());
-			t = Mod(t, l.vSize());
-			break;
-		case ImageWrap::Clamp:
-			s = Clamp(s, 0, l.uSize() - 1);
-			t = Clamp(t, 0, l.vSize() - 1);
-			break;
-		case ImageWrap::Black:
+			uint64_t key = 0;
+			std::shared_ptr<const CachedTile> tile;
+		};
+		static thread_local RecentTile recent[16];
+		const int ts = s >> TextureCache::tileLog2, tt = t >> TextureCache::tileLog2;
+		const uint64_t key = TextureCache::TileKey(textureId, level, ts, tt);
+		RecentTile &slot = recent[(tt ^ (ts << 1) ^ (level << 2) ^ (textureId * 7)) & 15];
+		if (slot.key != key)
 		{
-			static const T black = 0.f;
-			if (s < 0 || s >= (int)l.uSize() || t < 0 || t >= (int)l.vSize())
-				return black;
-			break;
+			std::shared_ptr<const CachedTile> tile = TextureCache::Get().Find(key);
+			slot.tile = tile ? std::move(tile) : loadTile(level, ts, tt);
+			slot.key = key;
 		}
+		const TexelTile<S> &tile = static_cast<const TexelTile<S> &>(*slot.tile);
+		T v;
+		DecodeTexel(tile(s & (TextureCache::tileSize - 1), t & (TextureCache::tileSize - 1)), &v);
+		return v;
+	}
+
+	template <typename T, typename S>
+	std::unique_ptr<MIPMap<T>> MIPMap<T, S>::decode() const
+	{
+		// Decode the image and filter it exactly as an eagerly built MIPMap
+		std::unique_ptr<MIPMap<T>> full;
+		{
+			std::unique_ptr<T[]> img = loader();
+			full.reset(new MIPMap<T>(loaderResolution, img.get(), doTrilinear,
+									 maxAnisotropy, wrapMode));
 		}
-		return l(s, t);
+		if (mipFilename.empty())
+			return full;
+
+		// Keep the filtered levels for later runs, and read them back from the
+		// file so that this run sees the same stored texel values
+		MipFileHeader info = mipSettings;
+		info.channels = MipTexel<T>::channels;
+		info.width = resolution[0];
+		info.height = resolution[1];
+		info.sourceWidth = loaderResolution[0];
+		info.sourceHeight = loaderResolution[1];
+		info.nLevels = Levels();
+		info.tileSize = TextureCache::tileSize;
+		info.wrapMode = (uint32_t)wrapMode;
+		const MIPMap<T> &levels = *full;
+		// Resampling can overshoot past 1, which 8-bit sRGB cannot hold; the
+		// coarser levels are averages of the finest one
+		if (info.format == (uint32_t)MipTexelFormat::SRGB8)
+		{
+			float maxValue = 0, c[4];
+			for (int t = 0; t < resolution[1]; ++t)
+				for (int s = 0; s < resolution[0]; ++s)
+				{
+					MipTexel<T>::Store(levels.texel(0, s, t), c);
+					for (int i = 0; i < MipTexel<T>::channels; ++i)
+						maxValue = std::max(maxValue, c[i]);
+				}
+			if (maxValue > 1)
+				info.format = (uint32_t)MipTexelFormat::Half;
+		}
+		auto tile = [&](int level, int ts, int tt, float *texels) {
+			const int s0 = ts * TextureCache::tileSize, t0 = tt * TextureCache::tileSize;
+			const int w = std::min(TextureCache::tileSize, levelRes[level][0] - s0);
+			const int h = std::min(TextureCache::tileSize, levelRes[level][1] - t0);
+			for (int t = 0; t < h; ++t)
+				for (int s = 0; s < w; ++s)
+					MipTexel<T>::Store(levels.texel(level, s0 + s, t0 + t),
+									   texels + (t * TextureCache::tileSize + s) *
+													MipTexel<T>::channels);
+		};
+		if (MipFile::Write(mipFilename, info, tile))
+		{
+			std::shared_ptr<const MipFile> file = std::make_shared<MipFile>(mipFilename);
+			if (file->IsValid())
+				std::atomic_store(&mipFile, file);
+		}
+		return full;
 	}
 
-	template <typename T>
-	T MIPMap<T>::Lookup(const Point2f &st, float width) const
+	template <typename T, typename S>
+	std::shared_ptr<const CachedTile> MIPMap<T, S>::readTile(const MipFile &file, int level,
+															 int ts, int tt) const
+	{
+		const int s0 = ts << TextureCache::tileLog2, t0 = tt << TextureCache::tileLog2;
+		const int w = std::min(TextureCache::tileSize, levelRes[level][0] - s0);
+		const int h = std::min(TextureCache::tileSize, levelRes[level][1] - t0);
+		const int c = MipTexel<T>::channels;
+		std::unique_ptr<float[]> texels(
+			new float[TextureCache::tileSize * TextureCache::tileSize * c]);
+		file.ReadTile(level, ts, tt, texels.get());
+		std::shared_ptr<TexelTile<S>> tile = std::make_shared<TexelTile<S>>(w, h);
+		for (int t = 0; t < h; ++t)
+			for (int s = 0; s < w; ++s)
+			{
+				T v;
+				MipTexel<T>::Load(&texels[(t * TextureCache::tileSize + s) * c], &v);
+				EncodeTexel(v, &(*tile)(s, t));
+			}
+		return tile;
+	}
+
+	template <typename T, typename S>
+	std::shared_ptr<const CachedTile> MIPMap<T, S>::loadTile(int level, int ts, int tt) const
+	{
+		TextureCache &cache = TextureCache::Get();
+		const uint64_t wanted = TextureCache::TileKey(textureId, level, ts, tt);
+		std::shared_ptr<const CachedTile> result;
+		// A tile of a .mip file is read on its own, without any locking
+		std::shared_ptr<const MipFile> file = std::atomic_load(&mipFile);
+		if (!file)
+		{
+			std::lock_guard<std::mutex> lock(loadMutex);
+			// Another thread may have loaded the texture while this one waited
+			result = cache.Find(wanted, false);
+			if (result)
+				return result;
+			if (decodedLevels())
+				return insertTiles(level, ts, tt);
+			file = std::atomic_load(&mipFile);
+		}
+		result = readTile(*file, level, ts, tt);
+		cache.Insert(wanted, result);
+		return result;
+	}
+
+	template <typename T, typename S>
+	bool MIPMap<T, S>::decodedLevels() const
+	{
+		// Called with _loadMutex_ held; false once tiles can be read from a
+		// .mip file. decode() writes that file when it can, and then the
+		// full precision levels are not needed past this call.
+		if (decoded.empty() && !std::atomic_load(&mipFile))
+		{
+			std::unique_ptr<MIPMap<T>> full = decode();
+			if (!std::atomic_load(&mipFile))
+			{
+				encodeLevels(*full, &decoded);
+				decodedBytes = MemoryBytes();
+				TextureCache::Get().Pin(decodedBytes);
+			}
+		}
+		return !decoded.empty();
+	}
+
+	template <typename T, typename S>
+	std::shared_ptr<const CachedTile> MIPMap<T, S>::insertTiles(int level, int ts, int tt) const
+	{
+		TextureCache &cache = TextureCache::Get();
+		const uint64_t wanted = TextureCache::TileKey(textureId, level, ts, tt);
+		auto makeTile = [&](int l, int x, int y) {
+			const int s0 = x << TextureCache::tileLog2, t0 = y << TextureCache::tileLog2;
+			const int w = std::min(TextureCache::tileSize, levelRes[l][0] - s0);
+			const int h = std::min(TextureCache::tileSize, levelRes[l][1] - t0);
+			std::shared_ptr<TexelTile<S>> tile = std::make_shared<TexelTile<S>>(w, h);
+			for (int t = 0; t < h; ++t)
+				for (int s = 0; s < w; ++s)
+					(*tile)(s, t) = (*decoded[l])(s0 + s, t0 + t);
+			return tile;
+		};
+
+		// The requested tile becomes the most recently used one; the rest of
+		// the pyramid only fills the room the cache has left, as the region
+		// around a lookup is likely to be read next
+		std::shared_ptr<const CachedTile> result = makeTile(level, ts, tt);
+		cache.Insert(wanted, result);
+		for (int l = 0; l < Levels(); ++l)
+		{
+			const int nt = (levelRes[l][1] + TextureCache::tileSize - 1) >> TextureCache::tileLog2;
+			const int ns = (levelRes[l][0] + TextureCache::tileSize - 1) >> TextureCache::tileLog2;
+			for (int y = 0; y < nt; ++y)
+				for (int x = 0; x < ns; ++x)
+				{
+					const uint64_t key = TextureCache::TileKey(textureId, l, x, y);
+					if (key != wanted)
+						cache.Insert(key, makeTile(l, x, y), true);
+				}
+		}
+		return result;
+	}
+
+	template <typename T, typename S>
+	T MIPMap<T, S>::Lookup(const Point2f &st, float width) const
 	{
 		++nTrilerpLookups;
 		// Compute MIPMap level for trilinear filtering
@@ -241,8 +649,8 @@ namespace Feimos
 		}
 	}
 
-	template <typename T>
-	T MIPMap<T>::Lookup(const Point2f &st, Vector2f dst0, Vector2f dst1) const
+	template <typename T, typename S>
+	T MIPMap<T, S>::Lookup(const Point2f &st, Vector2f dst0, Vector2f dst1) const
 	{
 		if (doTrilinear)
 		{
@@ -274,32 +682,40 @@ namespace Feimos
 					EWA(ilod + 1, st, dst0, dst1));
 	}
 
-	template <typename T>
-	T MIPMap<T>::triangle(int level, const Point2f &st) const
+	template <typename T, typename S>
+	T MIPMap<T, S>::triangle(int level, const Point2f &st) const
 	{
 		level = Clamp(level, 0, Levels() - 1);
-		float s = st[0] * pyramid[level]->uSize() - 0.5f;
-		float t = st[1] * pyramid[level]->vSize() - 0.5f;
+		const Point2i &l = levelRes[level];
+		float s = st[0] * l[0] - 0.5f;
+		float t = st[1] * l[1] - 0.5f;
 		int s0 = std::floor(s), t0 = std::floor(t);
 		float ds = s - s0, dt = t - t0;
+		// The four texels lie inside the level for all but lookups at its
+		// edges, which alone need the wrap mode
+		if (s0 >= 0 && t0 >= 0 && s0 + 1 < l[0] && t0 + 1 < l[1])
+			return (1 - ds) * (1 - dt) * texel(level, s0, t0) +
+				   (1 - ds) * dt * texel(level, s0, t0 + 1) +
+				   ds * (1 - dt) * texel(level, s0 + 1, t0) +
+				   ds * dt * texel(level, s0 + 1, t0 + 1);
 		return (1 - ds) * (1 - dt) * Texel(level, s0, t0) +
 			   (1 - ds) * dt * Texel(level, s0, t0 + 1) +
 			   ds * (1 - dt) * Texel(level, s0 + 1, t0) +
 			   ds * dt * Texel(level, s0 + 1, t0 + 1);
 	}
 
-	template <typename T>
-	T MIPMap<T>::EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const
+	template <typename T, typename S>
+	T MIPMap<T, S>::EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const
 	{
 		if (level >= Levels())
 			return Texel(Levels() - 1, 0, 0);
 		// Convert EWA coordinates to appropriate scale for level
-		st[0] = st[0] * pyramid[level]->uSize() - 0.5f;
-		st[1] = st[1] * pyramid[level]->vSize() - 0.5f;
-		dst0[0] *= pyramid[level]->uSize();
-		dst0[1] *= pyramid[level]->vSize();
-		dst1[0] *= pyramid[level]->uSize();
-		dst1[1] *= pyramid[level]->vSize();
+		st[0] = st[0] * levelRes[level][0] - 0.5f;
+		st[1] = st[1] * levelRes[level][1] - 0.5f;
+		dst0[0] *= levelRes[level][0];
+		dst0[1] *= levelRes[level][1];
+		dst1[0] *= levelRes[level][0];
+		dst1[1] *= levelRes[level][1];
 
 		// Compute ellipse coefficients to bound EWA filter region
 		float A = dst0[1] * dst0[1] + dst1[1] * dst1[1] + 1;
@@ -319,32 +735,215 @@ namespace Feimos
 		int t0 = std::ceil(st[1] - 2 * invDet * vSqrt);
 		int t1 = std::floor(st[1] + 2 * invDet * vSqrt);
 
-		// Scan over ellipse bound and compute quadratic equation
+		// Resolve the wrap mode once for the footprint's columns rather than
+		// per texel. Footprints inside the level need no wrapping, and those
+		// wider than _maxColumns_ wrap as they go.
+		const Point2i &res = levelRes[level];
+		constexpr int maxColumns = 64;
+		int columns[maxColumns];
+		const bool inside = s0 >= 0 && s1 < res[0];
+		const bool wrapped = !inside && s1 - s0 < maxColumns;
+		if (wrapped)
+			for (int is = s0; is <= s1; ++is)
+				columns[is - s0] = wrap(is, res[0]);
+
+		// Scan the rows of the ellipse bound. Wide rows only visit the columns
+		// between the roots of $A ss^2 + B ss tt + C tt^2 = 1$, widened by a
+		// texel for rounding; the squared radii of a row are computed
+		// together, up to _maxColumns_ at a time
 		T sum(0.f);
 		float sumWts = 0;
 		for (int it = t0; it <= t1; ++it)
 		{
 			float tt = it - st[1];
-			for (int is = s0; is <= s1; ++is)
+			int r0 = s0, r1 = s1;
+			if (s1 - s0 >= 8)
+			{
+				float b = B * tt, c = C * tt * tt - 1;
+				float disc = b * b - 4 * A * c;
+				if (disc < 0)
+					continue;
+				float root = std::sqrt(disc), inv2A = 0.5f / A;
+				r0 = std::max(s0, (int)std::floor(st[0] + (-b - root) * inv2A) - 1);
+				r1 = std::min(s1, (int)std::ceil(st[0] + (-b + root) * inv2A) + 1);
+			}
+			const int t = wrap(it, res[1]);
+			for (int is = r0; is <= r1; is += maxColumns)
 			{
-				float ss = is - st[0];
-				// Compute squared radius and filter texel if inside ellipse
-				float r2 = A * ss * ss + B * ss * tt + C * tt * tt;
-				if (r2 < 1)
+				const int n = std::min(maxColumns, r1 - is + 1);
+				// Same operation order as the per-texel radius of the book's
+				// filter, so the weights do not change
+				const float ctt = C * tt * tt;
+				float r2[maxColumns];
+#pragma omp simd
+				for (int i = 0; i < n; ++i)
 				{
-					int index =
-						std::min((int)(r2 * WeightLUTSize), WeightLUTSize - 1);
-					float weight = weightLut[index];
-					sum += Texel(level, is, it) * weight;
-					sumWts += weight;
+					float ss = (is + i) - st[0];
+					r2[i] = A * ss * ss + B * ss * tt + ctt;
+				}
+				// Filter the texels inside the ellipse; those outside a Black
+				// image count with their weight only
+				for (int i = 0; i < n; ++i)
+				{
+					if (r2[i] < 1)
+					{
+						int index =
+							std::min((int)(r2[i] * WeightLUTSize), WeightLUTSize - 1);
+						float weight = weightLut[index];
+						int s = inside ? is + i : wrapped ? columns[is + i - s0] : wrap(is + i, res[0]);
+						if (s >= 0 && t >= 0)
+							sum += texel(level, s, t) * weight;
+						sumWts += weight;
+					}
 				}
 			}
 		}
 		return sum / sumWts;
 	}
 
-	template <typename T>
-	float MIPMap<T>::weightLut[WeightLUTSize];
+	template <typename T, typename S>
+	void MIPMap<T, S>::buildRangePyramid() const
+	{
+		// A lazily loaded image without a .mip file is read from its decoded
+		// levels rather than tile by tile through the cache
+		bool fromDecoded = false;
+		if (textureId && !std::atomic_load(&mipFile))
+		{
+			std::lock_guard<std::mutex> lock(loadMutex);
+			fromDecoded = decodedLevels();
+		}
+		// Texels as lookups see them, after storage rounding
+		auto finest = [&](int s, int t) {
+			if (!fromDecoded)
+				return texel(0, s, t);
+			T v;
+			DecodeTexel((*decoded[0])(s, t), &v);
+			return v;
+		};
+		int w = resolution[0], h = resolution[1];
+		rangeRes.push_back(Point2i(w, h));
+		rangeMin.emplace_back(w * h);
+		rangeMax.emplace_back(w * h);
+		for (int t = 0; t < h; ++t)
+			for (int s = 0; s < w; ++s)
+				rangeMin[0][t * w + s] = rangeMax[0][t * w + s] = finest(s, t);
+		while (w > 1 || h > 1)
+		{
+			int w2 = std::max(1, w / 2), h2 = std::max(1, h / 2);
+			const std::vector<T> &lo = rangeMin.back(), &hi = rangeMax.back();
+			std::vector<T> lo2(w2 * h2), hi2(w2 * h2);
+			for (int t = 0; t < h2; ++t)
+			{
+				int ta = std::min(2 * t, h - 1), tb = std::min(2 * t + 1, h - 1);
+				for (int s = 0; s < w2; ++s)
+				{
+					int sa = std::min(2 * s, w - 1), sb = std::min(2 * s + 1, w - 1);
+					lo2[t * w2 + s] = texelMin(texelMin(lo[ta * w + sa], lo[ta * w + sb]),
+											   texelMin(lo[tb * w + sa], lo[tb * w + sb]));
+					hi2[t * w2 + s] = texelMax(texelMax(hi[ta * w + sa], hi[ta * w + sb]),
+											   texelMax(hi[tb * w + sa], hi[tb * w + sb]));
+				}
+			}
+			rangeMin.push_back(std::move(lo2));
+			rangeMax.push_back(std::move(hi2));
+			rangeRes.push_back(Point2i(w2, h2));
+			w = w2;
+			h = h2;
+		}
+	}
+
+	template <typename T, typename S>
+	void MIPMap<T, S>::TexelRange(const Bounds2f &st, T *minValue, T *maxValue) const
+	{
+		if (!rangeBuilt.load(std::memory_order_acquire))
+		{
+			std::lock_guard<std::mutex> lock(rangeMutex);
+			if (!rangeBuilt.load(std::memory_order_relaxed))
+			{
+				buildRangePyramid();
+				rangeBuilt.store(true, std::memory_order_release);
+			}
+		}
+
+		// Finest level texels a bilinear lookup inside _st_ can touch, per
+		// axis; the coordinates are reduced first so that they fit an int
+		int lo[2], hi[2];
+		for (int axis = 0; axis < 2; ++axis)
+		{
+			int res = resolution[axis];
+			float a = st.pMin[axis], b = st.pMax[axis];
+			if (wrapMode == ImageWrap::Repeat)
+			{
+				float shift = std::floor(a);
+				a -= shift;
+				b -= shift;
+				b = std::min(b, 2.f);
+			}
+			else
+			{
+				a = Clamp(a, -1.f, 2.f);
+				b = Clamp(b, -1.f, 2.f);
+			}
+			lo[axis] = (int)std::floor(a * res - 0.5f);
+			hi[axis] = (int)std::floor(b * res - 0.5f) + 1;
+			if (wrapMode == ImageWrap::Repeat && hi[axis] - lo[axis] >= res)
+			{
+				lo[axis] = 0;
+				hi[axis] = res - 1;
+			}
+		}
+
+		// Coarsest level at which the region covers at most 4x4 blocks
+		int level = 0;
+		auto blockOf = [](int texel, int level) {
+			return texel >= 0 ? texel >> level : -((-texel + (1 << level) - 1) >> level);
+		};
+		while (level + 1 < (int)rangeRes.size() &&
+			   (blockOf(hi[0], level) - blockOf(lo[0], level) >= 4 ||
+				blockOf(hi[1], level) - blockOf(lo[1], level) >= 4))
+			++level;
+
+		// Texels outside a black bordered image read as zero
+		*minValue = *maxValue = T(0.f);
+		bool first = !(wrapMode == ImageWrap::Black &&
+					   (lo[0] < 0 || hi[0] >= resolution[0] || lo[1] < 0 || hi[1] >= resolution[1]));
+		const Point2i res = rangeRes[level];
+		const std::vector<T> &levelMin = rangeMin[level], &levelMax = rangeMax[level];
+		for (int t = blockOf(lo[1], level); t <= blockOf(hi[1], level); ++t)
+		{
+			for (int s = blockOf(lo[0], level); s <= blockOf(hi[0], level); ++s)
+			{
+				int bs, bt;
+				if (wrapMode == ImageWrap::Repeat)
+				{
+					bs = Mod(s, res[0]);
+					bt = Mod(t, res[1]);
+				}
+				else
+				{
+					bs = Clamp(s, 0, res[0] - 1);
+					bt = Clamp(t, 0, res[1] - 1);
+				}
+				const T &bMin = levelMin[bt * res[0] + bs], &bMax = levelMax[bt * res[0] + bs];
+				*minValue = first ? bMin : texelMin(*minValue, bMin);
+				*maxValue = first ? bMax : texelMax(*maxValue, bMax);
+				first = false;
+			}
+		}
+	}
+
+	template <typename T, typename S>
+	void MIPMap<T, S>::ReleaseTexelRange() const
+	{
+		std::lock_guard<std::mutex> lock(rangeMutex);
+		std::vector<std::vector<T>>().swap(rangeMin);
+		std::vector<std::vector<T>>().swap(rangeMax);
+		std::vector<Point2i>().swap(rangeRes);
+		rangeBuilt.store(false, std::memory_order_release);
+	}
+
+	template <typename T, typename S>
+	float MIPMap<T, S>::weightLut[WeightLUTSize];
 
 }
 
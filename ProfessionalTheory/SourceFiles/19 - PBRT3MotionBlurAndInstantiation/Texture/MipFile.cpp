@@ -0,0 +1,173 @@
+#include "Texture/MipFile.h"
+#include "Texture/TexelFormat.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace Feimos
+{
+
+	// MipFile Method Definitions
+	MipFile::MipFile(const std::string &filename)
+	{
+		mapped.reset(new MappedFile(filename));
+		if (!mapped->IsValid() || mapped->Size() < sizeof(MipFileHeader))
+			return;
+		const MipFileHeader *h = (const MipFileHeader *)mapped->Data();
+		if (memcmp(h->magic, MipFileMagic, sizeof(h->magic)) != 0 ||
+			h->version != MipFileVersion || h->headerSize != sizeof(MipFileHeader) ||
+			h->fileSize != mapped->Size() || h->channels < 1 || h->channels > 4 ||
+			h->format > (uint32_t)MipTexelFormat::Half || h->tileSize == 0 ||
+			h->tileSize > MipFileMaxTileSize ||
+			!IsPowerOf2(h->width) || !IsPowerOf2(h->height) ||
+			h->nLevels < 1 || h->nLevels > (uint32_t)MipFileMaxLevels ||
+			std::max(h->width, h->height) > (1u << (MipFileMaxLevels - 1)) ||
+			h->nLevels != 1 + (uint32_t)Log2Int(std::max(h->width, h->height)))
+			return;
+		// Every level has to lie inside the file; compared by division so
+		// that corrupt offsets and tile counts cannot overflow
+		const uint64_t tileBytes = TileBytes(*h);
+		uint32_t w = h->width, ht = h->height;
+		for (uint32_t level = 0; level < h->nLevels; ++level)
+		{
+			uint64_t nTiles = (uint64_t)((w + h->tileSize - 1) / h->tileSize) *
+							  ((ht + h->tileSize - 1) / h->tileSize);
+			uint64_t offset = h->levelOffset[level];
+			if (offset % MipFileAlignment != 0 || offset < sizeof(MipFileHeader) ||
+				offset > h->fileSize || nTiles > (h->fileSize - offset) / tileBytes)
+				return;
+			w = std::max(1u, w / 2);
+			ht = std::max(1u, ht / 2);
+		}
+		header = h;
+	}
+
+	void MipFile::ReadTile(int level, int ts, int tt, float *texels) const
+	{
+		uint32_t w = std::max(1u, header->width >> level);
+		int tilesPerRow = (w + header->tileSize - 1) / header->tileSize;
+		size_t n = (size_t)header->tileSize * header->tileSize * header->channels;
+		const char *tile = mapped->Data() + header->levelOffset[level] +
+						   ((size_t)tt * tilesPerRow + ts) * TileBytes(*header);
+		if (header->format == (uint32_t)MipTexelFormat::SRGB8)
+		{
+			const float *lut = SRGB8ToLinear();
+			const uint8_t *codes = (const uint8_t *)tile;
+			for (size_t i = 0; i < n; ++i)
+				texels[i] = lut[codes[i]];
+		}
+		else
+		{
+			uint16_t half;
+			for (size_t i = 0; i < n; ++i)
+			{
+				memcpy(&half, tile + 2 * i, sizeof(half));
+				texels[i] = HalfToFloat(half);
+			}
+		}
+	}
+
+	bool MipFile::Write(const std::string &filename, const MipFileHeader &info,
+						const std::function<void(int, int, int, float *)> &tile)
+	{
+		MipFileHeader h = info;
+		memcpy(h.magic, MipFileMagic, sizeof(h.magic));
+		h.version = MipFileVersion;
+		h.headerSize = sizeof(MipFileHeader);
+		std::fill(h.levelOffset, h.levelOffset + MipFileMaxLevels, 0);
+		if (h.nLevels > (uint32_t)MipFileMaxLevels)
+			return false;
+
+		// Lay out the levels
+		std::vector<int> tilesX(h.nLevels), tilesY(h.nLevels);
+		uint64_t offset = sizeof(MipFileHeader);
+		uint32_t w = h.width, ht = h.height;
+		for (uint32_t level = 0; level < h.nLevels; ++level)
+		{
+			tilesX[level] = (w + h.tileSize - 1) / h.tileSize;
+			tilesY[level] = (ht + h.tileSize - 1) / h.tileSize;
+			h.levelOffset[level] = offset;
+			offset += (uint64_t)tilesX[level] * tilesY[level] * TileBytes(h);
+			offset = (offset + MipFileAlignment - 1) & ~(MipFileAlignment - 1);
+			w = std::max(1u, w / 2);
+			ht = std::max(1u, ht / 2);
+		}
+		h.fileSize = offset;
+
+		// Several textures, or several processes, may write the same file at
+		// once; each writer fills a temporary file of its own, and the last
+		// rename wins with identical contents
+		static std::atomic<unsigned> nextTemp(0);
+		std::string tempName = filename + "." + std::to_string((long long)getpid()) + "." +
+							   std::to_string(nextTemp++) + ".tmp";
+		FILE *f = fopen(tempName.c_str(), "wb");
+		if (!f)
+			return false;
+		bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+		const size_t nValues = (size_t)h.tileSize * h.tileSize * h.channels;
+		const size_t tileBytes = TileBytes(h);
+		for (uint32_t level = 0; ok && level < h.nLevels; ++level)
+		{
+			// The tiles of a row are encoded in parallel and written in order
+			std::vector<char> row((size_t)tilesX[level] * tileBytes);
+			for (int tt = 0; ok && tt < tilesY[level]; ++tt)
+			{
+#pragma omp parallel for schedule(dynamic, 1)
+				for (int ts = 0; ts < tilesX[level]; ++ts)
+				{
+					std::vector<float> texels(nValues, 0.f);
+					tile(level, ts, tt, texels.data());
+					char *out = row.data() + ts * tileBytes;
+					for (size_t i = 0; i < nValues; ++i)
+					{
+						if (h.format == (uint32_t)MipTexelFormat::SRGB8)
+							out[i] = (char)LinearToSRGB8(texels[i]);
+						else
+						{
+							uint16_t half = FloatToHalf(Clamp(texels[i], -MaxHalf, MaxHalf));
+							memcpy(out + 2 * i, &half, sizeof(half));
+						}
+					}
+				}
+				ok = fwrite(row.data(), 1, row.size(), f) == row.size();
+			}
+			// Pad to the next level, or to the end of the file
+			uint64_t end = level + 1 < h.nLevels ? h.levelOffset[level + 1] : h.fileSize;
+			uint64_t pad = end - h.levelOffset[level] -
+						   (uint64_t)tilesX[level] * tilesY[level] * tileBytes;
+			static const char zeros[MipFileAlignment] = {};
+			if (ok && pad > 0)
+				ok = fwrite(zeros, 1, (size_t)pad, f) == pad;
+		}
+		ok = fclose(f) == 0 && ok;
+		if (ok)
+		{
+			remove(filename.c_str());
+			ok = rename(tempName.c_str(), filename.c_str()) == 0;
+		}
+		if (!ok)
+			remove(tempName.c_str());
+		return ok;
+	}
+
+	bool MipFile::Stamp(const std::string &filename, uint64_t *size, int64_t *time)
+	{
+		struct stat st;
+		if (stat(filename.c_str(), &st) != 0)
+			return false;
+		*size = (uint64_t)st.st_size;
+		*time = (int64_t)st.st_mtime;
+		return true;
+	}
+
+}
@@ -0,0 +1,123 @@
+#pragma once
+#ifndef __MipFile_h__
+#define __MipFile_h__
+
+#include "Core/FeimosRender.h"
+#include "Core/MappedFile.h"
+#include "Core/Spectrum.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace Feimos
+{
+
+	// .mip pre-filtered texture layout. A fixed-size little-endian header is
+	// followed by the MIP levels, finest first, each starting at a multiple
+	// of MipFileAlignment. A level is a row-major grid of tiles of
+	// tileSize x tileSize texels; tiles at the right and top edges are
+	// padded to full size, so any tile is found without a table. Texels hold
+	// _channels_ values, either 8-bit sRGB encoded or half floats, and are
+	// the values an ImageTexture looks up: scale and gamma are applied and
+	// the levels are filtered exactly as MIPMap filters them.
+	constexpr char MipFileMagic[8] = {'F', 'E', 'I', 'M', 'I', 'P', '\0', '\0'};
+	constexpr uint32_t MipFileVersion = 1;
+	constexpr uint64_t MipFileAlignment = 16;
+	constexpr int MipFileMaxLevels = 24;
+	constexpr uint32_t MipFileMaxTileSize = 4096;
+
+	enum class MipTexelFormat : uint32_t
+	{
+		SRGB8,
+		Half
+	};
+
+	struct MipFileHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t headerSize;
+		uint32_t format, channels;
+		// Finest level resolution, rounded up to powers of two, and the
+		// resolution of the image it was made from
+		uint32_t width, height;
+		uint32_t sourceWidth, sourceHeight;
+		uint32_t nLevels, tileSize;
+		// Settings the texels depend on
+		uint32_t wrapMode, gamma;
+		float scale;
+		uint32_t pad;
+		// Size and modification time of the source image, to notice when it
+		// changes
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		uint64_t levelOffset[MipFileMaxLevels];
+		uint64_t fileSize;
+		uint64_t pad2;
+	};
+	static_assert(sizeof(MipFileHeader) % MipFileAlignment == 0,
+				  "the first level must follow the header without padding");
+
+	// Texel types a .mip file can hold, as the per-channel floats it stores
+	template <typename T>
+	struct MipTexel;
+	template <>
+	struct MipTexel<float>
+	{
+		static constexpr int channels = 1;
+		static void Load(const float *c, float *t) { *t = c[0]; }
+		static void Store(float t, float *c) { c[0] = t; }
+	};
+	template <>
+	struct MipTexel<RGBSpectrum>
+	{
+		static constexpr int channels = 3;
+		static void Load(const float *c, RGBSpectrum *t)
+		{
+			for (int i = 0; i < 3; ++i)
+				(*t)[i] = c[i];
+		}
+		static void Store(const RGBSpectrum &t, float *c)
+		{
+			for (int i = 0; i < 3; ++i)
+				c[i] = t[i];
+		}
+	};
+
+	// MipFile Declarations
+	// Read-only mapping of a .mip file. Tiles are decoded straight from the
+	// mapped pages, so only the tiles a render touches are ever read.
+	class MipFile
+	{
+	public:
+		MipFile(const std::string &filename);
+		bool IsValid() const { return header != nullptr; }
+		const MipFileHeader &Header() const { return *header; }
+		// Decodes tile (ts, tt) of _level_ into tileSize * tileSize texels of
+		// _channels_ floats each, row by row
+		void ReadTile(int level, int ts, int tt, float *texels) const;
+
+		// Writes a .mip file for _info_, whose format, resolutions, level count
+		// and settings must be filled in; _tile_ provides the texels of a tile
+		// in the layout ReadTile() returns. The file is written under a
+		// temporary name and renamed, so readers never see a partial file.
+		static bool Write(const std::string &filename, const MipFileHeader &info,
+						  const std::function<void(int, int, int, float *)> &tile);
+		// Size and modification time of a file, false when it does not exist
+		static bool Stamp(const std::string &filename, uint64_t *size, int64_t *time);
+		static size_t TileBytes(const MipFileHeader &h)
+		{
+			return (size_t)h.tileSize * h.tileSize * h.channels *
+				   (h.format == (uint32_t)MipTexelFormat::SRGB8 ? 1 : 2);
+		}
+
+	private:
+		std::unique_ptr<MappedFile> mapped;
+		const MipFileHeader *header = nullptr;
+	};
+
+}
+
+#endif
@@ -0,0 +1,115 @@
+#pragma once
+#ifndef __TexelFormat_h__
+#define __TexelFormat_h__
+
+#include "Core/FeimosRender.h"
+#include "Core/Spectrum.h"
+#include "Core/Quantize.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace Feimos
+{
+
+	// sRGB Transfer Table
+	// Linear value of each 8-bit sRGB code; decoding a texel is a table lookup
+	inline const float *SRGB8ToLinear()
+	{
+		static const struct Table
+		{
+			float v[256];
+			Table()
+			{
+				for (int i = 0; i < 256; ++i)
+					v[i] = InverseGammaCorrect(i / 255.f);
+			}
+		} table;
+		return table.v;
+	}
+
+	// Nearest 8-bit sRGB code of a linear value, clamped to [0, 1]
+	inline uint8_t LinearToSRGB8(float v)
+	{
+		const float *lut = SRGB8ToLinear();
+		int i = int(std::lower_bound(lut, lut + 256, v) - lut);
+		if (i == 256)
+			return 255;
+		if (i > 0 && v - lut[i - 1] <= lut[i] - v)
+			--i;
+		return (uint8_t)i;
+	}
+
+	// Largest finite half float; values of larger magnitude are clamped
+	// rather than stored as infinity
+	constexpr float MaxHalf = 65504.f;
+
+	// Compact Texel Types
+	// Storage types a MIPMap can keep its levels in. Lookups decode texels to
+	// the full precision type before filtering, so the filtering code is the
+	// same for every storage type.
+	struct RGB8Texel
+	{
+		uint8_t c[3];
+	};
+	struct RGBHalfTexel
+	{
+		uint16_t c[3];
+	};
+	struct HalfTexel
+	{
+		uint16_t c;
+	};
+
+	// A full precision type is its own storage
+	template <typename T>
+	inline void EncodeTexel(const T &v, T *t) { *t = v; }
+	template <typename T>
+	inline void DecodeTexel(const T &t, T *v) { *v = t; }
+
+	inline void EncodeTexel(const RGBSpectrum &v, RGB8Texel *t)
+	{
+		for (int i = 0; i < 3; ++i)
+			t->c[i] = LinearToSRGB8(v[i]);
+	}
+	inline void DecodeTexel(const RGB8Texel &t, RGBSpectrum *v)
+	{
+		const float *lut = SRGB8ToLinear();
+		for (int i = 0; i < 3; ++i)
+			(*v)[i] = lut[t.c[i]];
+	}
+
+	inline void EncodeTexel(const RGBSpectrum &v, RGBHalfTexel *t)
+	{
+		for (int i = 0; i < 3; ++i)
+			t->c[i] = FloatToHalf(Clamp(v[i], -MaxHalf, MaxHalf));
+	}
+	inline void DecodeTexel(const RGBHalfTexel &t, RGBSpectrum *v)
+	{
+		for (int i = 0; i < 3; ++i)
+			(*v)[i] = HalfToFloat(t.c[i]);
+	}
+
+	inline void EncodeTexel(float v, HalfTexel *t) { t->c = FloatToHalf(Clamp(v, -MaxHalf, MaxHalf)); }
+	inline void DecodeTexel(const HalfTexel &t, float *v) { *v = HalfToFloat(t.c); }
+
+	// Storage an ImageTexture picks for its texels: 8-bit sRGB for colour
+	// maps decoded from 8-bit images, half floats for everything else
+	template <typename T>
+	struct CompactTexel;
+	template <>
+	struct CompactTexel<RGBSpectrum>
+	{
+		typedef RGB8Texel Color;
+		typedef RGBHalfTexel Linear;
+	};
+	template <>
+	struct CompactTexel<float>
+	{
+		typedef HalfTexel Color;
+		typedef HalfTexel Linear;
+	};
+
+}
+
+#endif
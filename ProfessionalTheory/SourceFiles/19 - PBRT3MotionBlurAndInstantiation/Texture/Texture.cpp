@@ -12,6 +12,19 @@ namespace Feimos
 		*dstdy = Vector2f(su * si.dudy, sv * si.dvdy);
 		return Point2f(su * si.uv[0] + du, sv * si.uv[1] + dv);
 	}
+	bool UVMapping2D::MapBounds(const Point2f uv[3], Bounds2f *st) const
+	{
+		Bounds2f b(Point2f(su * uv[0][0] + du, sv * uv[0][1] + dv),
+				   Point2f(su * uv[1][0] + du, sv * uv[1][1] + dv));
+		*st = Union(b, Point2f(su * uv[2][0] + du, sv * uv[2][1] + dv));
+		return true;
+	}
+	bool UVMapping2D::MapDerivatives(Vector2f *dstdu, Vector2f *dstdv) const
+	{
+		*dstdu = Vector2f(su, 0.f);
+		*dstdv = Vector2f(0.f, sv);
+		return true;
+	}
 
 	// Texture Function Definitions
 	float Lanczos(float x, float tau)
@@ -15,6 +15,12 @@ namespace Feimos
 		virtual ~TextureMapping2D() {}
 		virtual Point2f Map(const SurfaceInteraction &si, Vector2f *dstdx,
 							Vector2f *dstdy) const = 0;
+		// $(s,t)$ bounds of a triangle with surface coordinates _uv_, for
+		// mappings that are affine in $(u,v)$; false otherwise
+		virtual bool MapBounds(const Point2f uv[3], Bounds2f *st) const { return false; }
+		// Derivatives of $(s,t)$ with respect to $u$ and $v$, for mappings
+		// that are affine in $(u,v)$; false otherwise
+		virtual bool MapDerivatives(Vector2f *dstdu, Vector2f *dstdv) const { return false; }
 	};
 
 	class UVMapping2D : public TextureMapping2D
@@ -25,6 +31,8 @@ namespace Feimos
 			: su(su), sv(sv), du(du), dv(dv) {}
 		Point2f Map(const SurfaceInteraction &si, Vector2f *dstdx,
 					Vector2f *dstdy) const;
+		bool MapBounds(const Point2f uv[3], Bounds2f *st) const;
+		bool MapDerivatives(Vector2f *dstdu, Vector2f *dstdv) const;
 
 	private:
 		const float su, sv, du, dv;
@@ -36,6 +44,18 @@ namespace Feimos
 	public:
 		// Texture Interface
 		virtual T Evaluate(const SurfaceInteraction &) const = 0;
+		// Conservative bounds of Evaluate() over a triangle with surface
+		// coordinates _uv_ when the lookup has no filter footprint (as in
+		// alpha tests); false if the texture cannot bound itself
+		virtual bool EvaluateRange(const Point2f uv[3], T *minValue, T *maxValue) const { return false; }
+		// Frees whatever EvaluateRange() keeps to answer quickly, once no
+		// more ranges are needed
+		virtual void ReleaseRange() const {}
+		// Value and its derivatives with respect to $u$ and $v$ from a single
+		// lookup, for textures that keep their gradient (as bump maps may);
+		// false otherwise, and Material::Bump() takes finite differences
+		virtual bool EvaluateGradient(const SurfaceInteraction &si, T *value,
+									  T *dvdu, T *dvdv) const { return false; }
 		virtual ~Texture() {}
 	};
 
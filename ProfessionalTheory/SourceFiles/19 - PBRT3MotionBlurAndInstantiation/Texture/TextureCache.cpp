@@ -0,0 +1,100 @@
+#include "Texture/TextureCache.h"
+#include <algorithm>
+
+namespace Feimos
+{
+
+	// TextureCache Method Definitions
+	TextureCache &TextureCache::Get()
+	{
+		// Never destroyed: static MIPMaps release their tiles on exit
+		static TextureCache *cache = new TextureCache();
+		return *cache;
+	}
+
+	std::shared_ptr<const CachedTile> TextureCache::Find(uint64_t key, bool count)
+	{
+		Shard &shard = ShardOf(key);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		auto it = shard.index.find(key);
+		if (it == shard.index.end())
+		{
+			if (count)
+				++shard.misses;
+			return nullptr;
+		}
+		if (count)
+			++shard.hits;
+		shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+		return it->second->tile;
+	}
+
+	void TextureCache::Insert(uint64_t key, std::shared_ptr<const CachedTile> tile,
+							  bool prefetch)
+	{
+		Shard &shard = ShardOf(key);
+		const size_t total = budget, held = pinned;
+		const size_t shardBudget = (total - std::min(held, total)) / nShards;
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		if (shard.index.find(key) != shard.index.end())
+			return;
+		if (prefetch)
+		{
+			if (shard.bytes + tile->bytes > shardBudget)
+				return;
+			shard.bytes += tile->bytes;
+			shard.lru.push_back(Entry{key, std::move(tile)});
+			shard.index[key] = std::prev(shard.lru.end());
+			return;
+		}
+		// Evict from the cold end; the new tile is kept even when it alone
+		// exceeds the shard's budget
+		while (!shard.lru.empty() && shard.bytes + tile->bytes > shardBudget)
+		{
+			const Entry &victim = shard.lru.back();
+			shard.bytes -= victim.tile->bytes;
+			shard.index.erase(victim.key);
+			shard.lru.pop_back();
+			++shard.evictions;
+		}
+		shard.bytes += tile->bytes;
+		shard.lru.push_front(Entry{key, std::move(tile)});
+		shard.index[key] = shard.lru.begin();
+	}
+
+	void TextureCache::Release(uint32_t texture)
+	{
+		for (Shard &shard : shards)
+		{
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			for (auto it = shard.lru.begin(); it != shard.lru.end();)
+			{
+				if ((uint32_t)(it->key >> 38) == texture)
+				{
+					shard.bytes -= it->tile->bytes;
+					shard.index.erase(it->key);
+					it = shard.lru.erase(it);
+				}
+				else
+					++it;
+			}
+		}
+	}
+
+	TextureCacheStats TextureCache::Stats() const
+	{
+		TextureCacheStats stats;
+		for (Shard &shard : shards)
+		{
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			stats.hits += shard.hits;
+			stats.misses += shard.misses;
+			stats.evictions += shard.evictions;
+			stats.residentBytes += shard.bytes;
+		}
+		stats.pinnedBytes = pinned;
+		stats.budgetBytes = budget;
+		return stats;
+	}
+
+}
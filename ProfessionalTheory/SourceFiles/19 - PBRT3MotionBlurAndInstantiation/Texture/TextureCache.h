@@ -0,0 +1,126 @@
+#pragma once
+#ifndef __TextureCache_h__
+#define __TextureCache_h__
+
+#include "Core/FeimosRender.h"
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace Feimos
+{
+
+	// CachedTile Declarations
+	// Storage of one tile of a MIP level held by the _TextureCache_; the
+	// cache only sees its size, the _MIPMap_ that made it knows the texel type
+	class CachedTile
+	{
+	public:
+		explicit CachedTile(size_t bytes) : bytes(bytes) {}
+		virtual ~CachedTile() {}
+		const size_t bytes;
+	};
+
+	template <typename T>
+	class TexelTile : public CachedTile
+	{
+	public:
+		TexelTile(int width, int height)
+			: CachedTile(sizeof(TexelTile<T>) + sizeof(T) * width * height),
+			  width(width), texels(new T[width * height]) {}
+		T &operator()(int s, int t) { return texels[t * width + s]; }
+		const T &operator()(int s, int t) const { return texels[t * width + s]; }
+
+	private:
+		const int width;
+		std::unique_ptr<T[]> texels;
+	};
+
+	struct TextureCacheStats
+	{
+		long long hits = 0, misses = 0, evictions = 0;
+		size_t residentBytes = 0, pinnedBytes = 0, budgetBytes = 0;
+	};
+
+	// TextureCache Declarations
+	// Process-wide cache of texture tiles under a memory budget. Tiles are
+	// keyed by (texture, level, tile s, tile t) and spread over independently
+	// locked shards, each of which evicts its least recently used tiles once
+	// it holds more than its share of the budget. Tiles handed out are
+	// reference counted, so evicting one never invalidates a lookup that is
+	// still reading it.
+	class TextureCache
+	{
+	public:
+		static constexpr int tileLog2 = 6;
+		static constexpr int tileSize = 1 << tileLog2;
+		static constexpr int nShards = 32;
+		static constexpr size_t defaultBudget = size_t(1) << 30;
+
+		static TextureCache &Get();
+		void SetBudget(size_t bytes) { budget = bytes; }
+		size_t Budget() const { return budget; }
+
+		// Identifier of a new texture; identifiers are never reused
+		uint32_t NewTexture() { return nextTexture++; }
+		// Drops the tiles of a texture that is going away
+		void Release(uint32_t texture);
+		static uint64_t TileKey(uint32_t texture, int level, int ts, int tt)
+		{
+			return ((uint64_t)texture << 38) | ((uint64_t)level << 32) |
+				   ((uint64_t)(uint16_t)ts << 16) | (uint16_t)tt;
+		}
+
+		// Resident tile for _key_, or null; _count_ selects whether the lookup
+		// shows up in the hit and miss counters
+		std::shared_ptr<const CachedTile> Find(uint64_t key, bool count = true);
+		// Adds a tile as the most recently used of its shard, evicting others
+		// to stay in budget. A _prefetch_ tile is only added as the least
+		// recently used one, and only when the shard has room to spare.
+		void Insert(uint64_t key, std::shared_ptr<const CachedTile> tile,
+					bool prefetch = false);
+		// Texel memory textures hold outside the tiles, such as the decoded
+		// levels of an image without a .mip file. It is charged to the
+		// budget, which leaves the shards that much less room.
+		void Pin(size_t bytes) { pinned += bytes; }
+		void Unpin(size_t bytes) { pinned -= bytes; }
+
+		TextureCacheStats Stats() const;
+
+	private:
+		TextureCache() : budget(defaultBudget), pinned(0), nextTexture(1) {}
+		struct Entry
+		{
+			uint64_t key;
+			std::shared_ptr<const CachedTile> tile;
+		};
+		struct Shard
+		{
+			std::mutex mutex;
+			// Most recently used first
+			std::list<Entry> lru;
+			std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+			size_t bytes = 0;
+			long long hits = 0, misses = 0, evictions = 0;
+		};
+		Shard &ShardOf(uint64_t key)
+		{
+			// Neighbouring tiles of one level land in different shards
+			key ^= key >> 29;
+			key *= 0xbf58476d1ce4e5b9ull;
+			key ^= key >> 32;
+			return shards[key % nShards];
+		}
+
+		std::atomic<size_t> budget, pinned;
+		std::atomic<uint32_t> nextTexture;
+		mutable Shard shards[nShards];
+	};
+
+}
+
+#endif